@@ -165,17 +165,21 @@
   
 ; Add multiarity versions of basic operators
 
+(def -reduce
+  (fn [f val coll] (if (empty? coll)
+                     val
+                     (-reduce f (f val (first coll)) (rest coll)))))
+
 (def reduce
-  "Reduces a collection by applying f"
+  "Reduces a collection by applying f. Sums and products of exact numbers are accumulated in place."
   (fn
     ([f coll] (if (empty? coll)
                 (f)
-                (if (empty? (rest coll))
-                  (first coll)
-                  (reduce f (f (first coll) (second coll)) (rest (rest coll))))))
-    ([f val coll] (if (empty? coll)
-                    val
-                    (reduce f (f val (first coll)) (rest coll))))))
+                (reduce f (first coll) (rest coll))))
+    ([f val coll] (let [r (-reduce-exact f val coll)]
+                    (if r
+                      (-reduce f (first r) (rest r))
+                      (-reduce f val coll))))))
 
 (defn max
   "Returns the maximum of the arguments"
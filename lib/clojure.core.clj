@@ -11,6 +11,7 @@
 (defn map? [x] (instance? clojure.lang.APersistentMap x))
 (defn image? [x] (instance? nanoclj.lang.Image x))
 (defn gradient? [x] (instance? nanoclj.lang.Gradient x))
+(defn table? [x] (instance? nanoclj.lang.Table x))
 (defn inst? [x] (instance? java.util.Date x))
 (defn uuid? [x] (instance? java.util.UUID x))
 (defn coll? [x] (or (identical? x '())
@@ -77,6 +78,7 @@
 (def map-entry clojure.lang.MapEntry)
 (def image nanoclj.lang.Image)
 (def tensor nanoclj.lang.Tensor)
+(def table nanoclj.lang.Table)
 
 (defn boolean?
   "Returns true if argument is a boolean"
@@ -475,7 +477,7 @@
   "Reads a file. Arguments are passed to Reader so same kind of input is supported
   (e.g. URL or filename)"
   [f & opts] (with-open [rdr (apply java.io.Reader f opts)]
-               (loop [c (.read rdr) s ""] (if (= c -1) s (recur (.read rdr) (conj s (char c)))))))
+               (or (-read-bytes rdr) "")))
 
 (defn read-line
   "Reads a line from *in* or a reader"
@@ -594,8 +596,41 @@
                      (and (gradient? x) (*out* :graphics)) (do
                                                              (mode :inline)
                                                              (-pr (nanoclj.art/plot-gradient x)))
+                     (table? x) (pr-table print-fn x)
                      :else (print-fn nil x)))
 
+(defn- pr-table
+  "Prints the header and the first rows of a table as a grid"
+  [print-fn x] (let [names (.columnNames x)
+                     n (.rowCount x)
+                     shown (min n (or *print-length* 10))
+                     cell (fn [v] (with-out-str (pr-inline print-fn v)))
+                     cols (mapv (fn [name] (let [col (x name)]
+                                             (cons (cell name) (map #(cell (col %)) (range shown))))) names)
+                     widths (mapv (fn [c] (apply max (map count c))) cols)
+                     line (fn [cells] (-print \|)
+                            (run! (fn [i] (let [s (nth cells i)]
+                                            (-print \space)
+                                            (run! -print (repeat (- (widths i) (count s)) \space))
+                                            (-print s)
+                                            (-print " |"))) (range (count cells))))
+                     ]
+                 (-print "#table [")
+                 (-print n)
+                 (-print " rows x ")
+                 (-print (count names))
+                 (-print " columns]")
+                 (when (seq names)
+                   (-print \newline)
+                   (line (mapv first cols))
+                   (-print \newline)
+                   (-print \|)
+                   (run! (fn [w] (run! -print (repeat (+ w 2) \-)) (-print \|)) widths)
+                   (run! (fn [i] (-print \newline) (line (mapv #(nth % (inc i)) cols))) (range shown))
+                   (when (< shown n)
+                     (-print \newline)
+                     (-print "...")))))
+
 (defn- pr-meta
   [print-fn x sep] (when *print-meta*
                      (let [m (meta x)]
@@ -959,6 +994,13 @@
                    (int-array size-or-seq 0)))
   ([size init-val-or-seq] (tensor java.lang.Integer/TYPE init-val-or-seq size)))
 
+(defn long-array
+  "Creates a long array of specified size"
+  ([size-or-seq] (if (seqable? size-or-seq)
+                   (long-array (count size-or-seq) size-or-seq)
+                   (long-array size-or-seq 0)))
+  ([size init-val-or-seq] (tensor java.lang.Long/TYPE init-val-or-seq size)))
+
 (defn float-array
   "Creates a float array of specified size"
   ([size-or-seq] (if (seqable? size-or-seq)
@@ -3,6 +3,7 @@
   (:gen-class)
   (:refer-clojure :only (defn read-string number?)))
 
+(def TYPE 8)
 (def MAX_VALUE 9223372036854775807)
 (def MIN_VALUE -9223372036854775808)
 
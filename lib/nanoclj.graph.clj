@@ -3,4 +3,37 @@
 
 (defn load
   "Loads a graph file"
-  [fn] (Graph/load fn))
+  [fn] (nanoclj.lang.Graph/load fn))
+
+(defn update-layout
+  "Runs the force-directed layout of a graph. The options are :iterations, :alpha, :alpha-decay, :gravity, :friction, :charge and :theta, the accuracy of the Barnes-Hut approximation (0 is exact)."
+  ([g] (.updateLayout g))
+  ([g opts] (.updateLayout g opts)))
+
+(defn bfs
+  "Returns the indices of the nodes reachable from start in breadth-first order. The start is a node, an index or a node id. The option :direction is :out (the default), :in or :both."
+  ([g start] (.bfs g start))
+  ([g start opts] (.bfs g start opts)))
+
+(defn dfs
+  "Returns the indices of the nodes reachable from start in depth-first preorder. The options are the same as for bfs."
+  ([g start] (.dfs g start))
+  ([g start opts] (.dfs g start opts)))
+
+(defn connected-components
+  "Returns a vector with the index of the weakly connected component of each node"
+  [g] (.connectedComponents g))
+
+(defn shortest-paths
+  "Computes the shortest paths from start with Dijkstra's algorithm. Returns a map with the :distances and the :previous node on the path for each node, which are nil for unreachable nodes. The options are :direction and :weight, the key of the edge weight in the edge data."
+  ([g start] (.shortestPaths g start))
+  ([g start opts] (.shortestPaths g start opts)))
+
+(defn page-rank
+  "Returns the PageRank of each node. The options are :damping, :iterations and :tolerance."
+  ([g] (.pageRank g))
+  ([g opts] (.pageRank g opts)))
+
+(defn degree-stats
+  "Returns a map with the :in and :out degrees of the nodes, and the :min, :max and :mean of their total degrees"
+  [g] (.degreeStats g))
@@ -1,22 +1,41 @@
 (ns nanoclj.image
   "Image processing operations"
-  (:refer-clojure :only (defn)))
+  (:refer-clojure :only (defn image)))
 
 (defn gaussian-blur
   "Applies gaussian blur to image"
-  [i radius]
-  (.transpose
-   (.horizontalGaussianBlur (.transpose
-                             (.horizontalGaussianBlur (image i) radius)) radius)))
+  [i radius] (.gaussianBlur (image i) radius))
 
 (defn load
-  "Loads an image"
-  [fn] (nanoclj.lang.Image/load fn))
+  "Loads an image. The options :region [x y width height] and :level n crop the image and halve its size n times while loading."
+  ([fn] (nanoclj.lang.Image/load fn))
+  ([fn opts] (nanoclj.lang.Image/load fn opts)))
 
 (defn save
-  "Saves an image"
-  [i fn] (.save (image i) fn))
+  "Saves an image. The options are :level (0-9) and :strategy (:default, :filtered, :huffman-only, :rle or :fixed) for PNG compression, and :quality (1-100) for JPEG."
+  ([i fn] (.save (image i) fn))
+  ([i fn opts] (.save (image i) fn opts)))
+
+(defn pyramid
+  "Returns a vector of the image and its downscaled versions, each half the size of the previous one. The levels are cached in the metadata of the image."
+  [i] (.pyramid (image i)))
+
+(defn thumbnail
+  "Scales an image to fit in a size x size box"
+  [i size] (.thumbnail (image i) size))
 
 (defn transpose
   "Transposes an image"
   [i] (.transpose (image i)))
+
+(defn rotate
+  "Rotates an image clockwise by a multiple of 90 degrees"
+  [i degrees] (.rotate (image i) degrees))
+
+(defn flip-horizontal
+  "Mirrors an image horizontally"
+  [i] (.flipHorizontal (image i)))
+
+(defn flip-vertical
+  "Mirrors an image vertically"
+  [i] (.flipVertical (image i)))
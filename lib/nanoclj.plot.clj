@@ -22,15 +22,23 @@
                                       :grid [ 0.7 0.7 0.7 ]
                                       :bg [ 1 1 1 ] } })
 
+(defn- data-min
+  "Returns the smallest value of plot data. Primitive arrays and typed vectors are reduced natively."
+  [xs] (if (nanoclj.lang.Tensor/isNumeric xs) (nanoclj.lang.Tensor/amin xs) (apply min xs)))
+
+(defn- data-max
+  "Returns the largest value of plot data. Primitive arrays and typed vectors are reduced natively."
+  [xs] (if (nanoclj.lang.Tensor/isNumeric xs) (nanoclj.lang.Tensor/amax xs) (apply max xs)))
+
 (defn linspace
   "Creates an evenly spaced vector from a to b with n points"
   ([a b] (linspace a b 200))
   ([a b n] (let [n (dec n)
                  step (/ (- b a) (double n))
                  ]
-             (loop [a (+ a step) n (dec n) acc [a]]
+             (loop [acc (vector-of :double a) a (+ a step) n (dec n)]
                (if (> n 0)
-                 (recur (+ a step) (dec n) (conj acc a))
+                 (recur (conj acc a) (+ a step) (dec n))
                  (conj acc b))))))
 
 (defn graph-plot
@@ -126,10 +134,10 @@
                     (partition 2 (args :data)) plot-colors)
 
                                         ; Get the combined range of all the plots
-         min-x (apply min (map #( apply min (first %1) ) plots))
-         min-y (apply min (map #( apply min (second %1) ) plots))
-         max-x (apply max (map #( apply max (first %1) ) plots))
-         max-y (apply max (map #( apply max (second %1) ) plots))
+         min-x (apply min (map #( data-min (first %1) ) plots))
+         min-y (apply min (map #( data-min (second %1) ) plots))
+         max-x (apply max (map #( data-max (first %1) ) plots))
+         max-y (apply max (map #( data-max (second %1) ) plots))
          range-x (- (double max-x) (double min-x))
          range-y (- max-y min-y)
 
@@ -260,10 +268,10 @@
          margin-right 15
          content-width (- width margin-left margin-right)
          content-height (- height margin-top margin-bottom)
-         min-x (apply min (map #( apply min (first %1) ) plots))
-         min-y (apply min (map #( apply min (second %1) ) plots))
-         max-x (apply max (map #( apply max (first %1) ) plots))
-         max-y (apply max (map #( apply max (second %1) ) plots))
+         min-x (apply min (map #( data-min (first %1) ) plots))
+         min-y (apply min (map #( data-min (second %1) ) plots))
+         max-x (apply max (map #( data-max (first %1) ) plots))
+         max-y (apply max (map #( data-max (second %1) ) plots))
          range-x (- max-x min-x)
          range-y (- max-y min-y)
          fit-x (fn [x] (+ (* (/ (- x min-x) range-x) content-width) margin-left))
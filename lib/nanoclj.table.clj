@@ -0,0 +1,45 @@
+(ns nanoclj.table
+  "Columnar table operations"
+  (:refer-clojure :exclude (filter sort-by group-by)))
+
+(defn load
+  "Loads a table from a CSV file or reader. Accepts the options :separator and :header"
+  [f & opts] (apply nanoclj.lang.Table/load f opts))
+
+(defn row-count
+  "Returns the number of rows in the table"
+  [t] (nanoclj.lang.Table/rowCount t))
+
+(defn column-names
+  "Returns the column names of the table"
+  [t] (nanoclj.lang.Table/columnNames t))
+
+(defn row
+  "Returns the row i of the table as a map"
+  [t i] (nanoclj.lang.Table/row t i))
+
+(defn rows
+  "Returns a lazy sequence of the rows of the table as maps"
+  [t] (map #(nanoclj.lang.Table/row t %) (range (nanoclj.lang.Table/rowCount t))))
+
+(defn project
+  "Returns a table with the given columns"
+  [t names] (nanoclj.lang.Table/project t names))
+
+(defn filter
+  "Returns the rows where the column compares to value with op (:< :<= := :not= :> :>=)"
+  [t col op value] (nanoclj.lang.Table/filter t col op value))
+
+(defn sort-by
+  "Returns the table sorted by a column. The sort is stable."
+  ([t col] (nanoclj.lang.Table/sortBy t col false))
+  ([t col reverse?] (nanoclj.lang.Table/sortBy t col reverse?)))
+
+(defn group-by
+  "Groups the table by a column and computes aggregates for each group.
+   Aggregates are given as a map from output names to [op column] where op is one of :count, :sum, :mean, :min or :max"
+  [t col aggs] (nanoclj.lang.Table/groupBy t col aggs))
+
+(defn aggregate
+  "Computes aggregates over all rows and returns them as a map. See group-by for the format."
+  [t aggs] (nanoclj.lang.Table/aggregate t aggs))
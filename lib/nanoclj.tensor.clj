@@ -0,0 +1,219 @@
+(ns nanoclj.tensor
+  "Elementwise operations on primitive arrays and typed vectors. The arguments are broadcast
+  against each other, and numbers are treated as scalars. Arithmetic is done with the core
+  functions +, -, * and /."
+  (:refer-clojure :exclude (abs min max < <= > >= == not= load save)))
+
+(defn abs
+  "Returns the absolute values of the elements"
+  [t] (nanoclj.lang.Tensor/abs t))
+
+(defn sqrt
+  "Returns the square roots of the elements"
+  [t] (nanoclj.lang.Tensor/sqrt t))
+
+(defn exp
+  "Returns e raised to the power of the elements"
+  [t] (nanoclj.lang.Tensor/exp t))
+
+(defn log
+  "Returns the natural logarithms of the elements"
+  [t] (nanoclj.lang.Tensor/log t))
+
+(defn sin
+  "Returns the sines of the elements"
+  [t] (nanoclj.lang.Tensor/sin t))
+
+(defn cos
+  "Returns the cosines of the elements"
+  [t] (nanoclj.lang.Tensor/cos t))
+
+(defn tanh
+  "Returns the hyperbolic tangents of the elements"
+  [t] (nanoclj.lang.Tensor/tanh t))
+
+(defn floor
+  "Rounds the elements towards negative infinity"
+  [t] (nanoclj.lang.Tensor/floor t))
+
+(defn ceil
+  "Rounds the elements towards positive infinity"
+  [t] (nanoclj.lang.Tensor/ceil t))
+
+(defn round
+  "Rounds the elements to the nearest integer, halfway cases away from zero"
+  [t] (nanoclj.lang.Tensor/round t))
+
+(defn min
+  "Returns the elementwise minimum"
+  [a b] (nanoclj.lang.Tensor/min a b))
+
+(defn max
+  "Returns the elementwise maximum"
+  [a b] (nanoclj.lang.Tensor/max a b))
+
+(defn <
+  "Returns a boolean tensor that is true where a is less than b"
+  [a b] (nanoclj.lang.Tensor/lt a b))
+
+(defn <=
+  "Returns a boolean tensor that is true where a is less than or equal to b"
+  [a b] (nanoclj.lang.Tensor/le a b))
+
+(defn >
+  "Returns a boolean tensor that is true where a is greater than b"
+  [a b] (nanoclj.lang.Tensor/gt a b))
+
+(defn >=
+  "Returns a boolean tensor that is true where a is greater than or equal to b"
+  [a b] (nanoclj.lang.Tensor/ge a b))
+
+(defn ==
+  "Returns a boolean tensor that is true where a is equal to b"
+  [a b] (nanoclj.lang.Tensor/eq a b))
+
+(defn not=
+  "Returns a boolean tensor that is true where a is not equal to b"
+  [a b] (nanoclj.lang.Tensor/ne a b))
+
+(def ^:private fuse-binary-ops {"+" :add "-" :sub "*" :mul "/" :div "min" :min "max" :max})
+
+(def ^:private fuse-unary-ops {"abs" :abs "sqrt" :sqrt "exp" :exp "log" :log "sin" :sin "cos" :cos
+                               "tanh" :tanh "floor" :floor "ceil" :ceil "round" :round})
+
+(defn- fuse-compile
+  "Appends the postfix code of form to acc, which is [code operands]. Symbols that occur
+  several times are loaded from the same operand."
+  [acc form]
+  (let [op-name (when (and (seq? form) (symbol? (first form))) (name (first form)))
+        args (when op-name (rest form))
+        n (count args)
+        emit (fn [acc op] (update acc 0 conj op))]
+    (cond (and (= op-name "-") (= n 1)) (emit (fuse-compile acc (first args)) :neg)
+          (and (fuse-unary-ops op-name) (= n 1)) (emit (fuse-compile acc (first args)) (fuse-unary-ops op-name))
+          (and (fuse-binary-ops op-name) (or (= n 1) (clojure.core/> n 1)) (not (and (= op-name "/") (= n 1))))
+          (reduce (fn [acc arg] (emit (fuse-compile acc arg) (fuse-binary-ops op-name)))
+                  (fuse-compile acc (first args)) (rest args))
+          :else (let [[code operands] acc
+                      i (when (symbol? form) (loop [i 0] (cond (= i (count operands)) nil
+                                                               (= (nth operands i) form) i
+                                                               :else (recur (inc i)))))]
+                  (if i
+                    [(conj code i) operands]
+                    [(conj code (count operands)) (conj operands form)])))))
+
+(def-macro (fuse expr)
+  "Evaluates an elementwise expression of +, -, *, /, min, max and the math functions of this namespace in a
+  single pass, without creating the intermediate tensors. Other subexpressions are evaluated normally and used
+  as operands, which are broadcast against each other. The result is a float array if all the operands are
+  floats and a double array otherwise."
+  (let [[code operands] (nanoclj.tensor/fuse-compile [[] []] expr)]
+    `(nanoclj.lang.Tensor/fuse ~code (vector ~@(into () (reverse operands))))))
+
+(defn sum
+  "Returns the sum of the elements, or the sums along an axis"
+  ([t] (nanoclj.lang.Tensor/sum t))
+  ([t axis] (nanoclj.lang.Tensor/sum t axis)))
+
+(defn mean
+  "Returns the mean of the elements, or the means along an axis"
+  ([t] (nanoclj.lang.Tensor/mean t))
+  ([t axis] (nanoclj.lang.Tensor/mean t axis)))
+
+(defn amin
+  "Returns the smallest element, or the smallest elements along an axis"
+  ([t] (nanoclj.lang.Tensor/amin t))
+  ([t axis] (nanoclj.lang.Tensor/amin t axis)))
+
+(defn amax
+  "Returns the largest element, or the largest elements along an axis"
+  ([t] (nanoclj.lang.Tensor/amax t))
+  ([t axis] (nanoclj.lang.Tensor/amax t axis)))
+
+(defn argmin
+  "Returns the index of the first smallest element, or the indices along an axis"
+  ([t] (nanoclj.lang.Tensor/argmin t))
+  ([t axis] (nanoclj.lang.Tensor/argmin t axis)))
+
+(defn argmax
+  "Returns the index of the first largest element, or the indices along an axis"
+  ([t] (nanoclj.lang.Tensor/argmax t))
+  ([t axis] (nanoclj.lang.Tensor/argmax t axis)))
+
+(defn variance
+  "Returns the population variance of the elements, or the variances along an axis"
+  ([t] (nanoclj.lang.Tensor/variance t))
+  ([t axis] (nanoclj.lang.Tensor/variance t axis)))
+
+(defn std
+  "Returns the population standard deviation of the elements, or the deviations along an axis"
+  ([t] (nanoclj.lang.Tensor/std t))
+  ([t axis] (nanoclj.lang.Tensor/std t axis)))
+
+(defn norm
+  "Returns the Euclidean norm of the elements, or the norms along an axis"
+  ([t] (nanoclj.lang.Tensor/norm t))
+  ([t axis] (nanoclj.lang.Tensor/norm t axis)))
+
+(defn shape
+  "Returns the dimensions of a tensor, starting from the outermost one"
+  [t] (nanoclj.lang.Tensor/shape t))
+
+(defn reshape
+  "Returns an array with the elements of t and the given shape. The data is shared if t is contiguous."
+  [t shape] (nanoclj.lang.Tensor/reshape t shape))
+
+(defn matrix
+  "Creates a double matrix from a sequence of rows"
+  [rows] (reshape (reduce into (vector-of :double) rows) [(count rows) (count (first rows))]))
+
+(defn matmul
+  "Returns the matrix product of a and b. A vector is treated as a row vector on the left and as a column vector on the right."
+  [a b] (nanoclj.lang.Tensor/matmul a b))
+
+(defn dot
+  "Returns the dot product of two vectors"
+  [a b] (nanoclj.lang.Tensor/matmul a b))
+
+(defn transpose
+  "Returns a view of a tensor with the order of the axes reversed"
+  [m] (nanoclj.lang.Tensor/transpose m))
+
+(defn slice
+  "Returns a view of a tensor restricted by one index per axis, starting from the outermost one.
+  An index is nil for the whole axis, a number that selects a position and removes the axis,
+  or a vector [start end] or [start end step]."
+  [t & indices] (apply nanoclj.lang.Tensor/slice t indices))
+
+(defn contiguous?
+  "Returns true if the elements of a tensor are stored contiguously"
+  [t] (nanoclj.lang.Tensor/isContiguous t))
+
+(defn contiguous
+  "Returns t if its elements are contiguous, and otherwise a contiguous copy"
+  [t] (nanoclj.lang.Tensor/contiguous t))
+
+(defn lu
+  "Returns the LU decomposition of a square matrix with partial pivoting as a vector of the combined
+  LU matrix and the row permutation. L has an implicit unit diagonal."
+  [m] (nanoclj.lang.Tensor/lu m))
+
+(defn det
+  "Returns the determinant of a square matrix"
+  [m] (nanoclj.lang.Tensor/det m))
+
+(defn solve
+  "Solves the linear system ax = b, where b is a vector or a matrix"
+  [a b] (nanoclj.lang.Tensor/solve a b))
+
+(defn cholesky
+  "Returns the lower triangular Cholesky factor of a symmetric positive definite matrix"
+  [m] (nanoclj.lang.Tensor/cholesky m))
+
+(defn load
+  "Loads a tensor from a NumPy .npy file. The file is mapped into memory when possible."
+  [f] (nanoclj.lang.Tensor/load f))
+
+(defn save
+  "Saves a tensor to a NumPy .npy file"
+  [t f] (nanoclj.lang.Tensor/save t f))
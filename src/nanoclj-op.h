@@ -4,6 +4,8 @@ _OP_DEF("load-reader", 0, OP_LOAD_READER)
 _OP_DEF(0, 0, OP_T0LVL)
 _OP_DEF("read", 0, OP_READ)
 _OP_DEF("-read", "Reads a single character", OP_READ_CHAR)
+_OP_DEF("-read-line", "Reads a line of text", OP_READ_LINE)
+_OP_DEF("-read-bytes", "Reads up to n bytes or the rest of the input", OP_READ_BYTES)
 _OP_DEF("gensym", "Generates an unique symbol", OP_GENSYM)
 _OP_DEF(0, 0, OP_EVAL)
 _OP_DEF(0, 0, OP_E0COLL)
@@ -63,6 +65,7 @@ _OP_DEF("-sub'", 0, OP_SUBP)
 _OP_DEF("-mul", 0, OP_MUL)
 _OP_DEF("-mul'", 0, OP_MULP)
 _OP_DEF("-div", 0, OP_DIV)
+_OP_DEF("-reduce-exact", 0, OP_REDUCE_EXACT)
 _OP_DEF("quot", 0, OP_QUOT)
 _OP_DEF("rem", 0, OP_REM)
 _OP_DEF("peek", 0, OP_PEEK)
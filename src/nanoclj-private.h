@@ -12,6 +12,12 @@
 
 #define STRBUFFSIZE 256
 
+/* size of the read buffer of file ports */
+#define NANOCLJ_PORT_BUFFER_SIZE 65536
+
+/* smaller files are read instead of memory-mapped */
+#define NANOCLJ_MMAP_MIN_SIZE (1 << 20)
+
 #include <zlib.h>
 
 #ifdef __cplusplus
@@ -161,6 +167,8 @@ extern "C" {
     nanoclj_cell_t * Audio;
     nanoclj_cell_t * Image;
     nanoclj_cell_t * Graph;
+    nanoclj_cell_t * Table;
+    nanoclj_cell_t * Tensor;
     nanoclj_cell_t * Double;
     nanoclj_cell_t * SecureRandom;
     nanoclj_cell_t * OutOfMemoryError;
@@ -184,6 +192,7 @@ extern "C" {
     
     char strbuff[STRBUFFSIZE];
     nanoclj_tensor_t * rdbuff;
+    nanoclj_tensor_t * bigint_scratch;	/* scratch limbs for accumulating BigInts and Ratios */
 
     nanoclj_token_t tok;
     nanoclj_val_t value;
@@ -68,7 +68,12 @@
 #include "nanoclj_term.h"
 #include "nanoclj_utf8.h"
 #include "nanoclj_tensor.h"
+#include "nanoclj_tensor_math.h"
+#include "nanoclj_linalg.h"
+#include "nanoclj_npy.h"
 #include "nanoclj_bigint.h"
+#include "nanoclj_image.h"
+#include "nanoclj_png.h"
 
 #define BACKQUOTE 	'`'
 #define DELIMITERS  	"()[]{}\";\f\t\v\n\r, "
@@ -214,6 +219,12 @@ union nanoclj_port_rep {
     int32_t num_states;
     nanoclj_term_state_t states[256];
     int32_t backchars[2];
+    uint8_t * rbuf;
+    size_t rbuf_pos, rbuf_len;
+    int read_errno;		/* the errno of a failed read, or 0 */
+    uint8_t * wbuf;
+    size_t wbuf_len, wbuf_size;
+    nanoclj_flush_policy_t flush_policy;
     int window_lines, window_columns, window_width, window_height;
     float window_scale_factor;
   } stdio;
@@ -242,6 +253,13 @@ struct nanoclj_graph_array_s {
   uint32_t num_nodes, num_edges, reserved_nodes, reserved_edges;
   nanoclj_node_t * nodes;
   nanoclj_edge_t * edges;
+  float * x, * y, * px, * py;	/* positions and previous positions of the nodes */
+  /* The outgoing and incoming edges of each node, built when needed for the edges so far */
+  nanoclj_csr_t out, in;
+  uint32_t csr_num_nodes, csr_num_edges;
+  /* Open addressing hash of the node keys for find_node_index(). Entries are node indices + 1. */
+  uint32_t * node_hash;
+  uint32_t node_hash_size, num_hashed_nodes;
 };
 
 #define T_NEGATIVE     128	/* 000000001yyxxxxx */
@@ -291,6 +309,11 @@ static nanoclj_val_t sym_theme;
 static nanoclj_val_t kw_doc;
 static nanoclj_val_t kw_width;
 static nanoclj_val_t kw_height;
+static nanoclj_val_t kw_pyramid;
+static nanoclj_val_t kw_region;
+static nanoclj_val_t kw_level;
+static nanoclj_val_t kw_strategy;
+static nanoclj_val_t kw_quality;
 static nanoclj_val_t kw_channels;
 static nanoclj_val_t kw_graphics;
 static nanoclj_val_t kw_watches;
@@ -320,6 +343,10 @@ static nanoclj_val_t kw_double;
 static nanoclj_val_t kw_byte;
 static nanoclj_val_t kw_short;
 static nanoclj_val_t kw_boolean;
+static nanoclj_val_t kw_long;
+static nanoclj_val_t kw_ubyte;
+static nanoclj_val_t kw_ushort;
+static nanoclj_val_t kw_uint;
 static nanoclj_val_t kw_reload;
 static nanoclj_val_t kw_import;
 static nanoclj_val_t kw_private;
@@ -332,6 +359,11 @@ static nanoclj_val_t kw_as;
 static nanoclj_val_t kw_window_size;
 static nanoclj_val_t kw_cell_size;
 static nanoclj_val_t kw_scale_factor;
+static nanoclj_val_t kw_buffer_size;
+static nanoclj_val_t kw_flush;
+static nanoclj_val_t kw_newline;
+static nanoclj_val_t kw_size;
+static nanoclj_val_t kw_explicit;
 
 static nanoclj_val_t str_java_class_path;
 
@@ -342,6 +374,7 @@ static inline uint_fast16_t prim_type_extended(nanoclj_val_t value) {
   case SIGNATURE_EMPTYLIST: return T_EMPTYLIST;
   case SIGNATURE_BOOLEAN: return T_BOOLEAN;
   case SIGNATURE_INTEGER: return T_BYTE + ((value.as_long >> 32) & 0xffff);
+  case SIGNATURE_LONG: return T_LONG;
   case SIGNATURE_CODEPOINT: return T_CODEPOINT;
   case SIGNATURE_PROC: return T_PROC;
   case SIGNATURE_KEYWORD: return T_KEYWORD;
@@ -359,6 +392,7 @@ static inline uint_fast16_t prim_type(nanoclj_val_t value) {
   case SIGNATURE_EMPTYLIST: return T_EMPTYLIST;
   case SIGNATURE_BOOLEAN: return T_BOOLEAN;
   case SIGNATURE_INTEGER: return T_LONG;
+  case SIGNATURE_LONG: return T_LONG;
   case SIGNATURE_CODEPOINT: return T_CODEPOINT;
   case SIGNATURE_PROC: return T_PROC;
   case SIGNATURE_KEYWORD: return T_KEYWORD;
@@ -675,6 +709,17 @@ static inline const void * get_const_ptr(const nanoclj_cell_t * c) {
   }
 }
 
+static inline nanoclj_val_t mk_boxed_long(long long num);
+
+/* Returns an element of a 1D tensor, boxing the long elements that don't fit in a primitive */
+static inline nanoclj_val_t tensor_get_value(const nanoclj_tensor_t * tensor, int64_t i) {
+  if (tensor_is_long_type(tensor->type)) {
+    int64_t v = tensor_load_long(tensor->type, tensor->data + i * tensor->nb[0]);
+    if (!is_long_prim_range(v)) return mk_boxed_long(v);
+  }
+  return tensor_get(tensor, i);
+}
+
 static inline nanoclj_val_t get_indexed_value(const nanoclj_cell_t * coll, int64_t ielem) {
   switch (_type(coll)) {
   case T_HASHMAP:
@@ -694,7 +739,7 @@ static inline nanoclj_val_t get_indexed_value(const nanoclj_cell_t * coll, int64
     if (_is_small(coll)) {
       return _smalldata_unchecked(coll)[ielem];
     } else {
-      return tensor_get(_tensor_unchecked(coll), _offset_unchecked(coll) + ielem);
+      return tensor_get_value(_tensor_unchecked(coll), _offset_unchecked(coll) + ielem);
     }
   }
 }
@@ -810,6 +855,7 @@ static inline nanoclj_tensor_t * get_tensor(nanoclj_cell_t * c) {
   case T_BIGINT:
   case T_TENSOR:
   case T_MESH:
+  case T_TABLE:
     return c->_collection.tensor;
   case T_IMAGE:
     return c->_image.tensor;
@@ -862,6 +908,7 @@ static inline nanoclj_cell_t * get_metadata(nanoclj_cell_t * c) {
   case T_HASHSET:
   case T_QUEUE:
   case T_GRADIENT:
+  case T_TABLE:
     if (!_is_small(c)) {
       return c->_collection.meta;
     }
@@ -893,6 +940,7 @@ static inline bool set_metadata(nanoclj_cell_t * c, nanoclj_cell_t * meta) {
   case T_HASHSET:
   case T_QUEUE:
   case T_GRADIENT:
+  case T_TABLE:
     if (!_is_small(c)) {
       c->_collection.meta = meta;
       return true;
@@ -998,7 +1046,7 @@ static inline bool convert_to_long(nanoclj_val_t p, long long * l) {
   case T_LONG:
   case T_PROC:
   case T_CODEPOINT:
-    *l = decode_integer(p);
+    *l = decode_long(p);
     return true;
   case T_DOUBLE:
     if (p.as_double < LLONG_MIN || p.as_double >= 9223372036854775808.0) return false;
@@ -1068,7 +1116,7 @@ static inline bool convert_to_double(nanoclj_val_t p, double * d) {
   switch (prim_type(p)) {
   case T_BOOLEAN:
   case T_LONG:
-    *d = decode_integer(p);
+    *d = decode_long(p);
     return true;
   case T_DOUBLE:
     *d = p.as_double;
@@ -1137,7 +1185,7 @@ static inline nanoclj_ratio_t mk_ratio(long long v) {
 static inline nanoclj_bigint_t to_bigint(nanoclj_val_t p) {
   switch (prim_type(p)) {
   case T_LONG:
-    return mk_bigint(decode_integer(p));
+    return mk_bigint(decode_long(p));
   case T_CELL:
     {
       nanoclj_cell_t * c = decode_pointer(p);
@@ -1167,7 +1215,7 @@ static inline nanoclj_bigint_t to_bigint(nanoclj_val_t p) {
 static inline nanoclj_ratio_t to_ratio(nanoclj_val_t p) {
   switch (prim_type(p)) {
   case T_LONG:
-    return mk_ratio(decode_integer(p));
+    return mk_ratio(decode_long(p));
   case T_CELL:
     {
       nanoclj_cell_t * c = decode_pointer(p);
@@ -1514,10 +1562,10 @@ struct {
 static inline int alloc_cellseg(int n) {
   nanoclj_val_t p;
 
-  if (g_allocator.last_cell_seg + 1 >= g_allocator.n_seg_reserved) {
-    g_allocator.n_seg_reserved = (g_allocator.n_seg_reserved + 1) * 2;
-    g_allocator.alloc_seg = realloc(g_allocator.alloc_seg, n * sizeof(nanoclj_cell_t *));
-    g_allocator.cell_seg = realloc(g_allocator.cell_seg, n * sizeof(nanoclj_val_t));
+  if (g_allocator.last_cell_seg + n >= g_allocator.n_seg_reserved) {
+    g_allocator.n_seg_reserved = (g_allocator.last_cell_seg + n + 1) * 2;
+    g_allocator.alloc_seg = realloc(g_allocator.alloc_seg, g_allocator.n_seg_reserved * sizeof(nanoclj_cell_t *));
+    g_allocator.cell_seg = realloc(g_allocator.cell_seg, g_allocator.n_seg_reserved * sizeof(nanoclj_val_t));
   }
   
   for (int k = 0; k < n; k++) {
@@ -1560,17 +1608,77 @@ static inline int alloc_cellseg(int n) {
   return n;
 }
 
+/* Moves the buffered output of a file port to the FILE. Must be called before writing to the FILE directly. */
+static inline void port_write_buffer(nanoclj_port_rep_t * pr) {
+  if (pr->stdio.wbuf_len) {
+    fwrite(pr->stdio.wbuf, 1, pr->stdio.wbuf_len, pr->stdio.file);
+    pr->stdio.wbuf_len = 0;
+  }
+}
+
+static inline void port_flush_output(nanoclj_port_rep_t * pr) {
+  port_write_buffer(pr);
+  fflush(pr->stdio.file);
+}
+
+/* Writes to the output buffer of a file port. The buffer is flushed according to the flush policy,
+ * and in explicit mode it grows until flushed. Ports without a buffer write straight to the FILE. */
+static inline void port_write_output(nanoclj_port_rep_t * pr, const char * s, size_t len) {
+  if (!pr->stdio.wbuf_size) {
+    fwrite(s, 1, len, pr->stdio.file);
+    return;
+  }
+  if (pr->stdio.wbuf_len + len > pr->stdio.wbuf_size) {
+    if (pr->stdio.flush_policy == nanoclj_flush_explicit) {
+      size_t new_size = 2 * pr->stdio.wbuf_size;
+      if (new_size < pr->stdio.wbuf_len + len) new_size = pr->stdio.wbuf_len + len;
+      uint8_t * new_buf = realloc(pr->stdio.wbuf, new_size);
+      if (!new_buf) {
+	port_flush_output(pr);
+	fwrite(s, 1, len, pr->stdio.file);
+	return;
+      }
+      pr->stdio.wbuf = new_buf;
+      pr->stdio.wbuf_size = new_size;
+    } else {
+      port_flush_output(pr);
+      if (len >= pr->stdio.wbuf_size) {
+	fwrite(s, 1, len, pr->stdio.file);
+	fflush(pr->stdio.file);
+	return;
+      }
+    }
+  }
+  if (!pr->stdio.wbuf) {
+    pr->stdio.wbuf = malloc(pr->stdio.wbuf_size);
+    if (!pr->stdio.wbuf) {
+      fwrite(s, 1, len, pr->stdio.file);
+      return;
+    }
+  }
+  memcpy(pr->stdio.wbuf + pr->stdio.wbuf_len, s, len);
+  pr->stdio.wbuf_len += len;
+  if (pr->stdio.flush_policy == nanoclj_flush_on_newline && memchr(s, '\n', len)) {
+    port_flush_output(pr);
+  }
+}
+
 static inline int port_close(nanoclj_cell_t * p) {
   int r = 0;
   nanoclj_port_rep_t * pr = _rep_unchecked(p);
   switch (_port_type_unchecked(p)) {
   case port_file:
+    port_write_buffer(pr);
+    free(pr->stdio.wbuf);
+    pr->stdio.wbuf = NULL;
+    pr->stdio.wbuf_size = 0;
     if (pr->stdio.filename) {
       free(pr->stdio.filename);
     }
     if (pr->stdio.rc) {
       free(pr->stdio.rc);
     }
+    free(pr->stdio.rbuf);
     FILE * fh = pr->stdio.file;
     if (fh && (fh != stdout && fh != stderr && fh != stdin)) {
       int fd = fileno(fh);
@@ -1604,6 +1712,18 @@ static inline int port_close(nanoclj_cell_t * p) {
   return r;
 }
 
+/* Flushes the output buffers of all open file ports, e.g. before exiting */
+static inline void flush_all_ports() {
+  for (int_fast32_t i = 0; i <= g_allocator.last_cell_seg; i++) {
+    nanoclj_cell_t * p = decode_pointer(g_allocator.cell_seg[i]);
+    for (nanoclj_cell_t * end = p + CELL_SEGSIZE; p < end; p++) {
+      if ((_type(p) == T_WRITER || _type(p) == T_OUTPUT_STREAM) && _port_type_unchecked(p) == port_file) {
+	port_flush_output(_rep_unchecked(p));
+      }
+    }
+  }
+}
+
 static inline void finalize_cell(nanoclj_cell_t * a) {
   if (_is_small(a)) {
     return;
@@ -1627,9 +1747,20 @@ static inline void finalize_cell(nanoclj_cell_t * a) {
   case T_GRAPH_EDGE:
     {
       nanoclj_graph_array_t * g = _graph_unchecked(a);
-      if (g->refcnt > 0 && --(g->refcnt)) {
+      if (g->refcnt > 0 && --(g->refcnt) == 0) {
 	free(g->nodes);
 	free(g->edges);
+	free(g->x);
+	free(g->y);
+	free(g->px);
+	free(g->py);
+	free(g->out.offsets);
+	free(g->out.nodes);
+	free(g->out.edges);
+	free(g->in.offsets);
+	free(g->in.nodes);
+	free(g->in.edges);
+	free(g->node_hash);
 	free(g);
       }
     }
@@ -1741,21 +1872,25 @@ static inline nanoclj_val_t mk_date(nanoclj_t * sc, long long num) {
 }
 
 /* get number atom (integer) */
+/* Allocates a cell for a long that doesn't fit in a primitive. Returns nil if out of memory. */
+static inline nanoclj_val_t mk_boxed_long(long long num) {
+  nanoclj_cell_t * x = get_cell_x(T_LONG, T_GC_ATOM | T_SMALL | 1, NULL, NULL, NULL);
+  if (x) _lvalue_unchecked(x) = num;
+  return mk_pointer(x);
+}
+
 static inline nanoclj_val_t mk_long(nanoclj_t * sc, long long num) {
-  if (num >= INT_MIN && num <= INT_MAX) {
+  if (is_long_prim_range(num)) {
     return mk_long_prim(num);
   } else {
-    nanoclj_cell_t * x = get_cell_x(T_LONG, T_GC_ATOM | T_SMALL | 1, NULL, NULL, NULL);
-    if (x) {
-      _lvalue_unchecked(x) = num;
-
-#if RETAIN_ALLOCS
-      retain(sc, x);
-#endif
-    } else {
+    nanoclj_val_t x = mk_boxed_long(num);
+    if (is_nil(x)) {
       sc->pending_exception = sc->OutOfMemoryError;
     }
-    return mk_pointer(x);
+#if RETAIN_ALLOCS
+    else retain(sc, decode_pointer(x));
+#endif
+    return x;
   }
 }
 
@@ -1765,6 +1900,11 @@ static inline nanoclj_graph_array_t * mk_graph_array() {
   g->refcnt = 0;
   g->nodes = NULL;
   g->edges = NULL;
+  g->x = g->y = g->px = g->py = NULL;
+  g->out = g->in = (nanoclj_csr_t){ NULL, NULL, NULL };
+  g->csr_num_nodes = g->csr_num_edges = 0;
+  g->node_hash = NULL;
+  g->node_hash_size = g->num_hashed_nodes = 0;
   return g;
 }
 
@@ -1772,13 +1912,18 @@ static inline void graph_array_append_node(nanoclj_graph_array_t * g, nanoclj_va
   if (g->num_nodes >= g->reserved_nodes) {
     g->reserved_nodes = (g->reserved_nodes + 1) * 2;
     g->nodes = realloc(g->nodes, g->reserved_nodes * sizeof(nanoclj_node_t));
+    g->x = realloc(g->x, g->reserved_nodes * sizeof(float));
+    g->y = realloc(g->y, g->reserved_nodes * sizeof(float));
+    g->px = realloc(g->px, g->reserved_nodes * sizeof(float));
+    g->py = realloc(g->py, g->reserved_nodes * sizeof(float));
   }
-  nanoclj_node_t * n = &(g->nodes[g->num_nodes++]);
-  n->pos = n->ppos = (nanoclj_vec2f){ (double)rand() / RAND_MAX, (double)rand() / RAND_MAX };
-  n->data = d;
+  uint32_t i = g->num_nodes++;
+  g->nodes[i].data = d;
+  g->x[i] = g->px[i] = (double)rand() / RAND_MAX;
+  g->y[i] = g->py[i] = (double)rand() / RAND_MAX;
 }
 
-static inline void graph_array_append_edge(nanoclj_graph_array_t * g, uint32_t source, uint32_t target) {
+static inline void graph_array_append_edge(nanoclj_graph_array_t * g, uint32_t source, uint32_t target, nanoclj_val_t d) {
   if (g->num_edges >= g->reserved_edges) {
     g->reserved_edges = (g->reserved_edges + 1) * 2;
     g->edges = realloc(g->edges, g->reserved_edges * sizeof(nanoclj_edge_t));
@@ -1786,7 +1931,7 @@ static inline void graph_array_append_edge(nanoclj_graph_array_t * g, uint32_t s
   nanoclj_edge_t * e = &(g->edges[g->num_edges++]);
   e->source = source;
   e->target = target;
-  e->data = mk_nil();
+  e->data = d;
 }
 
 static inline nanoclj_cell_t * mk_graph(nanoclj_t * sc, uint16_t type, uint32_t offset, uint32_t size, nanoclj_graph_array_t * ga) {
@@ -1869,9 +2014,11 @@ static inline nanoclj_cell_t * mk_image(nanoclj_t * sc, int32_t width, int32_t h
 					nanoclj_internal_format_t f, nanoclj_cell_t * meta) {
   nanoclj_tensor_t * tensor = mk_tensor_3d(nanoclj_i8, get_format_channels(f), get_format_bpp(f),
 					   width, width * get_format_bpp(f), height);
-  nanoclj_cell_t * img = mk_image_with_tensor(sc, tensor, meta);
-  if (!img) tensor_free(tensor);
-  return img;
+  if (!tensor) {
+    sc->pending_exception = sc->OutOfMemoryError;
+    return NULL;
+  }
+  return mk_image_with_tensor(sc, tensor, meta);
 }
 
 static inline nanoclj_cell_t * mk_object_from_tensor(nanoclj_t * sc, uint16_t type, size_t offset, size_t size, nanoclj_tensor_t * tensor) {
@@ -2008,8 +2155,10 @@ static inline void initialize_collection(nanoclj_cell_t * c, int32_t offset, int
   }
 }
 
-static inline nanoclj_cell_t * get_collection_object(nanoclj_t * sc, int32_t t, int32_t offset, int32_t size, nanoclj_tensor_t * store, nanoclj_cell_t * meta) {
-  nanoclj_cell_t * x = get_cell_x(t, T_GC_ATOM, NULL, NULL, meta);
+/* Like get_cell, marks its inputs: src is the collection the new one is made from and val the
+ * value being added, since they may only be referenced from C when gc runs */
+static inline nanoclj_cell_t * get_collection_object_x(nanoclj_t * sc, int32_t t, int32_t offset, int32_t size, nanoclj_tensor_t * store, nanoclj_cell_t * meta, const nanoclj_cell_t * src, nanoclj_val_t val) {
+  nanoclj_cell_t * x = get_cell_x(t, T_GC_ATOM, (nanoclj_cell_t *)src, is_cell(val) ? decode_pointer(val) : NULL, meta);
   if (x) {
     initialize_collection(x, offset, size, store, meta);
     
@@ -2022,6 +2171,10 @@ static inline nanoclj_cell_t * get_collection_object(nanoclj_t * sc, int32_t t,
   return x;
 }
 
+static inline nanoclj_cell_t * get_collection_object(nanoclj_t * sc, int32_t t, int32_t offset, int32_t size, nanoclj_tensor_t * store, nanoclj_cell_t * meta) {
+  return get_collection_object_x(sc, t, offset, size, store, meta, NULL, mk_nil());
+}
+
 static inline nanoclj_cell_t * get_string_object(nanoclj_t * sc, int32_t t, const char *str, size_t len, size_t padding) {
   nanoclj_tensor_t * s = 0;
   if (len + padding > NANOCLJ_SMALL_STR_SIZE) {
@@ -2182,11 +2335,35 @@ static inline nanoclj_val_t nanoclj_throw(nanoclj_t * sc, nanoclj_cell_t * e) {
   return mk_nil();
 }
 
+/* Refills the read buffer of a file port. Returns false on EOF or error, and the errno of
+ * an error is stored in the port so that it can be thrown by handle_port_exceptions. */
+static inline bool port_fill_buffer(nanoclj_port_rep_t * pr) {
+  if (!pr->stdio.rbuf) {
+    pr->stdio.rbuf = malloc(NANOCLJ_PORT_BUFFER_SIZE);
+    if (!pr->stdio.rbuf) {
+      pr->stdio.read_errno = ENOMEM;
+      return false;
+    }
+  }
+  /* read() returns whatever is available, so interactive input is not blocked on a full buffer */
+  ssize_t n;
+  do {
+    n = read(fileno(pr->stdio.file), pr->stdio.rbuf, NANOCLJ_PORT_BUFFER_SIZE);
+  } while (n < 0 && errno == EINTR);
+  pr->stdio.rbuf_pos = 0;
+  pr->stdio.rbuf_len = n > 0 ? n : 0;
+  if (n < 0) pr->stdio.read_errno = errno;
+  return n > 0;
+}
+
 static inline int32_t inchar_raw(nanoclj_cell_t * p) {
   nanoclj_port_rep_t * pr = _rep_unchecked(p);
   switch (_port_type_unchecked(p)) {
   case port_file:
-    return fgetc(pr->stdio.file);
+    if (pr->stdio.rbuf_pos == pr->stdio.rbuf_len && !port_fill_buffer(pr)) {
+      return EOF;
+    }
+    return pr->stdio.rbuf[pr->stdio.rbuf_pos++];
   case port_string:
     if (pr->string.read_pos == pr->string.data->ne[0]) {
       return EOF;
@@ -2275,6 +2452,16 @@ static inline void update_cursor(int32_t c, nanoclj_cell_t * p, int line_len) {
 static inline bool handle_port_exceptions(nanoclj_t * sc, nanoclj_cell_t * p) {
   if (_port_type_unchecked(p) == port_file) {
     nanoclj_port_rep_t * pr = _rep_unchecked(p);
+    if (pr->stdio.read_errno) {
+      int e = pr->stdio.read_errno;
+      pr->stdio.read_errno = 0;
+      if (e == ENOMEM) {
+	nanoclj_throw(sc, sc->OutOfMemoryError);
+      } else {
+	nanoclj_throw(sc, mk_exception(sc, sc->IOException, strerror(e)));
+      }
+      return true;
+    }
     if (pr->stdio.rc) {
       int rc = *(pr->stdio.rc);
       switch (rc) {
@@ -2315,6 +2502,8 @@ static inline int32_t inchar(nanoclj_t * sc, nanoclj_cell_t * p) {
   }
   if (c != EOF) {
     update_cursor(c, p, 0);
+  } else if (_port_type_unchecked(p) == port_file && _rep_unchecked(p)->stdio.read_errno) {
+    handle_port_exceptions(sc, p);
   }
   return c;
 }
@@ -2325,6 +2514,17 @@ static inline int32_t backchar(int32_t c, nanoclj_cell_t * p) {
     nanoclj_port_rep_t *pr = _rep_unchecked(p);
     switch (_port_type_unchecked(p)) {
     case port_file:
+      {
+	/* If the character is still in the read buffer, just rewind */
+	utf8proc_uint8_t buff[4];
+	size_t l = _type(p) == T_READER ? utf8proc_encode_char(c, &buff[0]) : 1;
+	if (l == 1) buff[0] = c;
+	if (pr->stdio.backchars[0] == -1 && pr->stdio.rbuf_pos >= l &&
+	    memcmp(pr->stdio.rbuf + pr->stdio.rbuf_pos - l, &buff[0], l) == 0) {
+	  pr->stdio.rbuf_pos -= l;
+	  break;
+	}
+      }
       if (pr->stdio.backchars[0] == -1) {
 	pr->stdio.backchars[0] = c;
       } else if (pr->stdio.backchars[1] == -1) {
@@ -2347,6 +2547,134 @@ static inline int32_t backchar(int32_t c, nanoclj_cell_t * p) {
   return c;
 }
 
+/* Returns the buffered input of a port without consuming it. The buffer
+ * of a file port is refilled if it is empty. Returns an empty view on EOF. */
+static inline strview_t port_buffered_input(nanoclj_cell_t * p) {
+  nanoclj_port_rep_t * pr = _rep_unchecked(p);
+  switch (_port_type_unchecked(p)) {
+  case port_file:
+    if (pr->stdio.rbuf_pos == pr->stdio.rbuf_len && !port_fill_buffer(pr)) {
+      break;
+    }
+    return (strview_t){ (const char *)pr->stdio.rbuf + pr->stdio.rbuf_pos, pr->stdio.rbuf_len - pr->stdio.rbuf_pos };
+  case port_string:
+    {
+      size_t n = pr->string.data->ne[0] - pr->string.read_pos;
+      return (strview_t){ (const char *)pr->string.data->data + pr->string.read_pos, n < INT_MAX ? n : INT_MAX };
+    }
+  }
+  return (strview_t){ 0 };
+}
+
+/* Consumes n bytes of buffered input and updates the cursor */
+static inline void port_consume(nanoclj_cell_t * p, size_t n) {
+  nanoclj_port_rep_t * pr = _rep_unchecked(p);
+  switch (_port_type_unchecked(p)) {
+  case port_file:
+    {
+      const char * s = (const char *)pr->stdio.rbuf + pr->stdio.rbuf_pos, * end = s + n, * nl;
+      while ((nl = memchr(s, '\n', end - s))) {
+	_line_unchecked(p)++;
+	_column_unchecked(p) = 0;
+	s = nl + 1;
+      }
+      for (; s < end && end - s >= utf8_sequence_length(*s); s = utf8_next(s)) {
+	update_cursor(decode_utf8(s), p, 0);
+      }
+      pr->stdio.rbuf_pos += n;
+    }
+    break;
+  case port_string:
+    pr->string.read_pos += n;
+    break;
+  }
+}
+
+/* Moves the pushed back characters of a file port to out (if not NULL). Returns true if delim was found */
+static inline bool port_drain_backchars(nanoclj_cell_t * p, int32_t delim, nanoclj_tensor_t * out) {
+  if (_port_type_unchecked(p) == port_file) {
+    nanoclj_port_rep_t * pr = _rep_unchecked(p);
+    for (int i = 1; i >= 0; i--) {
+      int32_t c = pr->stdio.backchars[i];
+      if (c != -1) {
+	pr->stdio.backchars[i] = -1;
+	update_cursor(c, p, 0);
+	if (c == delim) return true;
+	if (out) tensor_mutate_append_codepoint(out, c);
+      }
+    }
+  }
+  return false;
+}
+
+/* Reads bytes up to the delimiter or EOF and appends them to out (if not NULL).
+ * The delimiter is consumed but not stored. Returns true if the delimiter was found. */
+static inline bool port_read_until(nanoclj_cell_t * p, uint8_t delim, nanoclj_tensor_t * out) {
+  if (port_drain_backchars(p, delim, out)) return true;
+  while ( 1 ) {
+    strview_t sv = port_buffered_input(p);
+    if (!sv.size) return false;
+    const char * d = memchr(sv.ptr, delim, sv.size);
+    size_t n = d ? d - sv.ptr : sv.size;
+    if (out) tensor_mutate_append_bytes(out, (const uint8_t *)sv.ptr, n);
+    if (d) {
+      port_consume(p, n + 1);
+      return true;
+    }
+    port_consume(p, n);
+  }
+}
+
+/* Maps the remaining contents of an unread file port into memory. Returns NULL if the port is
+ * not backed by a regular file, if it has already been read, or if the file is small. */
+static inline nanoclj_tensor_t * port_map_input(nanoclj_cell_t * p) {
+  if (_port_type_unchecked(p) != port_file) return NULL;
+  nanoclj_port_rep_t * pr = _rep_unchecked(p);
+  if (pr->stdio.rbuf_len || pr->stdio.backchars[0] != -1) return NULL;
+  int fd = fileno(pr->stdio.file);
+  nanoclj_tensor_t * t = mk_tensor_1d_mapped(fd, NANOCLJ_MMAP_MIN_SIZE);
+  if (t) lseek(fd, 0, SEEK_END);
+  return t;
+}
+
+/* Reads up to n bytes and appends them to out. Returns the number of bytes read. */
+static inline size_t port_read_bytes(nanoclj_cell_t * p, size_t n, nanoclj_tensor_t * out) {
+  int64_t start = out->ne[0];
+  port_drain_backchars(p, EOF, out);
+  while (out->ne[0] - start < n) {
+    strview_t sv = port_buffered_input(p);
+    if (!sv.size) break;
+    size_t l = n - (out->ne[0] - start);
+    if (l > sv.size) l = sv.size;
+    tensor_mutate_append_bytes(out, (const uint8_t *)sv.ptr, l);
+    port_consume(p, l);
+  }
+  return out->ne[0] - start;
+}
+
+/* Reads a run of printable ASCII characters that are not delimiters and appends them to out */
+static inline void port_read_span(nanoclj_cell_t * p, const char * delim, nanoclj_tensor_t * out) {
+  if (_port_type_unchecked(p) == port_file && _rep_unchecked(p)->stdio.backchars[0] != -1) {
+    return;
+  }
+  while ( 1 ) {
+    strview_t sv = port_buffered_input(p);
+    size_t n = 0;
+    for (; n < sv.size; n++) {
+      uint8_t c = sv.ptr[n];
+      if (c <= ' ' || c >= 127 || strchr(delim, c)) break;
+    }
+    tensor_mutate_append_bytes(out, (const uint8_t *)sv.ptr, n);
+    if (_port_type_unchecked(p) == port_file) {
+      _rep_unchecked(p)->stdio.rbuf_pos += n;
+      _column_unchecked(p) += n;
+    } else {
+      port_consume(p, n);
+    }
+    if (n < sv.size || !n) break;
+  }
+}
+
 /* Medium level cell allocation */
 
 /* get new cons cell */
@@ -2367,7 +2695,7 @@ static inline nanoclj_tensor_t * create_tensor_for_type(int_fast16_t t, nanoclj_
   else return mk_tensor_1d(val_type, size);
 }
 
-static inline nanoclj_cell_t * get_vector_object_with_tensor_type(nanoclj_t * sc, int_fast16_t t, nanoclj_tensor_type_t tensor_type, size_t size, nanoclj_cell_t * meta) {
+static inline nanoclj_cell_t * get_vector_object_x(nanoclj_t * sc, int_fast16_t t, nanoclj_tensor_type_t tensor_type, size_t size, nanoclj_cell_t * meta, const nanoclj_cell_t * src, nanoclj_val_t val) {
   nanoclj_tensor_t * store = NULL;
   if (size > NANOCLJ_SMALL_VEC_SIZE || (size > 1 && is_map_type(t)) || tensor_type != nanoclj_val || meta) {
     store = create_tensor_for_type(t, tensor_type, size);
@@ -2376,7 +2704,11 @@ static inline nanoclj_cell_t * get_vector_object_with_tensor_type(nanoclj_t * sc
       return NULL;
     }
   }
-  return get_collection_object(sc, t, 0, size, store, meta);
+  return get_collection_object_x(sc, t, 0, size, store, meta, src, val);
+}
+
+static inline nanoclj_cell_t * get_vector_object_with_tensor_type(nanoclj_t * sc, int_fast16_t t, nanoclj_tensor_type_t tensor_type, size_t size, nanoclj_cell_t * meta) {
+  return get_vector_object_x(sc, t, tensor_type, size, meta, NULL, mk_nil());
 }
 
 static inline nanoclj_cell_t * get_vector_object(nanoclj_t * sc, int_fast16_t t, size_t size) {
@@ -2426,6 +2758,168 @@ static inline nanoclj_val_t mk_vector_with_tensor(nanoclj_t * sc, nanoclj_tensor
   return mk_pointer(get_collection_object(sc, T_VECTOR, 0, a->ne[0], a, NULL));
 }
 
+/* Tables are stored like array maps: a 2D tensor of [name column] pairs,
+ * where the columns are vectors of equal length. The columns are initialized to nil. */
+static inline nanoclj_cell_t * mk_table(nanoclj_t * sc, size_t num_columns) {
+  nanoclj_tensor_t * tensor = mk_tensor_2d(nanoclj_val, 2, num_columns);
+  if (!tensor) {
+    sc->pending_exception = sc->OutOfMemoryError;
+    return NULL;
+  }
+  for (size_t i = 0; i < num_columns; i++) {
+    tensor_mutate_set_2d(tensor, 0, i, mk_nil());
+    tensor_mutate_set_2d(tensor, 1, i, mk_nil());
+  }
+  nanoclj_cell_t * table = get_collection_object(sc, T_TABLE, 0, num_columns, tensor, NULL);
+  if (!table) tensor_free(tensor);
+  return table;
+}
+
+static inline void table_set_column(nanoclj_cell_t * table, size_t i, nanoclj_val_t name, nanoclj_val_t column) {
+  tensor_mutate_set_2d(table->_collection.tensor, 0, i, name);
+  tensor_mutate_set_2d(table->_collection.tensor, 1, i, column);
+}
+
+static inline nanoclj_val_t table_get_name(const nanoclj_cell_t * table, size_t i) {
+  return tensor_get_2d(table->_collection.tensor, 0, i);
+}
+
+static inline nanoclj_val_t table_get_column(const nanoclj_cell_t * table, size_t i) {
+  return tensor_get_2d(table->_collection.tensor, 1, i);
+}
+
+static inline size_t table_get_row_count(const nanoclj_cell_t * table) {
+  if (get_size(table) == 0) return 0;
+  nanoclj_val_t col = table_get_column(table, 0);
+  return is_cell(col) ? get_size(decode_pointer(col)) : 0;
+}
+
+/* Returns the tensor of a primitive array or a typed vector, or NULL if the value is neither */
+static inline nanoclj_tensor_t * get_numeric_tensor(nanoclj_val_t v) {
+  if (!is_cell(v)) return NULL;
+  nanoclj_cell_t * c = decode_pointer(v);
+  if (_is_small(c) || (_type(c) != T_TENSOR && _type(c) != T_VECTOR)) return NULL;
+  nanoclj_tensor_t * tensor = c->_collection.tensor;
+  return tensor && tensor->type != nanoclj_val ? tensor : NULL;
+}
+
+static inline tensorview_t to_numeric_tensorview(nanoclj_val_t v) {
+  nanoclj_cell_t * c = decode_pointer(v);
+  tensorview_t tv = tensorview_from_tensor(c->_collection.tensor);
+  if (tv.n_dims == 1) {
+    tv.data = (uint8_t *)tv.data + c->_collection.offset * tv.nb[0];
+    tv.ne[0] = c->_collection.size;
+  }
+  return tv;
+}
+
+/* Stores a number in storage as type t and returns a single element view of it */
+static inline tensorview_t mk_scalar_tensorview(nanoclj_val_t v, nanoclj_tensor_type_t t, void * storage) {
+  switch (t) {
+  case nanoclj_boolean:
+  case nanoclj_i8: *(int8_t *)storage = (int8_t)to_long(v); break;
+  case nanoclj_i16: *(int16_t *)storage = (int16_t)to_long(v); break;
+  case nanoclj_i32: *(int32_t *)storage = (int32_t)to_long(v); break;
+  case nanoclj_f32: *(float *)storage = to_double(v); break;
+  case nanoclj_f64: *(double *)storage = to_double(v); break;
+  case nanoclj_val: break;
+  case nanoclj_i64: *(int64_t *)storage = to_long(v); break;
+  case nanoclj_u8: *(uint8_t *)storage = (uint8_t)to_long(v); break;
+  case nanoclj_u16: *(uint16_t *)storage = (uint16_t)to_long(v); break;
+  case nanoclj_u32: *(uint32_t *)storage = (uint32_t)to_long(v); break;
+  }
+  size_t s = tensor_get_cell_size(t);
+  return (tensorview_t){ 1, { 1, 1, 1 }, { s, s, s, s }, storage, t };
+}
+
+static inline nanoclj_cell_t * mk_numeric_array_result(nanoclj_t * sc, bool is_array, nanoclj_tensor_t * tensor) {
+  if (!tensor) {
+    sc->pending_exception = sc->OutOfMemoryError;
+    return NULL;
+  } else if (is_array) {
+    return mk_object_from_tensor(sc, T_TENSOR, 0, tensor->ne[tensor->n_dims - 1], tensor);
+  } else {
+    return get_collection_object(sc, T_VECTOR, 0, tensor->ne[0], tensor, NULL);
+  }
+}
+
+/* Applies a binary operation elementwise to primitive arrays, typed vectors and numbers
+ * with broadcasting. The result is an array if either argument is one, and a typed vector otherwise. */
+static inline nanoclj_cell_t * numeric_array_binary(nanoclj_t * sc, nanoclj_binary_op_t op, nanoclj_val_t x, nanoclj_val_t y) {
+  nanoclj_tensor_t * tx = get_numeric_tensor(x), * ty = get_numeric_tensor(y);
+  if ((!tx && !is_number(x)) || (!ty && !is_number(y)) || (!tx && !ty)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return NULL;
+  }
+  nanoclj_tensor_type_t t;
+  if (tx && ty) {
+    t = tensor_promote_types(tx->type, ty->type);
+  } else if (tx) {
+    t = tensor_promote_scalar(tx->type, !is_int_type(type(y)));
+  } else {
+    t = tensor_promote_scalar(ty->type, !is_int_type(type(x)));
+  }
+  double sx, sy;
+  tensorview_t vx = tx ? to_numeric_tensorview(x) : mk_scalar_tensorview(x, t, &sx);
+  tensorview_t vy = ty ? to_numeric_tensorview(y) : mk_scalar_tensorview(y, t, &sy);
+  if (!tensorview_can_broadcast(&vx, &vy)) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Tensor shapes cannot be broadcast together")));
+    return NULL;
+  }
+  bool is_array = type(x) == T_TENSOR || type(y) == T_TENSOR;
+  return mk_numeric_array_result(sc, is_array, tensor_binary(op, vx, vy, t));
+}
+
+/* Applies a unary operation elementwise to a primitive array or a typed vector */
+static inline nanoclj_cell_t * numeric_array_unary(nanoclj_t * sc, nanoclj_unary_op_t op, nanoclj_val_t x) {
+  if (!get_numeric_tensor(x)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return NULL;
+  }
+  return mk_numeric_array_result(sc, type(x) == T_TENSOR, tensor_unary(op, to_numeric_tensorview(x)));
+}
+
+/* Reduces a primitive array or a typed vector along an axis, or all of it if axis is nil. The axes
+ * are numbered from the outermost dimension, and reducing a 1D tensor along its axis gives a number. */
+static inline nanoclj_val_t numeric_array_reduce(nanoclj_t * sc, nanoclj_reduce_op_t op, nanoclj_val_t x, nanoclj_val_t axis) {
+  if (!get_numeric_tensor(x)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return mk_nil();
+  }
+  tensorview_t tv = to_numeric_tensorview(x);
+  int d = -1;
+  if (!is_nil(axis)) {
+    long long a = to_long(axis);
+    if (!is_int_type(type(axis)) || a < 0 || a >= tv.n_dims) {
+      nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Axis out of range")));
+      return mk_nil();
+    }
+    d = tv.n_dims - 1 - a;
+  }
+  bool is_extremum = op == nanoclj_reduce_min || op == nanoclj_reduce_max || op == nanoclj_reduce_argmin || op == nanoclj_reduce_argmax;
+  if (is_extremum && (d == -1 ? tensorview_n_elem(&tv) : tv.ne[d]) == 0) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Reduction of an empty tensor")));
+    return mk_nil();
+  }
+  if (d == -1 || tv.n_dims == 1) {
+    int64_t index;
+    double v = tensor_reduce_all(op, tv, nanoclj_get_cpu_count(), &index);
+    switch (op) {
+    case nanoclj_reduce_argmin:
+    case nanoclj_reduce_argmax:
+      return mk_long(sc, index);
+    case nanoclj_reduce_min:
+    case nanoclj_reduce_max:
+      if (tensor_is_long_type(tv.type)) return mk_long(sc, (long long)v);
+      else if (!tensor_is_float_type(tv.type)) return mk_int((int32_t)v);
+    default:
+      return mk_double(v);
+    }
+  }
+  nanoclj_cell_t * r = mk_numeric_array_result(sc, type(x) == T_TENSOR, tensor_reduce_axis(op, tv, d, nanoclj_get_cpu_count()));
+  return r ? mk_pointer(r) : mk_nil();
+}
+
 static inline nanoclj_val_t mk_mapentry(nanoclj_t * sc, nanoclj_val_t key, nanoclj_val_t val) {
   nanoclj_cell_t * vec = get_vector_object(sc, T_MAPENTRY, 2);
   if (vec) {
@@ -2529,7 +3023,9 @@ static inline nanoclj_cell_t * subvec(nanoclj_t * sc, nanoclj_cell_t * vec, size
   if (_is_small(vec)) {
     new_vec = get_vector_object(sc, vec->type, end - start);
     if (end > start) {
-      memcpy(get_ptr(new_vec), get_ptr(vec) + start * sizeof(nanoclj_val_t), (end - start) * sizeof(nanoclj_val_t));
+      /* Small maps store the key and the value for each entry */
+      size_t n = is_map_type(vec->type) ? 2 : 1;
+      memcpy(get_ptr(new_vec), get_ptr(vec) + start * n * sizeof(nanoclj_val_t), (end - start) * n * sizeof(nanoclj_val_t));
     }
   } else {
     new_vec = get_collection_object(sc, vec->type, _offset_unchecked(vec) + start, end - start, _tensor_unchecked(vec), NULL);
@@ -2708,6 +3204,14 @@ static inline nanoclj_cell_t * seq(nanoclj_t * sc, nanoclj_cell_t * coll) {
       _set_seq(coll);
       return coll;
     }
+  case T_TABLE:
+    /* A table is seqed as [name column] entries through an array map sharing the same tensor */
+    if (get_size(coll) == 0) {
+      return NULL;
+    } else {
+      coll = get_collection_object(sc, T_ARRAYMAP, 0, get_size(coll), _tensor_unchecked(coll), NULL);
+      return seq(sc, coll);
+    }
   }
 
   return coll;
@@ -2735,6 +3239,7 @@ static inline bool is_empty(nanoclj_t * sc, nanoclj_cell_t * coll) {
   case T_QUEUE:
   case T_TENSOR:
   case T_GRADIENT:
+  case T_TABLE:
     return get_size(coll) == 0;
 
   case T_GRAPH:
@@ -2764,7 +3269,7 @@ static inline bool _is_zero(nanoclj_cell_t * c) {
 static inline bool is_zero(nanoclj_val_t p) {
   switch (prim_type(p)) {
   case T_LONG:
-    return decode_integer(p) == 0;
+    return decode_long(p) == 0;
   case T_DOUBLE:
     return p.as_double == 0.0;
   case T_CELL:
@@ -2994,6 +3499,7 @@ static inline size_t count(nanoclj_t * sc, nanoclj_cell_t * coll) {
   case T_TENSOR:
   case T_GRADIENT:
   case T_VAR:
+  case T_TABLE:
     return get_size(coll);
 
   case T_HASHMAP:
@@ -3080,6 +3586,405 @@ static inline nanoclj_val_t fifth(nanoclj_t * sc, nanoclj_cell_t * a) {
 #include "nanoclj_curl.h"
 #endif
 
+/* Returns the shape of a primitive array or a typed vector, starting from the outermost dimension */
+static inline nanoclj_val_t numeric_array_shape(nanoclj_t * sc, nanoclj_val_t x) {
+  if (!get_numeric_tensor(x)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return mk_nil();
+  }
+  tensorview_t tv = to_numeric_tensorview(x);
+  nanoclj_cell_t * vec = get_vector_object(sc, T_VECTOR, tv.n_dims);
+  if (!vec) return mk_nil();
+  retain(sc, vec);
+  for (int d = 0; d < tv.n_dims; d++) set_indexed_value(vec, d, mk_long(sc, tv.ne[tv.n_dims - 1 - d]));
+  return mk_pointer(vec);
+}
+
+/* Returns an array that shares the data of x with the shape and strides of tv */
+static inline nanoclj_val_t mk_numeric_array_view(nanoclj_t * sc, nanoclj_val_t x, const tensorview_t * tv) {
+  nanoclj_tensor_t * r = mk_tensor_view(get_numeric_tensor(x), tv->type, tv->n_dims, tv->ne, tv->nb, tv->data);
+  nanoclj_cell_t * c = mk_numeric_array_result(sc, true, r);
+  return c ? mk_pointer(c) : mk_nil();
+}
+
+/* Returns the elements of a primitive array or a typed vector with a new shape. Contiguous data is
+ * shared with the result and other data is copied. */
+static inline nanoclj_val_t numeric_array_reshape(nanoclj_t * sc, nanoclj_val_t x, nanoclj_val_t shape) {
+  if (!get_numeric_tensor(x)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return mk_nil();
+  }
+  tensorview_t tv = to_numeric_tensorview(x);
+  int64_t ne[NANOCLJ_MAX_DIMS] = { 1, 1, 1 }, n = 1;
+  int n_dims = is_cell(shape) ? count(sc, decode_pointer(shape)) : 0;
+  if (n_dims < 1 || n_dims > NANOCLJ_MAX_DIMS) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid shape")));
+    return mk_nil();
+  }
+  nanoclj_cell_t * s = seq(sc, decode_pointer(shape));
+  for (int d = n_dims - 1; d >= 0; d--, s = next(sc, s)) {
+    ne[d] = to_long(first(sc, s));
+    if (ne[d] < 0) n = -1;
+    else n *= ne[d];
+  }
+  if (n != tensorview_n_elem(&tv)) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Shape doesn't match the number of elements")));
+    return mk_nil();
+  }
+  bool is_contiguous = tensorview_is_contiguous(&tv);
+  if (is_contiguous && n_dims == 1 && tv.n_dims == 1) {
+    return x;
+  } else if (is_contiguous) {
+    tv.n_dims = n_dims;
+    tv.nb[0] = tensor_get_cell_size(tv.type);
+    for (int d = 0; d < NANOCLJ_MAX_DIMS; d++) {
+      tv.ne[d] = ne[d];
+      tv.nb[d + 1] = tv.nb[d] * ne[d];
+    }
+    return mk_numeric_array_view(sc, x, &tv);
+  }
+  nanoclj_tensor_t * tmp = tensorview_convert(&tv, tv.type), * r = NULL;
+  if (tmp && (r = mk_tensor_nd(tv.type, n_dims, ne))) {
+    memcpy(r->data, tmp->data, n * r->nb[0]);
+  }
+  tensor_free(tmp);
+  nanoclj_cell_t * c = mk_numeric_array_result(sc, true, r);
+  return c ? mk_pointer(c) : mk_nil();
+}
+
+/* Returns a view of a primitive array or a typed vector with the order of the axes reversed.
+ * Vectors are returned as they are. */
+static inline nanoclj_val_t numeric_array_transpose(nanoclj_t * sc, nanoclj_val_t x) {
+  if (!get_numeric_tensor(x)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return mk_nil();
+  }
+  tensorview_t tv = to_numeric_tensorview(x), r = tv;
+  if (tv.n_dims == 1) return x;
+  for (int d = 0; d < tv.n_dims; d++) {
+    r.ne[d] = tv.ne[tv.n_dims - 1 - d];
+    r.nb[d] = tv.nb[tv.n_dims - 1 - d];
+  }
+  return mk_numeric_array_view(sc, x, &r);
+}
+
+/* Returns a view of a primitive array or a typed vector restricted by one index per axis, starting from the
+ * outermost one. An index is nil for the whole axis, a number that selects a position and removes the axis,
+ * or a vector [start end] or [start end step]. The remaining axes are kept whole. */
+static inline nanoclj_val_t numeric_array_slice(nanoclj_t * sc, nanoclj_val_t x, nanoclj_cell_t * indices) {
+  if (!get_numeric_tensor(x)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return mk_nil();
+  }
+  tensorview_t tv = to_numeric_tensorview(x), r = tv;
+  uint8_t * data = tv.data;
+  r.n_dims = 0;
+  for (int d = tv.n_dims - 1; d >= 0; d--, indices = next(sc, indices)) {
+    nanoclj_val_t idx = indices ? first(sc, indices) : mk_nil();
+    int64_t start = 0, end = tv.ne[d], step = 1;
+    if (is_number(idx)) {
+      start = to_long(idx);
+      if (start < 0 || start >= tv.ne[d]) {
+	nanoclj_throw(sc, mk_index_exception(sc, "Index out of bounds"));
+	return mk_nil();
+      }
+      data += start * tv.nb[d];
+      continue;
+    } else if (is_cell(idx) && is_vector_type(_type(decode_pointer(idx)))) {
+      nanoclj_cell_t * range = decode_pointer(idx);
+      size_t n = get_size(range);
+      if (n < 2 || n > 3) {
+	nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Range must be [start end] or [start end step]")));
+	return mk_nil();
+      }
+      start = to_long(get_indexed_value(range, 0));
+      end = to_long(get_indexed_value(range, 1));
+      if (n == 3) step = to_long(get_indexed_value(range, 2));
+    } else if (!is_nil(idx)) {
+      nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid index")));
+      return mk_nil();
+    }
+    if (step < 1) {
+      nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Step must be positive")));
+      return mk_nil();
+    } else if (start < 0 || end > tv.ne[d] || start > end) {
+      nanoclj_throw(sc, mk_index_exception(sc, "Index out of bounds"));
+      return mk_nil();
+    }
+    data += start * tv.nb[d];
+    r.ne[r.n_dims] = (end - start + step - 1) / step;
+    r.nb[r.n_dims] = tv.nb[d] * step;
+    r.n_dims++;
+  }
+  if (indices) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Too many indices")));
+    return mk_nil();
+  } else if (r.n_dims == 0) {
+    return tensor_is_long_type(tv.type) ? mk_long(sc, tensor_load_long(tv.type, data)) : tensor_load_val(tv.type, data);
+  }
+  /* The axes were collected from the outermost one */
+  for (int d = 0; d < r.n_dims / 2; d++) {
+    int64_t ne = r.ne[d];
+    size_t nb = r.nb[d];
+    r.ne[d] = r.ne[r.n_dims - 1 - d];
+    r.nb[d] = r.nb[r.n_dims - 1 - d];
+    r.ne[r.n_dims - 1 - d] = ne;
+    r.nb[r.n_dims - 1 - d] = nb;
+  }
+  r.data = data;
+  return mk_numeric_array_view(sc, x, &r);
+}
+
+static inline bool numeric_array_is_contiguous(nanoclj_val_t x) {
+  if (!get_numeric_tensor(x)) return false;
+  tensorview_t tv = to_numeric_tensorview(x);
+  return tensorview_is_contiguous(&tv);
+}
+
+/* Returns x if its elements are contiguous, and otherwise a contiguous copy */
+static inline nanoclj_val_t numeric_array_contiguous(nanoclj_t * sc, nanoclj_val_t x) {
+  if (!get_numeric_tensor(x)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return mk_nil();
+  } else if (numeric_array_is_contiguous(x)) {
+    return x;
+  }
+  tensorview_t tv = to_numeric_tensorview(x);
+  nanoclj_cell_t * c = mk_numeric_array_result(sc, true, tensorview_convert(&tv, tv.type));
+  return c ? mk_pointer(c) : mk_nil();
+}
+
+static const struct {
+  const char * name;
+  tensor_expr_kind_t kind;
+  int op;
+} tensor_expr_ops[] = {
+  { "add", tensor_expr_binary, nanoclj_binop_add },
+  { "sub", tensor_expr_binary, nanoclj_binop_sub },
+  { "mul", tensor_expr_binary, nanoclj_binop_mul },
+  { "div", tensor_expr_binary, nanoclj_binop_div },
+  { "min", tensor_expr_binary, nanoclj_binop_min },
+  { "max", tensor_expr_binary, nanoclj_binop_max },
+  { "neg", tensor_expr_unary, nanoclj_unop_neg },
+  { "abs", tensor_expr_unary, nanoclj_unop_abs },
+  { "sqrt", tensor_expr_unary, nanoclj_unop_sqrt },
+  { "exp", tensor_expr_unary, nanoclj_unop_exp },
+  { "log", tensor_expr_unary, nanoclj_unop_log },
+  { "sin", tensor_expr_unary, nanoclj_unop_sin },
+  { "cos", tensor_expr_unary, nanoclj_unop_cos },
+  { "tanh", tensor_expr_unary, nanoclj_unop_tanh },
+  { "floor", tensor_expr_unary, nanoclj_unop_floor },
+  { "ceil", tensor_expr_unary, nanoclj_unop_ceil },
+  { "round", tensor_expr_unary, nanoclj_unop_round }
+};
+
+/* Converts the code of a fused expression into instructions */
+static inline bool parse_tensor_expr(nanoclj_t * sc, nanoclj_cell_t * code_vec, tensor_expr_instr_t * code) {
+  size_t n_ops = sizeof(tensor_expr_ops) / sizeof(tensor_expr_ops[0]);
+  for (size_t i = 0; i < get_size(code_vec); i++) {
+    nanoclj_val_t v = get_indexed_value(code_vec, i);
+    if (is_int_type(type(v))) {
+      code[i] = (tensor_expr_instr_t){ tensor_expr_load, (int)to_long(v) };
+      continue;
+    }
+    size_t j = 0;
+    if (type(v) == T_KEYWORD) {
+      strview_t name = decode_symbol(v)->name;
+      while (j < n_ops && !strview_eq(name, mk_strview(tensor_expr_ops[j].name))) j++;
+    }
+    if (type(v) != T_KEYWORD || j == n_ops) {
+      nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Unknown operation")));
+      return false;
+    }
+    code[i] = (tensor_expr_instr_t){ tensor_expr_ops[j].kind, tensor_expr_ops[j].op };
+  }
+  return true;
+}
+
+/* Evaluates a fused expression over a vector of operands, which are primitive arrays, typed vectors
+ * or numbers. The code is a vector in postfix order, where an integer loads an operand and a keyword
+ * such as :add or :sqrt applies an operation to the topmost values. The result is an array if any
+ * of the operands is one, and a typed vector otherwise. */
+static inline nanoclj_val_t numeric_array_fuse(nanoclj_t * sc, nanoclj_val_t code0, nanoclj_val_t operands0) {
+  if (!is_cell(code0) || !is_vector_type(_type(decode_pointer(code0))) ||
+      !is_cell(operands0) || !is_vector_type(_type(decode_pointer(operands0)))) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Code and operands must be vectors")));
+    return mk_nil();
+  }
+  nanoclj_cell_t * code_vec = decode_pointer(code0), * operands_vec = decode_pointer(operands0);
+  size_t n_code = get_size(code_vec), n = get_size(operands_vec);
+  tensor_expr_instr_t * code = malloc((n_code + 1) * sizeof(tensor_expr_instr_t));
+  tensorview_t * operands = malloc((n + 1) * sizeof(tensorview_t));
+  bool * is_scalar = malloc(n + 1);
+  double * scalars = malloc((n + 1) * sizeof(double));
+  bool ok = code && operands && is_scalar && scalars, is_array = false;
+  if (!ok) {
+    sc->pending_exception = sc->OutOfMemoryError;
+  } else {
+    ok = parse_tensor_expr(sc, code_vec, code);
+  }
+  for (size_t i = 0; ok && i < n; i++) {
+    nanoclj_val_t v = get_indexed_value(operands_vec, i);
+    if (get_numeric_tensor(v)) {
+      operands[i] = to_numeric_tensorview(v);
+      is_scalar[i] = false;
+      is_array |= type(v) == T_TENSOR;
+    } else if (is_number(v)) {
+      operands[i] = mk_scalar_tensorview(v, nanoclj_f64, &scalars[i]);
+      is_scalar[i] = true;
+    } else {
+      nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+      ok = false;
+    }
+  }
+  nanoclj_val_t r = mk_nil();
+  if (ok) {
+    int n_dims;
+    int64_t ne[NANOCLJ_MAX_DIMS];
+    if (tensor_expr_depth(code, n_code, n) < 0) {
+      nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid expression")));
+    } else if (!tensorview_broadcast_shape(operands, n, &n_dims, ne)) {
+      nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Tensor shapes cannot be broadcast together")));
+    } else {
+      nanoclj_tensor_t * t = tensor_expr_eval(code, n_code, operands, is_scalar, n, nanoclj_get_cpu_count());
+      nanoclj_cell_t * c = mk_numeric_array_result(sc, is_array, t);
+      if (c) r = mk_pointer(c);
+    }
+  }
+  free(code);
+  free(operands);
+  free(is_scalar);
+  free(scalars);
+  return r;
+}
+
+/* Returns the type in which matrix operations are computed */
+static inline nanoclj_tensor_type_t get_linalg_type(const tensorview_t * a, const tensorview_t * b) {
+  return a->type == nanoclj_f32 && (!b || b->type == nanoclj_f32) ? nanoclj_f32 : nanoclj_f64;
+}
+
+/* Multiplies matrices and vectors. A vector on the left is a row vector and on the right a column vector,
+ * and the product of two vectors is their dot product. */
+static inline nanoclj_val_t numeric_array_matmul(nanoclj_t * sc, nanoclj_val_t x, nanoclj_val_t y) {
+  if (!get_numeric_tensor(x) || !get_numeric_tensor(y)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return mk_nil();
+  }
+  tensorview_t a = to_numeric_tensorview(x), b = to_numeric_tensorview(y);
+  nanoclj_tensor_type_t t = get_linalg_type(&a, &b);
+  if (a.n_dims > 2 || b.n_dims > 2 || a.ne[0] != (b.n_dims == 2 ? b.ne[1] : b.ne[0])) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Matrix dimensions don't match")));
+    return mk_nil();
+  }
+  nanoclj_tensor_t * r;
+  if (a.n_dims == 1 && b.n_dims == 1) {
+    double d;
+    if (!tensor_dot(a, b, t, &d)) return nanoclj_throw(sc, sc->OutOfMemoryError);
+    return mk_double(d);
+  } else if (b.n_dims == 1) {
+    r = tensor_matvec(a, b, t, nanoclj_get_cpu_count());
+  } else if (a.n_dims == 1) {
+    r = tensor_matvec(tensorview_transpose(b), a, t, nanoclj_get_cpu_count());
+  } else {
+    r = tensor_matmul(a, b, t, nanoclj_get_cpu_count());
+  }
+  nanoclj_cell_t * c = mk_numeric_array_result(sc, type(x) == T_TENSOR || type(y) == T_TENSOR, r);
+  return c ? mk_pointer(c) : mk_nil();
+}
+
+static inline bool get_square_matrix(nanoclj_t * sc, nanoclj_val_t x, tensorview_t * tv) {
+  if (!get_numeric_tensor(x)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return false;
+  }
+  *tv = to_numeric_tensorview(x);
+  if (tv->n_dims != 2 || tv->ne[0] != tv->ne[1]) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Matrix must be square")));
+    return false;
+  }
+  return true;
+}
+
+/* Computes the LU decomposition of a square matrix and returns a vector of the combined LU matrix
+ * and the row permutation, or the determinant if det is true */
+static inline nanoclj_val_t numeric_array_lu(nanoclj_t * sc, nanoclj_val_t x, bool det) {
+  tensorview_t a;
+  if (!get_square_matrix(sc, x, &a)) return mk_nil();
+  int64_t n = a.ne[0];
+  nanoclj_tensor_t * perm = mk_tensor_1d(nanoclj_i32, n);
+  if (!perm) {
+    nanoclj_throw(sc, sc->OutOfMemoryError);
+    return mk_nil();
+  }
+  int sign;
+  bool is_singular;
+  nanoclj_tensor_t * lu = tensor_lu(a, perm->data, &sign, &is_singular);
+  if (det) {
+    tensor_free(perm);
+    if (is_singular) return mk_double(0.0);
+    if (!lu) return nanoclj_throw(sc, sc->OutOfMemoryError);
+    double d = sign;
+    for (int64_t i = 0; i < n; i++) d *= ((double *)lu->data)[i * n + i];
+    tensor_free(lu);
+    return mk_double(d);
+  } else if (!lu) {
+    tensor_free(perm);
+    return nanoclj_throw(sc, is_singular ? mk_arithmetic_exception(sc, "Matrix is singular") : sc->OutOfMemoryError);
+  }
+  nanoclj_cell_t * lu_cell = mk_numeric_array_result(sc, true, lu);
+  if (!lu_cell) {
+    tensor_free(perm);
+    return mk_nil();
+  }
+  retain(sc, lu_cell);
+  nanoclj_cell_t * perm_cell = mk_numeric_array_result(sc, true, perm);
+  if (!perm_cell) return mk_nil();
+  retain(sc, perm_cell);
+  nanoclj_cell_t * vec = get_vector_object(sc, T_VECTOR, 2);
+  if (!vec) return mk_nil();
+  set_indexed_value(vec, 0, mk_pointer(lu_cell));
+  set_indexed_value(vec, 1, mk_pointer(perm_cell));
+  return mk_pointer(vec);
+}
+
+/* Solves AX = B, where B is a vector or a matrix, using LU decomposition */
+static inline nanoclj_val_t numeric_array_solve(nanoclj_t * sc, nanoclj_val_t x, nanoclj_val_t y) {
+  tensorview_t a;
+  if (!get_square_matrix(sc, x, &a)) return mk_nil();
+  if (!get_numeric_tensor(y)) {
+    nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+    return mk_nil();
+  }
+  tensorview_t b = to_numeric_tensorview(y);
+  if (b.n_dims > 2 || (b.n_dims == 2 ? b.ne[1] : b.ne[0]) != a.ne[0]) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Matrix dimensions don't match")));
+    return mk_nil();
+  }
+  int32_t * perm = malloc(a.ne[0] * sizeof(int32_t));
+  int sign;
+  bool is_singular;
+  nanoclj_tensor_t * lu = perm ? tensor_lu(a, perm, &sign, &is_singular) : NULL, * r = NULL;
+  if (lu) {
+    r = tensor_lu_solve(lu, perm, b);
+    tensor_free(lu);
+  }
+  free(perm);
+  if (!lu && is_singular) return nanoclj_throw(sc, mk_arithmetic_exception(sc, "Matrix is singular"));
+  nanoclj_cell_t * c = mk_numeric_array_result(sc, type(x) == T_TENSOR || type(y) == T_TENSOR, r);
+  return c ? mk_pointer(c) : mk_nil();
+}
+
+/* Returns the lower triangular Cholesky factor of a symmetric positive definite matrix */
+static inline nanoclj_val_t numeric_array_cholesky(nanoclj_t * sc, nanoclj_val_t x) {
+  tensorview_t a;
+  if (!get_square_matrix(sc, x, &a)) return mk_nil();
+  bool is_not_pd;
+  nanoclj_tensor_t * r = tensor_cholesky(a, &is_not_pd);
+  if (!r && is_not_pd) return nanoclj_throw(sc, mk_arithmetic_exception(sc, "Matrix is not positive definite"));
+  nanoclj_cell_t * c = mk_numeric_array_result(sc, true, r);
+  return c ? mk_pointer(c) : mk_nil();
+}
+
 static uint32_t prim_hasheq(nanoclj_val_t v, void * context) {
   switch (prim_type(v)) {
   case T_EMPTYLIST:
@@ -3095,7 +4000,7 @@ static uint32_t prim_hasheq(nanoclj_val_t v, void * context) {
     return v.as_long == kFALSE ? 1237 : 1231;
 
   case T_LONG:
-    return murmur3_hash_long(decode_integer(v));
+    return murmur3_hash_long(decode_long(v));
 
   case T_DOUBLE:
     if (v.as_double == 0.0) return 0;
@@ -3287,7 +4192,7 @@ static inline bool equals(nanoclj_t * sc, nanoclj_val_t a0, nanoclj_val_t b0) {
     /* nil == nil was tested in the previous comparison, regexes compared by value */
     return false;
   } else if (t_a == T_LONG && t_b == T_LONG) {
-    return decode_integer(a0) == decode_integer(b0);
+    return decode_long(a0) == decode_long(b0);
   } else if (t_a != T_CELL && t_b != T_CELL) {
     return false;
   } else if (t_a == T_LONG) {
@@ -3523,17 +4428,37 @@ static size_t find_index(nanoclj_t * sc, nanoclj_cell_t * coll, nanoclj_val_t ke
   return NPOS;
 }
 
+/* Returns the key of a node, which is the key of its data if the data is a map entry */
+static inline nanoclj_val_t get_node_key(nanoclj_graph_array_t * g, uint32_t i) {
+  nanoclj_val_t e = g->nodes[i].data;
+  return type(e) == T_MAPENTRY ? get_indexed_value(decode_pointer(e), 0) : e;
+}
+
+static inline void graph_array_hash_node(nanoclj_t * sc, nanoclj_graph_array_t * g, uint32_t i) {
+  uint32_t mask = g->node_hash_size - 1, j = hasheq(get_node_key(g, i), sc) & mask;
+  while (g->node_hash[j]) j = (j + 1) & mask;
+  g->node_hash[j] = i + 1;
+}
+
+/* Returns the index of the node with the given key. The nodes that have been added since the
+ * previous call are hashed first, and the hash is rebuilt when it is half full. */
 static inline size_t find_node_index(nanoclj_t * sc, nanoclj_graph_array_t * g, nanoclj_val_t key) {
-  for (uint32_t i = 0; i < g->num_nodes; i++) {
-    nanoclj_node_t * n = &(g->nodes[i]);
-    nanoclj_val_t e = n->data;
-    if (type(e) == T_MAPENTRY) {
-      nanoclj_val_t key2 = get_indexed_value(decode_pointer(e), 0);
-      strview_t sv = to_strview(key2);
-      if (equals(sc, key, key2)) {
-	return i;
-      }
-    } else if (equals(sc, key, e)) {
+  if (2 * g->num_nodes > g->node_hash_size) {
+    uint32_t size = 16;
+    while (size < 2 * g->num_nodes) size *= 2;
+    free(g->node_hash);
+    g->node_hash = calloc(size, sizeof(uint32_t));
+    g->node_hash_size = size;
+    g->num_hashed_nodes = 0;
+  }
+  for (; g->num_hashed_nodes < g->num_nodes; g->num_hashed_nodes++) {
+    graph_array_hash_node(sc, g, g->num_hashed_nodes);
+  }
+  if (!g->node_hash_size) return NPOS;
+  uint32_t mask = g->node_hash_size - 1;
+  for (uint32_t j = hasheq(key, sc) & mask; g->node_hash[j]; j = (j + 1) & mask) {
+    uint32_t i = g->node_hash[j] - 1;
+    if (equals(sc, key, get_node_key(g, i))) {
       return i;
     }
   }
@@ -3630,15 +4555,25 @@ static inline nanoclj_val_t find(nanoclj_t * sc, nanoclj_cell_t * coll, nanoclj_
     
   case T_GRAPH_NODE:
     {
-      nanoclj_node_t * n = &(_graph_unchecked(coll)->nodes[_node_offset_unchecked(coll)]);
+      nanoclj_graph_array_t * g = _graph_unchecked(coll);
+      size_t i = _node_offset_unchecked(coll);
+      nanoclj_node_t * n = &(g->nodes[i]);
       if (key.as_long == kw_position.as_long) {
-	return mk_vector_2d(sc, n->pos.x, n->pos.y);
+	return mk_vector_2d(sc, g->x[i], g->y[i]);
       } else if (key.as_long == kw_data.as_long) {
 	return n->data;
       }
     }
     break;
 
+  case T_TABLE:
+    for (size_t i = 0; i < get_size(coll); i++) {
+      if (equals(sc, table_get_name(coll, i), key)) {
+	return table_get_column(coll, i);
+      }
+    }
+    break;
+
   case T_GRAPH_EDGE:
     {
       nanoclj_edge_t * e = &(_graph_unchecked(coll)->edges[_edge_offset_unchecked(coll)]);
@@ -3646,6 +4581,8 @@ static inline nanoclj_val_t find(nanoclj_t * sc, nanoclj_cell_t * coll, nanoclj_
 	return mk_long(sc, e->source);
       } else if (key.as_long == kw_target.as_long) {
 	return mk_long(sc, e->target);
+      } else if (key.as_long == kw_data.as_long) {
+	return e->data;
       }
     }
     break;
@@ -3684,7 +4621,7 @@ static inline int compare(nanoclj_val_t a, nanoclj_val_t b) {
     int i = strview_cmp(sa->ns, sb->ns);
     return i ? i : strview_cmp(sa->name, sb->name);
   } else if (type_a != T_CELL && type_b != T_CELL) {
-    int ia = decode_integer(a), ib = decode_integer(b);
+    long long ia = decode_long(a), ib = decode_long(b);
     if (ia < ib) return -1;
     else if (ia > ib) return +1;
     return 0;
@@ -3848,11 +4785,11 @@ static inline nanoclj_val_t oblist_find_item(uint16_t type, strview_t ns, strvie
 static inline nanoclj_cell_t * copy_cell(nanoclj_t * sc, const nanoclj_cell_t * c) {
   size_t len = get_size(c);
   if (_is_small(c)) {
-    nanoclj_cell_t * new_c = get_collection_object(sc, _type(c), 0, len, NULL, NULL);
+    nanoclj_cell_t * new_c = get_collection_object_x(sc, _type(c), 0, len, NULL, NULL, c, mk_nil());
     memcpy(_smalldata_unchecked(new_c), _smalldata_unchecked(c), NANOCLJ_SMALL_VEC_SIZE * sizeof(nanoclj_val_t));
     return new_c;
   } else {
-    return get_collection_object(sc, _type(c), 0, len, c->_collection.tensor, c->_collection.meta);
+    return get_collection_object_x(sc, _type(c), 0, len, c->_collection.tensor, c->_collection.meta, c, mk_nil());
   }
 }
 
@@ -3862,7 +4799,7 @@ static inline nanoclj_cell_t * copy_for_mutation(nanoclj_t * sc, const nanoclj_c
     return copy_cell(sc, c);
   } else {
     nanoclj_tensor_t * s = tensor_dup(c->_collection.tensor);
-    return get_collection_object(sc, _type(c), 0, get_size(c), s, c->_collection.meta);
+    return get_collection_object_x(sc, _type(c), 0, get_size(c), s, c->_collection.meta, c, mk_nil());
   }
 }
 
@@ -3891,7 +4828,7 @@ static inline nanoclj_cell_t * copy_or_upgrade_so(nanoclj_t * sc, nanoclj_cell_t
       sc->pending_exception = sc->OutOfMemoryError;
       return NULL;
     }
-    nanoclj_cell_t * coll = get_collection_object(sc, t, 0, size + added_size, tensor, NULL);
+    nanoclj_cell_t * coll = get_collection_object_x(sc, t, 0, size + added_size, tensor, NULL, coll0, mk_nil());
     if (size > 0) {
       nanoclj_val_t * values = &(coll0->_small_tensor.vals[0]);
       if (t == T_VECTOR) {
@@ -3925,15 +4862,19 @@ static inline nanoclj_cell_t * vector_conjoin(nanoclj_t * sc, nanoclj_cell_t * v
       uint32_t h = hasheq(new_value, sc);
       new_vec->_collection.tensor = tensor_hash_mutate_set(new_vec->_collection.tensor, h, old_size, new_value, mk_nil(), sc, hasheq);
     } else {
-      new_vec = get_vector_object(sc, t, old_size + 1);
+      new_vec = get_vector_object_x(sc, t, nanoclj_val, old_size + 1, NULL, vec, new_value);
       memcpy(get_ptr(new_vec), _smalldata_unchecked(vec), old_size * sizeof(nanoclj_val_t));
       set_indexed_value(new_vec, old_size, new_value);
     }
     return new_vec;
   } else if (t == T_HASHSET) { // combine
     uint32_t h = hasheq(new_value, sc);
-    nanoclj_tensor_t * tensor = tensor_hash_mutate_set(vec->_collection.tensor, h, old_size, new_value, mk_nil(), sc, hasheq);
-    return get_collection_object(sc, t, _offset_unchecked(vec), old_size + 1, tensor, vec->_collection.meta);
+    nanoclj_tensor_t * tensor = tensor_hash_set(vec->_collection.tensor, h, old_size, new_value, mk_nil(), sc, hasheq);
+    if (!tensor) {
+      sc->pending_exception = sc->OutOfMemoryError;
+      return NULL;
+    }
+    return get_collection_object_x(sc, t, _offset_unchecked(vec), old_size + 1, tensor, vec->_collection.meta, vec, new_value);
   } else {
     size_t old_offset = _offset_unchecked(vec);
     nanoclj_tensor_t * tensor = _tensor_unchecked(vec);
@@ -3945,16 +4886,20 @@ static inline nanoclj_cell_t * vector_conjoin(nanoclj_t * sc, nanoclj_cell_t * v
     case nanoclj_f32: tensor = tensor_push_f32(tensor, old_offset + old_size, to_double(new_value)); break;
     case nanoclj_f64: tensor = tensor_push_f64(tensor, old_offset + old_size, to_double(new_value)); break;
     case nanoclj_val: tensor = tensor_push(tensor, old_offset + old_size, new_value); break;
+    case nanoclj_u8: tensor = tensor_push_i8(tensor, old_offset + old_size, to_long(new_value)); break;
+    case nanoclj_u16: tensor = tensor_push_i16(tensor, old_offset + old_size, to_long(new_value)); break;
+    case nanoclj_u32: tensor = tensor_push_i32(tensor, old_offset + old_size, to_long(new_value)); break;
+    case nanoclj_i64: tensor = tensor_push_i64(tensor, old_offset + old_size, to_long(new_value)); break;
     }
     if (!tensor) return NULL;
-    return get_collection_object(sc, t, old_offset, old_size + 1, tensor, vec->_collection.meta);
+    return get_collection_object_x(sc, t, old_offset, old_size + 1, tensor, vec->_collection.meta, vec, new_value);
   }
 }
 
 static inline nanoclj_cell_t * assoc(nanoclj_t * sc, nanoclj_cell_t * coll, nanoclj_val_t key, nanoclj_val_t value) {
   uint16_t t = _type(coll);
   if (t == T_LISTMAP) {
-    nanoclj_cell_t * new_coll = get_cell_x(t, 0, NULL, NULL, NULL);
+    nanoclj_cell_t * new_coll = get_cell_x(t, 0, coll, is_cell(value) ? decode_pointer(value) : NULL, NULL);
     if (new_coll) {
       new_coll->_cons.car = key;
       new_coll->_cons.value = value;
@@ -3971,7 +4916,7 @@ static inline nanoclj_cell_t * assoc(nanoclj_t * sc, nanoclj_cell_t * coll, nano
   } else if (is_map_type(t)) {
     if (_is_small(coll)) {
       if (_sodim1_unchecked(coll) == 0) {
-	coll = get_vector_object(sc, t, 1);
+	coll = get_vector_object_x(sc, t, nanoclj_val, 1, NULL, is_cell(key) ? decode_pointer(key) : NULL, value);
 	coll->_small_tensor.vals[0] = key;
 	coll->_small_tensor.vals[1] = value;
       } else {
@@ -3991,7 +4936,7 @@ static inline nanoclj_cell_t * assoc(nanoclj_t * sc, nanoclj_cell_t * coll, nano
 	nanoclj_tensor_t * tensor = coll->_collection.tensor;
 	nanoclj_val_t vec[2] = { key, value };
 	tensor = tensor_push_vec(tensor, old_size, &vec[0]);
-	coll = get_collection_object(sc, t, _offset_unchecked(coll), old_size + 1, tensor, meta);
+	coll = get_collection_object_x(sc, t, _offset_unchecked(coll), old_size + 1, tensor, meta, coll, value);
       } else {
 	nanoclj_tensor_t * old_tensor = coll->_collection.tensor;
 	nanoclj_tensor_t * tensor = mk_tensor_hash(2, 2, 2 * NANOCLJ_ARRAYMAP_LIMIT);
@@ -4001,13 +4946,17 @@ static inline nanoclj_cell_t * assoc(nanoclj_t * sc, nanoclj_cell_t * coll, nano
 	  tensor = tensor_hash_mutate_set(tensor, h, idx, old_key, old_val, sc, hasheq);
 	}
 	tensor = tensor_hash_mutate_set(tensor, hasheq(key, sc), old_size, key, value, sc, hasheq);
-	coll = get_collection_object(sc, T_HASHMAP, 0, old_size + 1, tensor, meta);
+	coll = get_collection_object_x(sc, T_HASHMAP, 0, old_size + 1, tensor, meta, coll, value);
       }
     } else {
       size_t old_size = get_size(coll);
       uint32_t h = hasheq(key, sc);
-      nanoclj_tensor_t * tensor = tensor_hash_mutate_set(coll->_collection.tensor, h, old_size, key, value, sc, hasheq);
-      coll = get_collection_object(sc, t, _offset_unchecked(coll), old_size + 1, tensor, coll->_collection.meta);
+      nanoclj_tensor_t * tensor = tensor_hash_set(coll->_collection.tensor, h, old_size, key, value, sc, hasheq);
+      if (!tensor) {
+	sc->pending_exception = sc->OutOfMemoryError;
+	return NULL;
+      }
+      coll = get_collection_object_x(sc, t, _offset_unchecked(coll), old_size + 1, tensor, coll->_collection.meta, coll, value);
     }
   } else {
     nanoclj_throw(sc, mk_index_exception(sc, "Index out of bounds"));
@@ -4117,8 +5066,9 @@ static inline nanoclj_val_t inc_slot_in_frame(nanoclj_cell_t * f, nanoclj_val_t
   return mk_nil();
 }
 
-static inline nanoclj_cell_t * new_slot_spec_in_frame(nanoclj_t * sc, nanoclj_cell_t * frame, nanoclj_val_t sym, nanoclj_val_t value) {
-  nanoclj_cell_t * slot = get_cell_x(T_LISTMAP, 0, NULL, NULL, NULL);
+/* The env, the frame and the value may only be referenced from C, so they are marked by gc */
+static inline nanoclj_cell_t * new_slot_spec_in_frame_x(nanoclj_t * sc, nanoclj_cell_t * env, nanoclj_cell_t * frame, nanoclj_val_t sym, nanoclj_val_t value) {
+  nanoclj_cell_t * slot = get_cell_x(T_LISTMAP, 0, env, frame, is_cell(value) ? decode_pointer(value) : NULL);
   if (slot) {
     slot->_cons.car = sym;
     slot->_cons.value = value;
@@ -4129,9 +5079,13 @@ static inline nanoclj_cell_t * new_slot_spec_in_frame(nanoclj_t * sc, nanoclj_ce
   return slot;
 }
 
+static inline nanoclj_cell_t * new_slot_spec_in_frame(nanoclj_t * sc, nanoclj_cell_t * frame, nanoclj_val_t sym, nanoclj_val_t value) {
+  return new_slot_spec_in_frame_x(sc, NULL, frame, sym, value);
+}
+
 static inline void new_slot_spec_in_env(nanoclj_t * sc, nanoclj_cell_t * env, nanoclj_val_t variable, nanoclj_val_t value) {
   nanoclj_cell_t * frame = decode_pointer(_car_unchecked(env));
-  _car_unchecked(env) = mk_pointer(new_slot_spec_in_frame(sc, frame, variable, value));  
+  _car_unchecked(env) = mk_pointer(new_slot_spec_in_frame_x(sc, env, frame, variable, value));
 }
 
 static inline void new_slot_in_env(nanoclj_t * sc, nanoclj_val_t variable, nanoclj_val_t value) {
@@ -4459,9 +5413,15 @@ static inline nanoclj_cell_t * update_meta_from_reader(nanoclj_t * sc, nanoclj_c
   nanoclj_cell_t * p = decode_pointer(p0);
   if (_port_type_unchecked(p) == port_file) {
     nanoclj_port_rep_t * pr = _rep_unchecked(p);
+    /* The intermediate maps are only referenced from here, so they must be protected from the GC */
+    retain(sc, md);
     md = assoc(sc, md, kw_line, mk_int(_line_unchecked(p) + 1));
+    retain(sc, md);
     md = assoc(sc, md, kw_column, mk_int(_column_unchecked(p) + 1));
-    md = assoc(sc, md, kw_file, mk_string(sc, pr->stdio.filename));
+    retain(sc, md);
+    nanoclj_val_t file = mk_string(sc, pr->stdio.filename);
+    retain_value(sc, file);
+    md = assoc(sc, md, kw_file, file);
   }
   return md;
 }
@@ -4734,6 +5694,12 @@ static inline nanoclj_cell_t * port_rep_from_file(nanoclj_t * sc, uint16_t type,
   pr->stdio.fg = sc->fg_color;
   pr->stdio.bg = sc->bg_color;
   pr->stdio.backchars[0] = pr->stdio.backchars[1] = -1;
+  pr->stdio.rbuf = NULL;
+  pr->stdio.rbuf_pos = pr->stdio.rbuf_len = 0;
+  pr->stdio.read_errno = 0;
+  pr->stdio.wbuf = NULL;
+  pr->stdio.wbuf_len = pr->stdio.wbuf_size = 0;
+  pr->stdio.flush_policy = nanoclj_flush_on_size;
   pr->stdio.rc = rc;
   pr->stdio.window_lines = pr->stdio.window_columns = 0;
   pr->stdio.window_width = pr->stdio.window_height = 0;
@@ -4741,6 +5707,7 @@ static inline nanoclj_cell_t * port_rep_from_file(nanoclj_t * sc, uint16_t type,
 
   nanoclj_cell_t * var = get_var_in_ns(sc->core_ns, sym_flush_on_newline);
   if (var && is_true(get_indexed_value(var, 1))) {
+    pr->stdio.flush_policy = nanoclj_flush_on_newline;
     setlinebuf(f);
   }
 
@@ -4770,6 +5737,24 @@ static inline nanoclj_cell_t * port_from_stream(nanoclj_t * sc, uint16_t type, n
   return p;
 }
 
+/* Throws an exception for a failed file operation based on errno */
+static inline void throw_file_exception(nanoclj_t * sc) {
+  char * msg = strerror(errno);
+  switch (errno) {
+  case ENOENT:
+    nanoclj_throw(sc, mk_exception(sc, sc->FileNotFoundException, msg));
+    break;
+  case EACCES:
+    nanoclj_throw(sc, mk_exception(sc, sc->AccessDeniedException, msg));
+    break;
+  case ENOMEM:
+    nanoclj_throw(sc, sc->OutOfMemoryError);
+    break;
+  default:
+    nanoclj_throw(sc, mk_exception(sc, sc->IOException, msg));
+  }
+}
+
 static inline nanoclj_cell_t * port_from_filename(nanoclj_t * sc, uint16_t type, strview_t sv) {
   const char * mode;
   switch (type) {
@@ -4814,24 +5799,47 @@ static inline nanoclj_cell_t * port_from_filename(nanoclj_t * sc, uint16_t type,
     }
   }
   if (!f) {
-    char * msg = strerror(errno);
-    switch (errno) {
-    case ENOENT:
-      nanoclj_throw(sc, mk_exception(sc, sc->FileNotFoundException, msg));
-      break;
-    case EACCES:
-      nanoclj_throw(sc, mk_exception(sc, sc->AccessDeniedException, msg));
-      break;
-    case ENOMEM:
-      nanoclj_throw(sc, sc->OutOfMemoryError);
-      break;
-    default:
-      nanoclj_throw(sc, mk_exception(sc, sc->IOException, msg));
-    }
+    throw_file_exception(sc);
     free(filename);
     return NULL;
   }
-  return port_rep_from_file(sc, type, f, filename, rc);
+  nanoclj_cell_t * p = port_rep_from_file(sc, type, f, filename, rc);
+  if (p && (type == T_WRITER || type == T_OUTPUT_STREAM)) {
+    _rep_unchecked(p)->stdio.wbuf_size = NANOCLJ_PORT_BUFFER_SIZE;
+  }
+  return p;
+}
+
+/* Sets the output buffer options of a file port: :buffer-size n and :flush (:size, :newline or :explicit).
+ * Other options are ignored. */
+static inline bool port_set_output_options(nanoclj_t * sc, nanoclj_cell_t * p, nanoclj_cell_t * opts) {
+  nanoclj_port_rep_t * pr = _rep_unchecked(p);
+  for (; opts; opts = next(sc, next(sc, opts))) {
+    nanoclj_val_t key = first(sc, opts), val = second(sc, opts);
+    if (key.as_long == kw_buffer_size.as_long) {
+      long long size = to_long(val);
+      if (size < 0) {
+	nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid buffer size")));
+	return false;
+      }
+      port_write_buffer(pr);
+      free(pr->stdio.wbuf);
+      pr->stdio.wbuf = NULL;
+      pr->stdio.wbuf_size = size;
+    } else if (key.as_long == kw_flush.as_long) {
+      if (val.as_long == kw_size.as_long) {
+	pr->stdio.flush_policy = nanoclj_flush_on_size;
+      } else if (val.as_long == kw_newline.as_long) {
+	pr->stdio.flush_policy = nanoclj_flush_on_newline;
+      } else if (val.as_long == kw_explicit.as_long) {
+	pr->stdio.flush_policy = nanoclj_flush_explicit;
+      } else {
+	nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid flush policy")));
+	return false;
+      }
+    }
+  }
+  return true;
 }
 
 static inline nanoclj_cell_t * port_from_string(nanoclj_t * sc, uint16_t type, strview_t sv) {
@@ -4884,23 +5892,20 @@ static inline nanoclj_val_t slurp(nanoclj_t * sc, uint16_t t, nanoclj_cell_t * a
   nanoclj_cell_t * rdr = mk_reader(sc, t, args);
   nanoclj_val_t r = mk_nil();
   if (rdr) {
-    nanoclj_tensor_t * array = mk_tensor_1d(nanoclj_i8, 0);
-    if (!array) return mk_nil();
-    size_t size = 0;
-    while ( 1 ) {
-      if (t == T_READER) {
-	int32_t c = inchar(sc, rdr);
-	if (c < 0) break;
-	size += tensor_mutate_append_codepoint(array, c);
-      } else {
-	int32_t c = inchar_raw(rdr);
-	if (c < 0) break;
-	uint8_t b = c;
-	size += tensor_mutate_append_bytes(array, &b, 1);
-      }
+    nanoclj_tensor_t * array = port_map_input(rdr);
+    size_t size;
+    if (array) {
+      size = array->ne[0];
+    } else {
+      array = mk_tensor_1d(nanoclj_i8, 0);
+      if (!array) return mk_nil();
+      size = port_read_bytes(rdr, SIZE_MAX, array);
     }
     if (handle_port_exceptions(sc, rdr)) {
       tensor_free(array);
+    } else if (t == T_READER && !utf8_is_valid(array->data, size)) {
+      tensor_free(array);
+      nanoclj_throw(sc, mk_exception(sc, sc->CharacterCodingException, "Invalid UTF8"));
     } else {
       r = mk_pointer(get_collection_object(sc, T_STRING, 0, size, array, NULL));
     }
@@ -4928,11 +5933,17 @@ static inline void putchars(nanoclj_t * sc, const char *s, size_t len, nanoclj_c
   nanoclj_port_rep_t * pr = _rep_unchecked(out);
   switch (_port_type_unchecked(out)) {
   case port_file:{
-    fwrite(s, 1, len, pr->stdio.file);
+    port_write_output(pr, s, len);
     const char * end = s + len;
+    bool wraps = pr->stdio.window_columns > 0 && pr->stdio.file == stdout;
     while (s < end) {
-      update_cursor(decode_utf8(s), out, pr->stdio.window_columns);
-      s = utf8_next(s);
+      if (!wraps && *s >= 32 && *s < 127) {
+	_column_unchecked(out)++;
+	s++;
+      } else {
+	update_cursor(decode_utf8(s), out, pr->stdio.window_columns);
+	s = utf8_next(s);
+      }
     }
   }
     break;
@@ -4959,6 +5970,7 @@ static inline void set_color(nanoclj_t * sc, nanoclj_color_t color, nanoclj_val_
   switch (port_type_unchecked(out)) {
   case port_file:
     pr->stdio.fg = color;
+    port_write_buffer(pr);
     set_term_fg_color(pr->stdio.file, color, sc->term_colors);
     break;
   case port_callback:
@@ -4984,6 +5996,7 @@ static inline void set_bg_color(nanoclj_t * sc, nanoclj_color_t color, nanoclj_v
   case port_file:
     pr->stdio.bg = color;
 #ifndef WIN32
+    port_write_buffer(pr);
     set_term_bg_color(pr->stdio.file, color, sc->term_colors);
 #endif
     break;
@@ -4995,6 +6008,7 @@ static inline void set_font_face(nanoclj_val_t family, bool is_italic, bool is_b
   switch (port_type_unchecked(out)) {
   case port_file:
 #ifndef WIN32
+    port_write_buffer(pr);
     set_term_font_face(pr->stdio.file, is_italic, is_bold);
 #endif
     break;
@@ -5037,6 +6051,7 @@ static inline char *readstr_upto(nanoclj_t * sc, char *delim, nanoclj_cell_t * i
   tensor_mutate_clear(rdbuff);
 
   while (1) {
+    if (!is_escaped) port_read_span(inport, delim, rdbuff);
     int c = inchar(sc, inport);
     if (c == EOF || sc->pending_exception) break;
 
@@ -5268,8 +6283,7 @@ static inline int token(nanoclj_t * sc, nanoclj_cell_t * inport) {
     }
 
   case ';':
-    while ((c = inchar(sc, inport)) != '\n' && c != EOF) { }
-    if (c == EOF) {
+    if (!port_read_until(inport, '\n', NULL)) {
       return TOK_EOF;
     } else {
       return token(sc, inport);
@@ -5308,9 +6322,7 @@ static inline int token(nanoclj_t * sc, nanoclj_cell_t * inport) {
       return TOK_SHARP_CONST;
     } else if (c == '!') {
       /* This is a shebang line, so skip it */
-      while ((c = inchar(sc, inport)) != '\n' && c != EOF) { }
-
-      if (c == EOF) {
+      if (!port_read_until(inport, '\n', NULL)) {
         return TOK_EOF;
       } else {
         return token(sc, inport);
@@ -5353,6 +6365,7 @@ static inline bool print_imageview(nanoclj_t * sc, imageview_t iv, nanoclj_cell_
     }
   case port_file:
     if (pr->stdio.file == stdout) {
+      port_write_buffer(pr);
       switch (sc->term_graphics) {
       case nanoclj_no_gfx: break;
 #if NANOCLJ_SIXEL
@@ -5450,7 +6463,7 @@ static inline void print_primitive(nanoclj_t * sc, nanoclj_val_t l, print_scheme
   case T_LONG:
     sv = (strview_t){
       sc->strbuff,
-      sprintf(sc->strbuff, "%d", decode_integer(l))
+      sprintf(sc->strbuff, "%lld", (long long)decode_long(l))
     };
     break;
   case T_DOUBLE:
@@ -6282,7 +7295,11 @@ static inline nanoclj_val_t mk_object(nanoclj_t * sc, uint_fast16_t t, nanoclj_c
       } else if (type(x) == t) {
 	return x;
       } else if (is_string(x) || is_file(x)) {
-	return mk_pointer(port_from_filename(sc, t, to_strview(x)));
+	z = port_from_filename(sc, t, to_strview(x));
+	if (z && !port_set_output_options(sc, z, next(sc, args))) {
+	  return mk_nil();
+	}
+	return mk_pointer(z);
       } else if (is_tensor(x)) {
 	return mk_pointer(port_from_string(sc, t, to_strview(x)));
       } else {
@@ -6399,6 +7416,10 @@ static inline nanoclj_val_t mk_object(nanoclj_t * sc, uint_fast16_t t, nanoclj_c
 	  case nanoclj_f32: tensor_mutate_set_f32(tensor, i, to_double(source_val)); break;
 	  case nanoclj_f64: tensor_mutate_set_f64(tensor, i, to_double(source_val)); break;
 	  case nanoclj_val: tensor_mutate_set(tensor, i, source_val); break;
+	  case nanoclj_u8: tensor_mutate_set_i8(tensor, i, to_long(source_val)); break;
+	  case nanoclj_u16: tensor_mutate_set_i16(tensor, i, to_long(source_val)); break;
+	  case nanoclj_u32: tensor_mutate_set_i32(tensor, i, to_long(source_val)); break;
+	  case nanoclj_i64: tensor_mutate_set_i64(tensor, i, to_long(source_val)); break;
 	  }
 	}
 	return mk_pointer(mk_object_from_tensor(sc, T_TENSOR, 0, dim1, tensor));
@@ -6429,6 +7450,75 @@ static inline nanoclj_val_t mk_object(nanoclj_t * sc, uint_fast16_t t, nanoclj_c
     nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid arguments for tensor")));
     break;
 
+  case T_TABLE:
+    if (!args) {
+      return mk_pointer(mk_table(sc, 0));
+    } else {
+      x = first(sc, args);
+      if (!is_cell(x)) break;
+      z = decode_pointer(x);
+      if (_type(z) == T_TABLE) {
+	return x;
+      } else if (is_map_type(_type(z))) {
+	/* A map from column names to columns */
+	nanoclj_cell_t * table = mk_table(sc, count(sc, z));
+	if (!table) return mk_nil();
+	retain(sc, table);
+	size_t num_rows = 0;
+	i = 0;
+	for (nanoclj_cell_t * s = seq(sc, z); s; s = next(sc, s), i++) {
+	  retain(sc, s);
+	  nanoclj_cell_t * e = decode_pointer(first(sc, s));
+	  nanoclj_val_t name = first(sc, e), col = second(sc, e);
+	  if (!is_vector(col)) {
+	    if (!is_cell(col) || !is_seqable_type(_type(decode_pointer(col)))) {
+	      return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Table column must be a collection")));
+	    }
+	    col = mk_pointer(mk_collection(sc, T_VECTOR, seq(sc, decode_pointer(col))));
+	  }
+	  size_t n = get_size(decode_pointer(col));
+	  if (i == 0) {
+	    num_rows = n;
+	  } else if (n != num_rows) {
+	    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Table columns must have equal lengths")));
+	  }
+	  table_set_column(table, i, name, col);
+	}
+	return mk_pointer(table);
+      } else if (is_seqable_type(_type(z)) || _is_sequence(z)) {
+	/* A sequence of row maps, the column names are taken from the first row */
+	nanoclj_cell_t * rows = _type(z) == T_VECTOR ? z : mk_collection(sc, T_VECTOR, seq(sc, z));
+	if (!rows) return mk_nil();
+	retain(sc, rows);
+	size_t num_rows = get_size(rows);
+	for (size_t r = 0; r < num_rows; r++) {
+	  y = get_indexed_value(rows, r);
+	  if (!is_cell(y) || !is_map_type(_type(decode_pointer(y)))) {
+	    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Table rows must be maps")));
+	  }
+	}
+	nanoclj_cell_t * row0 = num_rows ? decode_pointer(get_indexed_value(rows, 0)) : NULL;
+	nanoclj_cell_t * table = mk_table(sc, count(sc, row0));
+	if (!table) return mk_nil();
+	retain(sc, table);
+	i = 0;
+	for (nanoclj_cell_t * s = seq(sc, row0); s; s = next(sc, s), i++) {
+	  retain(sc, s);
+	  nanoclj_val_t name = first(sc, decode_pointer(first(sc, s)));
+	  nanoclj_cell_t * col = mk_vector(sc, num_rows);
+	  if (!col) return mk_nil();
+	  for (size_t r = 0; r < num_rows; r++) set_indexed_value(col, r, mk_nil());
+	  table_set_column(table, i, name, mk_pointer(col));
+	  for (size_t r = 0; r < num_rows; r++) {
+	    set_indexed_value(col, r, find(sc, decode_pointer(get_indexed_value(rows, r)), name, mk_nil()));
+	  }
+	}
+	return mk_pointer(table);
+      }
+    }
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid arguments for table")));
+    break;
+
   case T_GRADIENT:
     {
       int n = count(sc, args);
@@ -6564,6 +7654,166 @@ static inline bool unpack_args_2(nanoclj_t * sc, nanoclj_val_t * arg0, nanoclj_v
   return false;
 }
 
+/* Unpacks two arguments if they are both primitive longs or both doubles, and returns their primitive
+ * type so that arithmetic and comparisons can skip the generic dispatch. Returns T_NIL otherwise. */
+static inline uint_fast16_t unpack_prim_args_2(nanoclj_t * sc, nanoclj_val_t * arg0, nanoclj_val_t * arg1) {
+  nanoclj_cell_t * args = sc->args, * r;
+  if (args && _type(args) == T_LIST && (r = _cdr_unchecked(args)) && _type(r) == T_LIST && !_cdr_unchecked(r)) {
+    *arg0 = _car_unchecked(args);
+    *arg1 = _car_unchecked(r);
+    uint_fast16_t t = prim_type(*arg0);
+    if ((t == T_LONG || t == T_DOUBLE) && prim_type(*arg1) == t) return t;
+  }
+  return T_NIL;
+}
+
+/* Returns the primitive if the code of a closure is of the form ([x y] (op x y)) where op currently
+ * resolves to a primitive such as -add in the closure's environment, and nil otherwise. Core functions
+ * like + and < are defined this way, and calls with two arguments can then skip the closure.
+ * The op is resolved on each call so that redefinitions are seen. */
+static inline nanoclj_val_t get_inline_op(nanoclj_t * sc, nanoclj_cell_t * closure) {
+  nanoclj_val_t code = _car_unchecked(closure);
+  if (!is_list(code)) return mk_nil();
+  nanoclj_cell_t * c = decode_pointer(code), * body = _cdr_unchecked(c);
+  nanoclj_val_t params = _car_unchecked(c);
+  if (!is_vector(params) || get_size(decode_pointer(params)) != 2 || !body || _type(body) != T_LIST || _cdr_unchecked(body)) {
+    return mk_nil();
+  }
+  nanoclj_val_t x = get_indexed_value(decode_pointer(params), 0), y = get_indexed_value(decode_pointer(params), 1);
+  nanoclj_val_t form = _car_unchecked(body);
+  if (!is_symbol(x) || !is_symbol(y) || x.as_long == y.as_long || x.as_long == sym_amp.as_long || y.as_long == sym_amp.as_long ||
+      !is_list(form) || count(sc, decode_pointer(form)) != 3) {
+    return mk_nil();
+  }
+  nanoclj_cell_t * f = decode_pointer(form);
+  nanoclj_val_t op = _car_unchecked(f);
+  if (!is_symbol(op) || op.as_long == x.as_long || op.as_long == y.as_long ||
+      _cadr(f).as_long != x.as_long || _car(_cdr(_cdr(f))).as_long != y.as_long) {
+    return mk_nil();
+  }
+  op = resolve(sc, _cdr_unchecked(closure), op, mk_notfound());
+  return prim_type(op) == T_PROC ? op : mk_nil();
+}
+
+static inline bigintview_t long_to_bigintview(long long v, uint32_t * limbs) {
+  uint64_t u = v < 0 ? -(uint64_t)v : v;
+  limbs[0] = u & 0xffffffff;
+  limbs[1] = u >> 32;
+  return (bigintview_t){ limbs, limbs[1] ? 2 : (limbs[0] ? 1 : 0), v < 0 ? -1 : 1 };
+}
+
+/* Views an exact number as a numerator and a denominator, which is NULL for integers.
+ * The limbs of longs are stored in limbs. */
+static inline bool get_exact_number(nanoclj_val_t x, uint32_t * limbs, bigintview_t * num, const nanoclj_tensor_t ** den) {
+  switch (type(x)) {
+  case T_LONG:
+    *num = long_to_bigintview(to_long(x), limbs);
+    *den = NULL;
+    return true;
+  case T_BIGINT:
+    *num = _to_bigintview(decode_pointer(x));
+    *den = NULL;
+    return true;
+  case T_RATIO:
+    {
+      nanoclj_cell_t * c = decode_pointer(x);
+      *num = (bigintview_t){ c->_ratio.numerator->data, c->_ratio.numerator->ne[0], _sign(c) };
+      *den = c->_ratio.denominator;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Returns the opcode if f is addition or multiplication, or a function whose two argument arity is one */
+static inline int get_exact_reduce_op(nanoclj_t * sc, nanoclj_val_t f) {
+  if (is_cell(f) && !is_nil(f)) {
+    nanoclj_cell_t * c = decode_pointer(f);
+    if (_type(c) != T_MULTI_CLOSURE) return 0;
+    for (c = decode_pointer(_car_unchecked(c)); c; c = _cdr_unchecked(c)) {
+      nanoclj_cell_t * closure = decode_pointer(_car_unchecked(c));
+      nanoclj_cell_t * code = decode_pointer(_car_unchecked(closure));
+      if (test_binding(sc, decode_pointer(_car_unchecked(code)), 2, false)) break;
+    }
+    if (!c) return 0;
+    f = get_inline_op(sc, decode_pointer(_car_unchecked(c)));
+    if (is_nil(f)) return 0;
+  } else if (prim_type(f) != T_PROC) {
+    return 0;
+  }
+  int op = decode_integer(f);
+  return op == OP_ADD || op == OP_ADDP || op == OP_MUL || op == OP_MULP ? op : 0;
+}
+
+/* Reduces a sequence with addition or multiplication while the elements are exact numbers.
+ * Longs are combined directly until they overflow, and after that the result is accumulated
+ * in place as a BigInt or a Ratio. Returns the result consed to the rest of the sequence, so
+ * that the caller can continue with the generic reduction. */
+static inline nanoclj_cell_t * reduce_exact(nanoclj_t * sc, int op, nanoclj_val_t val, nanoclj_cell_t * coll) {
+  bool is_add = op == OP_ADD || op == OP_ADDP, promote = op == OP_ADDP || op == OP_MULP;
+  uint32_t limbs[2];
+  bigintview_t num;
+  const nanoclj_tensor_t * den;
+  bigint_accumulator_t acc;
+  bool is_big = false;
+  long long l = 0;
+
+  if (type(val) == T_LONG) {
+    l = to_long(val);
+  } else if (get_exact_number(val, limbs, &num, &den)) {
+    is_big = true;
+  } else {
+    return NULL;
+  }
+  /* Take the scratch tensor, since realizing the sequence might run another reduction */
+  nanoclj_tensor_t * tmp = sc->bigint_scratch ? sc->bigint_scratch : mk_tensor_1d(nanoclj_i32, 0);
+  sc->bigint_scratch = NULL;
+  if (is_big) bigint_accumulator_init(&acc, tmp, num, den);
+
+  for (coll = seq(sc, coll); coll; coll = next(sc, coll)) {
+    nanoclj_val_t x = first(sc, coll);
+    if (!is_big && type(x) == T_LONG) {
+      long long res;
+      if (!(is_add ? __builtin_saddll_overflow(l, to_long(x), &res) : __builtin_smulll_overflow(l, to_long(x), &res))) {
+	l = res;
+	continue;
+      } else if (!promote) {
+	break; /* the generic operation throws */
+      }
+    }
+    if (!get_exact_number(x, limbs, &num, &den)) break;
+    if (!is_big) {
+      uint32_t limbs_l[2];
+      bigint_accumulator_init(&acc, tmp, long_to_bigintview(l, limbs_l), NULL);
+      is_big = true;
+    }
+    if (is_add) {
+      bigint_accumulator_add(&acc, num, den);
+    } else {
+      bigint_accumulator_mul(&acc, num, den);
+    }
+  }
+
+  nanoclj_val_t r;
+  if (!is_big) {
+    r = mk_long(sc, l);
+  } else {
+    tmp = acc.tmp;
+    if (bigint_accumulator_is_integer(&acc)) {
+      tensor_free(acc.den);
+      r = mk_pointer(mk_bigint_from_tensor(sc, acc.sign, acc.num));
+    } else {
+      r = mk_pointer(mk_ratio_from_tensor(sc, acc.sign, acc.num, acc.den));
+    }
+  }
+  if (!sc->bigint_scratch) {
+    sc->bigint_scratch = tmp;
+  } else {
+    tensor_free(tmp);
+  }
+  return cons(sc, r, coll);
+}
+
 static inline bool unpack_args_2_not_nil(nanoclj_t * sc, nanoclj_val_t * arg0, nanoclj_val_t * arg1) {
   if (!unpack_args_2(sc, arg0, arg1)) return false;
   if (is_nil(*arg0) || is_nil(*arg1)) {
@@ -6681,6 +7931,7 @@ static inline void eval_in_thread(nanoclj_t * sc, nanoclj_val_t code) {
   child->value = mk_nil();
   child->rdbuff = mk_tensor_1d(nanoclj_i8, 0);
   child->load_stack = mk_tensor_1d(nanoclj_val, 0);
+  child->bigint_scratch = mk_tensor_1d(nanoclj_i32, 0);
 
   /* init sink */
   child->sink.type = T_LIST;
@@ -6705,9 +7956,10 @@ static inline nanoclj_val_t load_from_port(nanoclj_t * sc, nanoclj_cell_t * p) {
   int64_t n_ls = tensor_n_elem(sc->load_stack);
   nanoclj_cell_t * ns = get_current_ns(sc);
 
-  update_current_file(sc, p);
- 
+  /* The port is pushed first so that it is reachable while the file name is created */
   tensor_mutate_push(sc->load_stack, mk_pointer(p));
+  update_current_file(sc, p);
+
   save_from_C_call(sc);
   sc->envir = ns;
   sc->args = NULL;
@@ -6820,6 +8072,64 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
       s_return(sc, mk_int(c));
     }
 
+  case OP_READ_LINE:               /* -read-line */
+    if (!unpack_args_1(sc, &arg0)) {
+      return false;
+    } else if (!is_readable(arg0)) {
+      Error_0(sc, "Not a reader");
+    } else {
+      nanoclj_cell_t * p = decode_pointer(arg0);
+      nanoclj_tensor_t * line = mk_tensor_1d(nanoclj_i8, 0);
+      bool found = port_read_until(p, '\n', line);
+      if (handle_port_exceptions(sc, p)) {
+	tensor_free(line);
+	return false;
+      } else if (!found && !line->ne[0]) {
+	tensor_free(line);
+	s_return(sc, mk_nil());
+      }
+      if (line->ne[0] && tensor_get_i8(line, line->ne[0] - 1) == '\r') {
+	tensor_mutate_pop(line);
+      }
+      if (_type(p) == T_READER && !utf8_is_valid(line->data, line->ne[0])) {
+	tensor_free(line);
+	nanoclj_throw(sc, mk_exception(sc, sc->CharacterCodingException, "Invalid UTF8"));
+	return false;
+      }
+      s_return(sc, mk_string_with_tensor(sc, line));
+    }
+
+  case OP_READ_BYTES:               /* -read-bytes */
+    if (!unpack_args_1_plus(sc, &arg0, &arg_next)) {
+      return false;
+    } else if (!is_readable(arg0)) {
+      Error_0(sc, "Not a reader");
+    } else {
+      nanoclj_cell_t * p = decode_pointer(arg0);
+      size_t n = arg_next ? to_long(first(sc, arg_next)) : SIZE_MAX;
+      nanoclj_tensor_t * data = mk_tensor_1d(nanoclj_i8, 0);
+      size_t size = port_read_bytes(p, n, data);
+      if (_type(p) == T_READER && size) {
+	/* Complete the last codepoint */
+	const char * begin = data->data, * end = begin + size, * last = end - 1;
+	while (last > begin && end - last < 4 && (*last & 0xc0) == 0x80) last--;
+	size_t l = utf8_sequence_length(*last);
+	if (l > end - last) port_read_bytes(p, l - (end - last), data);
+      }
+      if (handle_port_exceptions(sc, p)) {
+	tensor_free(data);
+	return false;
+      } else if (!size && n) {
+	tensor_free(data);
+	s_return(sc, mk_nil());
+      } else if (_type(p) == T_READER && !utf8_is_valid(data->data, data->ne[0])) {
+	tensor_free(data);
+	nanoclj_throw(sc, mk_exception(sc, sc->CharacterCodingException, "Invalid UTF8"));
+	return false;
+      }
+      s_return(sc, mk_string_with_tensor(sc, data));
+    }
+
   case OP_GENSYM:
     if (!unpack_args_0_plus(sc, &arg_next)) {
       return false;
@@ -6957,7 +8267,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	retain(sc, sc->args);
 	if (_min_arity_unchecked(code_cell) > 0 || _max_arity_unchecked(code_cell) != -1) {
 	  int64_t n = count(sc, sc->args);
-	  if (n < _min_arity_unchecked(code_cell) || n > _max_arity_unchecked(code_cell)) {
+	  if (n < _min_arity_unchecked(code_cell) || (_max_arity_unchecked(code_cell) != -1 && n > _max_arity_unchecked(code_cell))) {
 	    nanoclj_val_t ns = find(sc, _ff_metadata(code_cell), kw_ns, mk_nil());
 	    nanoclj_val_t name_v = find(sc, _ff_metadata(code_cell), kw_name, mk_nil());
 	    nanoclj_val_t ns_name_v = mk_nil();
@@ -6985,6 +8295,11 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	    nanoclj_cell_t * binding = decode_pointer(_car_unchecked(code));
 
 	    if (test_binding(sc, binding, num_args, is_recur)) {
+	      if (num_args == 2) {
+		/* If the arity only calls a primitive, the arguments are passed to it directly */
+		nanoclj_val_t op = get_inline_op(sc, closure);
+		if (!is_nil(op)) s_goto(sc, decode_integer(op));
+	      }
 	      nanoclj_cell_t * env = _cdr_unchecked(closure);
 	      new_frame_in_env(sc, env);
 	      if (!destructure(sc, binding, sc->args, is_recur)) {
@@ -7148,6 +8463,8 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	  new_slot_spec_in_env(sc, env, sym_recur, mk_pointer(get_cell(sc, T_RECUR_CLOSURE, 0, closure_code, env, NULL)));
 	  nanoclj_val_t closure = mk_pointer(get_cell(sc, T_CLOSURE, 0, closure_code, env, NULL));
 	  closures = cons(sc, closure, closures);
+	  /* The closures are only referenced from here until the multi-closure is created */
+	  retain(sc, closures);
 	}
 	closures = reverse_in_place(closures, NULL);
 	s_return(sc, mk_pointer(get_cell(sc, T_MULTI_CLOSURE, 0, mk_pointer(closures), NULL, NULL)));
@@ -7832,7 +9149,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
       nanoclj_throw(sc, sc->NullPointerException);
       return false;
     case T_LONG:
-      s_return(sc, mk_long(sc, llabs(decode_integer(arg0))));
+      s_return(sc, mk_long(sc, llabs(decode_long(arg0))));
     case T_DOUBLE: s_return(sc, mk_double(fabs(arg0.as_double)));
     case T_CELL: {
       nanoclj_cell_t * c = decode_pointer(arg0);
@@ -7842,7 +9159,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	  long long v = _lvalue_unchecked(c);
 	  /* Clojure returns LLONG_MIN for (abs LLONG_MIN) */
 	  if (v == LLONG_MIN) s_return(sc, arg0);
-	  else mk_long(sc, llabs(v));
+	  else s_return(sc, mk_long(sc, llabs(v)));
 	}
       case T_RATIO:
 	s_return(sc, mk_pointer(mk_ratio_from_tensor(sc, 1, c->_ratio.numerator, c->_ratio.denominator)));
@@ -7871,7 +9188,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     case T_NIL:
       nanoclj_throw(sc, sc->NullPointerException);
       return false;
-    case T_LONG: s_return(sc, mk_long(sc, decode_integer(arg0) + 1LL));
+    case T_LONG: s_return(sc, mk_long(sc, decode_long(arg0) + 1LL));
     case T_DOUBLE: s_return(sc, mk_double(arg0.as_double + 1.0));
     case T_CELL: {
       nanoclj_cell_t * c = decode_pointer(arg0);
@@ -7917,7 +9234,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     case T_NIL:
       nanoclj_throw(sc, sc->NullPointerException);
       return false;
-    case T_LONG: s_return(sc, mk_long(sc, decode_integer(arg0) - 1LL));
+    case T_LONG: s_return(sc, mk_long(sc, decode_long(arg0) - 1LL));
     case T_DOUBLE: s_return(sc, mk_double(arg0.as_double - 1.0));
     case T_CELL: {
       nanoclj_cell_t * c = decode_pointer(arg0);
@@ -7956,15 +9273,21 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 
   case OP_ADD:                 /* add */
   case OP_ADDP:
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+      /* Primitive longs have 48 bits, so the sum can't overflow */
+    case T_LONG: s_return(sc, mk_long(sc, decode_long(arg0) + decode_long(arg1)));
+    case T_DOUBLE: s_return(sc, mk_double(arg0.as_double + arg1.as_double));
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else {
       uint16_t tx = type(arg0), ty = type(arg1);
-      if (!is_numeric_type(tx) || !is_numeric_type(ty)) {
+      if (get_numeric_tensor(arg0) || get_numeric_tensor(arg1)) {
+	if (!(z = numeric_array_binary(sc, nanoclj_binop_add, arg0, arg1))) return false;
+	s_return(sc, mk_pointer(z));
+      } else if (!is_numeric_type(tx) || !is_numeric_type(ty)) {
 	nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to java.lang.Number"));
 	return false;
-      } else if (tx == T_TENSOR || ty == T_TENSOR) {
-	/* TODO: implement tensor add */
       } else if (tx == T_DOUBLE || ty == T_DOUBLE) {
 	s_return(sc, mk_double(to_double(arg0) + to_double(arg1)));
       } else if (tx == T_RATIO || ty == T_RATIO) {
@@ -8008,11 +9331,18 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     
   case OP_SUB:                 /* minus */
   case OP_SUBP:
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+    case T_LONG: s_return(sc, mk_long(sc, decode_long(arg0) - decode_long(arg1)));
+    case T_DOUBLE: s_return(sc, mk_double(arg0.as_double - arg1.as_double));
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else {
       uint16_t tx = type(arg0), ty = type(arg1);
-      if (!is_numeric_type(tx) || !is_numeric_type(ty)) {
+      if (get_numeric_tensor(arg0) || get_numeric_tensor(arg1)) {
+	if (!(z = numeric_array_binary(sc, nanoclj_binop_sub, arg0, arg1))) return false;
+	s_return(sc, mk_pointer(z));
+      } else if (!is_numeric_type(tx) || !is_numeric_type(ty)) {
 	nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to java.lang.Number"));
 	return false;
       } else if (tx == T_DOUBLE || ty == T_DOUBLE) {
@@ -8058,11 +9388,22 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
   
   case OP_MUL:                 /* multiply */
   case OP_MULP:
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+    case T_LONG:{
+      long long res;
+      if (!__builtin_smulll_overflow(decode_long(arg0), decode_long(arg1), &res)) s_return(sc, mk_long(sc, res));
+      break;
+    }
+    case T_DOUBLE: s_return(sc, mk_double(arg0.as_double * arg1.as_double));
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else {
       uint16_t tx = type(arg0), ty = type(arg1);
-      if (!is_numeric_type(tx) || !is_numeric_type(ty)) {
+      if (get_numeric_tensor(arg0) || get_numeric_tensor(arg1)) {
+	if (!(z = numeric_array_binary(sc, nanoclj_binop_mul, arg0, arg1))) return false;
+	s_return(sc, mk_pointer(z));
+      } else if (!is_numeric_type(tx) || !is_numeric_type(ty)) {
       	nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to java.lang.Number"));
 	return false;
       } else if (tx == T_DOUBLE || ty == T_DOUBLE) {
@@ -8097,11 +9438,24 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     }
     
   case OP_DIV:                 /* divide */
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+    case T_LONG:{
+      long long a = decode_long(arg0), b = decode_long(arg1);
+      if (b != 0 && a % b == 0) s_return(sc, mk_long(sc, a / b));
+      break;
+    }
+    case T_DOUBLE:
+      if (arg1.as_double != 0.0) s_return(sc, mk_double(arg0.as_double / arg1.as_double));
+      break;
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else {
       uint16_t tx = type(arg0), ty = type(arg1);
-      if (!is_numeric_type(tx) || !is_numeric_type(ty)) {
+      if (get_numeric_tensor(arg0) || get_numeric_tensor(arg1)) {
+	if (!(z = numeric_array_binary(sc, nanoclj_binop_div, arg0, arg1))) return false;
+	s_return(sc, mk_pointer(z));
+      } else if (!is_numeric_type(tx) || !is_numeric_type(ty)) {
       	nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to java.lang.Number"));
 	return false;
       } else if (is_zero(arg1)) {
@@ -8149,6 +9503,16 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
       }
     }
 
+  case OP_REDUCE_EXACT:         /* -reduce-exact */
+    if (!unpack_args_3(sc, &arg0, &arg1, &arg2)) {
+      return false;
+    } else {
+      int op = get_exact_reduce_op(sc, arg0);
+      if (!op || !is_cell(arg2)) s_return(sc, mk_nil());
+      nanoclj_cell_t * r = reduce_exact(sc, op, arg1, decode_pointer(arg2));
+      s_return(sc, r ? mk_pointer(r) : mk_nil());
+    }
+
   case OP_QUOT:                 /* quot */
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
@@ -8165,10 +9529,10 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
       } else if (tx == T_RATIO || ty == T_RATIO) {
 	s_return(sc, mk_nil());
       } else if (tx == T_BIGINT) {
-	if (prim_type(arg1) == T_LONG) {
+	if (prim_type(arg1) == T_LONG && decode_long(arg1) >= INT32_MIN && decode_long(arg1) <= INT32_MAX) {
 	  bigintview_t a = to_bigintview(arg0);
 	  nanoclj_tensor_t * t = bigintview_to_tensor(a);
-	  int32_t div = decode_integer(arg1);
+	  int32_t div = decode_long(arg1);
 	  tensor_bigint_mutate_idivmod(t, llabs(div));
 	  s_return(sc, mk_pointer(mk_bigint_from_tensor(sc, a.sign == (div > 0) - (div < 0) ? 1 : -1, t)));
 	} else {
@@ -8404,7 +9768,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
       }
       if (tensor) {
 	idx += get_offset(c);
-	s_return(sc, tensor_get(tensor, idx));
+	s_return(sc, tensor_get_value(tensor, idx));
       } else if (_is_small(c)) {
 	switch (_type(c)) {
 	case T_VECTOR:
@@ -8443,6 +9807,10 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	case nanoclj_f32: tensor_mutate_set_f32(tensor, idx, to_double(arg2)); break;
 	case nanoclj_f64: tensor_mutate_set_f64(tensor, idx, to_double(arg2)); break;
 	case nanoclj_val: tensor_mutate_set(tensor, idx, arg2); break;
+	case nanoclj_u8: tensor_mutate_set_i8(tensor, idx, to_long(arg2)); break;
+	case nanoclj_u16: tensor_mutate_set_i16(tensor, idx, to_long(arg2)); break;
+	case nanoclj_u32: tensor_mutate_set_i32(tensor, idx, to_long(arg2)); break;
+	case nanoclj_i64: tensor_mutate_set_i64(tensor, idx, to_long(arg2)); break;
 	}
 	s_return(sc, arg2);
       }
@@ -8531,6 +9899,17 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
       bool invalid_index = false;
       if (start < 0) {
 	invalid_index = true;
+      } else if (_type(c) == T_TENSOR && get_numeric_tensor(arg0)) {
+	/* Numeric arrays are sliced along the outermost axis without copying */
+	tensorview_t tv = to_numeric_tensorview(arg0);
+	int d = tv.n_dims - 1;
+	long long end = arg_next ? to_long(first(sc, arg_next)) : tv.ne[d];
+	if (start <= end && end <= tv.ne[d]) {
+	  tv.data = (uint8_t *)tv.data + start * tv.nb[d];
+	  tv.ne[d] = end - start;
+	  s_return(sc, mk_numeric_array_view(sc, arg0, &tv));
+	}
+	invalid_index = true;
       } else if (!arg_next) {
 	c = remove_prefix(sc, c, start);
 	s_return(sc, mk_pointer(c));
@@ -8540,8 +9919,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	  long long size = get_size(c);
 	  long long end = size;
 	  if (arg_next) end = to_long(first(sc, arg_next));
-	  if (end < start) end = start;
-	  if (start >= 0 && end <= size) {
+	  if (start <= end && end <= size) {
 	    s_return(sc, mk_pointer(subvec(sc, c, start, end)));
 	  } else {
 	    invalid_index = true;
@@ -8583,6 +9961,10 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     s_retbool(is_false(arg0));
     
   case OP_EQUIV:                  /* equiv */
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+    case T_LONG: s_retbool(decode_long(arg0) == decode_long(arg1));
+    case T_DOUBLE: s_retbool(arg0.as_double == arg1.as_double);
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else if (!is_number(arg0) || !is_number(arg1)) {
@@ -8595,6 +9977,10 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     }
     
   case OP_LT:                  /* lt */
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+    case T_LONG: s_retbool(decode_long(arg0) < decode_long(arg1));
+    case T_DOUBLE: s_retbool(arg0.as_double < arg1.as_double);
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else if (!is_number(arg0) || !is_number(arg1)) {
@@ -8606,6 +9992,10 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     s_retbool(compare(arg0, arg1) < 0);
 
   case OP_GT:                  /* gt */
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+    case T_LONG: s_retbool(decode_long(arg0) > decode_long(arg1));
+    case T_DOUBLE: s_retbool(arg0.as_double > arg1.as_double);
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else if (!is_number(arg0) || !is_number(arg1)) {
@@ -8617,6 +10007,10 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     s_retbool(compare(arg0, arg1) > 0);
   
   case OP_LE:                  /* le */
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+    case T_LONG: s_retbool(decode_long(arg0) <= decode_long(arg1));
+    case T_DOUBLE: s_retbool(arg0.as_double <= arg1.as_double);
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else if (!is_number(arg0) || !is_number(arg1)) {
@@ -8628,6 +10022,10 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     s_retbool(compare(arg0, arg1) <= 0);
 
   case OP_GE:                  /* ge */
+    switch (unpack_prim_args_2(sc, &arg0, &arg1)) {
+    case T_LONG: s_retbool(decode_long(arg0) >= decode_long(arg1));
+    case T_DOUBLE: s_retbool(arg0.as_double >= arg1.as_double);
+    }
     if (!unpack_args_2_not_nil(sc, &arg0, &arg1)) {
       return false;
     } else if (!is_number(arg0) || !is_number(arg1)) {
@@ -9815,6 +11213,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 		Error_0(sc, "Syntax error");
 	      }
 	      nanoclj_cell_t * s = mk_collection(sc, T_HASHSET, decode_pointer(arg));
+	      retain(sc, s);
 	      if (key.as_long == kw_only.as_long) {
 		only = s;
 	      } else if (key.as_long == kw_exclude.as_long) {
@@ -9903,6 +11302,14 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	t = nanoclj_i16;
       } else if (arg0.as_long == kw_boolean.as_long) {
 	t = nanoclj_boolean;
+      } else if (arg0.as_long == kw_long.as_long) {
+	t = nanoclj_i64;
+      } else if (arg0.as_long == kw_ubyte.as_long) {
+	t = nanoclj_u8;
+      } else if (arg0.as_long == kw_ushort.as_long) {
+	t = nanoclj_u16;
+      } else if (arg0.as_long == kw_uint.as_long) {
+	t = nanoclj_u32;
       } else {
 	nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid vector type")));
 	return false;
@@ -10168,6 +11575,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	break;
 #endif
       case port_file:
+	port_write_buffer(pr);
 	reset_color(pr->stdio.file);
 	pr->stdio.fg = sc->fg_color;
 	pr->stdio.bg = sc->bg_color;
@@ -10198,7 +11606,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
     s_return(sc, mk_nil());
 
   case OP_FLUSH:
-    x = get_out_port(sc);
+    x = sc->args ? first(sc, sc->args) : get_out_port(sc);
     if (is_writable(x)) {
       nanoclj_port_rep_t * pr = rep_unchecked(x);
       switch (port_type_unchecked(x)) {
@@ -10206,7 +11614,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	canvas_flush(pr->canvas.impl);
 	break;
       case port_file:
-	fflush(pr->stdio.file);
+	port_flush_output(pr);
 	break;
       }
     }
@@ -10231,6 +11639,7 @@ static inline bool opexe(nanoclj_t * sc, enum nanoclj_opcode op) {
 	case port_file:
 	  if (mode != pr->stdio.mode) {
 	    pr->stdio.mode = mode;
+	    port_write_buffer(pr);
 	    set_display_mode(pr->stdio.file, mode);
 	  }
 	  break;
@@ -10552,6 +11961,7 @@ bool nanoclj_init(nanoclj_t * sc) {
   sc->rdbuff = mk_tensor_1d(nanoclj_i8, 0);
   sc->load_stack = mk_tensor_1d(nanoclj_val, 0);
   sc->types = mk_tensor_1d(nanoclj_val, 0);
+  sc->bigint_scratch = mk_tensor_1d(nanoclj_i32, 0);
 
   if (alloc_cellseg(FIRST_CELLSEGS) != FIRST_CELLSEGS) {
     return false;
@@ -10632,6 +12042,11 @@ bool nanoclj_init(nanoclj_t * sc) {
     kw_doc = _S(":doc");
     kw_width = _S(":width");
     kw_height = _S(":height");
+    kw_pyramid = _S(":pyramid");
+    kw_region = _S(":region");
+    kw_level = _S(":level");
+    kw_strategy = _S(":strategy");
+    kw_quality = _S(":quality");
     kw_channels = _S(":channels");
     kw_graphics = _S(":graphics");
     kw_watches = _S(":watches");
@@ -10661,6 +12076,10 @@ bool nanoclj_init(nanoclj_t * sc) {
     kw_byte = _S(":byte");
     kw_short = _S(":short");
     kw_boolean = _S(":boolean");
+    kw_long = _S(":long");
+    kw_ubyte = _S(":ubyte");
+    kw_ushort = _S(":ushort");
+    kw_uint = _S(":uint");
     kw_reload = _S(":reload");
     kw_import = _S(":import");
     kw_private = _S(":private");
@@ -10672,6 +12091,11 @@ bool nanoclj_init(nanoclj_t * sc) {
     kw_cell_size = _S(":cell-size");
     kw_window_size = _S(":window-size");
     kw_scale_factor = _S(":scale-factor");
+    kw_buffer_size = _S(":buffer-size");
+    kw_flush = _S(":flush");
+    kw_newline = _S(":newline");
+    kw_size = _S(":size");
+    kw_explicit = _S(":explicit");
     
     str_java_class_path = _T("java.class.path");
   }
@@ -10705,7 +12129,7 @@ bool nanoclj_init(nanoclj_t * sc) {
   nanoclj_cell_t * NullPointerException = mk_class(sc, "java.lang.NullPointerException", gentypeid(sc), RuntimeException);
   nanoclj_cell_t * ClassCastException = mk_class(sc, "java.lang.ClassCastException", T_CLASS_CAST_EXCEPTION, RuntimeException);
   nanoclj_cell_t * IllegalStateException = mk_class(sc, "java.lang.IllegalStateException", T_ILLEGAL_STATE_EXCEPTION, RuntimeException);
-  sc->IOException = mk_class(sc, "java.io.IOExeption", gentypeid(sc), Exception);
+  sc->IOException = mk_class(sc, "java.io.IOException", gentypeid(sc), Exception);
   nanoclj_cell_t * AFn = mk_class(sc, "clojure.lang.AFn", gentypeid(sc), sc->Object);
   
   mk_class(sc, "java.lang.Class", T_CLASS, AFn); /* non-standard parent */
@@ -10776,8 +12200,9 @@ bool nanoclj_init(nanoclj_t * sc) {
   mk_class(sc, "nanoclj.lang.Mesh", T_MESH, sc->Object);
   mk_class(sc, "nanoclj.lang.Shape", T_SHAPE, sc->Object);
   sc->Audio = mk_class(sc, "nanoclj.lang.Audio", T_AUDIO, sc->Object);
-  mk_class(sc, "nanoclj.lang.Tensor", T_TENSOR, sc->Object);
+  sc->Tensor = mk_class(sc, "nanoclj.lang.Tensor", T_TENSOR, sc->Object);
   sc->Graph = mk_class(sc, "nanoclj.lang.Graph", T_GRAPH, sc->Object);
+  sc->Table = mk_class(sc, "nanoclj.lang.Table", T_TABLE, sc->Object);
   mk_class(sc, "nanoclj.lang.GraphNode", T_GRAPH_NODE, sc->Object);
   mk_class(sc, "nanoclj.lang.GraphEdge", T_GRAPH_EDGE, sc->Object);
   mk_class(sc, "nanoclj.lang.Alias", T_ALIAS, AFn);
@@ -10883,6 +12308,7 @@ static void nanoclj_deinit_allocator() {
 }
 
 void nanoclj_deinit(nanoclj_t * sc) {
+  flush_all_ports();
   sc->core_ns = NULL;
   dump_stack_free(sc);
   sc->envir = NULL;
@@ -10894,7 +12320,8 @@ void nanoclj_deinit(nanoclj_t * sc) {
   tensor_free(sc->rdbuff);
   tensor_free(sc->load_stack);
   tensor_free(sc->types);
-  sc->rdbuff = sc->load_stack = sc->types = NULL;
+  tensor_free(sc->bigint_scratch);
+  sc->rdbuff = sc->load_stack = sc->types = sc->bigint_scratch = NULL;
 
   nanoclj_deinit_oblist();
 
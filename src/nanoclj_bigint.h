@@ -33,27 +33,123 @@ static inline nanoclj_tensor_t * bigintview_to_tensor(bigintview_t bv) {
   return t;
 }
 
-static inline size_t bigintview_to_string(bigintview_t bv, char ** buff) {
-  nanoclj_tensor_t * tensor = bigintview_to_tensor(bv);
-  nanoclj_tensor_t * digits = mk_tensor_1d_padded(nanoclj_i8, 0, 256);
-  while (!tensor_is_empty(tensor)) {
-    /* divide the bigint by 1e9 and put the remainder in r */
-    uint64_t r = tensor_bigint_mutate_idivmod(tensor, 1000000000);
-    /* print the remainder */
-    for (int_fast8_t i = 0; i < 9 && (!tensor_is_empty(tensor) || r > 0); i++, r /= 10) {
-      uint8_t c = '0' + (r % 10);
-      tensor_mutate_append_bytes(digits, &c, 1);
+/* A power of 10^9 with its scaled reciprocal floor(B^2m / p), where B = 2^32 and m is the number of limbs in p */
+typedef struct {
+  nanoclj_tensor_t * p, * inv;
+} bigint_power_t;
+
+/* Refines an approximation x of floor(B^2m / p) with Newton's iteration until it is exact */
+static inline nanoclj_tensor_t * bigint_mutate_reciprocal(nanoclj_tensor_t * x, const nanoclj_tensor_t * p) {
+  int64_t m = p->ne[0];
+  nanoclj_tensor_t * target = mk_tensor_1d(nanoclj_i32, 2 * m + 1);
+  tensor_mutate_fill_i8(target, 0);
+  ((uint32_t *)target->data)[2 * m] = 1;
+  while ( 1 ) {
+    nanoclj_tensor_t * e = tensor_bigint_mul(p, x);
+    int c = tensor_cmp(e, target);
+    nanoclj_tensor_t * d = c > 0 ? tensor_bigint_sub(e, target) : tensor_bigint_sub(target, e);
+    tensor_free(e);
+    if (tensor_cmp(d, p) < 0) {
+      /* x p is within p of B^2m, so x is exact or one too large */
+      if (c > 0) tensor_bigint_mutate_sub_int(x, 1);
+      tensor_free(d);
+      break;
+    }
+    nanoclj_tensor_t * delta = tensor_bigint_mul(x, d);
+    tensor_bigint_mutate_rshift_limbs(delta, 2 * m);
+    if (tensor_is_empty(delta)) tensor_bigint_assign(delta, 1);
+    if (c > 0) {
+      tensor_bigint_mutate_sub(x, delta);
+    } else {
+      nanoclj_tensor_t * tmp = tensor_bigint_add(x, delta);
+      tensor_free(x);
+      x = tmp;
+    }
+    tensor_free(delta);
+    tensor_free(d);
+  }
+  tensor_free(target);
+  return x;
+}
+
+/* Returns 10^(9 * 2^k) and its reciprocal. Each reciprocal is estimated by squaring the previous one. */
+static inline const bigint_power_t * bigint_get_decimal_power(bigint_power_t * powers, int k) {
+  if (!powers[k].p) {
+    if (k == 0) {
+      powers[0].p = mk_tensor_bigint(1000000000);
+      powers[0].inv = mk_tensor_bigint(UINT64_MAX / 1000000000);
+    } else {
+      const bigint_power_t * prev = bigint_get_decimal_power(powers, k - 1);
+      nanoclj_tensor_t * p = tensor_bigint_mul(prev->p, prev->p);
+      nanoclj_tensor_t * x = tensor_bigint_mul(prev->inv, prev->inv);
+      tensor_bigint_mutate_rshift_limbs(x, 4 * prev->p->ne[0] - 2 * p->ne[0]);
+      powers[k].p = p;
+      powers[k].inv = bigint_mutate_reciprocal(x, p);
+    }
+  }
+  return &powers[k];
+}
+
+/* Divides a number that has at most 2m limbs with a power, using the reciprocal for the quotient */
+static inline void bigint_divmod_power(const nanoclj_tensor_t * a, const bigint_power_t * pw, nanoclj_tensor_t ** q, nanoclj_tensor_t ** rem) {
+  *q = tensor_bigint_mul(a, pw->inv);
+  tensor_bigint_mutate_rshift_limbs(*q, 2 * pw->p->ne[0]);
+  nanoclj_tensor_t * tmp = tensor_bigint_mul(*q, pw->p);
+  *rem = tensor_bigint_sub(a, tmp);
+  tensor_free(tmp);
+  /* The estimated quotient is at most two too small */
+  while (tensor_cmp(*rem, pw->p) >= 0) {
+    tensor_bigint_mutate_sub(*rem, pw->p);
+    tensor_bigint_mutate_add_int(*q, 1);
+  }
+}
+
+/* Appends the decimal digits of the tensor padded with zeros to pad digits, and frees the tensor.
+ * Long numbers are split by a power of ten, and the halves are printed separately. */
+static inline void bigint_mutate_print(nanoclj_tensor_t * tensor, int64_t pad, bigint_power_t * powers, nanoclj_tensor_t * digits) {
+  int64_t n = tensor->ne[0];
+  if (n < BIGINT_DC_THRESHOLD) {
+    char buff[BIGINT_DC_THRESHOLD * 10];
+    int64_t len = 0;
+    while (!tensor_is_empty(tensor)) {
+      /* divide the bigint by 1e9 and put the remainder in r */
+      uint32_t r = tensor_bigint_mutate_idivmod(tensor, 1000000000);
+      /* print the remainder */
+      for (int_fast8_t i = 0; i < 9 && (!tensor_is_empty(tensor) || r > 0); i++, r /= 10) {
+	buff[len++] = '0' + (r % 10);
+      }
     }
+    for (int64_t i = len; i < pad; i++) tensor_mutate_append_bytes(digits, (const uint8_t *)"0", 1);
+    for (int64_t i = len - 1; i >= 0; i--) tensor_mutate_append_bytes(digits, (const uint8_t *)&buff[i], 1);
+    tensor_free(tensor);
+  } else {
+    int k = 0;
+    while (2 * bigint_get_decimal_power(powers, k)->p->ne[0] < n) k++;
+    int64_t pad_low = INT64_C(9) << k;
+    nanoclj_tensor_t * q, * rem;
+    bigint_divmod_power(tensor, &powers[k], &q, &rem);
+    tensor_free(tensor);
+    bigint_mutate_print(q, pad > pad_low ? pad - pad_low : 0, powers, digits);
+    bigint_mutate_print(rem, pad_low, powers, digits);
   }
+}
+
+static inline size_t bigintview_to_string(bigintview_t bv, char ** buff) {
+  nanoclj_tensor_t * digits = mk_tensor_1d_padded(nanoclj_i8, 0, 256);
   if (bv.sign == -1) {
     tensor_mutate_append_bytes(digits, (const uint8_t *)"-", 1);
   }
+  bigint_power_t powers[BIGINT_MAX_POWERS] = { 0 };
+  bigint_mutate_print(bigintview_to_tensor(bv), 0, powers, digits);
+  for (int i = 0; i < BIGINT_MAX_POWERS && powers[i].p; i++) {
+    tensor_free(powers[i].p);
+    tensor_free(powers[i].inv);
+  }
   size_t n = digits->ne[0];
   *buff = malloc(n + 1);
-  for (size_t i = 0; i < n; i++) (*buff)[n - 1 - i] = *((char *)digits->data + i);
+  memcpy(*buff, digits->data, n);
   (*buff)[n] = 0;
   tensor_free(digits);
-  tensor_free(tensor);
   return n;
 }
 
@@ -175,4 +271,157 @@ static inline bool bigint_is_representable_as_long(bigintview_t bv) {
   return false;
 }
 
+static inline int bigint_limbs_cmp(const uint32_t * a, int64_t n_a, const uint32_t * b, int64_t n_b) {
+  if (n_a != n_b) return n_a < n_b ? -1 : 1;
+  for (int64_t i = n_a - 1; i >= 0; i--) {
+    if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+static inline void tensor_bigint_set(nanoclj_tensor_t * tensor, bigintview_t bv) {
+  tensor_bigint_reserve(tensor, bv.size);
+  memcpy(tensor->data, bv.limbs, bv.size * sizeof(uint32_t));
+  tensor->ne[0] = bv.size;
+}
+
+/* Adds a signed number to the magnitude in a, whose sign is in *sign, in place. b must not
+ * point to the limbs of a. */
+static inline void tensor_bigint_mutate_add_signed(nanoclj_tensor_t * a, int * sign, bigintview_t b) {
+  int64_t n_a = a->ne[0], n_b = b.size;
+  if (!n_b) {
+    return;
+  } else if (!n_a) {
+    tensor_bigint_set(a, b);
+    *sign = b.sign;
+  } else if (*sign == b.sign) {
+    int64_t n = n_a > n_b ? n_a : n_b;
+    tensor_bigint_reserve(a, n + 1);
+    uint32_t * limbs = a->data;
+    limbs[n] = n_a >= n_b ? bigint_limbs_add(limbs, limbs, n_a, b.limbs, n_b) : bigint_limbs_add(limbs, b.limbs, n_b, limbs, n_a);
+    a->ne[0] = n + 1;
+    tensor_mutate_trim(a);
+  } else {
+    int c = bigint_limbs_cmp(a->data, n_a, b.limbs, n_b);
+    if (c > 0) {
+      bigint_limbs_sub(a->data, a->data, n_a, b.limbs, n_b);
+    } else {
+      tensor_bigint_reserve(a, n_b);
+      bigint_limbs_sub(a->data, b.limbs, n_b, a->data, n_a);
+      a->ne[0] = n_b;
+      *sign = c ? b.sign : 0;
+    }
+    tensor_mutate_trim(a);
+  }
+}
+
+/* An exact sum or product of BigInts and Ratios that is updated in place. The numerator and the
+ * denominator are owned by the accumulator, and tmp is a scratch tensor that keeps its capacity
+ * between operations. The denominator is one for integers. */
+typedef struct {
+  nanoclj_tensor_t * num, * den, * tmp;
+  int sign;
+} bigint_accumulator_t;
+
+static inline void bigint_accumulator_swap_tmp(bigint_accumulator_t * acc, nanoclj_tensor_t ** t) {
+  nanoclj_tensor_t * tmp = acc->tmp;
+  acc->tmp = *t;
+  *t = tmp;
+}
+
+static inline bool bigint_accumulator_is_integer(const bigint_accumulator_t * acc) {
+  return acc->den->ne[0] == 1 && *(uint32_t *)acc->den->data == 1;
+}
+
+static inline void bigint_accumulator_set_zero(bigint_accumulator_t * acc) {
+  acc->sign = 0;
+  tensor_mutate_clear(acc->num);
+  tensor_bigint_assign(acc->den, 1);
+}
+
+/* Adds num / den, where den is NULL for integers */
+static inline void bigint_accumulator_add(bigint_accumulator_t * acc, bigintview_t num, const nanoclj_tensor_t * den) {
+  if (!den) {
+    if (bigint_accumulator_is_integer(acc)) {
+      tensor_bigint_mutate_add_signed(acc->num, &acc->sign, num);
+    } else {
+      /* a / b + c = (a + c b) / b, which doesn't need to be normalized */
+      tensor_bigint_mul_into(acc->tmp, num.limbs, num.size, acc->den->data, acc->den->ne[0]);
+      tensor_bigint_mutate_add_signed(acc->num, &acc->sign, (bigintview_t){ acc->tmp->data, acc->tmp->ne[0], num.sign });
+    }
+  } else if (bigint_accumulator_is_integer(acc)) {
+    /* a + c / d = (a d + c) / d */
+    tensor_bigint_mul_into(acc->tmp, acc->num->data, acc->num->ne[0], den->data, den->ne[0]);
+    bigint_accumulator_swap_tmp(acc, &acc->num);
+    tensor_bigint_mutate_add_signed(acc->num, &acc->sign, num);
+    tensor_bigint_set(acc->den, (bigintview_t){ den->data, den->ne[0], 1 });
+  } else {
+    /* Knuth 4.5.1: with g = gcd(b, d), a / b + c / d = (a (d / g) + c (b / g)) / (b d / g),
+     * and only the gcd of the numerator and g has to be removed */
+    nanoclj_tensor_t * g = tensor_bigint_gcd(acc->den, den);
+    nanoclj_tensor_t * b1 = tensor_dup(acc->den), * d1 = tensor_dup(den);
+    tensor_bigint_mutate_div(b1, g);
+    tensor_bigint_mutate_div(d1, g);
+    tensor_bigint_mul_into(acc->tmp, acc->num->data, acc->num->ne[0], d1->data, d1->ne[0]);
+    bigint_accumulator_swap_tmp(acc, &acc->num);
+    tensor_bigint_mul_into(acc->tmp, num.limbs, num.size, b1->data, b1->ne[0]);
+    tensor_bigint_mutate_add_signed(acc->num, &acc->sign, (bigintview_t){ acc->tmp->data, acc->tmp->ne[0], num.sign });
+    if (!acc->sign) {
+      bigint_accumulator_set_zero(acc);
+    } else {
+      nanoclj_tensor_t * g2 = tensor_bigint_gcd(acc->num, g);
+      tensor_bigint_mutate_div(acc->num, g2);
+      tensor_bigint_set(d1, (bigintview_t){ den->data, den->ne[0], 1 });
+      tensor_bigint_mutate_div(d1, g2);
+      tensor_bigint_mul_into(acc->den, b1->data, b1->ne[0], d1->data, d1->ne[0]);
+      tensor_free(g2);
+    }
+    tensor_free(g);
+    tensor_free(b1);
+    tensor_free(d1);
+  }
+}
+
+/* Multiplies with num / den, where den is NULL for integers */
+static inline void bigint_accumulator_mul(bigint_accumulator_t * acc, bigintview_t num, const nanoclj_tensor_t * den) {
+  if (!acc->sign || !num.size) {
+    bigint_accumulator_set_zero(acc);
+  } else if (!den && bigint_accumulator_is_integer(acc)) {
+    tensor_bigint_mul_into(acc->tmp, acc->num->data, acc->num->ne[0], num.limbs, num.size);
+    bigint_accumulator_swap_tmp(acc, &acc->num);
+    acc->sign *= num.sign;
+  } else {
+    /* (a / b) (c / d) = ((a / g1) (c / g2)) / ((b / g2) (d / g1)) with g1 = gcd(a, d) and g2 = gcd(c, b) */
+    nanoclj_tensor_t * c = bigintview_to_tensor(num), * d1 = NULL;
+    if (den) {
+      nanoclj_tensor_t * g1 = tensor_bigint_gcd(acc->num, den);
+      tensor_bigint_mutate_div(acc->num, g1);
+      d1 = tensor_dup(den);
+      tensor_bigint_mutate_div(d1, g1);
+      tensor_free(g1);
+    }
+    nanoclj_tensor_t * g2 = tensor_bigint_gcd(c, acc->den);
+    tensor_bigint_mutate_div(c, g2);
+    tensor_bigint_mutate_div(acc->den, g2);
+    tensor_bigint_mul_into(acc->tmp, acc->num->data, acc->num->ne[0], c->data, c->ne[0]);
+    bigint_accumulator_swap_tmp(acc, &acc->num);
+    if (d1) {
+      tensor_bigint_mul_into(acc->tmp, acc->den->data, acc->den->ne[0], d1->data, d1->ne[0]);
+      bigint_accumulator_swap_tmp(acc, &acc->den);
+      tensor_free(d1);
+    }
+    acc->sign *= num.sign;
+    tensor_free(c);
+    tensor_free(g2);
+  }
+}
+
+/* Starts an accumulator from num / den using the scratch tensor tmp */
+static inline void bigint_accumulator_init(bigint_accumulator_t * acc, nanoclj_tensor_t * tmp, bigintview_t num, const nanoclj_tensor_t * den) {
+  acc->num = bigintview_to_tensor(num);
+  acc->den = den ? tensor_dup(den) : mk_tensor_bigint(1);
+  acc->tmp = tmp;
+  acc->sign = num.size ? num.sign : 0;
+}
+
 #endif
@@ -0,0 +1,374 @@
+#ifndef _NANOCLJ_CSV_H_
+#define _NANOCLJ_CSV_H_
+
+#include "nanoclj_threads.h"
+#include "nanoclj_utf8.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* Minimum number of bytes per chunk when parsing in parallel */
+#define CSV_MIN_CHUNK_SIZE (1 << 20)
+
+#define CSV_LOW7 UINT64_C(0x7f7f7f7f7f7f7f7f)
+#define CSV_BROADCAST(c) (UINT64_C(0x0101010101010101) * (uint8_t)(c))
+
+/* Field classes used for type inference */
+#define CSV_MISSING 1
+#define CSV_LONG 2
+#define CSV_DOUBLE 4
+#define CSV_STRING 8
+
+typedef enum {
+  csv_type_long = 0,
+  csv_type_double,
+  csv_type_string
+} csv_column_type_t;
+
+typedef struct {
+  const char * ptr;
+  size_t size;
+  bool is_escaped; /* the field contains doubled quotes */
+} csv_field_t;
+
+typedef struct {
+  csv_column_type_t type;
+  int flags;
+  void * data; /* int64_t, double or csv_field_t array depending on type */
+} csv_column_t;
+
+typedef struct {
+  size_t n_rows, n_cols;
+  csv_field_t * header;
+  csv_column_t * columns;
+  bool is_valid;
+} csv_table_t;
+
+typedef struct {
+  const char * begin, * end;
+  size_t n_quotes, n_rows, row_offset, n_cols;
+  int * flags;
+  csv_column_t * columns;
+  uint8_t sep;
+  int phase;
+  bool is_valid;
+} csv_chunk_t;
+
+/* Returns a mask with the high bit set in every zero byte of v */
+static inline uint64_t csv_zero_bytes(uint64_t v) {
+  return ~(((v & CSV_LOW7) + CSV_LOW7) | v | CSV_LOW7);
+}
+
+/* Returns a pointer to the first separator, quote, CR or LF in [p, end), or end if there are none.
+ * Eight bytes are tested at a time. */
+static inline const char * csv_find_special(const char * p, const char * end, uint8_t sep) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  const uint64_t ms = CSV_BROADCAST(sep), mq = CSV_BROADCAST('"'), mr = CSV_BROADCAST('\r'), mn = CSV_BROADCAST('\n');
+  while (end - p >= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    uint64_t m = csv_zero_bytes(v ^ ms) | csv_zero_bytes(v ^ mq) | csv_zero_bytes(v ^ mr) | csv_zero_bytes(v ^ mn);
+    if (m) return p + (__builtin_ctzll(m) >> 3);
+    p += 8;
+  }
+#endif
+  for (; p < end; p++) {
+    uint8_t c = *p;
+    if (c == sep || c == '"' || c == '\r' || c == '\n') break;
+  }
+  return p;
+}
+
+/* Parses the field at *p and advances *p past the separator or line break that ends it.
+ * Returns true if the field was the last one in its record. */
+static inline bool csv_parse_field(const char ** p, const char * end, uint8_t sep, csv_field_t * f) {
+  const char * s = *p;
+  f->is_escaped = false;
+  if (s < end && *s == '"') {
+    const char * q = s + 1;
+    while ( 1 ) {
+      const char * c = memchr(q, '"', end - q);
+      if (!c) { /* unterminated quote */
+	f->ptr = s + 1;
+	f->size = end - f->ptr;
+	*p = end;
+	return true;
+      } else if (c + 1 < end && c[1] == '"') {
+	f->is_escaped = true;
+	q = c + 2;
+      } else {
+	f->ptr = s + 1;
+	f->size = c - f->ptr;
+	s = c + 1;
+	break;
+      }
+    }
+    /* Skip anything between the closing quote and the end of the field */
+    while (s < end && *s != sep && *s != '\r' && *s != '\n') s++;
+  } else {
+    const char * t = s;
+    while ((t = csv_find_special(t, end, sep)) < end && *t == '"') t++;
+    f->ptr = s;
+    f->size = t - s;
+    s = t;
+  }
+  if (s >= end) {
+    *p = end;
+    return true;
+  } else if (*s == sep) {
+    *p = s + 1;
+    return false;
+  }
+  if (*s == '\r' && s + 1 < end && s[1] == '\n') s++;
+  *p = s + 1;
+  return true;
+}
+
+/* Skips empty lines, returns false if there are no more records */
+static inline bool csv_skip_blank(const char ** p, const char * end) {
+  const char * s = *p;
+  while (s < end && (*s == '\n' || *s == '\r')) s++;
+  *p = s;
+  return s < end;
+}
+
+/* Copies a field to out replacing doubled quotes with single ones. Returns the length. */
+static inline size_t csv_unescape(csv_field_t f, char * out) {
+  size_t n = 0;
+  for (size_t i = 0; i < f.size; i++) {
+    out[n++] = f.ptr[i];
+    if (f.ptr[i] == '"' && i + 1 < f.size && f.ptr[i + 1] == '"') i++;
+  }
+  return n;
+}
+
+/* Classifies the contents of a field as missing, long, double or string */
+static inline int csv_classify(csv_field_t f) {
+  if (f.size == 0) return CSV_MISSING;
+  if (f.is_escaped || f.size >= 64) return CSV_STRING;
+  const char * s = f.ptr, * end = f.ptr + f.size;
+  if (*s == '-' || *s == '+') s++;
+  const char * digits = s;
+  while (s < end && *s >= '0' && *s <= '9') s++;
+  size_t n_int = s - digits;
+  if (s == end) {
+    if (n_int == 0) return CSV_STRING;
+    return n_int <= 18 ? CSV_LONG : CSV_DOUBLE;
+  }
+  size_t n_frac = 0;
+  if (*s == '.') {
+    const char * frac = ++s;
+    while (s < end && *s >= '0' && *s <= '9') s++;
+    n_frac = s - frac;
+  }
+  if (n_int + n_frac == 0) return CSV_STRING;
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    s++;
+    if (s < end && (*s == '-' || *s == '+')) s++;
+    const char * exp = s;
+    while (s < end && *s >= '0' && *s <= '9') s++;
+    if (s == exp) return CSV_STRING;
+  }
+  return s == end ? CSV_DOUBLE : CSV_STRING;
+}
+
+/* Assumes that the field has been classified as a long */
+static inline int64_t csv_parse_long(csv_field_t f) {
+  const char * s = f.ptr, * end = f.ptr + f.size;
+  bool is_negative = *s == '-';
+  if (*s == '-' || *s == '+') s++;
+  int64_t v = 0;
+  for (; s < end; s++) v = 10 * v + (*s - '0');
+  return is_negative ? -v : v;
+}
+
+/* Assumes that the field has been classified as a long or a double */
+static inline double csv_parse_double(csv_field_t f) {
+  char buffer[64];
+  memcpy(buffer, f.ptr, f.size);
+  buffer[f.size] = 0;
+  return strtod(buffer, NULL);
+}
+
+static inline csv_column_type_t csv_resolve_type(int flags) {
+  if (flags & CSV_STRING || !(flags & (CSV_LONG | CSV_DOUBLE))) {
+    return csv_type_string;
+  } else if (flags & (CSV_DOUBLE | CSV_MISSING)) {
+    return csv_type_double;
+  } else {
+    return csv_type_long;
+  }
+}
+
+static inline void csv_store(csv_column_t * col, size_t row, csv_field_t f) {
+  switch (col->type) {
+  case csv_type_long:
+    ((int64_t *)col->data)[row] = csv_parse_long(f);
+    break;
+  case csv_type_double:
+    ((double *)col->data)[row] = f.size ? csv_parse_double(f) : NAN;
+    break;
+  case csv_type_string:
+    ((csv_field_t *)col->data)[row] = f;
+    break;
+  }
+}
+
+/* Worker for the three parsing phases: counting quotes, classifying fields and storing values */
+static NANOCLJ_THREAD_SIG csv_chunk_main(void * arg) {
+  csv_chunk_t * chunk = arg;
+  const char * p = chunk->begin, * end = chunk->end;
+  switch (chunk->phase) {
+  case 0:
+    chunk->n_quotes = 0;
+    while ((p = memchr(p, '"', end - p))) {
+      chunk->n_quotes++;
+      p++;
+    }
+    break;
+  case 1:
+    chunk->is_valid = utf8_is_valid(p, end - p);
+    while (csv_skip_blank(&p, end)) {
+      size_t col = 0;
+      csv_field_t f;
+      bool is_last = false;
+      while (!is_last) {
+	is_last = csv_parse_field(&p, end, chunk->sep, &f);
+	if (col < chunk->n_cols) chunk->flags[col++] |= csv_classify(f);
+      }
+      for (; col < chunk->n_cols; col++) chunk->flags[col] |= CSV_MISSING;
+      chunk->n_rows++;
+    }
+    break;
+  case 2:
+    for (size_t row = chunk->row_offset; csv_skip_blank(&p, end); row++) {
+      size_t col = 0;
+      csv_field_t f;
+      bool is_last = false;
+      while (!is_last) {
+	is_last = csv_parse_field(&p, end, chunk->sep, &f);
+	if (col < chunk->n_cols) csv_store(&chunk->columns[col++], row, f);
+      }
+      f = (csv_field_t){ 0 };
+      for (; col < chunk->n_cols; col++) csv_store(&chunk->columns[col], row, f);
+    }
+    break;
+  }
+  return 0;
+}
+
+/* Finds the start of the first record beginning at or after p given the number of
+ * quotes before p. Returns end if there is none. */
+static inline const char * csv_find_record_start(const char * p, const char * end, size_t n_quotes) {
+  bool is_quoted = n_quotes & 1;
+  for (; p < end; p++) {
+    if (*p == '"') {
+      is_quoted = !is_quoted;
+    } else if (*p == '\n' && !is_quoted) {
+      return p + 1;
+    }
+  }
+  return end;
+}
+
+static inline void csv_free_table(csv_table_t * table) {
+  for (size_t i = 0; i < table->n_cols; i++) {
+    free(table->columns[i].data);
+  }
+  free(table->columns);
+  free(table->header);
+}
+
+/* Parses a CSV buffer into typed columns using up to max_threads threads. If has_header is true,
+ * the first record is used as the header. */
+static inline void csv_read_columns(const char * data, size_t size, uint8_t sep, bool has_header, int max_threads, csv_table_t * table) {
+  const char * p = data, * end = data + size;
+  if (size >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0) p += 3; /* skip BOM */
+
+  table->n_rows = table->n_cols = 0;
+  table->header = NULL;
+  table->columns = NULL;
+  table->is_valid = true;
+
+  /* The first record determines the number of columns */
+  if (!csv_skip_blank(&p, end)) return;
+  const char * first = p;
+  size_t reserved = 0;
+  for (bool is_last = false; !is_last; ) {
+    csv_field_t f;
+    is_last = csv_parse_field(&p, end, sep, &f);
+    if (table->n_cols == reserved) {
+      reserved = 2 * reserved + 8;
+      table->header = realloc(table->header, reserved * sizeof(csv_field_t));
+    }
+    table->header[table->n_cols++] = f;
+  }
+  if (has_header) {
+    table->is_valid = utf8_is_valid(first, p - first);
+  } else {
+    free(table->header);
+    table->header = NULL;
+    p = first;
+  }
+  table->columns = calloc(table->n_cols, sizeof(csv_column_t));
+
+  size_t n_chunks = (end - p) / CSV_MIN_CHUNK_SIZE + 1;
+  if (n_chunks > max_threads) n_chunks = max_threads;
+  if (n_chunks < 1) n_chunks = 1;
+  csv_chunk_t * chunks = calloc(n_chunks, sizeof(csv_chunk_t));
+  size_t chunk_size = (end - p) / n_chunks;
+  for (size_t i = 0; i < n_chunks; i++) {
+    chunks[i].begin = p + i * chunk_size;
+    chunks[i].end = i + 1 == n_chunks ? end : p + (i + 1) * chunk_size;
+    chunks[i].sep = sep;
+    chunks[i].n_cols = table->n_cols;
+    chunks[i].flags = calloc(table->n_cols, sizeof(int));
+    chunks[i].columns = table->columns;
+  }
+
+  /* Align the chunks to record boundaries using the quote parity at the start of each chunk */
+  if (n_chunks > 1) {
+    nanoclj_run_parallel(csv_chunk_main, chunks, sizeof(csv_chunk_t), n_chunks);
+    size_t n_quotes = chunks[0].n_quotes;
+    for (size_t i = 1; i < n_chunks; i++) {
+      const char * start = csv_find_record_start(chunks[i].begin, end, n_quotes);
+      if (start < chunks[i - 1].begin) start = chunks[i - 1].begin;
+      n_quotes += chunks[i].n_quotes;
+      chunks[i].begin = chunks[i - 1].end = start;
+    }
+  }
+
+  for (size_t i = 0; i < n_chunks; i++) chunks[i].phase = 1;
+  nanoclj_run_parallel(csv_chunk_main, chunks, sizeof(csv_chunk_t), n_chunks);
+
+  for (size_t i = 0; i < n_chunks; i++) {
+    chunks[i].row_offset = table->n_rows;
+    table->n_rows += chunks[i].n_rows;
+    if (!chunks[i].is_valid) table->is_valid = false;
+    for (size_t j = 0; j < table->n_cols; j++) {
+      table->columns[j].flags |= chunks[i].flags[j];
+    }
+  }
+  for (size_t j = 0; j < table->n_cols; j++) {
+    csv_column_t * col = &table->columns[j];
+    col->type = csv_resolve_type(col->flags);
+    switch (col->type) {
+    case csv_type_long: col->data = malloc(table->n_rows * sizeof(int64_t)); break;
+    case csv_type_double: col->data = malloc(table->n_rows * sizeof(double)); break;
+    case csv_type_string: col->data = malloc(table->n_rows * sizeof(csv_field_t)); break;
+    }
+  }
+
+  if (table->is_valid) {
+    for (size_t i = 0; i < n_chunks; i++) chunks[i].phase = 2;
+    nanoclj_run_parallel(csv_chunk_main, chunks, sizeof(csv_chunk_t), n_chunks);
+  }
+
+  for (size_t i = 0; i < n_chunks; i++) free(chunks[i].flags);
+  free(chunks);
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include "linenoise.h"
 #include "nanoclj_utils.h"
 #include "nanoclj_graph.h"
+#include "nanoclj_csv.h"
 
 #ifdef WIN32
 
@@ -59,6 +60,7 @@ static nanoclj_val_t Thread_sleep(nanoclj_t * sc, nanoclj_cell_t * args) {
 /* System */
 
 static nanoclj_val_t System_exit(nanoclj_t * sc, nanoclj_cell_t * args) {
+  flush_all_ports();
   exit(to_int(first(sc, args)));
 }
 
@@ -421,9 +423,30 @@ static inline nanoclj_val_t browse_url(nanoclj_t * sc, nanoclj_cell_t * args) {
 #endif
 }
 
+/* Loads an image. The decoded pixels become the data of the image without copying. The options
+ * :region [x y width height] and :level n crop the image and halve its size n times before the
+ * full-size pixels are released, so only the result is kept in memory. */
 static inline nanoclj_val_t Image_load(nanoclj_t * sc, nanoclj_cell_t * args) {
   nanoclj_val_t src = first(sc, args);
-  strview_t sv = to_strview(slurp(sc, T_INPUT_STREAM, args));
+  nanoclj_cell_t * opts = is_cell(second(sc, args)) ? decode_pointer(second(sc, args)) : NULL;
+  nanoclj_val_t region = find(sc, opts, kw_region, mk_nil()), level0 = find(sc, opts, kw_level, mk_int(0));
+  if ((!is_nil(region) && (!is_vector(region) || get_size(decode_pointer(region)) != 4)) || !is_number(level0) || to_long(level0) < 0) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid options")));
+  }
+  /* The region is [x y width height], each a non-negative int */
+  int rv[4];
+  if (!is_nil(region)) {
+    nanoclj_cell_t * r = decode_pointer(region);
+    for (int i = 0; i < 4; i++) {
+      nanoclj_val_t v = get_indexed_value(r, i);
+      long long l;
+      if (!is_number(v) || !convert_to_long(v, &l) || l < 0 || l > INT_MAX) {
+	return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid region")));
+      }
+      rv[i] = l;
+    }
+  }
+  strview_t sv = to_strview(slurp(sc, T_INPUT_STREAM, cons(sc, src, NULL)));
   if (sc->pending_exception) return mk_nil();
   
   int w, h, channels;
@@ -433,13 +456,6 @@ static inline nanoclj_val_t Image_load(nanoclj_t * sc, nanoclj_cell_t * args) {
     return nanoclj_throw(sc, mk_runtime_exception(sc, mk_string_fmt(sc, "%s [%.*s]", stbi_failure_reason(), (int)src_sv.size, src_sv.ptr)));
   }
 
-  nanoclj_cell_t * meta = mk_hashmap(sc);
-  meta = assoc(sc, meta, kw_width, mk_int(w));
-  meta = assoc(sc, meta, kw_height, mk_int(h));
-  if (is_string_type(type(src))) {
-    meta = assoc(sc, meta, kw_file, src);
-  }
-  
   nanoclj_internal_format_t f;
   switch (channels) {
   case 1: f = nanoclj_r8; break;
@@ -449,72 +465,261 @@ static inline nanoclj_val_t Image_load(nanoclj_t * sc, nanoclj_cell_t * args) {
     stbi_image_free(data);
     return mk_nil();
   }
-  nanoclj_cell_t * image = mk_image(sc, w, h, f, meta);
-  memcpy(image->_image.tensor->data, data, w * h * get_format_bpp(f));
-  stbi_image_free(data);
-  return mk_pointer(image);
+  int bpp = get_format_bpp(f);
+
+  if (!is_nil(region)) {
+    int x0 = rv[0], y0 = rv[1], rw = rv[2], rh = rv[3];
+    if (x0 > w || y0 > h || rw > w - x0 || rh > h - y0) {
+      stbi_image_free(data);
+      return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Region is outside the image")));
+    }
+    uint8_t * cropped = malloc((size_t)rw * rh * bpp);
+    if (!cropped) {
+      stbi_image_free(data);
+      return nanoclj_throw(sc, sc->OutOfMemoryError);
+    }
+    for (int y = 0; y < rh; y++) {
+      memcpy(cropped + (size_t)y * rw * bpp, data + ((size_t)(y0 + y) * w + x0) * bpp, (size_t)rw * bpp);
+    }
+    stbi_image_free(data);
+    data = cropped;
+    w = rw;
+    h = rh;
+  }
+  for (long level = to_long(level0); level > 0 && (w > 1 || h > 1); level--) {
+    uint8_t * half = malloc((size_t)((w + 1) / 2) * ((h + 1) / 2) * bpp);
+    if (!half) {
+      free(data);
+      return nanoclj_throw(sc, sc->OutOfMemoryError);
+    }
+    if (!image_downsample(data, (size_t)w * bpp, w, h, bpp, half, nanoclj_get_cpu_count())) {
+      free(half);
+      free(data);
+      return nanoclj_throw(sc, sc->OutOfMemoryError);
+    }
+    free(data);
+    data = half;
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+  }
+  
+  nanoclj_cell_t * meta = mk_hashmap(sc);
+  meta = assoc(sc, meta, kw_width, mk_int(w));
+  meta = assoc(sc, meta, kw_height, mk_int(h));
+  if (is_string_type(type(src))) {
+    meta = assoc(sc, meta, kw_file, src);
+  }
+
+  /* stb_image allocates with malloc, so the tensor can own the pixels */
+  nanoclj_tensor_t * tensor = mk_tensor_3d_with_data(nanoclj_i8, channels, bpp, w, w * bpp, h, data);
+  if (!tensor) {
+    free(data);
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
+  }
+  return mk_pointer(mk_image_with_tensor(sc, tensor, meta));
+}
+
+typedef struct {
+  imageview_t iv;
+  uint8_t * dst;
+  int target_w, target_h, y0, y1;
+} resize_task_t;
+
+/* Resizes the rows y0..y1 of the target. The strip uses the scale of the whole image and is offset
+ * by y0, so the result is the same as when resizing in one piece. */
+static inline NANOCLJ_THREAD_SIG resize_main(void * arg) {
+  resize_task_t * task = arg;
+  imageview_t iv = task->iv;
+  int bpp = get_format_bpp(iv.format), alpha;
+  switch (iv.format) {
+  case nanoclj_ra8: alpha = 1; break;
+  case nanoclj_rgba8: case nanoclj_bgra8: alpha = 3; break;
+  default: alpha = STBIR_ALPHA_CHANNEL_NONE;
+  }
+  stbir_resize_subpixel(iv.ptr, iv.width, iv.height, iv.stride,
+			task->dst + (size_t)task->y0 * task->target_w * bpp, task->target_w, task->y1 - task->y0, task->target_w * bpp,
+			STBIR_TYPE_UINT8, bpp, alpha, STBIR_FLAG_ALPHA_PREMULTIPLIED, STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP,
+			STBIR_FILTER_DEFAULT, STBIR_FILTER_DEFAULT, STBIR_COLORSPACE_LINEAR, NULL,
+			(float)task->target_w / iv.width, (float)task->target_h / iv.height, 0.0f, (float)task->y0);
+  return 0;
+}
+
+/* Resizes an image in horizontal strips that are processed in parallel. The internal formats of Cairo are
+ * resized as they are: the padding byte of bgr8_32 is treated as a channel, and bgra8 is premultiplied. */
+static inline nanoclj_cell_t * resize_imageview(nanoclj_t * sc, imageview_t iv, int target_w, int target_h) {
+  nanoclj_cell_t * target_image = mk_image(sc, target_w, target_h, iv.format, NULL);
+  if (!target_image) return NULL;
+  resize_task_t task = { iv, target_image->_image.tensor->data, target_w, target_h, 0, target_h };
+  int n_threads = nanoclj_get_cpu_count();
+  if (n_threads > target_h / IMAGE_PARALLEL_MIN_ROWS) n_threads = target_h / IMAGE_PARALLEL_MIN_ROWS;
+  if (n_threads < 2 || !iv.width || !iv.height) {
+    if (iv.width && iv.height) resize_main(&task);
+  } else {
+    resize_task_t * tasks = malloc(n_threads * sizeof(resize_task_t));
+    if (!tasks) {
+      sc->pending_exception = sc->OutOfMemoryError;
+      return NULL;
+    }
+    for (int i = 0; i < n_threads; i++) {
+      tasks[i] = task;
+      tasks[i].y0 = target_h * i / n_threads;
+      tasks[i].y1 = target_h * (i + 1) / n_threads;
+    }
+    nanoclj_run_parallel(resize_main, tasks, sizeof(resize_task_t), n_threads);
+    free(tasks);
+  }
+  return target_image;
 }
 
-/* Resizes an image. Only support simple formats r8, rgb8 or rgba8. */
 static inline nanoclj_val_t Image_resize(nanoclj_t * sc, nanoclj_cell_t * args) {
   imageview_t iv = to_imageview(first(sc, args));
   nanoclj_val_t target_w0 = second(sc, args), target_h0 = third(sc, args);
   if (!iv.ptr || !is_number(target_w0) || !is_number(target_h0)) {
     return nanoclj_throw(sc, mk_illegal_arg_exception(sc, _T("Invalid arguments")));
   }
+  return mk_pointer(resize_imageview(sc, iv, to_int(target_w0), to_int(target_h0)));
+}
 
-  int target_w = to_int(target_w0), target_h = to_int(target_h0);
-  int channels = get_format_channels(iv.format);
-
-  uint32_t stride = iv.stride;
-  uint8_t * tmp = NULL;
-  nanoclj_internal_format_t f = iv.format;
-  if (iv.format == nanoclj_bgr8_32) {
-    f = nanoclj_rgb8;
-    tmp = convert_imageview(iv, f);
-    stride = 3 * iv.width;
+/* Returns a vector of the image followed by images of half the size, down to 1x1. The levels are built
+ * from each other and cached in the metadata of the image. */
+static inline nanoclj_cell_t * get_image_pyramid(nanoclj_t * sc, nanoclj_cell_t * image) {
+  nanoclj_cell_t * meta = get_metadata(image);
+  nanoclj_val_t cached = find(sc, meta, kw_pyramid, mk_nil());
+  if (!is_nil(cached)) return decode_pointer(cached);
+
+  imageview_t iv = to_imageview(mk_pointer(image));
+  int n = 1;
+  for (int64_t w = iv.width, h = iv.height; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) n++;
+  nanoclj_cell_t * levels = mk_vector(sc, n);
+  if (!levels) return NULL;
+  retain(sc, levels);
+  set_indexed_value(levels, 0, mk_pointer(image));
+  int n_threads = nanoclj_get_cpu_count();
+  for (int i = 1; i < n; i++) {
+    nanoclj_cell_t * level = mk_image(sc, (iv.width + 1) / 2, (iv.height + 1) / 2, iv.format, NULL);
+    if (!level || !image_downsample(iv.ptr, iv.stride, iv.width, iv.height, get_format_bpp(iv.format), level->_image.tensor->data, n_threads)) {
+      sc->pending_exception = sc->OutOfMemoryError;
+      return NULL;
+    }
+    set_indexed_value(levels, i, mk_pointer(level));
+    iv = to_imageview(mk_pointer(level));
   }
+  set_metadata(image, assoc(sc, meta ? meta : mk_hashmap(sc), kw_pyramid, mk_pointer(levels)));
+  return levels;
+}
 
-  nanoclj_cell_t * target_image = mk_image(sc, target_w, target_h, f, NULL);
-  nanoclj_tensor_t * img = target_image->_image.tensor;
-  uint8_t * target_ptr = img->data;
-
-  stbir_resize_uint8_generic(tmp ? tmp : iv.ptr, iv.width, iv.height, stride, target_ptr, target_w, target_h, 0, channels, 0, STBIR_FLAG_ALPHA_PREMULTIPLIED, STBIR_EDGE_CLAMP, STBIR_FILTER_DEFAULT, STBIR_COLORSPACE_LINEAR, NULL);
-
-  free(tmp);
+static inline nanoclj_val_t Image_pyramid(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_val_t image = first(sc, args);
+  if (!is_image(image)) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not an Image")));
+  }
+  return mk_pointer(get_image_pyramid(sc, decode_pointer(image)));
+}
 
-  return mk_pointer(target_image);
+/* Scales an image to fit in a size x size box. The smallest pyramid level that is at least as large as
+ * the result is resized, so that repeated thumbnails of the same image are fast. */
+static inline nanoclj_val_t Image_thumbnail(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_val_t image = first(sc, args), size0 = second(sc, args);
+  if (!is_image(image)) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not an Image")));
+  } else if (!is_number(size0) || to_long(size0) < 1) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid size")));
+  }
+  imageview_t iv = to_imageview(image);
+  long long size = to_long(size0);
+  if (iv.width <= size && iv.height <= size) return image;
+  double scale = (double)size / (iv.width > iv.height ? iv.width : iv.height);
+  int target_w = (int)llround(iv.width * scale), target_h = (int)llround(iv.height * scale);
+  if (target_w < 1) target_w = 1;
+  if (target_h < 1) target_h = 1;
+  nanoclj_cell_t * levels = get_image_pyramid(sc, decode_pointer(image));
+  if (!levels) return mk_nil();
+  for (int64_t i = get_size(levels) - 1; i >= 0; i--) {
+    imageview_t level = to_imageview(get_indexed_value(levels, i));
+    if (level.width >= target_w && level.height >= target_h) {
+      return mk_pointer(resize_imageview(sc, level, target_w, target_h));
+    }
+  }
+  return mk_pointer(resize_imageview(sc, iv, target_w, target_h));
 }
 
-static inline nanoclj_val_t Image_transpose(nanoclj_t * sc, nanoclj_cell_t * args) {
-  imageview_t iv = to_imageview(first(sc, args));
+static inline nanoclj_val_t transform_image(nanoclj_t * sc, nanoclj_val_t image, image_transform_t t) {
+  imageview_t iv = to_imageview(image);
   if (!iv.ptr) {
     return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not an Image")));
   }
-  int w = iv.width, h = iv.height, stride = iv.stride;
-  nanoclj_cell_t * new_image = mk_image(sc, h, w, iv.format, NULL);
-  uint8_t * data = new_image->_image.tensor->data;
-  size_t bpp = get_format_bpp(iv.format);
-  
-  for (int y = 0; y < h; y++) {
-    for (int x = 0; x < w; x++) {
-      for (int c = 0; c < bpp; c++) {
-	data[bpp * (x * h + y) + c] = iv.ptr[y * stride + x * bpp + c];
-      }
-    }
+  int w = iv.width, h = iv.height;
+  bool transposing = image_transform_is_transposing(t);
+  nanoclj_cell_t * new_image = mk_image(sc, transposing ? h : w, transposing ? w : h, iv.format, NULL);
+  if (!new_image) return mk_nil();
+  if (!image_transform(iv.ptr, iv.stride, w, h, get_format_bpp(iv.format), t, new_image->_image.tensor->data, nanoclj_get_cpu_count())) {
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
   }
-  
   return mk_pointer(new_image);
 }
 
+static inline nanoclj_val_t Image_transpose(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return transform_image(sc, first(sc, args), image_transform_transpose);
+}
+
+/* Rotates an image clockwise by a multiple of 90 degrees */
+static inline nanoclj_val_t Image_rotate(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_val_t degrees = second(sc, args);
+  if (!is_number(degrees) || to_long(degrees) % 90 != 0) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Rotation must be a multiple of 90 degrees")));
+  }
+  switch ((to_long(degrees) % 360 + 360) % 360) {
+  case 90: return transform_image(sc, first(sc, args), image_transform_rotate_90);
+  case 180: return transform_image(sc, first(sc, args), image_transform_rotate_180);
+  case 270: return transform_image(sc, first(sc, args), image_transform_rotate_270);
+  }
+  return first(sc, args);
+}
+
+static inline nanoclj_val_t Image_flipHorizontal(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return transform_image(sc, first(sc, args), image_transform_flip_horizontal);
+}
+
+static inline nanoclj_val_t Image_flipVertical(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return transform_image(sc, first(sc, args), image_transform_flip_vertical);
+}
+
+/* Returns the zlib strategy named by a keyword, or -1 if the name is unknown */
+static inline int get_deflate_strategy(nanoclj_val_t v) {
+  static const struct { const char * name; int strategy; } strategies[] = {
+    { "default", Z_DEFAULT_STRATEGY }, { "filtered", Z_FILTERED }, { "huffman-only", Z_HUFFMAN_ONLY },
+    { "rle", Z_RLE }, { "fixed", Z_FIXED }
+  };
+  if (type(v) == T_KEYWORD) {
+    strview_t name = decode_symbol(v)->name;
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+      if (strview_eq(name, mk_strview(strategies[i].name))) return strategies[i].strategy;
+    }
+  }
+  return -1;
+}
+
+/* Saves an image in a format determined by the file extension. The options are :level (0-9) and
+ * :strategy (:default, :filtered, :huffman-only, :rle or :fixed) for PNG compression, and :quality (1-100) for JPEG. */
 static inline nanoclj_val_t Image_save(nanoclj_t * sc, nanoclj_cell_t * args) {
   imageview_t iv = to_imageview(first(sc, args));
   nanoclj_val_t filename0 = second(sc, args);
+  nanoclj_cell_t * opts = is_cell(third(sc, args)) ? decode_pointer(third(sc, args)) : NULL;
   if (!iv.ptr) {
     return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not an Image")));
   } else if (!is_string(filename0)) {
     return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not a string")));
   }
+  png_options_t png_options = png_default_options();
+  png_options.n_threads = nanoclj_get_cpu_count();
+  nanoclj_val_t level = find(sc, opts, kw_level, mk_nil()), strategy = find(sc, opts, kw_strategy, mk_nil());
+  nanoclj_val_t quality = find(sc, opts, kw_quality, mk_int(95));
+  if (!is_nil(level)) png_options.level = is_number(level) ? to_long(level) : -2;
+  if (!is_nil(strategy)) png_options.strategy = get_deflate_strategy(strategy);
+  if (png_options.level < -1 || png_options.level > 9 || png_options.strategy < 0 ||
+      !is_number(quality) || to_long(quality) < 1 || to_long(quality) > 100) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid options")));
+  }
   char * filename = alloc_c_str(to_strview(filename0));
   char * ext = strrchr(filename, '.');
   if (!ext) {
@@ -536,13 +741,17 @@ static inline nanoclj_val_t Image_save(nanoclj_t * sc, nanoclj_cell_t * args) {
 
     int success = 0;
     if (strcmp(ext, ".png") == 0) {
-      success = stbi_write_png(filename, w, h, channels, tmp ? tmp : iv.ptr, iv.stride);
+      FILE * f = fopen(filename, "wb");
+      if (f) {
+	success = png_write(f, tmp ? tmp : iv.ptr, tmp ? w * channels : iv.stride, w, h, channels, png_options);
+	success = fclose(f) == 0 && success;
+      }
     } else if (strcmp(ext, ".bmp") == 0) {
       success = stbi_write_bmp(filename, w, h, channels, tmp ? tmp : iv.ptr);
     } else if (strcmp(ext, ".tga") == 0) {
       success = stbi_write_tga(filename, w, h, channels, tmp ? tmp : iv.ptr);
     } else if (strcmp(ext, ".jpg") == 0) {
-      success = stbi_write_jpg(filename, w, h, channels, tmp ? tmp : iv.ptr, 95);
+      success = stbi_write_jpg(filename, w, h, channels, tmp ? tmp : iv.ptr, to_long(quality));
     } else {
       free(tmp);
       free(filename);
@@ -560,36 +769,7 @@ static inline nanoclj_val_t Image_save(nanoclj_t * sc, nanoclj_cell_t * args) {
   return (nanoclj_val_t)kTRUE;
 }
 
-static inline int * mk_kernel(float radius, int * size) {
-  int r = (int)ceil(radius);
-
-  if (r <= 0) {
-    *size = 0;
-    return NULL;
-  }
-  
-  int rows = 2 * r + 1;
-  float sigma = radius / 3;
-  float sigma22 = 2.0f * sigma * sigma;
-  float sigmaPi2 = 2.0f * (float)M_PI * sigma;
-  float sqrtSigmaPi2 = sqrt(sigmaPi2);
-
-  int * kernel = malloc(rows * sizeof(int));
-
-  int row = -r;
-  float first_value = exp(-row*row/sigma22) / sqrtSigmaPi2;
-  int i = 0;
-  kernel[i++] = 1;
-
-  for ( ; i < rows; row++) {
-    kernel[i++] = (int)(exp(-row * row / sigma22) / sqrtSigmaPi2 / first_value);
-  }
-  *size = rows;
-  return kernel;
-}
-
-/* Horizontal gaussian blur */
-nanoclj_val_t Image_horizontalGaussianBlur(nanoclj_t * sc, nanoclj_cell_t * args) {
+static inline nanoclj_val_t image_blur(nanoclj_t * sc, nanoclj_cell_t * args, bool vertical) {
   imageview_t iv = to_imageview(first(sc, args));
   nanoclj_val_t radius = second(sc, args);
   if (!iv.ptr) {
@@ -598,80 +778,32 @@ nanoclj_val_t Image_horizontalGaussianBlur(nanoclj_t * sc, nanoclj_cell_t * args
   if (!is_number(radius)) {
     return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not a number")));
   }
-  int w = iv.width, h = iv.height, stride = iv.stride;
-  size_t bpp = get_format_bpp(iv.format);
-  int kernel_size;
-  int * kernel = mk_kernel(to_double(radius), &kernel_size);
-
-  int total = 0;
-  for (int i = 0; i < kernel_size; i++) total += kernel[i];
-  
-  nanoclj_cell_t * r = mk_image(sc, w, h, iv.format, NULL);
-  uint8_t * output_data = r->_image.tensor->data;
-    
-  switch (iv.format) {
-  case nanoclj_rgba8:
-  case nanoclj_bgra8:
-    for (int row = 0; row < h; row++) {
-      for (int col = 0; col < w; col++) {
-	int c0 = 0, c1 = 0, c2 = 0, c3 = 0;
-	for (int i = 0; i < kernel_size; i++) {
-	  const uint8_t * ptr = iv.ptr + row * stride + clamp(col + i - kernel_size / 2, 0, w - 1) * 4;
-	  c0 += *ptr++ * kernel[i];
-	  c1 += *ptr++ * kernel[i];
-	  c2 += *ptr++ * kernel[i];
-	  c3 += *ptr++ * kernel[i];
-	}
-	uint8_t * ptr = output_data + (row * w + col) * 4;
-	*ptr++ = (uint8_t)(c0 / total);
-	*ptr++ = (uint8_t)(c1 / total);
-	*ptr++ = (uint8_t)(c2 / total);
-	*ptr++ = (uint8_t)(c3 / total);
-      }
-    }
-    break;
-  case nanoclj_rgb8:
-  case nanoclj_bgr8_32:
-    for (int row = 0; row < h; row++) {
-      for (int col = 0; col < w; col++) {
-	int c0 = 0, c1 = 0, c2 = 0;
-	for (int i = 0; i < kernel_size; i++) {
-	  const uint8_t * ptr = iv.ptr + row * stride + clamp(col + i - kernel_size / 2, 0, w - 1) * bpp;
-	  c0 += *ptr++ * kernel[i];
-	  c1 += *ptr++ * kernel[i];
-	  c2 += *ptr++ * kernel[i];
-	}
-	uint8_t * ptr = output_data + (row * w + col) * bpp;
-	*ptr++ = (uint8_t)(c0 / total);
-	*ptr++ = (uint8_t)(c1 / total);
-	*ptr++ = (uint8_t)(c2 / total);
-      }
-    }
-    break;
-  case nanoclj_r8:
-    for (int row = 0; row < h; row++) {
-      for (int col = 0; col < w; col++) {
-	int c0 = 0;
-	for (int i = 0; i < kernel_size; i++) {
-	  const uint8_t * ptr = iv.ptr + row * stride + clamp(col + i - kernel_size / 2, 0, w - 1);
-	  c0 += *ptr * kernel[i];
-	}
-	uint8_t * ptr = output_data + row * w + col;
-	*ptr = (uint8_t)(c0 / total);
-      }
-    }
-    break;
-  default:
-    r = NULL;
+  nanoclj_cell_t * r = mk_image(sc, iv.width, iv.height, iv.format, NULL);
+  if (!r) return mk_nil();
+  if (!image_gaussian_blur(iv.ptr, iv.stride, iv.width, iv.height, get_format_bpp(iv.format), to_double(radius), vertical,
+			   r->_image.tensor->data, nanoclj_get_cpu_count())) {
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
   }
-  free(kernel);
   return mk_pointer(r);
 }
 
+/* Horizontal gaussian blur */
+static inline nanoclj_val_t Image_horizontalGaussianBlur(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return image_blur(sc, args, false);
+}
+
+/* Gaussian blur in both directions */
+static inline nanoclj_val_t Image_gaussianBlur(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return image_blur(sc, args, true);
+}
+
 static inline nanoclj_val_t Audio_load(nanoclj_t * sc, nanoclj_cell_t * args) {
   nanoclj_val_t src = first(sc, args);
-  strview_t sv = to_strview(slurp(sc, T_INPUT_STREAM, args));
+  nanoclj_val_t input = slurp(sc, T_INPUT_STREAM, args);
   if (sc->pending_exception) return mk_nil();
+  /* The frames are decoded after allocating the Audio object, so the input must be kept alive */
+  retain_value(sc, input);
+  strview_t sv = to_strview(input);
   
   drwav wav;
   if (!drwav_init_memory(&wav, sv.ptr, sv.size, NULL)) {
@@ -888,24 +1020,287 @@ static inline nanoclj_val_t Geo_load(nanoclj_t * sc, nanoclj_cell_t * args) {
   return mk_pointer(r);
 }
 
+/* Runs the force-directed layout of a graph. The options are :iterations, :alpha, :alpha-decay,
+ * :gravity, :friction, :charge and :theta, the accuracy of the Barnes-Hut approximation (0 is exact). */
 static inline nanoclj_val_t Graph_updateLayout(nanoclj_t * sc, nanoclj_cell_t * args) {
   nanoclj_cell_t * g = decode_pointer(first(sc, args));
-  float gravity = 0.075f, friction = 0.9f, charge = -35.0f;
-  float alpha = 0.1f;
-  
-  for (int i = 0; i < 1000; i++) {
-    relax_links(g, alpha);
-    apply_gravity(g, alpha, gravity);
-    apply_repulsion(g, alpha, charge);
-    apply_drag(g, friction);
+  nanoclj_cell_t * opts = is_cell(second(sc, args)) ? decode_pointer(second(sc, args)) : NULL;
+  graph_layout_params_t params = graph_layout_default_params();
+  struct { const char * name; float * value; } float_params[] = {
+    { "alpha", &params.alpha }, { "alpha-decay", &params.alpha_decay }, { "gravity", &params.gravity },
+    { "friction", &params.friction }, { "charge", &params.charge }, { "theta", &params.theta }
+  };
+  nanoclj_val_t iterations = find(sc, opts, def_keyword("iterations"), mk_int(params.iterations));
+  if (!is_number(iterations)) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid options")));
+  }
+  params.iterations = to_long(iterations);
+  for (size_t i = 0; i < sizeof(float_params) / sizeof(float_params[0]); i++) {
+    nanoclj_val_t v = find(sc, opts, def_keyword(float_params[i].name), mk_nil());
+    if (is_nil(v)) continue;
+    if (!is_number(v)) {
+      return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid options")));
+    }
+    *float_params[i].value = to_double(v);
+  }
+  if (!update_layout(g, params, nanoclj_get_cpu_count())) {
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
   }
   return mk_nil();
 }
 
+/* Returns the graph array of a graph and builds its adjacency if needed, or NULL on error */
+static inline nanoclj_graph_array_t * get_graph_adjacency(nanoclj_t * sc, nanoclj_val_t g) {
+  if (type(g) != T_GRAPH) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not a Graph")));
+    return NULL;
+  }
+  nanoclj_graph_array_t * ga = _graph_unchecked(decode_pointer(g));
+  if (!graph_array_update_csr(ga)) {
+    nanoclj_throw(sc, sc->OutOfMemoryError);
+    return NULL;
+  }
+  return ga;
+}
+
+/* Returns the index of a node given as a GraphNode, an index or the key of the node */
+static inline size_t get_graph_node_index(nanoclj_t * sc, nanoclj_graph_array_t * g, nanoclj_val_t v) {
+  if (type(v) == T_GRAPH_NODE && _graph_unchecked(decode_pointer(v)) == g) {
+    return _node_offset_unchecked(decode_pointer(v));
+  } else if (is_number(v)) {
+    long long i = to_long(v);
+    return i >= 0 && i < g->num_nodes ? i : NPOS;
+  }
+  return find_node_index(sc, g, v);
+}
+
+/* Sets the edges to follow from the :direction option, which is :out (the default), :in or :both */
+static inline bool get_graph_direction(nanoclj_t * sc, nanoclj_graph_array_t * g, nanoclj_cell_t * opts,
+				       const nanoclj_csr_t ** a, const nanoclj_csr_t ** b) {
+  nanoclj_val_t direction = find(sc, opts, def_keyword("direction"), def_keyword("out"));
+  *b = NULL;
+  if (direction.as_long == def_keyword("out").as_long) {
+    *a = &(g->out);
+  } else if (direction.as_long == def_keyword("in").as_long) {
+    *a = &(g->in);
+  } else if (direction.as_long == def_keyword("both").as_long) {
+    *a = &(g->out);
+    *b = &(g->in);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static inline nanoclj_val_t traverse_graph(nanoclj_t * sc, nanoclj_cell_t * args, bool depth_first) {
+  nanoclj_graph_array_t * g = get_graph_adjacency(sc, first(sc, args));
+  if (!g) return mk_nil();
+  nanoclj_cell_t * opts = is_cell(third(sc, args)) ? decode_pointer(third(sc, args)) : NULL;
+  size_t source = get_graph_node_index(sc, g, second(sc, args));
+  const nanoclj_csr_t * a, * b;
+  if (source == NPOS) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Node not found")));
+  } else if (!get_graph_direction(sc, g, opts, &a, &b)) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid options")));
+  }
+  size_t n = g->num_nodes, num_visited;
+  uint32_t * order = malloc(n * sizeof(uint32_t));
+  if (depth_first) {
+    bool * visited = calloc(n, sizeof(bool));
+    uint32_t * stack = malloc(n * sizeof(uint32_t)), * cursors = malloc(n * sizeof(uint32_t));
+    if (order && visited && stack && cursors) num_visited = graph_dfs(a, b, source, order, visited, stack, cursors);
+    else num_visited = NPOS;
+    free(visited);
+    free(stack);
+    free(cursors);
+  } else {
+    int32_t * depth = malloc(n * sizeof(int32_t));
+    if (order && depth) {
+      for (size_t i = 0; i < n; i++) depth[i] = -1;
+      num_visited = graph_bfs(a, b, source, order, depth);
+    } else {
+      num_visited = NPOS;
+    }
+    free(depth);
+  }
+  if (num_visited == NPOS) {
+    free(order);
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
+  }
+  nanoclj_cell_t * r = mk_vector(sc, num_visited);
+  for (size_t i = 0; i < num_visited; i++) set_indexed_value(r, i, mk_long(sc, order[i]));
+  free(order);
+  return mk_pointer(r);
+}
+
+/* Returns the indices of the nodes reachable from a node in breadth-first order. The option
+ * :direction is :out, :in or :both. */
+static inline nanoclj_val_t Graph_bfs(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return traverse_graph(sc, args, false);
+}
+
+/* Returns the indices of the nodes reachable from a node in depth-first preorder */
+static inline nanoclj_val_t Graph_dfs(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return traverse_graph(sc, args, true);
+}
+
+/* Returns a vector with the index of the weakly connected component of each node */
+static inline nanoclj_val_t Graph_connectedComponents(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_graph_array_t * g = get_graph_adjacency(sc, first(sc, args));
+  if (!g) return mk_nil();
+  size_t n = g->num_nodes;
+  int32_t * component = malloc((n ? n : 1) * sizeof(int32_t));
+  if (!component || (n && !graph_connected_components(&(g->out), &(g->in), n, component))) {
+    free(component);
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
+  }
+  nanoclj_cell_t * r = mk_vector(sc, n);
+  for (size_t i = 0; i < n; i++) set_indexed_value(r, i, mk_long(sc, component[i]));
+  free(component);
+  return mk_pointer(r);
+}
+
+/* Computes the shortest paths from a node with Dijkstra's algorithm and returns a map with the
+ * :distances and the :previous nodes on the paths, which are nil for unreachable nodes. The options
+ * are :direction, and :weight, the key of the edge weight in the edge data (all weights are 1 by default). */
+static inline nanoclj_val_t Graph_shortestPaths(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_graph_array_t * g = get_graph_adjacency(sc, first(sc, args));
+  if (!g) return mk_nil();
+  nanoclj_cell_t * opts = is_cell(third(sc, args)) ? decode_pointer(third(sc, args)) : NULL;
+  size_t source = get_graph_node_index(sc, g, second(sc, args));
+  const nanoclj_csr_t * a, * b;
+  if (source == NPOS) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Node not found")));
+  } else if (!get_graph_direction(sc, g, opts, &a, &b)) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid options")));
+  }
+  size_t n = g->num_nodes;
+  nanoclj_val_t weight_key = find(sc, opts, def_keyword("weight"), mk_nil());
+  double * weights = NULL;
+  if (!is_nil(weight_key)) {
+    weights = malloc((g->num_edges ? g->num_edges : 1) * sizeof(double));
+    if (!weights) return nanoclj_throw(sc, sc->OutOfMemoryError);
+    for (size_t i = 0; i < g->num_edges; i++) {
+      nanoclj_val_t data = g->edges[i].data, w = is_cell(data) ? find(sc, decode_pointer(data), weight_key, mk_nil()) : mk_nil();
+      double v = 1;
+      if (is_number(w)) {
+	v = to_double(w);
+      } else if (is_string(w)) {
+	char * str = alloc_c_str(to_strview(w)), * end;
+	v = strtod(str, &end);
+	if (end == str) v = NAN;
+	free(str);
+      } else if (!is_nil(w)) {
+	v = NAN;
+      }
+      if (!(v >= 0)) {
+	free(weights);
+	return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid edge weight")));
+      }
+      weights[i] = v;
+    }
+  }
+  double * distance = malloc((n ? n : 1) * sizeof(double));
+  int64_t * previous = malloc((n ? n : 1) * sizeof(int64_t));
+  if (!distance || !previous || !graph_dijkstra(a, b, n, source, weights, distance, previous)) {
+    free(weights);
+    free(distance);
+    free(previous);
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
+  }
+  free(weights);
+  nanoclj_cell_t * distances = mk_vector(sc, n);
+  retain(sc, distances);
+  nanoclj_cell_t * previous_nodes = mk_vector(sc, n);
+  retain(sc, previous_nodes);
+  for (size_t i = 0; i < n; i++) {
+    set_indexed_value(distances, i, previous[i] >= 0 || i == source ? mk_double(distance[i]) : mk_nil());
+    set_indexed_value(previous_nodes, i, previous[i] >= 0 ? mk_long(sc, previous[i]) : mk_nil());
+  }
+  free(distance);
+  free(previous);
+  nanoclj_cell_t * r = assoc(sc, mk_hashmap(sc), def_keyword("distances"), mk_pointer(distances));
+  return mk_pointer(assoc(sc, r, def_keyword("previous"), mk_pointer(previous_nodes)));
+}
+
+/* Returns the PageRank of each node. The options are :damping (0.85), :iterations (100) and
+ * :tolerance (1e-6), the limit for the sum of the changes in an iteration. */
+static inline nanoclj_val_t Graph_pageRank(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_graph_array_t * g = get_graph_adjacency(sc, first(sc, args));
+  if (!g) return mk_nil();
+  nanoclj_cell_t * opts = is_cell(second(sc, args)) ? decode_pointer(second(sc, args)) : NULL;
+  nanoclj_val_t damping = find(sc, opts, def_keyword("damping"), mk_double(0.85));
+  nanoclj_val_t iterations = find(sc, opts, def_keyword("iterations"), mk_int(100));
+  nanoclj_val_t tolerance = find(sc, opts, def_keyword("tolerance"), mk_double(1e-6));
+  if (!is_number(damping) || !is_number(iterations) || !is_number(tolerance) || to_double(damping) < 0 || to_double(damping) > 1) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid options")));
+  }
+  size_t n = g->num_nodes;
+  double * rank = malloc((n ? n : 1) * sizeof(double));
+  if (!rank || graph_pagerank(&(g->out), &(g->in), n, to_double(damping), to_long(iterations), to_double(tolerance), rank, nanoclj_get_cpu_count()) < 0) {
+    free(rank);
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
+  }
+  nanoclj_cell_t * r = mk_vector(sc, n);
+  for (size_t i = 0; i < n; i++) set_indexed_value(r, i, mk_double(rank[i]));
+  free(rank);
+  return mk_pointer(r);
+}
+
+/* Returns a map with the :in and :out degrees of the nodes, and the :min, :max and :mean of their total degrees */
+static inline nanoclj_val_t Graph_degreeStats(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_graph_array_t * g = get_graph_adjacency(sc, first(sc, args));
+  if (!g) return mk_nil();
+  size_t n = g->num_nodes, min_degree = 0, max_degree = 0, total = 0;
+  nanoclj_cell_t * in = mk_vector(sc, n);
+  retain(sc, in);
+  nanoclj_cell_t * out = mk_vector(sc, n);
+  retain(sc, out);
+  for (size_t i = 0; i < n; i++) {
+    size_t d_in = g->in.offsets[i + 1] - g->in.offsets[i], d_out = g->out.offsets[i + 1] - g->out.offsets[i];
+    set_indexed_value(in, i, mk_long(sc, d_in));
+    set_indexed_value(out, i, mk_long(sc, d_out));
+    if (i == 0 || d_in + d_out < min_degree) min_degree = d_in + d_out;
+    if (d_in + d_out > max_degree) max_degree = d_in + d_out;
+    total += d_in + d_out;
+  }
+  nanoclj_cell_t * r = assoc(sc, mk_hashmap(sc), def_keyword("in"), mk_pointer(in));
+  r = assoc(sc, r, def_keyword("out"), mk_pointer(out));
+  r = assoc(sc, r, def_keyword("min"), mk_long(sc, min_degree));
+  r = assoc(sc, r, def_keyword("max"), mk_long(sc, max_degree));
+  return mk_pointer(assoc(sc, r, def_keyword("mean"), n ? mk_double((double)total / n) : mk_nil()));
+}
+
 static void XMLCDECL silent_error_handler(void *ctx, const char *msg, ...) {
   
 }
   
+/* Returns the data elements of a GraphML node or edge as a map, or NULL if there are none */
+static inline nanoclj_cell_t * read_graphml_data(nanoclj_t * sc, xmlDoc * doc, xmlNode * node) {
+  nanoclj_cell_t * attributes = NULL;
+  xmlNode * child = node->children;
+  for (; child; child = child->next) {
+    if (child->type != XML_ELEMENT_NODE || strcmp((const char *)child->name, "data") != 0) continue;
+    xmlAttr * child_property = child->properties;
+    nanoclj_val_t key = mk_nil(), value = mk_nil();
+    for (; child_property; child_property = child_property->next) {
+      if (strcmp((const char*)child_property->name, "key") == 0) {
+	xmlChar * value = xmlNodeListGetString(doc, child_property->children, 1);
+	key = mk_string(sc, (const char *)value);
+	xmlFree(value);
+      }
+    }
+    xmlNode * content = child->children;
+    if (content && content->type == XML_TEXT_NODE) {
+      value = mk_string(sc, (const char *)content->content);
+    }
+    if (!is_nil(key)) {
+      attributes = assoc(sc, attributes ? attributes : mk_hashmap(sc), key, value);
+    }
+  }
+  return attributes;
+}
+
 static inline nanoclj_val_t Graph_load(nanoclj_t * sc, nanoclj_cell_t * args) {
   nanoclj_val_t src = first(sc, args);
   strview_t sv = to_strview(slurp(sc, T_READER, args));
@@ -952,9 +1347,9 @@ static inline nanoclj_val_t Graph_load(nanoclj_t * sc, nanoclj_cell_t * args) {
       }
       if (!is_nil(source) && !is_nil(target)) {
 	size_t si = find_node_index(sc, g, source), ti = find_node_index(sc, g, target);
-	strview_t ssv = to_strview(source), tsv = to_strview(target);
 	if (si != NPOS && ti != NPOS) {
-	  graph_array_append_edge(g, si, ti);
+	  nanoclj_cell_t * attributes = read_graphml_data(sc, doc, node);
+	  graph_array_append_edge(g, si, ti, attributes ? mk_pointer(attributes) : mk_nil());
 	}
       }
     } else if (node->type == XML_ELEMENT_NODE && strcmp((const char *)node->name, "node") == 0) {
@@ -966,29 +1361,9 @@ static inline nanoclj_val_t Graph_load(nanoclj_t * sc, nanoclj_cell_t * args) {
 	id = mk_string(sc, (const char *)value);
 	xmlFree(value);
       }
-      nanoclj_cell_t * attributes = mk_hashmap(sc);
-      xmlNode * child = node->children;
-      for (; child; child = child->next) {
-	if (child->type != XML_ELEMENT_NODE || strcmp((const char *)child->name, "data") != 0) continue;
-	xmlAttr * child_property = child->properties;
-	nanoclj_val_t key = mk_nil(), value = mk_nil();
-	for (; child_property; child_property = child_property->next) {
-	  if (strcmp((const char*)child_property->name, "key") == 0) {
-	    xmlChar * value = xmlNodeListGetString(doc, child_property->children, 1);
-	    key = mk_string(sc, (const char *)value);
-	    xmlFree(value);
-	  }
-	}
-	xmlNode * content = child->children;
-	if (content && content->type == XML_TEXT_NODE) {
-	  value = mk_string(sc, (const char *)content->content);
-	}
-	if (!is_nil(key)) {
-	  attributes = assoc(sc, attributes, key, value);
-	}
-      }
+      nanoclj_cell_t * attributes = read_graphml_data(sc, doc, node);
       if (!is_nil(id)) {
-	graph_array_append_node(g, mk_mapentry(sc, id, mk_pointer(attributes)));
+	graph_array_append_node(g, mk_mapentry(sc, id, mk_pointer(attributes ? attributes : mk_hashmap(sc))));
       }
     }
   }
@@ -1082,32 +1457,52 @@ static inline nanoclj_val_t clojure_data_csv_read_csv(nanoclj_t * sc, nanoclj_ce
 
   bool is_quoted = false;
   nanoclj_tensor_t * vec = NULL, * value = NULL;
-  int32_t delimiter = ',';
-  
+  uint8_t delimiter = ',';
+
+  /* Read the row a line at a time and continue on the next line if a quoted field spans lines */
+  nanoclj_tensor_t * line = mk_tensor_1d(nanoclj_i8, 0);
+  bool found = port_read_until(rdr, '\n', line);
+  size_t i = 0;
   while ( 1 ) {
-    int32_t c = inchar(sc, rdr);
-    if (c == -1) break;
-    if (c == '\r') continue;
-    if (!is_quoted) {
-      if (!vec) vec = mk_tensor_1d(nanoclj_val, 0);
-      if (c == '\n') {
-	break;
-      } else {
+    const uint8_t * s = line->data;
+    size_t n = line->ne[0], span = i;
+    for (; i < n; i++) {
+      if (value) {
+	/* Skip to the next character that may end the field */
+	i = (const uint8_t *)csv_find_special((const char *)s + i, (const char *)s + n, delimiter) - s;
+	if (i == n) break;
+      }
+      uint8_t c = s[i];
+      if (c == '\r' || (!is_quoted && (c == '"' || c == delimiter)) || (is_quoted && c == '"')) {
+	if (value) tensor_mutate_append_bytes(value, s + span, i - span);
+	span = i + 1;
+	if (c == '\r') continue;
+	if (!vec) vec = mk_tensor_1d(nanoclj_val, 0);
 	if (!value) value = mk_tensor_1d(nanoclj_i8, 0);
 	if (c == '"') {
-	  is_quoted = true;
-	} else if (c == delimiter) {
+	  is_quoted = !is_quoted;
+	} else {
 	  tensor_mutate_push(vec, mk_string_with_tensor(sc, value));
 	  value = mk_tensor_1d(nanoclj_i8, 0);
-	} else {
-	  tensor_mutate_append_codepoint(value, c);
 	}
+      } else if (!value) {
+	if (!vec) vec = mk_tensor_1d(nanoclj_val, 0);
+	value = mk_tensor_1d(nanoclj_i8, 0);
+	span = i;
       }
-    } else if (c == '"') {
-      is_quoted = false;
-    } else {
-      tensor_mutate_append_codepoint(value, c);
     }
+    if (value) tensor_mutate_append_bytes(value, s + span, i - span);
+    if (!found || !is_quoted) break;
+    tensor_mutate_append_bytes(value, (const uint8_t *)"\n", 1);
+    found = port_read_until(rdr, '\n', line);
+  }
+  if (found && !vec) vec = mk_tensor_1d(nanoclj_val, 0);
+  bool is_valid = utf8_is_valid(line->data, line->ne[0]);
+  tensor_free(line);
+  if (!is_valid) {
+    if (vec) tensor_free(vec);
+    if (value) tensor_free(value);
+    return nanoclj_throw(sc, mk_exception(sc, sc->CharacterCodingException, "Invalid UTF8"));
   }
 
   if (vec) {
@@ -1121,6 +1516,812 @@ static inline nanoclj_val_t clojure_data_csv_read_csv(nanoclj_t * sc, nanoclj_ce
   }
 }
 
+static inline nanoclj_val_t mk_csv_string(nanoclj_t * sc, csv_field_t f) {
+  if (!f.is_escaped) {
+    return mk_string_from_sv(sc, (strview_t){ f.ptr, f.size });
+  }
+  char * buffer = malloc(f.size);
+  nanoclj_val_t r = mk_string_from_sv(sc, (strview_t){ buffer, csv_unescape(f, buffer) });
+  free(buffer);
+  return r;
+}
+
+/* Creates a vector from a parsed column. Longs and doubles are stored in typed vectors. */
+static inline nanoclj_val_t mk_csv_column(nanoclj_t * sc, csv_column_t * col, size_t n) {
+  nanoclj_tensor_t * tensor;
+  if (col->type == csv_type_long || col->type == csv_type_double) {
+    tensor = mk_tensor_1d(col->type == csv_type_long ? nanoclj_i64 : nanoclj_f64, n);
+    if (!tensor) return nanoclj_throw(sc, sc->OutOfMemoryError);
+    memcpy(tensor->data, col->data, n * sizeof(int64_t));
+    return mk_vector_with_tensor(sc, tensor);
+  }
+  tensor = mk_tensor_1d(nanoclj_val, n);
+  if (!tensor) return nanoclj_throw(sc, sc->OutOfMemoryError);
+  for (size_t i = 0; i < n; i++) tensor_mutate_set(tensor, i, mk_nil());
+  /* The vector is retained so that the elements survive GC while they are being created */
+  nanoclj_val_t vec = mk_vector_with_tensor(sc, tensor);
+  retain_value(sc, vec);
+  for (size_t i = 0; i < n; i++) {
+    tensor_mutate_set(tensor, i, mk_csv_string(sc, ((csv_field_t *)col->data)[i]));
+  }
+  return vec;
+}
+
+/* Reads CSV data into a map from header names (or column indices) to columns, or into a table.
+ * Column types are inferred as longs, doubles or strings. Large inputs are parsed in parallel. */
+static inline nanoclj_val_t read_csv_columns(nanoclj_t * sc, nanoclj_cell_t * args, bool as_table) {
+  uint8_t sep = ',';
+  bool has_header = true;
+  for (nanoclj_cell_t * opts = next(sc, args); opts; opts = next(sc, next(sc, opts))) {
+    nanoclj_val_t key = first(sc, opts), val = second(sc, opts);
+    if (key.as_long == _S(":separator").as_long) {
+      sep = to_int(val);
+    } else if (key.as_long == _S(":header").as_long) {
+      has_header = is_true(val);
+    }
+  }
+
+  nanoclj_cell_t * rdr = mk_reader(sc, T_INPUT_STREAM, args);
+  if (!rdr) return mk_nil();
+  nanoclj_tensor_t * input = port_map_input(rdr);
+  if (!input) {
+    input = mk_tensor_1d(nanoclj_i8, 0);
+    port_read_bytes(rdr, SIZE_MAX, input);
+  }
+  bool has_error = handle_port_exceptions(sc, rdr);
+  port_close(rdr);
+  if (has_error) {
+    tensor_free(input);
+    return mk_nil();
+  }
+
+  csv_table_t table;
+  csv_read_columns(input->data, input->ne[0], sep, has_header, nanoclj_get_cpu_count(), &table);
+  if (!table.is_valid) {
+    csv_free_table(&table);
+    tensor_free(input);
+    return nanoclj_throw(sc, mk_exception(sc, sc->CharacterCodingException, "Invalid UTF8"));
+  }
+
+  nanoclj_cell_t * r = as_table ? mk_table(sc, table.n_cols) : mk_hashmap(sc);
+  retain(sc, r);
+  for (size_t i = 0; i < table.n_cols; i++) {
+    nanoclj_val_t col = mk_csv_column(sc, &table.columns[i], table.n_rows);
+    retain_value(sc, col);
+    nanoclj_val_t key = has_header ? mk_csv_string(sc, table.header[i]) : mk_int(i);
+    if (as_table) {
+      table_set_column(r, i, key, col);
+    } else {
+      r = assoc(sc, r, key, col);
+      retain(sc, r);
+    }
+  }
+  csv_free_table(&table);
+  tensor_free(input);
+  return mk_pointer(r);
+}
+
+static inline nanoclj_val_t clojure_data_csv_read_columns(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return read_csv_columns(sc, args, false);
+}
+
+static inline nanoclj_cell_t * to_table(nanoclj_t * sc, nanoclj_val_t v) {
+  if (is_cell(v) && _type(decode_pointer(v)) == T_TABLE) {
+    return decode_pointer(v);
+  }
+  nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not a Table")));
+  return NULL;
+}
+
+static inline nanoclj_cell_t * table_find_column(nanoclj_t * sc, nanoclj_cell_t * table, nanoclj_val_t name) {
+  nanoclj_val_t col = find(sc, table, name, mk_nil());
+  if (is_cell(col)) {
+    return decode_pointer(col);
+  }
+  nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Unknown column")));
+  return NULL;
+}
+
+/* Returns the values of a double column, or NULL if the column is not a double vector */
+static inline const double * table_get_doubles(const nanoclj_cell_t * col) {
+  if (_is_small(col) || _is_reverse(col) || _tensor_unchecked(col)->type != nanoclj_f64) {
+    return NULL;
+  }
+  return (const double *)_tensor_unchecked(col)->data + _offset_unchecked(col);
+}
+
+/* Returns the values of a long column, or NULL if the column is not a long vector */
+static inline const int64_t * table_get_longs(const nanoclj_cell_t * col) {
+  if (_is_small(col) || _is_reverse(col) || _tensor_unchecked(col)->type != nanoclj_i64) {
+    return NULL;
+  }
+  return (const int64_t *)_tensor_unchecked(col)->data + _offset_unchecked(col);
+}
+
+/* Creates a new column from the rows idx of col */
+static inline nanoclj_val_t table_gather_column(nanoclj_t * sc, nanoclj_cell_t * col, const size_t * idx, size_t n) {
+  if (!_is_small(col) && !_is_reverse(col) && _tensor_unchecked(col)->type != nanoclj_val) {
+    const nanoclj_tensor_t * src = _tensor_unchecked(col);
+    size_t element_size = src->nb[0], offset = _offset_unchecked(col);
+    nanoclj_tensor_t * tensor = mk_tensor_1d(src->type, n);
+    if (!tensor) return nanoclj_throw(sc, sc->OutOfMemoryError);
+    for (size_t i = 0; i < n; i++) {
+      memcpy(tensor->data + i * element_size, src->data + (offset + idx[i]) * element_size, element_size);
+    }
+    return mk_vector_with_tensor(sc, tensor);
+  }
+  nanoclj_cell_t * vec = mk_vector(sc, n);
+  if (!vec) return mk_nil();
+  for (size_t i = 0; i < n; i++) {
+    set_indexed_value(vec, i, get_indexed_value(col, idx[i]));
+  }
+  return mk_pointer(vec);
+}
+
+/* Creates a new table from the rows idx of table */
+static inline nanoclj_val_t table_gather(nanoclj_t * sc, nanoclj_cell_t * table, const size_t * idx, size_t n) {
+  size_t num_columns = get_size(table);
+  nanoclj_cell_t * r = mk_table(sc, num_columns);
+  if (!r) return mk_nil();
+  retain(sc, r);
+  for (size_t j = 0; j < num_columns; j++) {
+    nanoclj_val_t col = table_gather_column(sc, decode_pointer(table_get_column(table, j)), idx, n);
+    if (is_nil(col)) return mk_nil();
+    table_set_column(r, j, table_get_name(table, j), col);
+  }
+  return mk_pointer(r);
+}
+
+/* Comparison results as bits: less, equal, greater and unordered (NaN) */
+#define TABLE_CMP_LT 1
+#define TABLE_CMP_EQ 2
+#define TABLE_CMP_GT 4
+#define TABLE_CMP_NAN 8
+
+static inline int table_parse_comparison(nanoclj_val_t op) {
+  if (op.as_long == _S(":<").as_long) return TABLE_CMP_LT;
+  else if (op.as_long == _S(":<=").as_long) return TABLE_CMP_LT | TABLE_CMP_EQ;
+  else if (op.as_long == _S(":=").as_long) return TABLE_CMP_EQ;
+  else if (op.as_long == _S(":not=").as_long) return TABLE_CMP_LT | TABLE_CMP_GT | TABLE_CMP_NAN;
+  else if (op.as_long == _S(":>").as_long) return TABLE_CMP_GT;
+  else if (op.as_long == _S(":>=").as_long) return TABLE_CMP_GT | TABLE_CMP_EQ;
+  return 0;
+}
+
+static inline int table_compare_doubles(double a, double b) {
+  if (a < b) return TABLE_CMP_LT;
+  else if (a > b) return TABLE_CMP_GT;
+  else if (a == b) return TABLE_CMP_EQ;
+  else return TABLE_CMP_NAN;
+}
+
+static inline nanoclj_val_t Table_rowCount(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_cell_t * table = to_table(sc, first(sc, args));
+  if (!table) return mk_nil();
+  return mk_long(sc, table_get_row_count(table));
+}
+
+static inline nanoclj_val_t Table_columnNames(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_cell_t * table = to_table(sc, first(sc, args));
+  if (!table) return mk_nil();
+  nanoclj_cell_t * names = mk_vector(sc, get_size(table));
+  if (!names) return mk_nil();
+  for (size_t i = 0; i < get_size(table); i++) {
+    set_indexed_value(names, i, table_get_name(table, i));
+  }
+  return mk_pointer(names);
+}
+
+static inline nanoclj_val_t Table_row(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_cell_t * table = to_table(sc, first(sc, args));
+  if (!table) return mk_nil();
+  long long i = to_long(second(sc, args));
+  if (i < 0 || i >= table_get_row_count(table)) {
+    return nanoclj_throw(sc, mk_index_exception(sc, "Index out of bounds"));
+  }
+  nanoclj_cell_t * row = mk_collection(sc, T_ARRAYMAP, NULL);
+  for (size_t j = 0; row && j < get_size(table); j++) {
+    retain(sc, row);
+    nanoclj_cell_t * col = decode_pointer(table_get_column(table, j));
+    row = assoc(sc, row, table_get_name(table, j), get_indexed_value(col, i));
+  }
+  return row ? mk_pointer(row) : mk_nil();
+}
+
+/* Returns a table with the given columns. The column vectors are shared. */
+static inline nanoclj_val_t Table_project(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_cell_t * table = to_table(sc, first(sc, args));
+  if (!table) return mk_nil();
+  nanoclj_val_t names0 = second(sc, args);
+  nanoclj_cell_t * names = is_cell(names0) ? decode_pointer(names0) : NULL;
+  nanoclj_cell_t * r = mk_table(sc, count(sc, names));
+  if (!r) return mk_nil();
+  retain(sc, r);
+  size_t j = 0;
+  for (nanoclj_cell_t * s = seq(sc, names); s; s = next(sc, s), j++) {
+    retain(sc, s);
+    nanoclj_val_t name = first(sc, s);
+    nanoclj_cell_t * col = table_find_column(sc, table, name);
+    if (!col) return mk_nil();
+    table_set_column(r, j, name, mk_pointer(col));
+  }
+  return mk_pointer(r);
+}
+
+/* Returns the rows where (op column value) is true */
+static inline nanoclj_val_t Table_filter(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_cell_t * table = to_table(sc, first(sc, args));
+  if (!table) return mk_nil();
+  nanoclj_cell_t * col = table_find_column(sc, table, second(sc, args));
+  if (!col) return mk_nil();
+  int accept = table_parse_comparison(third(sc, args));
+  if (!accept) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid comparison")));
+  }
+  nanoclj_val_t value = first(sc, next(sc, next(sc, next(sc, args))));
+  size_t num_rows = table_get_row_count(table), n = 0;
+  size_t * idx = malloc(num_rows * sizeof(size_t));
+  if (!idx) return nanoclj_throw(sc, sc->OutOfMemoryError);
+  const double * data = table_get_doubles(col);
+  const int64_t * longs = table_get_longs(col);
+  if (longs && is_int_type(type(value))) {
+    long long v = to_long(value);
+    for (size_t i = 0; i < num_rows; i++) {
+      if ((longs[i] < v ? TABLE_CMP_LT : longs[i] > v ? TABLE_CMP_GT : TABLE_CMP_EQ) & accept) idx[n++] = i;
+    }
+  } else if (longs && is_number(value)) {
+    double v = to_double(value);
+    for (size_t i = 0; i < num_rows; i++) {
+      if (table_compare_doubles(longs[i], v) & accept) idx[n++] = i;
+    }
+  } else if (data) {
+    double v = to_double(value);
+    for (size_t i = 0; i < num_rows; i++) {
+      if (table_compare_doubles(data[i], v) & accept) idx[n++] = i;
+    }
+  } else if (accept == TABLE_CMP_EQ || accept == (TABLE_CMP_LT | TABLE_CMP_GT | TABLE_CMP_NAN)) {
+    bool eq = accept == TABLE_CMP_EQ;
+    for (size_t i = 0; i < num_rows; i++) {
+      if (equals(sc, get_indexed_value(col, i), value) == eq) idx[n++] = i;
+    }
+  } else {
+    for (size_t i = 0; i < num_rows; i++) {
+      nanoclj_val_t a = get_indexed_value(col, i);
+      int c = equals(sc, a, value) ? 0 : compare(a, value);
+      if ((c < 0 ? TABLE_CMP_LT : c > 0 ? TABLE_CMP_GT : TABLE_CMP_EQ) & accept) idx[n++] = i;
+    }
+  }
+  nanoclj_val_t r = table_gather(sc, table, idx, n);
+  free(idx);
+  return r;
+}
+
+typedef struct {
+  const nanoclj_cell_t * col;
+  const double * data;
+  const int64_t * longs;
+  bool reverse;
+} table_sort_key_t;
+
+static inline int table_compare_rows(const table_sort_key_t * key, size_t a, size_t b) {
+  int r;
+  if (key->longs) {
+    int64_t x = key->longs[a], y = key->longs[b];
+    r = x < y ? -1 : x > y ? 1 : 0;
+  } else if (key->data) {
+    double x = key->data[a], y = key->data[b];
+    /* NaNs are sorted last */
+    r = x < y ? -1 : x > y ? 1 : isnan(x) - isnan(y);
+  } else {
+    r = compare(get_indexed_value(key->col, a), get_indexed_value(key->col, b));
+  }
+  return key->reverse ? -r : r;
+}
+
+/* Stable bottom-up merge sort of row indices. Returns false if out of memory. */
+static inline bool table_sort_indices(const table_sort_key_t * key, size_t * idx, size_t n) {
+  size_t * tmp = malloc(n * sizeof(size_t));
+  if (!tmp) return false;
+  size_t * a = idx, * b = tmp;
+  for (size_t width = 1; width < n; width *= 2) {
+    for (size_t lo = 0; lo < n; lo += 2 * width) {
+      size_t mid = lo + width < n ? lo + width : n;
+      size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+      size_t i = lo, j = mid, k = lo;
+      while (i < mid && j < hi) b[k++] = table_compare_rows(key, a[j], a[i]) < 0 ? a[j++] : a[i++];
+      while (i < mid) b[k++] = a[i++];
+      while (j < hi) b[k++] = a[j++];
+    }
+    size_t * t = a; a = b; b = t;
+  }
+  if (a != idx) memcpy(idx, a, n * sizeof(size_t));
+  free(tmp);
+  return true;
+}
+
+/* Returns the row indices sorted by col, or NULL if out of memory */
+static inline size_t * table_sorted_indices(nanoclj_cell_t * table, nanoclj_cell_t * col, bool reverse) {
+  size_t n = table_get_row_count(table);
+  size_t * idx = malloc(n * sizeof(size_t));
+  if (!idx) return NULL;
+  for (size_t i = 0; i < n; i++) idx[i] = i;
+  table_sort_key_t key = { col, table_get_doubles(col), table_get_longs(col), reverse };
+  if (!table_sort_indices(&key, idx, n)) {
+    free(idx);
+    return NULL;
+  }
+  return idx;
+}
+
+static inline nanoclj_val_t Table_sortBy(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_cell_t * table = to_table(sc, first(sc, args));
+  if (!table) return mk_nil();
+  nanoclj_cell_t * col = table_find_column(sc, table, second(sc, args));
+  if (!col) return mk_nil();
+  bool reverse = is_true(third(sc, args));
+  size_t * idx = table_sorted_indices(table, col, reverse);
+  if (!idx) return nanoclj_throw(sc, sc->OutOfMemoryError);
+  nanoclj_val_t r = table_gather(sc, table, idx, table_get_row_count(table));
+  free(idx);
+  return r;
+}
+
+typedef enum {
+  table_agg_count = 0,
+  table_agg_sum,
+  table_agg_mean,
+  table_agg_min,
+  table_agg_max
+} table_agg_op_t;
+
+typedef struct {
+  nanoclj_val_t name;
+  table_agg_op_t op;
+  const nanoclj_cell_t * col;
+  const double * data;
+  const int64_t * longs;
+} table_agg_t;
+
+/* Parses aggregates given as a map from output names to [op column] */
+static inline table_agg_t * table_parse_aggregates(nanoclj_t * sc, nanoclj_cell_t * table, nanoclj_val_t aggs0, size_t * n) {
+  nanoclj_cell_t * aggs = is_cell(aggs0) ? decode_pointer(aggs0) : NULL;
+  if (!aggs || !is_map_type(_type(aggs))) {
+    nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Aggregates must be a map")));
+    return NULL;
+  }
+  *n = count(sc, aggs);
+  table_agg_t * r = malloc(*n * sizeof(table_agg_t));
+  if (!r) {
+    nanoclj_throw(sc, sc->OutOfMemoryError);
+    return NULL;
+  }
+  size_t i = 0;
+  for (nanoclj_cell_t * s = seq(sc, aggs); s; s = next(sc, s), i++) {
+    retain(sc, s);
+    nanoclj_cell_t * e = decode_pointer(first(sc, s));
+    nanoclj_val_t spec0 = second(sc, e);
+    nanoclj_cell_t * spec = is_cell(spec0) ? decode_pointer(spec0) : NULL;
+    nanoclj_val_t op = first(sc, spec);
+    r[i].name = first(sc, e);
+    if (op.as_long == _S(":count").as_long) r[i].op = table_agg_count;
+    else if (op.as_long == _S(":sum").as_long) r[i].op = table_agg_sum;
+    else if (op.as_long == _S(":mean").as_long) r[i].op = table_agg_mean;
+    else if (op.as_long == _S(":min").as_long) r[i].op = table_agg_min;
+    else if (op.as_long == _S(":max").as_long) r[i].op = table_agg_max;
+    else {
+      free(r);
+      nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Invalid aggregate")));
+      return NULL;
+    }
+    if (r[i].op == table_agg_count) {
+      r[i].col = NULL;
+      r[i].data = NULL;
+      r[i].longs = NULL;
+    } else {
+      nanoclj_cell_t * col = table_find_column(sc, table, second(sc, spec));
+      if (!col) {
+	free(r);
+	return NULL;
+      }
+      r[i].col = col;
+      r[i].data = table_get_doubles(col);
+      r[i].longs = table_get_longs(col);
+    }
+  }
+  return r;
+}
+
+/* Returns true if the aggregate is a long: a count, or a sum, min or max of a long column */
+static inline bool table_is_long_aggregate(const table_agg_t * agg) {
+  return agg->op == table_agg_count || (agg->longs && agg->op != table_agg_mean);
+}
+
+/* Computes a long aggregate over the rows idx (n > 0 for min and max). Returns false if the sum overflows. */
+static inline bool table_compute_long_aggregate(const table_agg_t * agg, const size_t * idx, size_t n, long long * r) {
+  if (agg->op == table_agg_count) {
+    *r = n;
+    return true;
+  }
+  long long acc = agg->op == table_agg_sum ? 0 : agg->longs[idx[0]];
+  for (size_t i = 0; i < n; i++) {
+    long long v = agg->longs[idx[i]];
+    switch (agg->op) {
+    case table_agg_sum: if (__builtin_saddll_overflow(acc, v, &acc)) return false; break;
+    case table_agg_min: if (v < acc) acc = v; break;
+    case table_agg_max: if (v > acc) acc = v; break;
+    default: break;
+    }
+  }
+  *r = acc;
+  return true;
+}
+
+/* Computes an aggregate over the rows idx. Missing values (nil or NaN) are skipped. */
+static inline double table_compute_aggregate(const table_agg_t * agg, const size_t * idx, size_t n) {
+  if (agg->op == table_agg_count) return n;
+  double acc = agg->op == table_agg_min ? INFINITY : agg->op == table_agg_max ? -INFINITY : 0.0;
+  size_t num_values = 0;
+  for (size_t i = 0; i < n; i++) {
+    double v = agg->data ? agg->data[idx[i]] : agg->longs ? agg->longs[idx[i]] : to_double(get_indexed_value(agg->col, idx[i]));
+    if (isnan(v)) continue;
+    num_values++;
+    switch (agg->op) {
+    case table_agg_count: break;
+    case table_agg_sum:
+    case table_agg_mean: acc += v; break;
+    case table_agg_min: if (v < acc) acc = v; break;
+    case table_agg_max: if (v > acc) acc = v; break;
+    }
+  }
+  if (agg->op == table_agg_mean || agg->op == table_agg_min || agg->op == table_agg_max) {
+    if (!num_values) return NAN;
+    if (agg->op == table_agg_mean) acc /= num_values;
+  }
+  return acc;
+}
+
+/* Returns a map of aggregates over all rows */
+static inline nanoclj_val_t Table_aggregate(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_cell_t * table = to_table(sc, first(sc, args));
+  if (!table) return mk_nil();
+  size_t num_aggs;
+  table_agg_t * aggs = table_parse_aggregates(sc, table, second(sc, args), &num_aggs);
+  if (!aggs) return mk_nil();
+  size_t num_rows = table_get_row_count(table);
+  size_t * idx = malloc(num_rows * sizeof(size_t));
+  if (!idx) {
+    free(aggs);
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
+  }
+  for (size_t i = 0; i < num_rows; i++) idx[i] = i;
+  nanoclj_cell_t * r = mk_collection(sc, T_ARRAYMAP, NULL);
+  for (size_t j = 0; r && j < num_aggs; j++) {
+    retain(sc, r);
+    nanoclj_val_t v;
+    if (!table_is_long_aggregate(&aggs[j])) {
+      v = mk_double(table_compute_aggregate(&aggs[j], idx, num_rows));
+    } else if (!num_rows && aggs[j].op != table_agg_count && aggs[j].op != table_agg_sum) {
+      v = mk_nil();
+    } else {
+      long long l;
+      if (!table_compute_long_aggregate(&aggs[j], idx, num_rows, &l)) {
+	r = NULL;
+	nanoclj_throw(sc, mk_arithmetic_exception(sc, "Integer overflow"));
+	break;
+      }
+      v = mk_long(sc, l);
+    }
+    r = assoc(sc, r, aggs[j].name, v);
+  }
+  free(idx);
+  free(aggs);
+  return r ? mk_pointer(r) : mk_nil();
+}
+
+/* Groups the rows by the values of a column and returns a table with the group keys and the aggregates */
+static inline nanoclj_val_t Table_groupBy(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_cell_t * table = to_table(sc, first(sc, args));
+  if (!table) return mk_nil();
+  nanoclj_val_t key_name = second(sc, args);
+  nanoclj_cell_t * key_col = table_find_column(sc, table, key_name);
+  if (!key_col) return mk_nil();
+  size_t num_aggs;
+  table_agg_t * aggs = table_parse_aggregates(sc, table, third(sc, args), &num_aggs);
+  if (!aggs) return mk_nil();
+
+  size_t num_rows = table_get_row_count(table), num_groups = 0;
+  size_t * idx = table_sorted_indices(table, key_col, false);
+  size_t * group_start = malloc((num_rows + 1) * sizeof(size_t));
+  size_t * first_rows = malloc(num_rows * sizeof(size_t));
+  if (!idx || !group_start || !first_rows) {
+    free(first_rows);
+    free(group_start);
+    free(idx);
+    free(aggs);
+    return nanoclj_throw(sc, sc->OutOfMemoryError);
+  }
+  table_sort_key_t key = { key_col, table_get_doubles(key_col), table_get_longs(key_col), false };
+  for (size_t i = 0; i < num_rows; i++) {
+    if (i == 0 || table_compare_rows(&key, idx[i - 1], idx[i]) != 0) {
+      first_rows[num_groups] = idx[i];
+      group_start[num_groups++] = i;
+    }
+  }
+  group_start[num_groups] = num_rows;
+
+  nanoclj_cell_t * r = mk_table(sc, 1 + num_aggs);
+  if (r) {
+    retain(sc, r);
+    nanoclj_val_t keys = table_gather_column(sc, key_col, first_rows, num_groups);
+    if (is_nil(keys)) r = NULL;
+    else table_set_column(r, 0, key_name, keys);
+  }
+  /* Counts and the sums, minimums and maximums of long columns are stored as longs */
+  for (size_t j = 0; r && j < num_aggs; j++) {
+    bool is_long = table_is_long_aggregate(&aggs[j]);
+    nanoclj_tensor_t * tensor = mk_tensor_1d(is_long ? nanoclj_i64 : nanoclj_f64, num_groups);
+    if (!tensor) {
+      r = NULL;
+      nanoclj_throw(sc, sc->OutOfMemoryError);
+      break;
+    }
+    for (size_t g = 0; g < num_groups; g++) {
+      const size_t * rows = idx + group_start[g];
+      size_t n = group_start[g + 1] - group_start[g];
+      if (!is_long) {
+	tensor_mutate_set_f64(tensor, g, table_compute_aggregate(&aggs[j], rows, n));
+      } else {
+	long long v;
+	if (!table_compute_long_aggregate(&aggs[j], rows, n, &v)) {
+	  tensor_free(tensor);
+	  r = NULL;
+	  nanoclj_throw(sc, mk_arithmetic_exception(sc, "Integer overflow"));
+	  break;
+	}
+	tensor_mutate_set_i64(tensor, g, v);
+      }
+    }
+    if (r) table_set_column(r, 1 + j, aggs[j].name, mk_vector_with_tensor(sc, tensor));
+  }
+  free(first_rows);
+  free(group_start);
+  free(idx);
+  free(aggs);
+  return r ? mk_pointer(r) : mk_nil();
+}
+
+/* Loads a table from CSV data */
+static inline nanoclj_val_t Table_load(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return read_csv_columns(sc, args, true);
+}
+
+/* Tensor */
+
+static inline nanoclj_val_t tensor_unary_func(nanoclj_t * sc, nanoclj_cell_t * args, nanoclj_unary_op_t op) {
+  nanoclj_cell_t * r = numeric_array_unary(sc, op, first(sc, args));
+  return r ? mk_pointer(r) : mk_nil();
+}
+
+static inline nanoclj_val_t tensor_binary_func(nanoclj_t * sc, nanoclj_cell_t * args, nanoclj_binary_op_t op) {
+  nanoclj_cell_t * r = numeric_array_binary(sc, op, first(sc, args), second(sc, args));
+  return r ? mk_pointer(r) : mk_nil();
+}
+
+static inline nanoclj_val_t Tensor_isNumeric(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return mk_boolean(get_numeric_tensor(first(sc, args)) != NULL);
+}
+
+static inline nanoclj_val_t tensor_reduce_func(nanoclj_t * sc, nanoclj_cell_t * args, nanoclj_reduce_op_t op) {
+  nanoclj_cell_t * rest = next(sc, args);
+  return numeric_array_reduce(sc, op, first(sc, args), rest ? first(sc, rest) : mk_nil());
+}
+
+static inline nanoclj_val_t Tensor_sum(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_sum);
+}
+
+static inline nanoclj_val_t Tensor_mean(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_mean);
+}
+
+static inline nanoclj_val_t Tensor_amin(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_min);
+}
+
+static inline nanoclj_val_t Tensor_amax(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_max);
+}
+
+static inline nanoclj_val_t Tensor_argmin(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_argmin);
+}
+
+static inline nanoclj_val_t Tensor_argmax(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_argmax);
+}
+
+static inline nanoclj_val_t Tensor_variance(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_var);
+}
+
+static inline nanoclj_val_t Tensor_std(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_std);
+}
+
+static inline nanoclj_val_t Tensor_norm(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_reduce_func(sc, args, nanoclj_reduce_norm);
+}
+
+static inline nanoclj_val_t Tensor_shape(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_shape(sc, first(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_reshape(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_reshape(sc, first(sc, args), second(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_matmul(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_matmul(sc, first(sc, args), second(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_transpose(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_transpose(sc, first(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_slice(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_slice(sc, first(sc, args), next(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_contiguous(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_contiguous(sc, first(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_isContiguous(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return mk_boolean(numeric_array_is_contiguous(first(sc, args)));
+}
+
+static inline nanoclj_val_t Tensor_fuse(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_fuse(sc, first(sc, args), second(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_load(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_val_t filename0 = first(sc, args);
+  if (!is_string(filename0)) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not a string")));
+  }
+  char * filename = alloc_c_str(to_strview(filename0));
+  FILE * f = fopen(filename, "rb");
+  free(filename);
+  if (!f) {
+    throw_file_exception(sc);
+    return mk_nil();
+  }
+  nanoclj_tensor_t * tensor = NULL;
+  npy_status_t s = npy_load(f, &tensor);
+  fclose(f);
+  if (s == npy_error_io) {
+    throw_file_exception(sc);
+    return mk_nil();
+  } else if (s != npy_ok) {
+    return nanoclj_throw(sc, mk_exception(sc, sc->IOException, npy_status_message(s)));
+  }
+  nanoclj_cell_t * c = mk_numeric_array_result(sc, true, tensor);
+  return c ? mk_pointer(c) : mk_nil();
+}
+
+static inline nanoclj_val_t Tensor_save(nanoclj_t * sc, nanoclj_cell_t * args) {
+  nanoclj_val_t x = first(sc, args), filename0 = second(sc, args);
+  if (!get_numeric_tensor(x)) {
+    return nanoclj_throw(sc, mk_class_cast_exception(sc, "Argument cannot be cast to nanoclj.lang.Tensor"));
+  } else if (!is_string(filename0)) {
+    return nanoclj_throw(sc, mk_illegal_arg_exception(sc, mk_string(sc, "Not a string")));
+  }
+  char * filename = alloc_c_str(to_strview(filename0));
+  FILE * f = fopen(filename, "wb");
+  free(filename);
+  if (!f) {
+    throw_file_exception(sc);
+    return mk_nil();
+  }
+  tensorview_t tv = to_numeric_tensorview(x);
+  npy_status_t s = npy_save(f, &tv);
+  if (fclose(f) != 0 && s == npy_ok) s = npy_error_io;
+  if (s == npy_error_io) {
+    throw_file_exception(sc);
+  } else if (s != npy_ok) {
+    nanoclj_throw(sc, mk_exception(sc, sc->IOException, npy_status_message(s)));
+  }
+  return mk_nil();
+}
+
+static inline nanoclj_val_t Tensor_lu(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_lu(sc, first(sc, args), false);
+}
+
+static inline nanoclj_val_t Tensor_det(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_lu(sc, first(sc, args), true);
+}
+
+static inline nanoclj_val_t Tensor_solve(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_solve(sc, first(sc, args), second(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_cholesky(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return numeric_array_cholesky(sc, first(sc, args));
+}
+
+static inline nanoclj_val_t Tensor_abs(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_abs);
+}
+
+static inline nanoclj_val_t Tensor_sqrt(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_sqrt);
+}
+
+static inline nanoclj_val_t Tensor_exp(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_exp);
+}
+
+static inline nanoclj_val_t Tensor_log(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_log);
+}
+
+static inline nanoclj_val_t Tensor_sin(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_sin);
+}
+
+static inline nanoclj_val_t Tensor_cos(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_cos);
+}
+
+static inline nanoclj_val_t Tensor_tanh(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_tanh);
+}
+
+static inline nanoclj_val_t Tensor_floor(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_floor);
+}
+
+static inline nanoclj_val_t Tensor_ceil(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_ceil);
+}
+
+static inline nanoclj_val_t Tensor_round(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_unary_func(sc, args, nanoclj_unop_round);
+}
+
+static inline nanoclj_val_t Tensor_min(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_binary_func(sc, args, nanoclj_binop_min);
+}
+
+static inline nanoclj_val_t Tensor_max(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_binary_func(sc, args, nanoclj_binop_max);
+}
+
+static inline nanoclj_val_t Tensor_lt(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_binary_func(sc, args, nanoclj_binop_lt);
+}
+
+static inline nanoclj_val_t Tensor_le(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_binary_func(sc, args, nanoclj_binop_le);
+}
+
+static inline nanoclj_val_t Tensor_gt(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_binary_func(sc, args, nanoclj_binop_gt);
+}
+
+static inline nanoclj_val_t Tensor_ge(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_binary_func(sc, args, nanoclj_binop_ge);
+}
+
+static inline nanoclj_val_t Tensor_eq(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_binary_func(sc, args, nanoclj_binop_eq);
+}
+
+static inline nanoclj_val_t Tensor_ne(nanoclj_t * sc, nanoclj_cell_t * args) {
+  return tensor_binary_func(sc, args, nanoclj_binop_ne);
+}
+
 #if NANOCLJ_USE_LINENOISE
 static nanoclj_t * linenoise_sc = NULL;
 
@@ -1377,22 +2578,88 @@ static inline void register_functions(nanoclj_t * sc) {
 
   intern_foreign_func(sc, browse, "browse-url", browse_url, 1, 1);
 
-  intern_foreign_func(sc, sc->Image, "load", Image_load, 1, 1);
+  intern_foreign_func(sc, sc->Image, "load", Image_load, 1, 2);
   intern_foreign_func(sc, sc->Image, "resize", Image_resize, 3, 3);
+  intern_foreign_func(sc, sc->Image, "pyramid", Image_pyramid, 1, 1);
+  intern_foreign_func(sc, sc->Image, "thumbnail", Image_thumbnail, 2, 2);
   intern_foreign_func(sc, sc->Image, "transpose", Image_transpose, 1, 1);
-  intern_foreign_func(sc, sc->Image, "save", Image_save, 2, 2);
+  intern_foreign_func(sc, sc->Image, "rotate", Image_rotate, 2, 2);
+  intern_foreign_func(sc, sc->Image, "flipHorizontal", Image_flipHorizontal, 1, 1);
+  intern_foreign_func(sc, sc->Image, "flipVertical", Image_flipVertical, 1, 1);
+  intern_foreign_func(sc, sc->Image, "save", Image_save, 2, 3);
   intern_foreign_func(sc, sc->Image, "horizontalGaussianBlur", Image_horizontalGaussianBlur, 2, 2);
+  intern_foreign_func(sc, sc->Image, "gaussianBlur", Image_gaussianBlur, 2, 2);
 
   intern_foreign_func(sc, sc->Audio, "load", Audio_load, 1, 1);
   intern_foreign_func(sc, sc->Audio, "lowpass", Audio_lowpass, 1, 1);
 
   intern_foreign_func(sc, Geo, "load", Geo_load, 1, 1);
 
-  intern_foreign_func(sc, sc->Graph, "updateLayout", Graph_updateLayout, 1, 1);
+  intern_foreign_func(sc, sc->Graph, "updateLayout", Graph_updateLayout, 1, 2);
   intern_foreign_func(sc, sc->Graph, "load", Graph_load, 1, 1);
+  intern_foreign_func(sc, sc->Graph, "bfs", Graph_bfs, 2, 3);
+  intern_foreign_func(sc, sc->Graph, "dfs", Graph_dfs, 2, 3);
+  intern_foreign_func(sc, sc->Graph, "connectedComponents", Graph_connectedComponents, 1, 1);
+  intern_foreign_func(sc, sc->Graph, "shortestPaths", Graph_shortestPaths, 2, 3);
+  intern_foreign_func(sc, sc->Graph, "pageRank", Graph_pageRank, 1, 2);
+  intern_foreign_func(sc, sc->Graph, "degreeStats", Graph_degreeStats, 1, 1);
+
+  intern_foreign_func(sc, sc->Table, "load", Table_load, 1, -1);
+  intern_foreign_func(sc, sc->Table, "rowCount", Table_rowCount, 1, 1);
+  intern_foreign_func(sc, sc->Table, "columnNames", Table_columnNames, 1, 1);
+  intern_foreign_func(sc, sc->Table, "row", Table_row, 2, 2);
+  intern_foreign_func(sc, sc->Table, "project", Table_project, 2, 2);
+  intern_foreign_func(sc, sc->Table, "filter", Table_filter, 4, 4);
+  intern_foreign_func(sc, sc->Table, "sortBy", Table_sortBy, 2, 3);
+  intern_foreign_func(sc, sc->Table, "groupBy", Table_groupBy, 3, 3);
+  intern_foreign_func(sc, sc->Table, "aggregate", Table_aggregate, 2, 2);
+
+  intern_foreign_func(sc, sc->Tensor, "abs", Tensor_abs, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "sqrt", Tensor_sqrt, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "exp", Tensor_exp, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "log", Tensor_log, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "sin", Tensor_sin, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "cos", Tensor_cos, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "tanh", Tensor_tanh, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "floor", Tensor_floor, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "ceil", Tensor_ceil, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "round", Tensor_round, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "min", Tensor_min, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "max", Tensor_max, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "lt", Tensor_lt, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "le", Tensor_le, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "gt", Tensor_gt, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "ge", Tensor_ge, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "eq", Tensor_eq, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "ne", Tensor_ne, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "isNumeric", Tensor_isNumeric, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "sum", Tensor_sum, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "mean", Tensor_mean, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "amin", Tensor_amin, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "amax", Tensor_amax, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "argmin", Tensor_argmin, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "argmax", Tensor_argmax, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "variance", Tensor_variance, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "std", Tensor_std, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "norm", Tensor_norm, 1, 2);
+  intern_foreign_func(sc, sc->Tensor, "shape", Tensor_shape, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "reshape", Tensor_reshape, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "matmul", Tensor_matmul, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "transpose", Tensor_transpose, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "slice", Tensor_slice, 1, -1);
+  intern_foreign_func(sc, sc->Tensor, "contiguous", Tensor_contiguous, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "isContiguous", Tensor_isContiguous, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "fuse", Tensor_fuse, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "lu", Tensor_lu, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "det", Tensor_det, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "solve", Tensor_solve, 2, 2);
+  intern_foreign_func(sc, sc->Tensor, "cholesky", Tensor_cholesky, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "load", Tensor_load, 1, 1);
+  intern_foreign_func(sc, sc->Tensor, "save", Tensor_save, 2, 2);
 
   intern_foreign_func(sc, xml, "parse", clojure_xml_parse, 1, 1);
   intern_foreign_func(sc, csv, "read-csv", clojure_data_csv_read_csv, 1, 1);
+  intern_foreign_func(sc, csv, "read-columns", clojure_data_csv_read_columns, 1, -1);
 
 #if NANOCLJ_USE_LINENOISE
   nanoclj_cell_t * linenoise = def_namespace(sc, "linenoise", __FILE__);
@@ -17,13 +17,13 @@ E2:_setmark(p);
   switch (_type(p)) {
   case T_FOREIGN_FUNCTION:{
     nanoclj_cell_t * meta = _ff_metadata(p);
-    if (meta) mark(meta);
+    if (meta && !_is_mark(meta)) mark(meta);
     break;
   }
   case T_IMAGE:
     {
       nanoclj_cell_t * meta = p->_image.meta;
-      if (meta) mark(meta);
+      if (meta && !_is_mark(meta)) mark(meta);
     }
     break;
   case T_VAR:
@@ -33,16 +33,18 @@ E2:_setmark(p);
   case T_HASHMAP:
   case T_QUEUE:
   case T_MAPENTRY:
+  case T_TABLE:
     if (_is_small(p)) {
       size_t s = _sodim0_unchecked(p) * _sodim1_unchecked(p);
       nanoclj_val_t * data = _smalldata_unchecked(p);
       for (int64_t i = 0; i < s; i++) {
 	nanoclj_val_t v = data[i];
-	if (is_cell(v)) mark(decode_pointer(v));
+	if (is_cell(v) && !is_mark(v)) mark(decode_pointer(v));
       }
     } else {
       nanoclj_tensor_t * tensor = p->_collection.tensor;
-      size_t num = _size_unchecked(p);
+      /* Typed vectors (e.g. vector-of :double) contain no references */
+      size_t num = tensor->type == nanoclj_val ? _size_unchecked(p) : 0;
       if (tensor_is_sparse(tensor)) {
 	int64_t num_buckets = tensor_hash_get_bucket_count(tensor);
 	for (int64_t offset = 0; offset < num_buckets; offset++) {
@@ -50,11 +52,11 @@ E2:_setmark(p);
 	  if (idx >= 0 && idx < num) {
 	    if (tensor->n_dims == 1) {
 	      nanoclj_val_t v = tensor_get(tensor, offset);
-	      if (is_cell(v)) mark(decode_pointer(v));
+	      if (is_cell(v) && !is_mark(v)) mark(decode_pointer(v));
 	    } else {
 	      for (int64_t i = 0; i < tensor->ne[0]; i++) {
 		nanoclj_val_t v = tensor_get_2d(tensor, i, offset);
-		if (is_cell(v)) mark(decode_pointer(v));
+		if (is_cell(v) && !is_mark(v)) mark(decode_pointer(v));
 	      }
 	    }
 	  }
@@ -65,17 +67,17 @@ E2:_setmark(p);
 	for (size_t i = 0; i < num; i++) {
 	  if (tensor->n_dims == 1) {
 	    nanoclj_val_t v = data[offset + i];
-	    if (is_cell(v)) mark(decode_pointer(v));
+	    if (is_cell(v) && !is_mark(v)) mark(decode_pointer(v));
 	  } else {
 	    for (int64_t j = 0; j < tensor->ne[0]; j++) {
 	      nanoclj_val_t v = tensor_get_2d(tensor, j, i);
-	      if (is_cell(v)) mark(decode_pointer(v));
+	      if (is_cell(v) && !is_mark(v)) mark(decode_pointer(v));
 	    }
 	  }
 	}
       }
 
-      if (p->_collection.meta) mark(p->_collection.meta);
+      if (p->_collection.meta && !_is_mark(p->_collection.meta)) mark(p->_collection.meta);
     }
     break;
 
@@ -85,7 +87,11 @@ E2:_setmark(p);
       nanoclj_graph_array_t * g = _graph_unchecked(p);
       for (size_t i = 0; i < num; i++) {
 	nanoclj_val_t v = g->nodes[i].data;
-	if (is_cell(v)) mark(decode_pointer(v));
+	if (is_cell(v) && !is_mark(v)) mark(decode_pointer(v));
+      }
+      for (size_t i = 0; i < g->num_edges; i++) {
+	nanoclj_val_t v = g->edges[i].data;
+	if (is_cell(v) && !is_mark(v)) mark(decode_pointer(v));
       }
     }
     break;
@@ -97,10 +103,10 @@ E2:_setmark(p);
   /* mark cons cell meta here (not an atom) */
   if (_type(p) == T_LISTMAP) {
     nanoclj_val_t value = p->_cons.value;
-    if (is_cell(value)) mark(decode_pointer(value));
+    if (is_cell(value) && !is_mark(value)) mark(decode_pointer(value));
   } else {
     nanoclj_cell_t * meta = _cons_metadata(p);
-    if (meta) mark(meta);
+    if (meta && !_is_mark(meta)) mark(meta);
   }
   
   /* E4: down car */
@@ -174,6 +180,8 @@ static void mark_thread(nanoclj_t * sc) {
   if (sc->pending_exception) mark(sc->pending_exception);
 
   mark(sc->EMPTYVEC);
+  if (sc->EMPTYMAP) mark(sc->EMPTYMAP);
+  if (sc->EMPTYSET) mark(sc->EMPTYSET);
   
   /* Mark recent objects the interpreter doesn't know about yet. */
   mark_value(_car(&(sc->sink)));
@@ -1,97 +1,612 @@
 #ifndef _NANOCLJ_GRAPH_H_
 #define _NANOCLJ_GRAPH_H_
 
+#include "nanoclj_threads.h"
+
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
 
 #define EPSILON 0.00000001
 
-// Gauss-Seidel relaxation for links
-static inline void relax_links(nanoclj_cell_t * g, float alpha) {
-  size_t num_nodes = g->_graph.num_nodes;
-  size_t num_edges = g->_graph.num_edges;
-  nanoclj_graph_array_t * ga = g->_graph.rep;
-  
-  for (size_t i = 0; i < num_edges; i++) {
-    nanoclj_edge_t * e = &(ga->edges[g->_graph.edge_offset + i]);
-    int tail = e->source, head = e->target;
-    if (tail == head) continue;
-    if (tail < g->_graph.node_offset || tail >= g->_graph.node_offset + g->_graph.num_nodes) continue;
-    if (head < g->_graph.node_offset || head >= g->_graph.node_offset + g->_graph.num_nodes) continue;
-    
+/* Barnes-Hut quadtree for the repulsion. Each leaf holds one node, or a list of nodes if they are
+ * at the same position or the maximum depth is reached. Cells that are small compared to their
+ * distance, as given by theta, are approximated by their center of mass, unless they contain
+ * the node whose force is computed. */
+
+#define GRAPH_QUADTREE_MAX_DEPTH 32
+/* Squared distances are clamped to this value to avoid infinite forces */
+#define GRAPH_MIN_DISTANCE2 0.1f
+
+typedef struct {
+  float cx, cy, mass;		/* center of mass and the number of nodes */
+  float x, y, half;		/* center and half size of the square */
+  int32_t child[4];		/* 0 if there is no child, since the root is never a child */
+  int32_t first;		/* the first node of a leaf, or -1 */
+} graph_quad_t;
+
+typedef struct {
+  graph_quad_t * quads;
+  int32_t * next;		/* the next node in the same leaf, or -1 */
+  size_t num_quads, reserved_quads;
+} graph_quadtree_t;
+
+/* Adds a quad and returns its index, or -1 if out of memory */
+static inline int32_t graph_quadtree_add(graph_quadtree_t * t, float x, float y, float half) {
+  if (t->num_quads >= t->reserved_quads) {
+    size_t reserved = (t->reserved_quads + 1) * 2;
+    graph_quad_t * quads = realloc(t->quads, reserved * sizeof(graph_quad_t));
+    if (!quads) return -1;
+    t->quads = quads;
+    t->reserved_quads = reserved;
+  }
+  graph_quad_t * q = &(t->quads[t->num_quads]);
+  *q = (graph_quad_t){ 0, 0, 0, x, y, half, { 0, 0, 0, 0 }, -1 };
+  return t->num_quads++;
+}
+
+static inline int graph_quadrant(const graph_quad_t * q, float x, float y) {
+  return (x >= q->x ? 1 : 0) + (y >= q->y ? 2 : 0);
+}
+
+/* Returns the child of quad in the given quadrant, creating it if needed, or -1 if out of memory */
+static inline int32_t graph_quadtree_child(graph_quadtree_t * t, int32_t quad, int quadrant) {
+  int32_t c = t->quads[quad].child[quadrant];
+  if (!c) {
+    graph_quad_t * q = &(t->quads[quad]);
+    float h = q->half / 2;
+    c = graph_quadtree_add(t, q->x + (quadrant & 1 ? h : -h), q->y + (quadrant & 2 ? h : -h), h);
+    if (c < 0) return -1;
+    t->quads[quad].child[quadrant] = c;
+  }
+  return c;
+}
+
+static inline bool graph_quadtree_insert(graph_quadtree_t * t, const float * x, const float * y, int32_t i) {
+  int32_t quad = 0;
+  for (int depth = 0; ; depth++) {
+    graph_quad_t * q = &(t->quads[quad]);
+    bool is_leaf = !q->child[0] && !q->child[1] && !q->child[2] && !q->child[3];
+    if (is_leaf && q->first == -1) {
+      q->first = i;
+      t->next[i] = -1;
+      return true;
+    } else if (is_leaf) {
+      int32_t first = q->first;
+      if (depth >= GRAPH_QUADTREE_MAX_DEPTH || (x[first] == x[i] && y[first] == y[i])) {
+	t->next[i] = t->next[first];
+	t->next[first] = i;
+	return true;
+      }
+      /* Split the leaf by moving its nodes to a child */
+      int32_t c = graph_quadtree_child(t, quad, graph_quadrant(q, x[first], y[first]));
+      if (c < 0) return false;
+      t->quads[quad].first = -1;
+      t->quads[c].first = first;
+    }
+    quad = graph_quadtree_child(t, quad, graph_quadrant(&(t->quads[quad]), x[i], y[i]));
+    if (quad < 0) return false;
+  }
+}
+
+/* Computes the centers of mass of quad and its children */
+static inline void graph_quadtree_sum(graph_quadtree_t * t, const float * x, const float * y, int32_t quad) {
+  float cx = 0, cy = 0, mass = 0;
+  for (int32_t i = t->quads[quad].first; i != -1; i = t->next[i]) {
+    cx += x[i];
+    cy += y[i];
+    mass += 1;
+  }
+  for (int k = 0; k < 4; k++) {
+    int32_t c = t->quads[quad].child[k];
+    if (c) {
+      graph_quadtree_sum(t, x, y, c);
+      graph_quad_t * cq = &(t->quads[c]);
+      cx += cq->cx * cq->mass;
+      cy += cq->cy * cq->mass;
+      mass += cq->mass;
+    }
+  }
+  graph_quad_t * q = &(t->quads[quad]);
+  q->mass = mass;
+  q->cx = mass > 0 ? cx / mass : q->x;
+  q->cy = mass > 0 ? cy / mass : q->y;
+}
+
+/* Builds the tree of the nodes. Returns false if out of memory. */
+static inline bool graph_quadtree_build(graph_quadtree_t * t, const float * x, const float * y, size_t num_nodes) {
+  float x0 = num_nodes ? x[0] : 0, y0 = num_nodes ? y[0] : 0, x1 = x0, y1 = y0;
+  for (size_t i = 1; i < num_nodes; i++) {
+    x0 = fminf(x0, x[i]);
+    x1 = fmaxf(x1, x[i]);
+    y0 = fminf(y0, y[i]);
+    y1 = fmaxf(y1, y[i]);
+  }
+  float half = fmaxf(x1 - x0, y1 - y0) / 2 + 1.0f;
+  t->num_quads = 0;
+  int32_t * next = realloc(t->next, (num_nodes ? num_nodes : 1) * sizeof(int32_t));
+  if (!next) return false;
+  t->next = next;
+  if (graph_quadtree_add(t, (x0 + x1) / 2, (y0 + y1) / 2, half) < 0) return false;
+  for (size_t i = 0; i < num_nodes; i++) {
+    if (!graph_quadtree_insert(t, x, y, i)) return false;
+  }
+  graph_quadtree_sum(t, x, y, 0);
+  return true;
+}
+
+static inline void graph_quadtree_free(graph_quadtree_t * t) {
+  free(t->quads);
+  free(t->next);
+}
+
+/* Returns the sum of (q - p) / |q - p|^2 over the nodes q other than i */
+static inline nanoclj_vec2f graph_quadtree_repulsion(const graph_quadtree_t * t, const float * x, const float * y, int32_t i, float theta2) {
+  nanoclj_vec2f p = { x[i], y[i] }, f = { 0, 0 };
+  int32_t stack[4 * GRAPH_QUADTREE_MAX_DEPTH + 4];
+  int n = 0;
+  stack[n++] = 0;
+  while (n > 0) {
+    const graph_quad_t * q = &(t->quads[stack[--n]]);
+    if (q->mass == 0) continue;
+    float dx = q->cx - p.x, dy = q->cy - p.y, d2 = dx * dx + dy * dy;
+    float size = 2 * q->half;
+    bool inside = fabsf(p.x - q->x) <= q->half && fabsf(p.y - q->y) <= q->half;
+    if (q->first == -1 && !inside && size * size < theta2 * d2) {
+      if (d2 < GRAPH_MIN_DISTANCE2) d2 = GRAPH_MIN_DISTANCE2;
+      f.x += dx * q->mass / d2;
+      f.y += dy * q->mass / d2;
+      continue;
+    }
+    for (int32_t j = q->first; j != -1; j = t->next[j]) {
+      if (j == i) continue;
+      float ex = x[j] - p.x, ey = y[j] - p.y, e2 = ex * ex + ey * ey;
+      if (e2 < GRAPH_MIN_DISTANCE2) e2 = GRAPH_MIN_DISTANCE2;
+      f.x += ex / e2;
+      f.y += ey / e2;
+    }
+    for (int k = 0; k < 4; k++) {
+      if (q->child[k]) stack[n++] = q->child[k];
+    }
+  }
+  return f;
+}
+
+typedef struct {
+  int iterations;
+  float alpha, alpha_decay, gravity, friction, charge, theta;
+} graph_layout_params_t;
+
+static inline graph_layout_params_t graph_layout_default_params() {
+  return (graph_layout_params_t){ 1000, 0.1f, 0.0f, 0.075f, 0.9f, -35.0f, 0.8f };
+}
+
+/* The layout keeps the positions of the nodes in separate arrays, and each iteration is split into
+ * passes over ranges of edges or nodes that run in parallel. The link displacements are accumulated
+ * in per-thread arrays and summed for each node, so that no two threads write the same node. */
+
+/* Minimum number of nodes per thread for the repulsion, and of nodes or edges for the other passes */
+#define GRAPH_PARALLEL_MIN_NODES 256
+#define GRAPH_PARALLEL_MIN_ITEMS 16384
+
+typedef enum {
+  graph_pass_links = 0,
+  graph_pass_nodes,
+  graph_pass_repulsion,
+  graph_pass_drag
+} graph_pass_t;
+
+typedef struct {
+  graph_pass_t pass;
+  float * x, * y, * px, * py;	/* positions and previous positions */
+  const nanoclj_edge_t * edges;
+  uint32_t node_offset;
+  size_t num_nodes;
+  float * acc;			/* dx, dy and the number of links of each node, for each thread */
+  int num_acc;
+  const graph_quadtree_t * tree;
+  float alpha, gravity, charge, theta2, friction;
+  size_t i0, i1;		/* range of edges or nodes */
+} graph_layout_task_t;
+
+static inline void graph_relax_links(const graph_layout_task_t * t) {
+  size_t n = t->num_nodes;
+  const float * restrict x = t->x, * restrict y = t->y;
+  float * restrict ax = t->acc, * restrict ay = ax + n, * restrict count = ay + n;
+  for (size_t i = t->i0; i < t->i1; i++) {
+    uint32_t tail = t->edges[i].source - t->node_offset, head = t->edges[i].target - t->node_offset;
+    if (tail == head || tail >= n || head >= n) continue;
+
     float edge_weight = 1, w1 = 1, w2 = 1;
-    
-    nanoclj_node_t * n1 = &(ga->nodes[tail]), * n2 = &(ga->nodes[head]);
-    nanoclj_vec2f d = n2->pos;
-    d.x -= n1->pos.x;
-    d.y -= n1->pos.y;
-    float l = sqrtf(d.x*d.x + d.y*d.y);
-    
-    if (l < EPSILON) continue;
-
-    d.x /= l;
-    d.y /= l;
-    
-    l *= alpha * edge_weight;
+
+    float dx = x[head] - x[tail], dy = y[head] - y[tail];
+    if (dx * dx + dy * dy < EPSILON * EPSILON) continue;
+    dx *= t->alpha * edge_weight;
+    dy *= t->alpha * edge_weight;
 
     float k = w1 / (w1 + w2);
-    n2->pos.x -= d.x * l * k;
-    n2->pos.y -= d.y * l * k;
-    n1->pos.x += d.x * l * (1 - k);
-    n1->pos.y += d.y * l * (1 - k);
+    ax[head] -= dx * k;
+    ay[head] -= dy * k;
+    ax[tail] += dx * (1 - k);
+    ay[tail] += dy * (1 - k);
+    count[head]++;
+    count[tail]++;
   }
 }
 
-static inline void apply_drag(nanoclj_cell_t * g, float friction) {
-  nanoclj_graph_array_t * ga = g->_graph.rep;
-  for (int i = 0; i < g->_graph.num_nodes; i++) {
-    nanoclj_node_t * n = &(ga->nodes[g->_graph.node_offset + i]);
-    nanoclj_vec2f pos = n->pos;
-    pos.x -= friction * (n->ppos.x - pos.x);
-    pos.y -= friction * (n->ppos.y - pos.y);
-    n->ppos = n->pos;
-    n->pos = pos;
+/* Sums the link displacements of all threads, moves the nodes and applies the gravity */
+static inline void graph_move_nodes(const graph_layout_task_t * t) {
+  size_t n = t->num_nodes, i0 = t->i0, i1 = t->i1;
+  float * restrict x = t->x, * restrict y = t->y;
+  float * restrict ax = t->acc, * restrict ay = ax + n, * restrict count = ay + n;
+  for (int j = 1; j < t->num_acc; j++) {
+    float * restrict bx = t->acc + 3 * n * j, * restrict by = bx + n, * restrict bcount = by + n;
+    for (size_t i = i0; i < i1; i++) {
+      ax[i] += bx[i];
+      ay[i] += by[i];
+      count[i] += bcount[i];
+      bx[i] = by[i] = bcount[i] = 0;
+    }
+  }
+  /* A node with c links is moved as far as c successive links toward the same point would move it */
+  float a = t->alpha * 0.5f;
+  for (size_t i = i0; i < i1; i++) {
+    float c = count[i], s = c > 1 && a > EPSILON ? (1 - powf(1 - a, c)) / (a * c) : 1;
+    x[i] += ax[i] * s;
+    y[i] += ay[i] * s;
+    ax[i] = ay[i] = count[i] = 0;
+  }
+  float k = t->alpha * t->gravity;
+  if (k < EPSILON) return;
+  for (size_t i = i0; i < i1; i++) {
+    float weight = 1.0f;
+    float d2 = x[i] * x[i] + y[i] * y[i];
+    // pd.position -= pos * (k * sqrtf(d) / d * weight);
+    float s = d2 > 0.001f * 0.001f ? k * weight : 0;
+    x[i] -= x[i] * s;
+    y[i] -= y[i] * s;
   }
 }
 
-static inline void apply_gravity(nanoclj_cell_t * g, float alpha, float gravity) {
-  float k = alpha * gravity;
-  if (k < EPSILON) return;
+static inline void graph_apply_repulsion(const graph_layout_task_t * t) {
+  float k = t->alpha * t->charge;
+  for (size_t i = t->i0; i < t->i1; i++) {
+    nanoclj_vec2f f = graph_quadtree_repulsion(t->tree, t->x, t->y, i, t->theta2);
+    t->px[i] -= f.x * k;
+    t->py[i] -= f.y * k;
+  }
+}
+
+static inline void graph_apply_drag(const graph_layout_task_t * t) {
+  float * restrict x = t->x, * restrict y = t->y, * restrict px = t->px, * restrict py = t->py;
+  float friction = t->friction;
+  for (size_t i = t->i0; i < t->i1; i++) {
+    float nx = x[i] - friction * (px[i] - x[i]), ny = y[i] - friction * (py[i] - y[i]);
+    px[i] = x[i];
+    py[i] = y[i];
+    x[i] = nx;
+    y[i] = ny;
+  }
+}
+
+static inline NANOCLJ_THREAD_SIG graph_layout_main(void * arg) {
+  graph_layout_task_t * t = arg;
+  switch (t->pass) {
+  case graph_pass_links: graph_relax_links(t); break;
+  case graph_pass_nodes: graph_move_nodes(t); break;
+  case graph_pass_repulsion: graph_apply_repulsion(t); break;
+  case graph_pass_drag: graph_apply_drag(t); break;
+  }
+  return 0;
+}
+
+/* Runs a pass over n items with at most n_threads threads that have at least min_items items each */
+static inline void graph_layout_run(graph_layout_task_t * tasks, const graph_layout_task_t * proto, graph_pass_t pass,
+				    size_t n, size_t min_items, int n_threads) {
+  if (n_threads > n / min_items) n_threads = n / min_items;
+  if (n_threads < 1) n_threads = 1;
+  for (int i = 0; i < n_threads; i++) {
+    tasks[i] = *proto;
+    tasks[i].pass = pass;
+    tasks[i].i0 = n * i / n_threads;
+    tasks[i].i1 = n * (i + 1) / n_threads;
+    if (pass == graph_pass_links) tasks[i].acc = proto->acc + 3 * proto->num_nodes * i;
+  }
+  if (n_threads == 1) {
+    graph_layout_main(tasks);
+  } else {
+    nanoclj_run_parallel(graph_layout_main, tasks, sizeof(graph_layout_task_t), n_threads);
+  }
+}
+
+/* Runs the force-directed layout. Alpha is multiplied by 1 - alpha_decay after each iteration.
+ * Returns false if out of memory. */
+static inline bool update_layout(nanoclj_cell_t * g, graph_layout_params_t params, int n_threads) {
   nanoclj_graph_array_t * ga = g->_graph.rep;
-  for (int i = 0; i < g->_graph.num_nodes; i++) {
-    nanoclj_node_t * n = &(ga->nodes[g->_graph.node_offset + i]);
-    float weight = 1.0f;
-    nanoclj_vec2f pos = n->pos;
-    float d = sqrtf(pos.x * pos.x + pos.y * pos.y);
-    if (d > 0.001) {
-      // pd.position -= pos * (k * sqrtf(d) / d * weight);
-      n->pos.x -= pos.x * k * weight;
-      n->pos.y -= pos.y * k * weight;
+  size_t n = g->_graph.num_nodes, num_edges = g->_graph.num_edges, offset = g->_graph.node_offset;
+  if (n_threads < 1) n_threads = 1;
+  /* The link pass uses the same number of threads as there are accumulators */
+  int num_acc = n_threads < num_edges / GRAPH_PARALLEL_MIN_ITEMS ? n_threads : num_edges / GRAPH_PARALLEL_MIN_ITEMS;
+  if (num_acc < 1) num_acc = 1;
+  graph_quadtree_t tree = { 0 };
+  graph_layout_task_t proto = {
+    graph_pass_links, ga->x + offset, ga->y + offset, ga->px + offset, ga->py + offset,
+    ga->edges + g->_graph.edge_offset, offset, n, calloc(3 * n * num_acc + 1, sizeof(float)), num_acc,
+    &tree, params.alpha, params.gravity, params.charge, params.theta * params.theta, params.friction
+  };
+  graph_layout_task_t * tasks = malloc(n_threads * sizeof(graph_layout_task_t));
+  bool ok = proto.acc && tasks;
+  for (int i = 0; ok && i < params.iterations; i++) {
+    graph_layout_run(tasks, &proto, graph_pass_links, num_edges, GRAPH_PARALLEL_MIN_ITEMS, num_acc);
+    graph_layout_run(tasks, &proto, graph_pass_nodes, n, GRAPH_PARALLEL_MIN_ITEMS, n_threads);
+    if (!(ok = graph_quadtree_build(&tree, proto.x, proto.y, n))) break;
+    graph_layout_run(tasks, &proto, graph_pass_repulsion, n, GRAPH_PARALLEL_MIN_NODES, n_threads);
+    graph_layout_run(tasks, &proto, graph_pass_drag, n, GRAPH_PARALLEL_MIN_ITEMS, n_threads);
+    proto.alpha *= 1 - params.alpha_decay;
+  }
+  graph_quadtree_free(&tree);
+  free(proto.acc);
+  free(tasks);
+  return ok;
+}
+
+/* Builds the adjacency of the edges from source to target, or from target to source if reverse is
+ * true. The edges of each node are in the order of the edge list. */
+static inline bool graph_csr_build(nanoclj_csr_t * csr, const nanoclj_edge_t * edges, size_t num_edges, size_t num_nodes, bool reverse) {
+  uint32_t * offsets = realloc(csr->offsets, (num_nodes + 1) * sizeof(uint32_t));
+  if (offsets) csr->offsets = offsets;
+  uint32_t * nodes = realloc(csr->nodes, (num_edges ? num_edges : 1) * sizeof(uint32_t));
+  if (nodes) csr->nodes = nodes;
+  uint32_t * edge_indices = realloc(csr->edges, (num_edges ? num_edges : 1) * sizeof(uint32_t));
+  if (edge_indices) csr->edges = edge_indices;
+  if (!offsets || !nodes || !edge_indices) return false;
+
+  memset(offsets, 0, (num_nodes + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < num_edges; i++) {
+    uint32_t from = reverse ? edges[i].target : edges[i].source, to = reverse ? edges[i].source : edges[i].target;
+    if (from < num_nodes && to < num_nodes) offsets[from + 1]++;
+  }
+  for (size_t i = 0; i < num_nodes; i++) offsets[i + 1] += offsets[i];
+  /* Each offset is advanced to the end of its node while filling, and then shifted back */
+  for (size_t i = 0; i < num_edges; i++) {
+    uint32_t from = reverse ? edges[i].target : edges[i].source, to = reverse ? edges[i].source : edges[i].target;
+    if (from < num_nodes && to < num_nodes) {
+      uint32_t j = offsets[from]++;
+      nodes[j] = to;
+      edge_indices[j] = i;
     }
   }
+  memmove(offsets + 1, offsets, num_nodes * sizeof(uint32_t));
+  offsets[0] = 0;
+  return true;
 }
 
-static inline void apply_repulsion(nanoclj_cell_t * g, float alpha, float charge) {
-  size_t num_nodes = g->_graph.num_nodes;
-  nanoclj_graph_array_t * ga = g->_graph.rep;
-  float k = alpha * charge;
+/* Builds the adjacency of a graph array, unless it is up to date */
+static inline bool graph_array_update_csr(nanoclj_graph_array_t * g) {
+  if (g->out.offsets && g->csr_num_nodes == g->num_nodes && g->csr_num_edges == g->num_edges) return true;
+  g->csr_num_nodes = g->csr_num_edges = 0;
+  if (!graph_csr_build(&(g->out), g->edges, g->num_edges, g->num_nodes, false) ||
+      !graph_csr_build(&(g->in), g->edges, g->num_edges, g->num_nodes, true)) {
+    return false;
+  }
+  g->csr_num_nodes = g->num_nodes;
+  g->csr_num_edges = g->num_edges;
+  return true;
+}
+
+/* The traversals follow the edges in a, and also those in b if it is not NULL, so that both the
+ * outgoing and the incoming edges can be followed. The j-th neighbour of v is in a if j is less
+ * than the degree of v in a. */
+
+static inline uint32_t graph_degree(const nanoclj_csr_t * a, const nanoclj_csr_t * b, uint32_t v) {
+  return a->offsets[v + 1] - a->offsets[v] + (b ? b->offsets[v + 1] - b->offsets[v] : 0);
+}
+
+static inline uint32_t graph_neighbour(const nanoclj_csr_t * a, const nanoclj_csr_t * b, uint32_t v, uint32_t j, uint32_t * edge) {
+  uint32_t n = a->offsets[v + 1] - a->offsets[v];
+  const nanoclj_csr_t * c = j < n ? a : b;
+  uint32_t k = c->offsets[v] + (j < n ? j : j - n);
+  if (edge) *edge = c->edges[k];
+  return c->nodes[k];
+}
+
+/* Visits the nodes reachable from source in breadth-first order and stores them in order. The
+ * depth of each visited node is set, and the depths must be initialized to -1 for the unvisited
+ * nodes. Returns the number of visited nodes. */
+static inline size_t graph_bfs(const nanoclj_csr_t * a, const nanoclj_csr_t * b, uint32_t source, uint32_t * order, int32_t * depth) {
+  size_t head = 0, tail = 0;
+  order[tail++] = source;
+  depth[source] = 0;
+  while (head < tail) {
+    uint32_t v = order[head++], degree = graph_degree(a, b, v);
+    for (uint32_t j = 0; j < degree; j++) {
+      uint32_t w = graph_neighbour(a, b, v, j, NULL);
+      if (depth[w] < 0) {
+	depth[w] = depth[v] + 1;
+	order[tail++] = w;
+      }
+    }
+  }
+  return tail;
+}
+
+/* Visits the nodes reachable from source in depth-first preorder. The stack and the cursors need
+ * space for all the nodes, and visited must be initialized to false. Returns the number of visited nodes. */
+static inline size_t graph_dfs(const nanoclj_csr_t * a, const nanoclj_csr_t * b, uint32_t source, uint32_t * order,
+			       bool * visited, uint32_t * stack, uint32_t * cursors) {
+  size_t n = 0, num_visited = 0;
+  visited[source] = true;
+  order[num_visited++] = source;
+  stack[n] = source;
+  cursors[n++] = 0;
+  while (n > 0) {
+    uint32_t v = stack[n - 1];
+    if (cursors[n - 1] == graph_degree(a, b, v)) {
+      n--;
+      continue;
+    }
+    uint32_t w = graph_neighbour(a, b, v, cursors[n - 1]++, NULL);
+    if (!visited[w]) {
+      visited[w] = true;
+      order[num_visited++] = w;
+      stack[n] = w;
+      cursors[n++] = 0;
+    }
+  }
+  return num_visited;
+}
 
+/* Finds the weakly connected components and stores the component of each node. Returns the number of components. */
+static inline size_t graph_connected_components(const nanoclj_csr_t * out, const nanoclj_csr_t * in, size_t num_nodes, int32_t * component) {
+  uint32_t * order = malloc((num_nodes ? num_nodes : 1) * sizeof(uint32_t));
+  int32_t * depth = malloc((num_nodes ? num_nodes : 1) * sizeof(int32_t));
+  if (!order || !depth) {
+    free(order);
+    free(depth);
+    return 0;
+  }
+  for (size_t i = 0; i < num_nodes; i++) depth[i] = -1;
+  size_t num_components = 0, num_visited = 0;
   for (size_t i = 0; i < num_nodes; i++) {
-    nanoclj_node_t * n1 = &(ga->nodes[g->_graph.node_offset + i]);
-    float weight1 = 1.0f;
-    for (size_t j = i + 1; j < num_nodes; j++) {
-      nanoclj_node_t * n2 = &(ga->nodes[g->_graph.node_offset + j]);
-      float weight2 = 1.0f;
-      nanoclj_vec2f d = n2->pos;
-      d.x -= n1->pos.x;
-      d.y -= n1->pos.y;
-      float mag2 = d.x * d.x + d.y * d.y;
-      if (mag2 < 0.1) mag2 = 0.1;
-      n1->ppos.x -= d.x * k / mag2 / weight1;
-      n1->ppos.y -= d.y * k / mag2 / weight1;
-      n2->ppos.x += d.x * k / mag2 / weight2;
-      n2->ppos.y += d.y * k / mag2 / weight2;
+    if (depth[i] >= 0) continue;
+    size_t n = graph_bfs(out, in, i, order + num_visited, depth);
+    for (size_t j = 0; j < n; j++) component[order[num_visited + j]] = num_components;
+    num_visited += n;
+    num_components++;
+  }
+  free(order);
+  free(depth);
+  return num_components;
+}
+
+typedef struct {
+  double distance;
+  uint32_t node;
+} graph_heap_item_t;
+
+static inline void graph_heap_push(graph_heap_item_t * heap, size_t * n, graph_heap_item_t item) {
+  size_t i = (*n)++;
+  while (i > 0 && heap[(i - 1) / 2].distance > item.distance) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = item;
+}
+
+static inline graph_heap_item_t graph_heap_pop(graph_heap_item_t * heap, size_t * n) {
+  graph_heap_item_t top = heap[0], last = heap[--(*n)];
+  size_t i = 0;
+  while (2 * i + 1 < *n) {
+    size_t c = 2 * i + 1;
+    if (c + 1 < *n && heap[c + 1].distance < heap[c].distance) c++;
+    if (heap[c].distance >= last.distance) break;
+    heap[i] = heap[c];
+    i = c;
+  }
+  heap[i] = last;
+  return top;
+}
+
+/* Computes the shortest distances from source with Dijkstra's algorithm. The weights are given per
+ * edge and must be non-negative, and all weights are 1 if weights is NULL. Unreachable nodes have an
+ * infinite distance and -1 as the previous node. */
+static inline bool graph_dijkstra(const nanoclj_csr_t * a, const nanoclj_csr_t * b, size_t num_nodes, uint32_t source,
+				  const double * weights, double * distance, int64_t * previous) {
+  size_t capacity = a->offsets[num_nodes] + (b ? b->offsets[num_nodes] : 0) + 1, n = 0;
+  graph_heap_item_t * heap = malloc(capacity * sizeof(graph_heap_item_t));
+  if (!heap) return false;
+  for (size_t i = 0; i < num_nodes; i++) {
+    distance[i] = INFINITY;
+    previous[i] = -1;
+  }
+  distance[source] = 0;
+  graph_heap_push(heap, &n, (graph_heap_item_t){ 0, source });
+  while (n > 0) {
+    graph_heap_item_t item = graph_heap_pop(heap, &n);
+    uint32_t v = item.node, degree = graph_degree(a, b, v);
+    /* Skip the stale entries of nodes whose distance has decreased since they were pushed */
+    if (item.distance > distance[v]) continue;
+    for (uint32_t j = 0; j < degree; j++) {
+      uint32_t e, w = graph_neighbour(a, b, v, j, &e);
+      double d = item.distance + (weights ? weights[e] : 1);
+      if (d < distance[w]) {
+	distance[w] = d;
+	previous[w] = v;
+	graph_heap_push(heap, &n, (graph_heap_item_t){ d, w });
+      }
+    }
+  }
+  free(heap);
+  return true;
+}
+
+typedef struct {
+  const nanoclj_csr_t * out, * in;
+  const double * rank;
+  double * next;
+  double base, damping, delta;
+  size_t i0, i1;
+} graph_pagerank_task_t;
+
+static inline NANOCLJ_THREAD_SIG graph_pagerank_main(void * arg) {
+  graph_pagerank_task_t * t = arg;
+  const uint32_t * out_offsets = t->out->offsets, * in_offsets = t->in->offsets, * in_nodes = t->in->nodes;
+  double delta = 0;
+  for (size_t v = t->i0; v < t->i1; v++) {
+    double sum = 0;
+    for (uint32_t j = in_offsets[v]; j < in_offsets[v + 1]; j++) {
+      uint32_t u = in_nodes[j];
+      sum += t->rank[u] / (out_offsets[u + 1] - out_offsets[u]);
+    }
+    t->next[v] = t->base + t->damping * sum;
+    delta += fabs(t->next[v] - t->rank[v]);
+  }
+  t->delta = delta;
+  return 0;
+}
+
+/* Computes the PageRank of the nodes. The rank of the nodes without outgoing edges is distributed
+ * evenly to all nodes. The iteration stops when the sum of the changes is less than tolerance.
+ * Each node gathers the ranks over its incoming edges, so the nodes are split between the threads.
+ * Returns the number of iterations, or -1 if out of memory. */
+static inline int graph_pagerank(const nanoclj_csr_t * out, const nanoclj_csr_t * in, size_t num_nodes, double damping,
+				 int max_iterations, double tolerance, double * rank, int n_threads) {
+  if (!num_nodes) return 0;
+  for (size_t i = 0; i < num_nodes; i++) rank[i] = 1.0 / num_nodes;
+  double * next = malloc(num_nodes * sizeof(double));
+  if (n_threads > num_nodes / GRAPH_PARALLEL_MIN_ITEMS) n_threads = num_nodes / GRAPH_PARALLEL_MIN_ITEMS;
+  if (n_threads < 1) n_threads = 1;
+  graph_pagerank_task_t * tasks = malloc(n_threads * sizeof(graph_pagerank_task_t));
+  if (!next || !tasks) {
+    free(next);
+    free(tasks);
+    return -1;
+  }
+  int iteration = 0;
+  while (iteration < max_iterations) {
+    double dangling = 0;
+    for (size_t i = 0; i < num_nodes; i++) {
+      if (out->offsets[i] == out->offsets[i + 1]) dangling += rank[i];
+    }
+    double base = (1 - damping + damping * dangling) / num_nodes, delta = 0;
+    for (int i = 0; i < n_threads; i++) {
+      tasks[i] = (graph_pagerank_task_t){ out, in, rank, next, base, damping, 0, num_nodes * i / n_threads, num_nodes * (i + 1) / n_threads };
+    }
+    if (n_threads == 1) {
+      graph_pagerank_main(tasks);
+    } else {
+      nanoclj_run_parallel(graph_pagerank_main, tasks, sizeof(graph_pagerank_task_t), n_threads);
     }
+    for (int i = 0; i < n_threads; i++) delta += tasks[i].delta;
+    memcpy(rank, next, num_nodes * sizeof(double));
+    iteration++;
+    if (delta < tolerance) break;
   }
+  free(next);
+  free(tasks);
+  return iteration;
 }
 
 #endif
@@ -0,0 +1,350 @@
+#ifndef _NANOCLJ_IMAGE_H_
+#define _NANOCLJ_IMAGE_H_
+
+#include "nanoclj_threads.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+/* Image processing on interleaved 8-bit pixels. Rows are stride bytes apart and each pixel is
+ * bpp bytes. The channels are processed independently, so the format doesn't matter. */
+
+/* Gaussian kernel weights are fixed-point numbers that sum to 1 << IMAGE_BLUR_SHIFT */
+#define IMAGE_BLUR_SHIFT 16
+#define IMAGE_BLUR_BLOCK 1024
+/* Minimum number of rows per thread */
+#define IMAGE_PARALLEL_MIN_ROWS 64
+/* Size of the square tiles of the transposing copy */
+#define IMAGE_TILE 32
+
+/* Returns the weights 0..r of a normalized gaussian kernel with sigma = radius / 3. The kernel is
+ * symmetric, and weight r is the center. Returns NULL if r is 0 or if out of memory. */
+static inline int32_t * image_mk_gaussian_kernel(float radius, int * r_out) {
+  int r = (int)ceil(radius);
+  if (r <= 0) {
+    *r_out = 0;
+    return NULL;
+  }
+  *r_out = r;
+  float sigma = radius / 3;
+  float sigma22 = 2.0f * sigma * sigma;
+  double * w = malloc((r + 1) * sizeof(double));
+  int32_t * kernel = malloc((r + 1) * sizeof(int32_t));
+  if (!w || !kernel) {
+    free(w);
+    free(kernel);
+    return NULL;
+  }
+  double total = 0;
+  for (int i = 0; i <= r; i++) {
+    w[i] = exp(-(double)(r - i) * (r - i) / sigma22);
+    total += i == r ? w[i] : 2 * w[i];
+  }
+  int32_t sum = 0;
+  for (int i = 0; i < r; i++) {
+    kernel[i] = (int32_t)(w[i] / total * (1 << IMAGE_BLUR_SHIFT) + 0.5);
+    sum += 2 * kernel[i];
+  }
+  /* The center takes up the rounding error */
+  kernel[r] = (1 << IMAGE_BLUR_SHIFT) - sum;
+  free(w);
+  *r_out = r;
+  return kernel;
+}
+
+/* Sums the rows a[i] + b[i] weighted by the kernel into n bytes of dst. The rows are paired so that
+ * each weight is multiplied once, and the loops are simple enough to be vectorized. The row is
+ * processed in blocks of IMAGE_BLUR_BLOCK bytes to keep the accumulators in the L1 cache. */
+static inline void image_blur_rows(const uint8_t ** a, const uint8_t ** b, const uint8_t * center, const int32_t * kernel, int r,
+				   uint8_t * restrict dst, int64_t n) {
+  int32_t acc[IMAGE_BLUR_BLOCK];
+  const int32_t kc = kernel[r];
+  for (int64_t j0 = 0; j0 < n; j0 += IMAGE_BLUR_BLOCK) {
+    int64_t m = n - j0 < IMAGE_BLUR_BLOCK ? n - j0 : IMAGE_BLUR_BLOCK;
+    const uint8_t * restrict c = center + j0;
+    for (int64_t j = 0; j < m; j++) acc[j] = kc * c[j] + (1 << (IMAGE_BLUR_SHIFT - 1));
+    for (int i = 0; i < r; i++) {
+      const uint8_t * restrict ai = a[i] + j0, * restrict bi = b[i] + j0;
+      const int32_t k = kernel[i];
+      for (int64_t j = 0; j < m; j++) acc[j] += k * (ai[j] + bi[j]);
+    }
+    for (int64_t j = 0; j < m; j++) dst[j0 + j] = (uint8_t)(acc[j] >> IMAGE_BLUR_SHIFT);
+  }
+}
+
+typedef struct {
+  const uint8_t * src;
+  uint8_t * dst;
+  size_t src_stride, dst_stride;
+  int64_t width, height, bpp, y0, y1;
+  const int32_t * kernel;
+  int r;
+  bool vertical;
+  bool failed;
+} image_blur_task_t;
+
+/* Blurs the rows y0..y1 either horizontally or vertically. Sets failed if out of memory. */
+static inline NANOCLJ_THREAD_SIG image_blur_main(void * arg) {
+  image_blur_task_t * task = arg;
+  int64_t w = task->width, h = task->height, bpp = task->bpp, n = w * bpp;
+  int r = task->r;
+  const uint8_t ** rows = malloc(2 * (r + 1) * sizeof(const uint8_t *));
+  if (!rows) {
+    task->failed = true;
+    return 0;
+  }
+  const uint8_t ** a = rows, ** b = rows + r + 1;
+  if (!task->vertical) {
+    /* The row is copied with r clamped pixels on both sides so that the kernel doesn't need bounds checks */
+    uint8_t * padded = malloc((w + 2 * r) * bpp);
+    if (!padded) {
+      free(rows);
+      task->failed = true;
+      return 0;
+    }
+    for (int i = 0; i < r; i++) {
+      a[i] = padded + i * bpp;
+      b[i] = padded + (2 * r - i) * bpp;
+    }
+    for (int64_t y = task->y0; y < task->y1; y++) {
+      const uint8_t * s = task->src + y * task->src_stride;
+      memcpy(padded + r * bpp, s, n);
+      for (int i = 0; i < r; i++) {
+	memcpy(padded + i * bpp, s, bpp);
+	memcpy(padded + (r + w + i) * bpp, s + (w - 1) * bpp, bpp);
+      }
+      image_blur_rows(a, b, padded + r * bpp, task->kernel, r, task->dst + y * task->dst_stride, n);
+    }
+    free(padded);
+  } else {
+    /* The rows are clamped once per output row */
+    for (int64_t y = task->y0; y < task->y1; y++) {
+      for (int i = 0; i < r; i++) {
+	int64_t ya = y - r + i, yb = y + r - i;
+	a[i] = task->src + (ya < 0 ? 0 : ya) * task->src_stride;
+	b[i] = task->src + (yb >= h ? h - 1 : yb) * task->src_stride;
+      }
+      image_blur_rows(a, b, task->src + y * task->src_stride, task->kernel, r, task->dst + y * task->dst_stride, n);
+    }
+  }
+  free(rows);
+  return 0;
+}
+
+/* Returns false if out of memory */
+static inline bool image_blur_pass(image_blur_task_t task, int n_threads) {
+  if (n_threads > task.height / IMAGE_PARALLEL_MIN_ROWS) n_threads = task.height / IMAGE_PARALLEL_MIN_ROWS;
+  if (n_threads < 2) {
+    task.y0 = 0;
+    task.y1 = task.height;
+    image_blur_main(&task);
+    return !task.failed;
+  }
+  image_blur_task_t * tasks = malloc(n_threads * sizeof(image_blur_task_t));
+  if (!tasks) return false;
+  for (int i = 0; i < n_threads; i++) {
+    tasks[i] = task;
+    tasks[i].y0 = task.height * i / n_threads;
+    tasks[i].y1 = task.height * (i + 1) / n_threads;
+  }
+  nanoclj_run_parallel(image_blur_main, tasks, sizeof(image_blur_task_t), n_threads);
+  bool failed = false;
+  for (int i = 0; i < n_threads; i++) failed |= tasks[i].failed;
+  free(tasks);
+  return !failed;
+}
+
+/* Applies a gaussian blur to a w x h image and writes the result to dst with a stride of w * bpp.
+ * The horizontal pass writes to a temporary image that the vertical pass reads, and both passes
+ * split the rows between threads. If vertical is false, only the horizontal pass is done.
+ * Returns false if out of memory. */
+static inline bool image_gaussian_blur(const uint8_t * src, size_t stride, int64_t w, int64_t h, int64_t bpp,
+				       float radius, bool vertical, uint8_t * dst, int n_threads) {
+  int r;
+  int32_t * kernel = image_mk_gaussian_kernel(radius, &r);
+  size_t dst_stride = w * bpp;
+  if (!kernel) {
+    if (r) return false;
+    for (int64_t y = 0; y < h; y++) memcpy(dst + y * dst_stride, src + y * stride, dst_stride);
+    return true;
+  }
+  image_blur_task_t task = { src, dst, stride, dst_stride, w, h, bpp, 0, 0, kernel, r, false, false };
+  uint8_t * tmp = NULL;
+  if (vertical) {
+    tmp = malloc(dst_stride * h);
+    if (!tmp) {
+      free(kernel);
+      return false;
+    }
+    task.dst = tmp;
+  }
+  bool success = image_blur_pass(task, n_threads);
+  if (tmp) {
+    task.src = tmp;
+    task.src_stride = dst_stride;
+    task.dst = dst;
+    task.vertical = true;
+    if (success) success = image_blur_pass(task, n_threads);
+    free(tmp);
+  }
+  free(kernel);
+  return success;
+}
+
+typedef struct {
+  const uint8_t * src;
+  uint8_t * dst;
+  ptrdiff_t sx, sy;
+  size_t dst_stride;
+  int64_t width, height, bpp, y0, y1;
+} image_remap_task_t;
+
+/* Copies the tiles of the rows y0..y1. The pixel size is a constant, so that the copy compiles to single loads and stores. */
+#define IMAGE_REMAP_TILES(BPP)						\
+  for (int64_t ty = task->y0; ty < task->y1; ty += IMAGE_TILE) {	\
+    int64_t ty1 = ty + IMAGE_TILE < task->y1 ? ty + IMAGE_TILE : task->y1; \
+    for (int64_t tx = 0; tx < task->width; tx += IMAGE_TILE) {		\
+      int64_t tx1 = tx + IMAGE_TILE < task->width ? tx + IMAGE_TILE : task->width; \
+      for (int64_t y = ty; y < ty1; y++) {				\
+	const uint8_t * s = task->src + y * task->sy + tx * task->sx;	\
+	uint8_t * d = task->dst + y * task->dst_stride + tx * BPP;	\
+	for (int64_t x = tx; x < tx1; x++, s += task->sx, d += BPP) memcpy(d, s, BPP); \
+      }									\
+    }									\
+  }
+
+static inline NANOCLJ_THREAD_SIG image_remap_main(void * arg) {
+  image_remap_task_t * task = arg;
+  int64_t bpp = task->bpp;
+  if (task->sx == bpp) {
+    /* The rows are contiguous in the source */
+    for (int64_t y = task->y0; y < task->y1; y++) {
+      memcpy(task->dst + y * task->dst_stride, task->src + y * task->sy, task->width * bpp);
+    }
+  } else {
+    switch (bpp) {
+    case 1: IMAGE_REMAP_TILES(1); break;
+    case 2: IMAGE_REMAP_TILES(2); break;
+    case 3: IMAGE_REMAP_TILES(3); break;
+    case 4: IMAGE_REMAP_TILES(4); break;
+    default: IMAGE_REMAP_TILES(bpp); break;
+    }
+  }
+  return 0;
+}
+
+/* Writes a w x h image to dst with a stride of w * bpp. Destination pixel (x, y) is read from
+ * src + x * sx + y * sy, so transposes, rotations and flips only differ by the origin and the steps.
+ * The destination is processed in tiles so that both images are accessed a cache line at a time,
+ * and bands of tile rows are split between threads. Returns false if out of memory. */
+static inline bool image_remap(const uint8_t * src, ptrdiff_t sx, ptrdiff_t sy, int64_t w, int64_t h, int64_t bpp,
+			       uint8_t * dst, int n_threads) {
+  image_remap_task_t task = { src, dst, sx, sy, w * bpp, w, h, bpp, 0, h };
+  int64_t n_tiles = (h + IMAGE_TILE - 1) / IMAGE_TILE;
+  if (n_threads > n_tiles) n_threads = n_tiles;
+  if (n_threads > h / IMAGE_PARALLEL_MIN_ROWS) n_threads = h / IMAGE_PARALLEL_MIN_ROWS;
+  if (n_threads < 2) {
+    image_remap_main(&task);
+    return true;
+  }
+  image_remap_task_t * tasks = malloc(n_threads * sizeof(image_remap_task_t));
+  if (!tasks) return false;
+  for (int i = 0; i < n_threads; i++) {
+    tasks[i] = task;
+    tasks[i].y0 = n_tiles * i / n_threads * IMAGE_TILE;
+    tasks[i].y1 = i + 1 == n_threads ? h : n_tiles * (i + 1) / n_threads * IMAGE_TILE;
+  }
+  nanoclj_run_parallel(image_remap_main, tasks, sizeof(image_remap_task_t), n_threads);
+  free(tasks);
+  return true;
+}
+
+typedef enum {
+  image_transform_transpose = 0,
+  image_transform_rotate_90,
+  image_transform_rotate_180,
+  image_transform_rotate_270,
+  image_transform_flip_horizontal,
+  image_transform_flip_vertical
+} image_transform_t;
+
+/* Returns true if the transform swaps the width and the height */
+static inline bool image_transform_is_transposing(image_transform_t t) {
+  return t == image_transform_transpose || t == image_transform_rotate_90 || t == image_transform_rotate_270;
+}
+
+/* Transforms a w x h image. The rotations are clockwise. The result has a stride of width * bpp,
+ * and its width and height are swapped if the transform is transposing. Returns false if out of memory. */
+static inline bool image_transform(const uint8_t * src, size_t stride, int64_t w, int64_t h, int64_t bpp,
+				   image_transform_t t, uint8_t * dst, int n_threads) {
+  ptrdiff_t s = stride, b = bpp;
+  const uint8_t * last_col = src + (w - 1) * b, * last_row = src + (h - 1) * s;
+  switch (t) {
+  case image_transform_transpose: return image_remap(src, s, b, h, w, bpp, dst, n_threads);
+  case image_transform_rotate_90: return image_remap(last_row, -s, b, h, w, bpp, dst, n_threads);
+  case image_transform_rotate_180: return image_remap(last_row + (w - 1) * b, -b, -s, w, h, bpp, dst, n_threads);
+  case image_transform_rotate_270: return image_remap(last_col, s, -b, h, w, bpp, dst, n_threads);
+  case image_transform_flip_horizontal: return image_remap(last_col, -b, s, w, h, bpp, dst, n_threads);
+  case image_transform_flip_vertical: return image_remap(last_row, b, -s, w, h, bpp, dst, n_threads);
+  }
+  return true;
+}
+
+typedef struct {
+  const uint8_t * src;
+  uint8_t * dst;
+  size_t src_stride;
+  int64_t width, height, bpp, y0, y1;
+} image_downsample_task_t;
+
+/* Averages the 2x2 blocks of the source for the destination rows y0..y1 */
+static inline NANOCLJ_THREAD_SIG image_downsample_main(void * arg) {
+  image_downsample_task_t * task = arg;
+  int64_t w = task->width, h = task->height, bpp = task->bpp;
+  int64_t tw = (w + 1) / 2, n = (w / 2) * bpp;
+  for (int64_t y = task->y0; y < task->y1; y++) {
+    const uint8_t * restrict r0 = task->src + 2 * y * task->src_stride;
+    const uint8_t * restrict r1 = 2 * y + 1 < h ? r0 + task->src_stride : r0;
+    uint8_t * restrict d = task->dst + y * tw * bpp;
+    for (int64_t j = 0; j < n; j++) {
+      int64_t x = j / bpp, c = j - x * bpp, i = 2 * x * bpp + c;
+      d[j] = (uint8_t)((r0[i] + r0[i + bpp] + r1[i] + r1[i + bpp] + 2) >> 2);
+    }
+    /* The last column of an odd width is averaged with itself */
+    if (w & 1) {
+      for (int64_t c = 0; c < bpp; c++) {
+	int64_t i = (w - 1) * bpp + c;
+	d[n + c] = (uint8_t)((r0[i] + r1[i] + 1) >> 1);
+      }
+    }
+  }
+  return 0;
+}
+
+/* Halves the size of a w x h image by averaging 2x2 blocks. The result is (w + 1) / 2 x (h + 1) / 2
+ * pixels with a stride of its width * bpp, and the rows are split between threads. Returns false if out of memory. */
+static inline bool image_downsample(const uint8_t * src, size_t stride, int64_t w, int64_t h, int64_t bpp, uint8_t * dst, int n_threads) {
+  int64_t th = (h + 1) / 2;
+  image_downsample_task_t task = { src, dst, stride, w, h, bpp, 0, th };
+  if (n_threads > th / IMAGE_PARALLEL_MIN_ROWS) n_threads = th / IMAGE_PARALLEL_MIN_ROWS;
+  if (n_threads < 2) {
+    image_downsample_main(&task);
+    return true;
+  }
+  image_downsample_task_t * tasks = malloc(n_threads * sizeof(image_downsample_task_t));
+  if (!tasks) return false;
+  for (int i = 0; i < n_threads; i++) {
+    tasks[i] = task;
+    tasks[i].y0 = th * i / n_threads;
+    tasks[i].y1 = th * (i + 1) / n_threads;
+  }
+  nanoclj_run_parallel(image_downsample_main, tasks, sizeof(image_downsample_task_t), n_threads);
+  free(tasks);
+  return true;
+}
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef _NANOCLJ_LINALG_H_
+#define _NANOCLJ_LINALG_H_
+
+#include "nanoclj_tensor_math.h"
+
+/* Matrices are 2D tensors where dimension 0 is the column and dimension 1 is the row,
+ * so that rows are contiguous. */
+
+/* Block sizes of the matrix multiplication. A KC x NC panel of B and an MC x KC block of A
+ * are packed so that the micro-kernel reads both sequentially. */
+#define TENSOR_GEMM_MC 96
+#define TENSOR_GEMM_KC 256
+#define TENSOR_GEMM_NC 1024
+/* Minimum number of multiply-adds for using threads */
+#define TENSOR_GEMM_PARALLEL_MIN (1 << 20)
+
+/* Returns a view with the rows and columns swapped without copying the data */
+static inline tensorview_t tensorview_transpose(tensorview_t tv) {
+  int64_t ne0 = tv.ne[0];
+  size_t nb0 = tv.nb[0];
+  if (tv.n_dims < 2) {
+    tv.n_dims = 2;
+    tv.ne[1] = 1;
+    tv.nb[1] = nb0 * ne0;
+  }
+  tv.ne[0] = tv.ne[1];
+  tv.nb[0] = tv.nb[1];
+  tv.ne[1] = ne0;
+  tv.nb[1] = nb0;
+  return tv;
+}
+
+/* Returns the view as type t. If a conversion is needed, the converted tensor is stored in tmp. */
+static inline bool tensorview_as_type(tensorview_t * tv, nanoclj_tensor_type_t t, nanoclj_tensor_t ** tmp) {
+  *tmp = NULL;
+  if (tv->type == t) return true;
+  if (!(*tmp = tensorview_convert(tv, t))) return false;
+  *tv = tensorview_from_tensor(*tmp);
+  return true;
+}
+
+typedef struct {
+  const tensorview_t * a, * b;
+  void * c;
+  int64_t m0, m1, n, k;
+  bool failed;
+} tensor_gemm_task_t;
+
+/* The micro-kernel keeps an MR x NR block of C in registers and the inner loop is vectorized
+ * over NR. The edge blocks are padded with zeros when packing. */
+#define TENSOR_GEMM_KERNEL(NAME, T, MR, NR)				\
+  static void NAME##_pack_a(const tensorview_t * a, int64_t i0, int64_t mc, int64_t p0, int64_t kc, T * restrict ap) { \
+    for (int64_t is = 0; is < mc; is += MR) {				\
+      for (int64_t p = 0; p < kc; p++) {				\
+	const uint8_t * col = (const uint8_t *)a->data + (p0 + p) * a->nb[0]; \
+	for (int64_t r = 0; r < MR; r++) {				\
+	  *ap++ = is + r < mc ? *(const T *)(col + (i0 + is + r) * a->nb[1]) : (T)0; \
+	}								\
+      }									\
+    }									\
+  }									\
+  static void NAME##_pack_b(const tensorview_t * b, int64_t p0, int64_t kc, int64_t j0, int64_t nc, T * restrict bp) { \
+    for (int64_t js = 0; js < nc; js += NR) {				\
+      for (int64_t p = 0; p < kc; p++) {				\
+	const uint8_t * row = (const uint8_t *)b->data + (p0 + p) * b->nb[1]; \
+	for (int64_t r = 0; r < NR; r++) {				\
+	  *bp++ = js + r < nc ? *(const T *)(row + (j0 + js + r) * b->nb[0]) : (T)0; \
+	}								\
+      }									\
+    }									\
+  }									\
+  static inline void NAME##_micro(int64_t kc, const T * restrict ap, const T * restrict bp, T * restrict c, int64_t ldc, int64_t mr, int64_t nr) { \
+    T acc[MR][NR];							\
+    for (int i = 0; i < MR; i++) {					\
+      for (int j = 0; j < NR; j++) acc[i][j] = 0;			\
+    }									\
+    for (int64_t p = 0; p < kc; p++, ap += MR, bp += NR) {		\
+      for (int i = 0; i < MR; i++) {					\
+	for (int j = 0; j < NR; j++) acc[i][j] += ap[i] * bp[j];	\
+      }									\
+    }									\
+    for (int64_t i = 0; i < mr; i++) {					\
+      for (int64_t j = 0; j < nr; j++) c[i * ldc + j] += acc[i][j];	\
+    }									\
+  }									\
+  static NANOCLJ_THREAD_SIG NAME(void * arg) {				\
+    tensor_gemm_task_t * task = arg;					\
+    int64_t n = task->n, k = task->k;					\
+    T * c = task->c;							\
+    T * ap = malloc(TENSOR_GEMM_MC * TENSOR_GEMM_KC * sizeof(T));	\
+    T * bp = malloc(TENSOR_GEMM_KC * (TENSOR_GEMM_NC + NR) * sizeof(T)); \
+    if (ap && bp) {							\
+      for (int64_t jc = 0; jc < n; jc += TENSOR_GEMM_NC) {		\
+	int64_t nc = n - jc < TENSOR_GEMM_NC ? n - jc : TENSOR_GEMM_NC;	\
+	for (int64_t pc = 0; pc < k; pc += TENSOR_GEMM_KC) {		\
+	  int64_t kc = k - pc < TENSOR_GEMM_KC ? k - pc : TENSOR_GEMM_KC; \
+	  NAME##_pack_b(task->b, pc, kc, jc, nc, bp);			\
+	  for (int64_t ic = task->m0; ic < task->m1; ic += TENSOR_GEMM_MC) { \
+	    int64_t mc = task->m1 - ic < TENSOR_GEMM_MC ? task->m1 - ic : TENSOR_GEMM_MC; \
+	    NAME##_pack_a(task->a, ic, mc, pc, kc, ap);		\
+	    for (int64_t jr = 0; jr < nc; jr += NR) {			\
+	      for (int64_t ir = 0; ir < mc; ir += MR) {			\
+		NAME##_micro(kc, ap + ir * kc, bp + jr * kc, c + (ic + ir) * n + jc + jr, n, \
+			     mc - ir < MR ? mc - ir : MR, nc - jr < NR ? nc - jr : NR); \
+	      }								\
+	    }								\
+	  }								\
+	}								\
+      }									\
+    } else {								\
+      task->failed = true;						\
+    }									\
+    free(ap);								\
+    free(bp);								\
+    return 0;								\
+  }
+
+TENSOR_GEMM_KERNEL(tensor_gemm_f32, float, 4, 32)
+TENSOR_GEMM_KERNEL(tensor_gemm_f64, double, 4, 32)
+
+/* Multiplies an m x k matrix a with a k x n matrix b. The operands may be strided views, such
+ * as transposes. Type t must be f32 or f64, and the result is a contiguous m x n matrix of that type.
+ * The rows of the result are split between threads, so the result doesn't depend on the thread count.
+ * Returns NULL if memory runs out. */
+static inline nanoclj_tensor_t * tensor_matmul(tensorview_t a, tensorview_t b, nanoclj_tensor_type_t t, int n_threads) {
+  int64_t m = a.n_dims >= 2 ? a.ne[1] : 1, k = a.ne[0], n = b.ne[0];
+  nanoclj_tensor_t * ta, * tb;
+  if (!tensorview_as_type(&a, t, &ta)) return NULL;
+  if (!tensorview_as_type(&b, t, &tb)) {
+    tensor_free(ta);
+    return NULL;
+  }
+  nanoclj_tensor_t * r = mk_tensor_2d(t, n, m);
+  if (r) {
+    memset(r->data, 0, m * n * r->nb[0]);
+    NANOCLJ_THREAD_SIG (*fn)(void *) = t == nanoclj_f32 ? tensor_gemm_f32 : tensor_gemm_f64;
+    tensor_gemm_task_t task = { &a, &b, r->data, 0, m, n, k, false };
+    bool failed = false;
+    if (m * n * k < TENSOR_GEMM_PARALLEL_MIN || n_threads < 2 || m < 8) {
+      fn(&task);
+      failed = task.failed;
+    } else {
+      /* The row ranges are multiples of 4 to keep the micro-kernel blocks full */
+      if (n_threads > m / 4) n_threads = m / 4;
+      tensor_gemm_task_t * tasks = malloc(n_threads * sizeof(tensor_gemm_task_t));
+      if (tasks) {
+	for (int i = 0; i < n_threads; i++) {
+	  tasks[i] = task;
+	  tasks[i].m0 = (m / 4) * i / n_threads * 4;
+	  tasks[i].m1 = i + 1 == n_threads ? m : (m / 4) * (i + 1) / n_threads * 4;
+	}
+	nanoclj_run_parallel(fn, tasks, sizeof(tensor_gemm_task_t), n_threads);
+	for (int i = 0; i < n_threads; i++) failed |= tasks[i].failed;
+	free(tasks);
+      } else {
+	failed = true;
+      }
+    }
+    if (failed) {
+      tensor_free(r);
+      r = NULL;
+    }
+  }
+  tensor_free(ta);
+  tensor_free(tb);
+  return r;
+}
+
+#define TENSOR_DOT_KERNEL(NAME, T)					\
+  static inline T NAME(int64_t n, const T * restrict x, int64_t sx, const T * restrict y, int64_t sy) { \
+    T acc[TENSOR_REDUCE_LANES] = { 0 };					\
+    int64_t i = 0;							\
+    if (sx == 1 && sy == 1) {						\
+      for (; i + TENSOR_REDUCE_LANES <= n; i += TENSOR_REDUCE_LANES) {	\
+	for (int j = 0; j < TENSOR_REDUCE_LANES; j++) acc[j] += x[i + j] * y[i + j]; \
+      }									\
+    }									\
+    for (; i < n; i++) acc[0] += x[i * sx] * y[i * sy];			\
+    T s = 0;								\
+    for (int j = 0; j < TENSOR_REDUCE_LANES; j++) s += acc[j];		\
+    return s;								\
+  }
+
+TENSOR_DOT_KERNEL(tensor_dot_f32, float)
+TENSOR_DOT_KERNEL(tensor_dot_f64, double)
+
+/* Computes the dot product of two vectors of equal length in type t. Returns false if memory runs out. */
+static inline bool tensor_dot(tensorview_t x, tensorview_t y, nanoclj_tensor_type_t t, double * r) {
+  nanoclj_tensor_t * tx, * ty;
+  bool ok = false;
+  if (tensorview_as_type(&x, t, &tx)) {
+    if (tensorview_as_type(&y, t, &ty)) {
+      size_t es = tensor_get_cell_size(t);
+      if (t == nanoclj_f32) {
+	*r = tensor_dot_f32(x.ne[0], x.data, x.nb[0] / es, y.data, y.nb[0] / es);
+      } else {
+	*r = tensor_dot_f64(x.ne[0], x.data, x.nb[0] / es, y.data, y.nb[0] / es);
+      }
+      ok = true;
+      tensor_free(ty);
+    }
+    tensor_free(tx);
+  }
+  return ok;
+}
+
+typedef struct {
+  const tensorview_t * a, * x;
+  void * y;
+  int64_t m0, m1;
+} tensor_gemv_task_t;
+
+#define TENSOR_GEMV_KERNEL(NAME, T, DOT)				\
+  static NANOCLJ_THREAD_SIG NAME(void * arg) {				\
+    tensor_gemv_task_t * task = arg;					\
+    const tensorview_t * a = task->a, * x = task->x;			\
+    int64_t sa = a->nb[0] / sizeof(T), sx = x->nb[0] / sizeof(T);	\
+    for (int64_t i = task->m0; i < task->m1; i++) {			\
+      ((T *)task->y)[i] = DOT(a->ne[0], (const T *)((const uint8_t *)a->data + i * a->nb[1]), sa, x->data, sx); \
+    }									\
+    return 0;								\
+  }
+
+TENSOR_GEMV_KERNEL(tensor_gemv_f32, float, tensor_dot_f32)
+TENSOR_GEMV_KERNEL(tensor_gemv_f64, double, tensor_dot_f64)
+
+/* Multiplies an m x k matrix with a vector of length k */
+static inline nanoclj_tensor_t * tensor_matvec(tensorview_t a, tensorview_t x, nanoclj_tensor_type_t t, int n_threads) {
+  int64_t m = a.n_dims >= 2 ? a.ne[1] : 1;
+  nanoclj_tensor_t * ta, * tx;
+  if (!tensorview_as_type(&a, t, &ta)) return NULL;
+  if (!tensorview_as_type(&x, t, &tx)) {
+    tensor_free(ta);
+    return NULL;
+  }
+  if (!ta && a.nb[0] != tensor_get_cell_size(t)) {
+    /* Rows are made contiguous so that the dot products vectorize */
+    if (!(ta = tensorview_convert(&a, t))) {
+      tensor_free(tx);
+      return NULL;
+    }
+    a = tensorview_from_tensor(ta);
+  }
+  nanoclj_tensor_t * r = mk_tensor_1d(t, m);
+  if (r) {
+    NANOCLJ_THREAD_SIG (*fn)(void *) = t == nanoclj_f32 ? tensor_gemv_f32 : tensor_gemv_f64;
+    tensor_gemv_task_t task = { &a, &x, r->data, 0, m };
+    if (m * a.ne[0] < TENSOR_REDUCE_PARALLEL_MIN || n_threads < 2 || m < n_threads) {
+      fn(&task);
+    } else {
+      tensor_gemv_task_t * tasks = malloc(n_threads * sizeof(tensor_gemv_task_t));
+      if (tasks) {
+	for (int i = 0; i < n_threads; i++) {
+	  tasks[i] = task;
+	  tasks[i].m0 = m * i / n_threads;
+	  tasks[i].m1 = m * (i + 1) / n_threads;
+	}
+	nanoclj_run_parallel(fn, tasks, sizeof(tensor_gemv_task_t), n_threads);
+	free(tasks);
+      } else {
+	tensor_free(r);
+	r = NULL;
+      }
+    }
+  }
+  tensor_free(ta);
+  tensor_free(tx);
+  return r;
+}
+
+/* Computes the LU decomposition of a square matrix with partial pivoting, PA = LU, in double precision.
+ * L has an implicit unit diagonal and is stored below the diagonal of the result, and row i of PA
+ * is row perm[i] of A. Returns NULL on failure and sets is_singular if a pivot is zero. */
+static inline nanoclj_tensor_t * tensor_lu(tensorview_t a, int32_t * perm, int * sign, bool * is_singular) {
+  int64_t n = a.ne[0];
+  *is_singular = false;
+  nanoclj_tensor_t * r = tensorview_convert(&a, nanoclj_f64);
+  if (!r) return NULL;
+  double * lu = r->data;
+  *sign = 1;
+  for (int64_t i = 0; i < n; i++) perm[i] = i;
+  for (int64_t k = 0; k < n; k++) {
+    int64_t p = k;
+    for (int64_t i = k + 1; i < n; i++) {
+      if (fabs(lu[i * n + k]) > fabs(lu[p * n + k])) p = i;
+    }
+    if (lu[p * n + k] == 0.0) {
+      *is_singular = true;
+      tensor_free(r);
+      return NULL;
+    }
+    if (p != k) {
+      for (int64_t j = 0; j < n; j++) {
+	double tmp = lu[k * n + j];
+	lu[k * n + j] = lu[p * n + j];
+	lu[p * n + j] = tmp;
+      }
+      int32_t tmp = perm[k];
+      perm[k] = perm[p];
+      perm[p] = tmp;
+      *sign = -*sign;
+    }
+    double * restrict row_k = lu + k * n;
+    for (int64_t i = k + 1; i < n; i++) {
+      double * restrict row_i = lu + i * n;
+      double f = row_i[k] /= row_k[k];
+      for (int64_t j = k + 1; j < n; j++) row_i[j] -= f * row_k[j];
+    }
+  }
+  return r;
+}
+
+/* Solves LU X = PB for X, where B is a vector or a matrix with the same number of rows as LU */
+static inline nanoclj_tensor_t * tensor_lu_solve(const nanoclj_tensor_t * lu_tensor, const int32_t * perm, tensorview_t b) {
+  int64_t n = lu_tensor->ne[0], nrhs = b.n_dims >= 2 ? b.ne[0] : 1;
+  const double * lu = lu_tensor->data;
+  nanoclj_tensor_t * r = mk_tensor_nd(nanoclj_f64, b.n_dims >= 2 ? 2 : 1, b.ne);
+  if (!r) return NULL;
+  double * x = r->data;
+  /* The right-hand side is stored permuted with the columns of B contiguous in each row */
+  size_t row_stride = b.n_dims >= 2 ? b.nb[1] : b.nb[0], col_stride = b.n_dims >= 2 ? b.nb[0] : 0;
+  for (int64_t i = 0; i < n; i++) {
+    const uint8_t * src = (const uint8_t *)b.data + perm[i] * row_stride;
+    for (int64_t j = 0; j < nrhs; j++) x[i * nrhs + j] = tensor_load_f64(src + j * col_stride, b.type);
+  }
+  for (int64_t i = 0; i < n; i++) {
+    for (int64_t k = 0; k < i; k++) {
+      double f = lu[i * n + k];
+      for (int64_t j = 0; j < nrhs; j++) x[i * nrhs + j] -= f * x[k * nrhs + j];
+    }
+  }
+  for (int64_t i = n - 1; i >= 0; i--) {
+    for (int64_t k = i + 1; k < n; k++) {
+      double f = lu[i * n + k];
+      for (int64_t j = 0; j < nrhs; j++) x[i * nrhs + j] -= f * x[k * nrhs + j];
+    }
+    for (int64_t j = 0; j < nrhs; j++) x[i * nrhs + j] /= lu[i * n + i];
+  }
+  return r;
+}
+
+/* Computes the Cholesky factor L of a symmetric positive definite matrix, A = LL^T, in double
+ * precision. Only the lower triangle of A is read and the upper triangle of L is zero.
+ * Returns NULL on failure and sets is_not_pd if the matrix is not positive definite. */
+static inline nanoclj_tensor_t * tensor_cholesky(tensorview_t a, bool * is_not_pd) {
+  int64_t n = a.ne[0];
+  *is_not_pd = false;
+  nanoclj_tensor_t * r = tensorview_convert(&a, nanoclj_f64);
+  if (!r) return NULL;
+  double * l = r->data;
+  for (int64_t j = 0; j < n; j++) {
+    double * restrict row_j = l + j * n;
+    double d = row_j[j] - tensor_dot_f64(j, row_j, 1, row_j, 1);
+    if (!(d > 0.0)) {
+      *is_not_pd = true;
+      tensor_free(r);
+      return NULL;
+    }
+    row_j[j] = sqrt(d);
+    for (int64_t i = j + 1; i < n; i++) {
+      double * restrict row_i = l + i * n;
+      row_i[j] = (row_i[j] - tensor_dot_f64(j, row_i, 1, row_j, 1)) / row_j[j];
+    }
+    for (int64_t k = j + 1; k < n; k++) row_j[k] = 0.0;
+  }
+  return r;
+}
+
+#endif
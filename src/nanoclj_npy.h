@@ -0,0 +1,251 @@
+#ifndef _NANOCLJ_NPY_H_
+#define _NANOCLJ_NPY_H_
+
+#include "nanoclj_tensor.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* NumPy .npy files: a magic string, a version, the length of the header, and a header that is
+ * a Python dict literal with the keys descr, fortran_order and shape. The data follows the header
+ * and is aligned to NPY_ALIGNMENT bytes. */
+
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_SIZE 6
+#define NPY_ALIGNMENT 64
+#define NPY_MAX_HEADER_SIZE (1 << 20)
+
+typedef enum {
+  npy_ok = 0,
+  npy_error_io,
+  npy_error_format,
+  npy_error_dtype,
+  npy_error_dims,
+  npy_error_memory
+} npy_status_t;
+
+static inline const char * npy_status_message(npy_status_t s) {
+  switch (s) {
+  case npy_ok: return "Success";
+  case npy_error_io: return "I/O error";
+  case npy_error_format: return "Invalid NPY file";
+  case npy_error_dtype: return "Unsupported NPY data type";
+  case npy_error_dims: return "Unsupported number of dimensions";
+  case npy_error_memory: return "Out of memory";
+  }
+  return "";
+}
+
+static inline bool npy_is_little_endian() {
+  const uint16_t v = 1;
+  return *(const uint8_t *)&v == 1;
+}
+
+/* Returns the type code of the descr without the byte order, e.g. "f8" */
+static inline const char * npy_get_type_code(nanoclj_tensor_type_t t) {
+  switch (t) {
+  case nanoclj_boolean: return "b1";
+  case nanoclj_i8: return "i1";
+  case nanoclj_i16: return "i2";
+  case nanoclj_i32: return "i4";
+  case nanoclj_i64: return "i8";
+  case nanoclj_u8: return "u1";
+  case nanoclj_u16: return "u2";
+  case nanoclj_u32: return "u4";
+  case nanoclj_f32: return "f4";
+  case nanoclj_f64: return "f8";
+  case nanoclj_val: break;
+  }
+  return NULL;
+}
+
+/* Parses a descr such as "<f8". Data in the non-native byte order is not supported. */
+static inline bool npy_parse_descr(const char * s, size_t n, nanoclj_tensor_type_t * t) {
+  if (n != 3) return false;
+  char native = npy_is_little_endian() ? '<' : '>';
+  static const nanoclj_tensor_type_t types[] = { nanoclj_boolean, nanoclj_i8, nanoclj_i16, nanoclj_i32, nanoclj_i64,
+						 nanoclj_u8, nanoclj_u16, nanoclj_u32, nanoclj_f32, nanoclj_f64 };
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    const char * code = npy_get_type_code(types[i]);
+    if (s[1] == code[0] && s[2] == code[1]) {
+      if (s[0] != '|' && s[0] != '=' && (s[0] != native || code[1] == '1')) return false;
+      *t = types[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Returns a pointer to the value of key in the header dict, or NULL if the key is missing */
+static inline const char * npy_find_key(const char * header, const char * key) {
+  size_t n = strlen(key);
+  for (const char * p = header; (p = strstr(p, key)); p += n) {
+    if (p > header && (p[-1] == '\'' || p[-1] == '"') && p[n] == p[-1]) {
+      p += n + 1;
+      while (*p == ' ') p++;
+      if (*p != ':') return NULL;
+      p++;
+      while (*p == ' ') p++;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/* Parses a header dict. The shape is stored in ne with the innermost dimension first. */
+static inline npy_status_t npy_parse_header(const char * header, nanoclj_tensor_type_t * t, int * n_dims, int64_t * ne, bool * fortran_order) {
+  const char * descr = npy_find_key(header, "descr");
+  const char * order = npy_find_key(header, "fortran_order");
+  const char * shape = npy_find_key(header, "shape");
+  if (!descr || !order || !shape || (*descr != '\'' && *descr != '"') || *shape != '(') return npy_error_format;
+  const char * descr_end = strchr(descr + 1, *descr);
+  if (!descr_end) return npy_error_format;
+  if (!npy_parse_descr(descr + 1, descr_end - descr - 1, t)) return npy_error_dtype;
+  if (strncmp(order, "True", 4) == 0) *fortran_order = true;
+  else if (strncmp(order, "False", 5) == 0) *fortran_order = false;
+  else return npy_error_format;
+
+  int64_t dims[NANOCLJ_MAX_DIMS];
+  int n = 0;
+  const char * p = shape + 1;
+  while ( 1 ) {
+    while (*p == ' ' || *p == ',') p++;
+    if (*p == ')') break;
+    char * end;
+    long long v = strtoll(p, &end, 10);
+    if (end == p || v < 0) return npy_error_format;
+    if (n == NANOCLJ_MAX_DIMS) return npy_error_dims;
+    dims[n++] = v;
+    p = end;
+  }
+  /* A scalar is loaded as a vector of one element */
+  if (n == 0) dims[n++] = 1;
+  *n_dims = n;
+  for (int d = 0; d < n; d++) ne[d] = dims[n - 1 - d];
+  return npy_ok;
+}
+
+/* Reads the header and returns the offset of the data in *offset */
+static inline npy_status_t npy_read_header(FILE * f, nanoclj_tensor_type_t * t, int * n_dims, int64_t * ne, bool * fortran_order, size_t * offset) {
+  uint8_t preamble[12];
+  if (fread(preamble, 1, 10, f) != 10) return ferror(f) ? npy_error_io : npy_error_format;
+  if (memcmp(preamble, NPY_MAGIC, NPY_MAGIC_SIZE) != 0 || preamble[6] < 1 || preamble[6] > 3) return npy_error_format;
+  size_t header_size, start = 10;
+  if (preamble[6] == 1) {
+    header_size = preamble[8] | (preamble[9] << 8);
+  } else {
+    /* Versions 2 and 3 have a 32-bit header length */
+    if (fread(preamble + 10, 1, 2, f) != 2) return npy_error_format;
+    header_size = preamble[8] | (preamble[9] << 8) | (preamble[10] << 16) | ((size_t)preamble[11] << 24);
+    start = 12;
+  }
+  if (header_size > NPY_MAX_HEADER_SIZE) return npy_error_format;
+  char * header = malloc(header_size + 1);
+  if (!header) return npy_error_memory;
+  if (fread(header, 1, header_size, f) != header_size) {
+    free(header);
+    return npy_error_format;
+  }
+  header[header_size] = 0;
+  npy_status_t s = npy_parse_header(header, t, n_dims, ne, fortran_order);
+  free(header);
+  *offset = start + header_size;
+  return s;
+}
+
+/* Loads an NPY file. If possible, the file is mapped into memory and the result is a view of the
+ * mapping, so that the data is only read when it is accessed. The mapping is private, so modifying
+ * the tensor doesn't change the file. Arrays in Fortran order are loaded as transposed views. */
+static inline npy_status_t npy_load(FILE * f, nanoclj_tensor_t ** result) {
+  nanoclj_tensor_type_t t;
+  int n_dims;
+  int64_t ne[NANOCLJ_MAX_DIMS];
+  bool fortran_order;
+  size_t offset;
+  npy_status_t s = npy_read_header(f, &t, &n_dims, ne, &fortran_order, &offset);
+  if (s != npy_ok) return s;
+
+  /* The shape comes from the file, so the size must not overflow with the offset added */
+  size_t es = tensor_get_cell_size(t), size = es;
+  for (int d = 0; d < n_dims; d++) {
+    if (ne[d] && size > (SIZE_MAX - offset) / ne[d]) return npy_error_format;
+    size *= ne[d];
+  }
+
+  /* Strides of the data in the file */
+  size_t nb[NANOCLJ_MAX_DIMS];
+  for (int d = 0; d < n_dims; d++) {
+    if (!fortran_order) {
+      nb[d] = d == 0 ? es : nb[d - 1] * ne[d - 1];
+    } else {
+      int e = n_dims - 1 - d;
+      nb[e] = d == 0 ? es : nb[e + 1] * ne[e + 1];
+    }
+  }
+
+  nanoclj_tensor_t * base = NULL;
+  if (fseek(f, 0, SEEK_SET) == 0) base = mk_tensor_1d_mapped(fileno(f), 0);
+  if (base) {
+    if (base->ne[0] < offset + size) {
+      tensor_free(base);
+      return npy_error_format;
+    }
+  } else {
+    if (!(base = mk_tensor_1d(nanoclj_i8, size + offset))) return npy_error_memory;
+    if (fseek(f, offset, SEEK_SET) != 0 || fread((uint8_t *)base->data + offset, 1, size, f) != size) {
+      tensor_free(base);
+      return npy_error_format;
+    }
+  }
+  if (!(*result = mk_tensor_view(base, t, n_dims, ne, nb, (uint8_t *)base->data + offset))) {
+    tensor_free(base);
+    return npy_error_memory;
+  }
+  return npy_ok;
+}
+
+/* Writes a tensorview to an NPY file in C order */
+static inline npy_status_t npy_save(FILE * f, const tensorview_t * tv) {
+  const char * code = npy_get_type_code(tv->type);
+  if (!code) return npy_error_dtype;
+  char header[256];
+  int n = snprintf(header, sizeof(header), "{'descr': '%c%s', 'fortran_order': False, 'shape': (",
+		   code[1] == '1' ? '|' : (npy_is_little_endian() ? '<' : '>'), code);
+  for (int d = tv->n_dims - 1; d >= 0; d--) {
+    n += snprintf(header + n, sizeof(header) - n, d == 0 && tv->n_dims > 1 ? "%lld" : "%lld,", (long long)tv->ne[d]);
+    if (d > 0) n += snprintf(header + n, sizeof(header) - n, " ");
+  }
+  n += snprintf(header + n, sizeof(header) - n, "), }");
+  /* Pad with spaces and a newline so that the data is aligned */
+  size_t total = (10 + n + 1 + NPY_ALIGNMENT - 1) / NPY_ALIGNMENT * NPY_ALIGNMENT;
+  size_t header_size = total - 10;
+  uint8_t preamble[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, header_size & 0xff, header_size >> 8 };
+  if (fwrite(preamble, 1, 10, f) != 10 || fwrite(header, 1, n, f) != n) return npy_error_io;
+  for (size_t i = n; i + 1 < header_size; i++) {
+    if (fputc(' ', f) == EOF) return npy_error_io;
+  }
+  if (fputc('\n', f) == EOF) return npy_error_io;
+
+  size_t es = tensor_get_cell_size(tv->type);
+  int64_t ne0 = tv->ne[0], ne1 = tv->n_dims >= 2 ? tv->ne[1] : 1, ne2 = tv->n_dims >= 3 ? tv->ne[2] : 1;
+  uint8_t * row = tv->nb[0] != es ? malloc(ne0 * es) : NULL;
+  if (tv->nb[0] != es && !row && ne0 > 0) return npy_error_memory;
+  npy_status_t s = npy_ok;
+  for (int64_t i2 = 0; i2 < ne2 && s == npy_ok; i2++) {
+    for (int64_t i1 = 0; i1 < ne1 && s == npy_ok; i1++) {
+      const uint8_t * p = (const uint8_t *)tv->data + i1 * tv->nb[1] + i2 * tv->nb[2];
+      if (row) {
+	for (int64_t i0 = 0; i0 < ne0; i0++) memcpy(row + i0 * es, p + i0 * tv->nb[0], es);
+	p = row;
+      }
+      if (fwrite(p, es, ne0, f) != ne0) s = npy_error_io;
+    }
+  }
+  free(row);
+  return s;
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef _NANOCLJ_PNG_H_
+#define _NANOCLJ_PNG_H_
+
+#include "nanoclj_threads.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/* A PNG encoder that uses zlib. The rows are split into bands that are filtered and compressed
+ * in parallel. Each band except the last ends in a sync flush, so the compressed bands can be
+ * concatenated into one zlib stream, and their checksums are combined with adler32_combine. */
+
+/* Minimum number of uncompressed bytes per band */
+#define PNG_MIN_BAND_SIZE (1 << 18)
+/* Maximum size of the IDAT chunks */
+#define PNG_MAX_IDAT_SIZE (1 << 20)
+
+typedef struct {
+  int level, strategy, n_threads;
+} png_options_t;
+
+static inline png_options_t png_default_options() {
+  return (png_options_t){ Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY, 1 };
+}
+
+static inline uint8_t png_paeth(int a, int b, int c) {
+  int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+}
+
+static inline uint64_t png_sum_abs(const uint8_t * restrict p, size_t n) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < n; i++) sum += abs((int8_t)p[i]);
+  return sum;
+}
+
+/* Applies filter f to a row. The first bpp bytes have no left neighbour, and prev is NULL for the
+ * first row, in which case only filters 0 and 1 are used. */
+static inline void png_apply_filter(int f, const uint8_t * restrict row, const uint8_t * restrict prev, size_t n, int bpp, uint8_t * restrict out) {
+  size_t k = (size_t)bpp < n ? bpp : n;
+  switch (f) {
+  case 1:
+    memcpy(out, row, k);
+    for (size_t i = k; i < n; i++) out[i] = row[i] - row[i - bpp];
+    break;
+  case 2:
+    for (size_t i = 0; i < n; i++) out[i] = row[i] - prev[i];
+    break;
+  case 3:
+    for (size_t i = 0; i < k; i++) out[i] = row[i] - (prev[i] >> 1);
+    for (size_t i = k; i < n; i++) out[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+    break;
+  case 4:
+    for (size_t i = 0; i < k; i++) out[i] = row[i] - prev[i];
+    for (size_t i = k; i < n; i++) out[i] = row[i] - png_paeth(row[i - bpp], prev[i], prev[i - bpp]);
+    break;
+  }
+}
+
+/* Writes the filter type and the filtered row to out. The filter with the minimum sum of absolute
+ * values is chosen, unless adaptive is false. */
+static inline void png_filter_row(const uint8_t * restrict row, const uint8_t * restrict prev, size_t n, int bpp, bool adaptive,
+				  uint8_t * restrict out, uint8_t * restrict tmp) {
+  out[0] = 0;
+  memcpy(out + 1, row, n);
+  if (!adaptive) return;
+  uint64_t best = png_sum_abs(row, n);
+  for (int f = 1; f <= (prev ? 4 : 1); f++) {
+    png_apply_filter(f, row, prev, n, bpp, tmp);
+    uint64_t sum = png_sum_abs(tmp, n);
+    if (sum < best) {
+      best = sum;
+      out[0] = f;
+      memcpy(out + 1, tmp, n);
+    }
+  }
+}
+
+typedef struct {
+  const uint8_t * pixels;
+  size_t stride, row_size;
+  int bpp, y0, y1;
+  bool last;
+  png_options_t options;
+  uint8_t * output;
+  size_t output_size;
+  uLong adler;
+  bool ok;
+} png_band_t;
+
+static inline NANOCLJ_THREAD_SIG png_band_main(void * arg) {
+  png_band_t * band = arg;
+  size_t n = band->row_size, input_size = (size_t)(band->y1 - band->y0) * (n + 1);
+  uint8_t * input = malloc(input_size), * tmp = malloc(n + 1);
+  band->ok = false;
+  if (input && tmp) {
+    for (int y = band->y0; y < band->y1; y++) {
+      const uint8_t * row = band->pixels + y * band->stride;
+      png_filter_row(row, y > 0 ? row - band->stride : NULL, n, band->bpp, band->options.level != 0,
+		     input + (size_t)(y - band->y0) * (n + 1), tmp);
+    }
+    band->adler = adler32(adler32(0L, Z_NULL, 0), input, input_size);
+
+    z_stream strm = { 0 };
+    if (deflateInit2(&strm, band->options.level, Z_DEFLATED, -MAX_WBITS, 8, band->options.strategy) == Z_OK) {
+      /* The bound is for a finished stream, and a sync flush adds an empty stored block */
+      size_t capacity = deflateBound(&strm, input_size) + 16;
+      band->output = malloc(capacity);
+      if (band->output) {
+	strm.next_in = input;
+	strm.avail_in = input_size;
+	strm.next_out = band->output;
+	strm.avail_out = capacity;
+	int r = deflate(&strm, band->last ? Z_FINISH : Z_SYNC_FLUSH);
+	band->output_size = capacity - strm.avail_out;
+	band->ok = band->last ? r == Z_STREAM_END : r == Z_OK && strm.avail_in == 0 && strm.avail_out > 0;
+      }
+      deflateEnd(&strm);
+    }
+  }
+  free(input);
+  free(tmp);
+  return 0;
+}
+
+static inline void png_put_u32(uint8_t * p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static inline bool png_write_chunk(FILE * f, const char * type, const uint8_t * data, size_t size) {
+  uint8_t header[8], crc[4];
+  png_put_u32(header, size);
+  memcpy(header + 4, type, 4);
+  uLong c = crc32(crc32(0L, Z_NULL, 0), header + 4, 4);
+  if (size) c = crc32(c, data, size);
+  png_put_u32(crc, c);
+  return fwrite(header, 1, 8, f) == 8 && (!size || fwrite(data, 1, size, f) == size) && fwrite(crc, 1, 4, f) == 4;
+}
+
+/* Writes an 8-bit image with 1 to 4 channels (gray, gray-alpha, RGB or RGBA) */
+static inline bool png_write(FILE * f, const uint8_t * pixels, size_t stride, int w, int h, int channels, png_options_t options) {
+  static const uint8_t color_types[] = { 0, 0, 4, 2, 6 };
+  if (channels < 1 || channels > 4 || w <= 0 || h <= 0) return false;
+  size_t row_size = (size_t)w * channels;
+
+  int n_bands = options.n_threads;
+  size_t bands_max = (row_size + 1) * h / PNG_MIN_BAND_SIZE;
+  if (n_bands > bands_max) n_bands = bands_max;
+  if (n_bands > h) n_bands = h;
+  if (n_bands < 1) n_bands = 1;
+  png_band_t * bands = calloc(n_bands, sizeof(png_band_t));
+  if (!bands) return false;
+  for (int i = 0; i < n_bands; i++) {
+    bands[i] = (png_band_t){ pixels, stride, row_size, channels, h * i / n_bands, h * (i + 1) / n_bands, i + 1 == n_bands, options };
+  }
+  nanoclj_run_parallel(png_band_main, bands, sizeof(png_band_t), n_bands);
+
+  bool ok = true;
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for (int i = 0; i < n_bands; i++) {
+    ok = ok && bands[i].ok;
+    adler = adler32_combine(adler, bands[i].adler, (z_off_t)(bands[i].y1 - bands[i].y0) * (row_size + 1));
+  }
+
+  uint8_t ihdr[13];
+  png_put_u32(ihdr, w);
+  png_put_u32(ihdr + 4, h);
+  ihdr[8] = 8;
+  ihdr[9] = color_types[channels];
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+  /* The zlib header: deflate with a 32K window and a level hint, and a check value that makes it a multiple of 31 */
+  int level = options.level == Z_DEFAULT_COMPRESSION ? 6 : options.level;
+  uint8_t zlib_header[2] = { 0x78, (level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3) << 6 };
+  zlib_header[1] += 31 - ((zlib_header[0] << 8) + zlib_header[1]) % 31;
+  uint8_t zlib_trailer[4];
+  png_put_u32(zlib_trailer, adler);
+
+  ok = ok && fwrite("\x89PNG\r\n\x1a\n", 1, 8, f) == 8 && png_write_chunk(f, "IHDR", ihdr, 13);
+  ok = ok && png_write_chunk(f, "IDAT", zlib_header, 2);
+  for (int i = 0; i < n_bands && ok; i++) {
+    for (size_t offset = 0; offset < bands[i].output_size && ok; offset += PNG_MAX_IDAT_SIZE) {
+      size_t size = bands[i].output_size - offset < PNG_MAX_IDAT_SIZE ? bands[i].output_size - offset : PNG_MAX_IDAT_SIZE;
+      ok = png_write_chunk(f, "IDAT", bands[i].output + offset, size);
+    }
+  }
+  ok = ok && png_write_chunk(f, "IDAT", zlib_trailer, 4) && png_write_chunk(f, "IEND", NULL, 0);
+
+  for (int i = 0; i < n_bands; i++) free(bands[i].output);
+  free(bands);
+  return ok;
+}
+
+#endif
@@ -24,6 +24,7 @@ extern "C" {
 #define SIGNATURE_EMPTYLIST	SIGNATURE(MASK_SIGN | 2)
 #define SIGNATURE_REGEX		SIGNATURE(MASK_SIGN | 3)
 #define SIGNATURE_NOTFOUND      SIGNATURE(MASK_SIGN | 4)
+#define SIGNATURE_LONG		SIGNATURE(MASK_SIGN | 5)
 #define SIGNATURE_NIL		SIGNATURE(MASK_SIGN | 7)
 #define SIGNATURE_NAN		SIGNATURE(0)
 #define SIGNATURE_BOOLEAN	SIGNATURE(1)
@@ -34,6 +35,10 @@ extern "C" {
 #define SIGNATURE_SYMBOL	SIGNATURE(6)
 #define SIGNATURE_ALIAS		SIGNATURE(7)
 
+/* Longs in this range are stored in the 48-bit payload, and the rest are boxed */
+#define LONG_PRIM_MIN		(-(INT64_C(1) << 47))
+#define LONG_PRIM_MAX		((INT64_C(1) << 47) - 1)
+
 /* Predefined primitive values */
 #define kNAN	  UINT64_C(0x7ff8000000000000)
 #define kFALSE	  UINT64_C(0x7ff9000000000000)
@@ -77,8 +82,13 @@ static inline nanoclj_val_t mk_int(int32_t num) {
   return mk_val_from_long(SIGNATURE_INTEGER | (UINT64_C(2) << 32) | (uint32_t)num);
 }
 
-static inline nanoclj_val_t mk_long_prim(int32_t num) {
-  return mk_val_from_long(SIGNATURE_INTEGER | (UINT64_C(3) << 32) | (uint32_t)num);
+static inline bool is_long_prim_range(long long num) {
+  return num >= LONG_PRIM_MIN && num <= LONG_PRIM_MAX;
+}
+
+/* Creates a primitive long, num must be in the range LONG_PRIM_MIN..LONG_PRIM_MAX */
+static inline nanoclj_val_t mk_long_prim(int64_t num) {
+  return mk_val_from_long(SIGNATURE_LONG | ((uint64_t)num & MASK_PAYLOAD));
 }
 
 /* Creates a primitive for utf8 codepoint */
@@ -141,6 +151,14 @@ static inline int32_t decode_integer(nanoclj_val_t value) {
   return (uint32_t)(value.as_long & 0xffffffff);
 }
 
+/* Decodes a primitive byte, short, int or long */
+static inline int64_t decode_long(nanoclj_val_t value) {
+  if ((value.as_long & MASK_SIGNATURE) == SIGNATURE_LONG) {
+    return (int64_t)(value.as_long << 16) >> 16;
+  }
+  return decode_integer(value);
+}
+
 static inline bool is_cell(nanoclj_val_t v) {
   return (v.as_long & MASK_SIGNATURE) == SIGNATURE_CELL;
 }
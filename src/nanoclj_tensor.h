@@ -7,6 +7,11 @@
 
 #include <stdatomic.h>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 struct nanoclj_tensor_s {
   int n_dims;
   int64_t ne[NANOCLJ_MAX_DIMS]; /* number of elements */
@@ -15,6 +20,8 @@ struct nanoclj_tensor_s {
   void * data;
   nanoclj_tensor_type_t type;
   atomic_size_t refcnt;
+  size_t mapped_size; /* non-zero if data is a memory mapping */
+  struct nanoclj_tensor_s * base; /* owner of the data if the tensor is a view */
 };
 
 static inline size_t tensor_get_cell_size(nanoclj_tensor_type_t t) {
@@ -26,14 +33,32 @@ static inline size_t tensor_get_cell_size(nanoclj_tensor_type_t t) {
   case nanoclj_f32: return sizeof(float);
   case nanoclj_f64: return sizeof(double);
   case nanoclj_val: return sizeof(nanoclj_val_t);
+  case nanoclj_i64: return sizeof(uint64_t);
+  case nanoclj_u8: return sizeof(uint8_t);
+  case nanoclj_u16: return sizeof(uint16_t);
+  case nanoclj_u32: return sizeof(uint32_t);
   }
   return 0;
 }
 
+static inline void tensor_release(nanoclj_tensor_t * tensor);
+
 static inline void tensor_free(nanoclj_tensor_t * tensor) {
-  if (tensor) {
+  if (tensor && tensor->base) {
+    /* A view only owns its shape */
+    tensor_release(tensor->base);
+    free(tensor);
+  } else if (tensor) {
     free(tensor->sparse_indices);
+#ifndef WIN32
+    if (tensor->mapped_size) {
+      munmap(tensor->data, tensor->mapped_size);
+    } else {
+      free(tensor->data);
+    }
+#else
     free(tensor->data);
+#endif
     free(tensor);
   }
 }
@@ -50,6 +75,22 @@ static inline void tensor_release(nanoclj_tensor_t * tensor) {
   }
 }
 
+/* Reallocates the data of a tensor. Mapped data is copied into the heap. */
+static inline void * tensor_realloc_data(nanoclj_tensor_t * tensor, size_t size) {
+#ifndef WIN32
+  if (tensor->mapped_size) {
+    void * data = malloc(size);
+    if (data) {
+      memcpy(data, tensor->data, size < tensor->mapped_size ? size : tensor->mapped_size);
+      munmap(tensor->data, tensor->mapped_size);
+      tensor->mapped_size = 0;
+    }
+    return data;
+  }
+#endif
+  return realloc(tensor->data, size);
+}
+
 /* Assumes tensor is 1-dimensional and peeks the last element */
 static inline nanoclj_val_t tensor_peek(const nanoclj_tensor_t * tensor) {
   if (tensor->ne[0] > 0) {
@@ -75,7 +116,7 @@ static inline void tensor_mutate_pop(nanoclj_tensor_t * tensor) {
 static inline void tensor_mutate_push(nanoclj_tensor_t * tensor, nanoclj_val_t val) {
   if (tensor->ne[0] * tensor->nb[0] >= tensor->nb[1]) {
     tensor->nb[1] = 2 * (tensor->ne[0] + 1) * tensor->nb[0];
-    tensor->data = realloc(tensor->data, tensor->nb[1]);
+    tensor->data = tensor_realloc_data(tensor, tensor->nb[1]);
   }
   ((nanoclj_val_t *)tensor->data)[tensor->ne[0]++] = val;
 }
@@ -87,11 +128,11 @@ static inline void tensor_mutate_clear(nanoclj_tensor_t * tensor) {
 static inline int64_t tensor_n_elem(const nanoclj_tensor_t * tensor) {
   int64_t n = 1;
   switch (tensor->n_dims) {
-  case 3: n *= tensor->ne[2]; return true;
-  case 2: n *= tensor->ne[1]; return true;
-  case 1: n *= tensor->ne[0]; return true;
+  case 3: n *= tensor->ne[2];
+  case 2: n *= tensor->ne[1];
+  case 1: n *= tensor->ne[0];
   }
-  return false;
+  return n;
 }
 
 static inline size_t tensor_size(const nanoclj_tensor_t * tensor) {
@@ -116,9 +157,13 @@ static inline bool tensor_is_identity(const nanoclj_tensor_t * tensor) {
     /* Simple one-element object */
     switch (tensor->type) {
     case nanoclj_boolean:
-    case nanoclj_i8: return *(uint8_t*)tensor->data == 1;
-    case nanoclj_i16: return *(uint16_t*)tensor->data == 1;
-    case nanoclj_i32: return *(uint32_t*)tensor->data == 1;
+    case nanoclj_i8:
+    case nanoclj_u8: return *(uint8_t*)tensor->data == 1;
+    case nanoclj_i16:
+    case nanoclj_u16: return *(uint16_t*)tensor->data == 1;
+    case nanoclj_i32:
+    case nanoclj_u32: return *(uint32_t*)tensor->data == 1;
+    case nanoclj_i64: return *(uint64_t*)tensor->data == 1;
     case nanoclj_f32: return *(float*)tensor->data == 1.0f;
     case nanoclj_f64:
     case nanoclj_val: return *(double*)tensor->data == 1.0;
@@ -130,23 +175,27 @@ static inline bool tensor_is_identity(const nanoclj_tensor_t * tensor) {
 }
 
 static inline void tensor_mutate_set_i8(nanoclj_tensor_t * tensor, int64_t i, uint8_t v) {
-  ((uint8_t *)tensor->data)[i] = v;
+  *(uint8_t *)(tensor->data + i * tensor->nb[0]) = v;
 }
 
 static inline void tensor_mutate_set_i16(nanoclj_tensor_t * tensor, int64_t i, uint16_t v) {
-  ((uint16_t *)tensor->data)[i] = v;
+  *(uint16_t *)(tensor->data + i * tensor->nb[0]) = v;
 }
 
 static inline void tensor_mutate_set_i32(nanoclj_tensor_t * tensor, int64_t i, uint32_t v) {
-  ((uint32_t *)tensor->data)[i] = v;
+  *(uint32_t *)(tensor->data + i * tensor->nb[0]) = v;
+}
+
+static inline void tensor_mutate_set_i64(nanoclj_tensor_t * tensor, int64_t i, uint64_t v) {
+  *(uint64_t *)(tensor->data + i * tensor->nb[0]) = v;
 }
 
 static inline void tensor_mutate_set_f32(nanoclj_tensor_t * tensor, int64_t i, double v) {
-  ((float *)tensor->data)[i] = v;
+  *(float *)(tensor->data + i * tensor->nb[0]) = v;
 }
 
 static inline void tensor_mutate_set_f64(nanoclj_tensor_t * tensor, int64_t i, double v) {
-  ((double *)tensor->data)[i] = v;
+  *(double *)(tensor->data + i * tensor->nb[0]) = v;
 }
 
 static inline void tensor_mutate_set_f64_2d(nanoclj_tensor_t * tensor, int64_t i, int64_t j, double v) {
@@ -154,7 +203,7 @@ static inline void tensor_mutate_set_f64_2d(nanoclj_tensor_t * tensor, int64_t i
 }
 
 static inline void tensor_mutate_set(nanoclj_tensor_t * tensor, int64_t i, nanoclj_val_t v) {
-  tensor_mutate_set_f64(tensor, i, v.as_double);
+  ((nanoclj_val_t *)tensor->data)[i] = v;
 }
 
 static inline void tensor_mutate_set_2d(nanoclj_tensor_t * tensor, int64_t i, int64_t j, nanoclj_val_t v) {
@@ -162,23 +211,27 @@ static inline void tensor_mutate_set_2d(nanoclj_tensor_t * tensor, int64_t i, in
 }
 
 static inline uint8_t tensor_get_i8(const nanoclj_tensor_t * tensor, int64_t i) {
-  return ((uint8_t *)tensor->data)[i];
+  return *(uint8_t *)(tensor->data + i * tensor->nb[0]);
 }
 
 static inline uint16_t tensor_get_i16(const nanoclj_tensor_t * tensor, int64_t i) {
-  return ((uint16_t *)tensor->data)[i];
+  return *(uint16_t *)(tensor->data + i * tensor->nb[0]);
 }
 
 static inline uint32_t tensor_get_i32(const nanoclj_tensor_t * tensor, int64_t i) {
-  return ((uint32_t *)tensor->data)[i];
+  return *(uint32_t *)(tensor->data + i * tensor->nb[0]);
+}
+
+static inline uint64_t tensor_get_i64(const nanoclj_tensor_t * tensor, int64_t i) {
+  return *(uint64_t *)(tensor->data + i * tensor->nb[0]);
 }
 
 static inline double tensor_get_f32(const nanoclj_tensor_t * tensor, int64_t i) {
-  return ((float *)tensor->data)[i];
+  return *(float *)(tensor->data + i * tensor->nb[0]);
 }
 
 static inline double tensor_get_f64(const nanoclj_tensor_t * tensor, int64_t i) {
-  return ((double *)tensor->data)[i];
+  return *(double *)(tensor->data + i * tensor->nb[0]);
 }
 
 static inline double tensor_get_i8_2d(const nanoclj_tensor_t * tensor, int64_t i, int64_t j) {
@@ -201,40 +254,63 @@ static inline double tensor_get_f64_2d(const nanoclj_tensor_t * tensor, int64_t
   return *(double *)(tensor->data + i * tensor->nb[0] + j * tensor->nb[1]);
 }
 
-static inline nanoclj_val_t tensor_get(const nanoclj_tensor_t * tensor, int64_t i) {
-  switch (tensor->type) {
-  case nanoclj_boolean: return mk_boolean(tensor_get_i8(tensor, i));
-  case nanoclj_i8: return mk_byte(tensor_get_i8(tensor, i));
-  case nanoclj_i16: return mk_short(tensor_get_i16(tensor, i));
-  case nanoclj_i32: return mk_int(tensor_get_i32(tensor, i));
-  case nanoclj_f32: return mk_double(tensor_get_f32(tensor, i));
-  case nanoclj_f64: return mk_double(tensor_get_f64(tensor, i));
-  case nanoclj_val:
-    { /* Can't use mk_double() here since it would break nan-packing */
-      nanoclj_val_t v;
-      v.as_double = tensor_get_f64(tensor, i);
-      return v;
+/* Returns true if the elements of type t are 64-bit integers or unsigned 32-bit integers,
+ * which don't always fit in a primitive value */
+static inline bool tensor_is_long_type(nanoclj_tensor_type_t t) {
+  return t == nanoclj_i64 || t == nanoclj_u32;
+}
+
+/* Loads an element of type t from p as a 64-bit integer */
+static inline int64_t tensor_load_long(nanoclj_tensor_type_t t, const void * p) {
+  return t == nanoclj_i64 ? *(const int64_t *)p : *(const uint32_t *)p;
+}
+
+/* Loads a numeric element of type t from p. Unsigned integers are widened to the next signed type.
+ * Long elements that don't fit in 32 bits must be boxed by the caller, and nil is returned for them. */
+static inline nanoclj_val_t tensor_load_val(nanoclj_tensor_type_t t, const void * p) {
+  switch (t) {
+  case nanoclj_boolean: return mk_boolean(*(const uint8_t *)p);
+  case nanoclj_i8: return mk_byte(*(const uint8_t *)p);
+  case nanoclj_i16: return mk_short(*(const uint16_t *)p);
+  case nanoclj_i32: return mk_int(*(const uint32_t *)p);
+  case nanoclj_f32: return mk_double(*(const float *)p);
+  case nanoclj_f64: return mk_double(*(const double *)p);
+  case nanoclj_val: return *(const nanoclj_val_t *)p;
+  case nanoclj_u8: return mk_short(*(const uint8_t *)p);
+  case nanoclj_u16: return mk_int(*(const uint16_t *)p);
+  case nanoclj_i64:
+  case nanoclj_u32:
+    {
+      int64_t v = tensor_load_long(t, p);
+      if (is_long_prim_range(v)) return mk_long_prim(v);
     }
+    break;
   }
   return mk_nil();
 }
 
+static inline nanoclj_val_t tensor_get(const nanoclj_tensor_t * tensor, int64_t i) {
+  if (tensor->type == nanoclj_val) {
+    /* Can't use mk_double() here since it would break nan-packing */
+    return ((const nanoclj_val_t *)tensor->data)[i];
+  }
+  return tensor_load_val(tensor->type, tensor->data + i * tensor->nb[0]);
+}
+
 static inline nanoclj_val_t tensor_get_2d(const nanoclj_tensor_t * tensor, int64_t i, int64_t j) {
   switch (tensor->type) {
-  case nanoclj_boolean:
-  case nanoclj_i8: return mk_byte(tensor_get_i8_2d(tensor, i, j));
-  case nanoclj_i16: return mk_short(tensor_get_i16_2d(tensor, i, j));
-  case nanoclj_i32: return mk_int(tensor_get_i32_2d(tensor, i, j));
-  case nanoclj_f32: return mk_double(tensor_get_f32_2d(tensor, i, j));
-  case nanoclj_f64: return mk_double(tensor_get_f32_2d(tensor, i, j));
   case nanoclj_val:
     { /* Can't use mk_double() here since it would break nan-packing */
       nanoclj_val_t v;
       v.as_double = tensor_get_f64_2d(tensor, i, j);
       return v;
     }
+  case nanoclj_boolean:
+    /* Booleans are read as bytes */
+    return mk_byte(tensor_get_i8_2d(tensor, i, j));
+  default:
+    return tensor_load_val(tensor->type, tensor->data + i * tensor->nb[0] + j * tensor->nb[1]);
   }
-  return mk_nil();
 }
 
 /* Creates a 1D tensor with padding (reserve space)*/
@@ -256,6 +332,8 @@ static inline nanoclj_tensor_t * mk_tensor_1d_padded(nanoclj_tensor_type_t t, in
       tensor->nb[0] = type_size;
       tensor->nb[1] = size;
       tensor->refcnt = 0;
+      tensor->mapped_size = 0;
+      tensor->base = NULL;
       return tensor;
     } else {
       free(data);
@@ -285,6 +363,8 @@ static inline nanoclj_tensor_t * mk_tensor_2d_padded(nanoclj_tensor_type_t t, in
       tensor->nb[1] = d0 * type_size;
       tensor->nb[2] = size;
       tensor->refcnt = 0;
+      tensor->mapped_size = 0;
+      tensor->base = NULL;
       return tensor;
     }
   }
@@ -296,41 +376,147 @@ static inline nanoclj_tensor_t * mk_tensor_1d(nanoclj_tensor_type_t t, int64_t s
   return mk_tensor_1d_padded(t, size, 0);
 }
 
+/* Creates a 1D byte tensor by mapping the contents of a regular file of at least min_size bytes.
+ * Returns NULL if the file cannot be mapped, or if its size changed while it was being mapped, in
+ * which case it should be read instead. The mapping is private, so the tensor can be modified
+ * without affecting the file, but the unmodified pages are shared with the page cache: if the
+ * file is truncated while the tensor is alive, accessing the lost pages raises SIGBUS. */
+static inline nanoclj_tensor_t * mk_tensor_1d_mapped(int fd, size_t min_size) {
+#ifndef WIN32
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return NULL;
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (offset != 0 || st.st_size <= 0 || (size_t)st.st_size < min_size) return NULL;
+  size_t size = st.st_size;
+  void * data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) return NULL;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != size) {
+    munmap(data, size);
+    return NULL;
+  }
+  nanoclj_tensor_t * tensor = malloc(sizeof(nanoclj_tensor_t));
+  if (!tensor) {
+    munmap(data, size);
+    return NULL;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+  tensor->type = nanoclj_i8;
+  tensor->data = data;
+  tensor->sparse_indices = NULL;
+  tensor->n_dims = 1;
+  tensor->ne[0] = size;
+  tensor->nb[0] = 1;
+  tensor->nb[1] = size;
+  tensor->refcnt = 0;
+  tensor->mapped_size = size;
+  tensor->base = NULL;
+  return tensor;
+#else
+  return NULL;
+#endif
+}
+
 static inline nanoclj_tensor_t * mk_tensor_2d(nanoclj_tensor_type_t t, int64_t d0, int64_t d1) {
   return mk_tensor_2d_padded(t, d0, d1, 0);
 }
 
+/* Creates a 3D tensor that takes ownership of data, which must have been allocated with malloc */
+static inline nanoclj_tensor_t * mk_tensor_3d_with_data(nanoclj_tensor_type_t t, int64_t d0, size_t stride0,
+							int64_t d1, size_t stride1, int64_t d2, void * data) {
+  size_t type_size = tensor_get_cell_size(t);
+  if (!type_size || !data) return NULL;
+
+  nanoclj_tensor_t * tensor = malloc(sizeof(nanoclj_tensor_t));
+  if (tensor) {
+    tensor->type = t;
+    tensor->data = data;
+    tensor->sparse_indices = NULL;
+    tensor->n_dims = 3;
+    tensor->ne[0] = d0;
+    tensor->ne[1] = d1;
+    tensor->ne[2] = d2;
+    tensor->nb[0] = type_size;
+    tensor->nb[1] = stride0;
+    tensor->nb[2] = stride1;
+    tensor->nb[3] = d2 * stride1;
+    tensor->refcnt = 0;
+    tensor->mapped_size = 0;
+    tensor->base = NULL;
+  }
+  return tensor;
+}
+
 static inline nanoclj_tensor_t * mk_tensor_3d(nanoclj_tensor_type_t t, int64_t d0, size_t stride0,
 					      int64_t d1, size_t stride1, int64_t d2) {
+  if (!tensor_get_cell_size(t)) return NULL;
+  void * data = malloc(d2 * stride1);
+  nanoclj_tensor_t * tensor = mk_tensor_3d_with_data(t, d0, stride0, d1, stride1, d2, data);
+  if (!tensor) free(data);
+  return tensor;
+}
+
+/* Creates a contiguous tensor with the given shape */
+static inline nanoclj_tensor_t * mk_tensor_nd(nanoclj_tensor_type_t t, int n_dims, const int64_t * ne) {
   size_t type_size = tensor_get_cell_size(t);
-  if (!type_size) return NULL;
+  switch (n_dims) {
+  case 1: return mk_tensor_1d(t, ne[0]);
+  case 2: return mk_tensor_2d(t, ne[0], ne[1]);
+  case 3: return mk_tensor_3d(t, ne[0], ne[0] * type_size, ne[1], ne[0] * ne[1] * type_size, ne[2]);
+  }
+  return NULL;
+}
 
-  void * data = malloc(d2 * stride1);
-  if (data) {
-    nanoclj_tensor_t * tensor = malloc(sizeof(nanoclj_tensor_t));
-    if (!tensor) {
-      free(data);
-    } else {
-      tensor->type = t;
-      tensor->data = data;
-      tensor->sparse_indices = NULL;
-      tensor->n_dims = 3;
-      tensor->ne[0] = d0;
-      tensor->ne[1] = d1;
-      tensor->ne[2] = d2;
-      tensor->nb[0] = type_size;
-      tensor->nb[1] = stride0;
-      tensor->nb[2] = stride1;
-      tensor->nb[3] = d2 * stride1;
-      tensor->refcnt = 0;
-      return tensor;
+/* Creates a view that shares the data of base with its own type, shape and strides.
+ * The view keeps the owner of the data alive. */
+static inline nanoclj_tensor_t * mk_tensor_view(nanoclj_tensor_t * base, nanoclj_tensor_type_t t, int n_dims, const int64_t * ne, const size_t * nb, void * data) {
+  if (n_dims < 1 || n_dims > NANOCLJ_MAX_DIMS) return NULL;
+  nanoclj_tensor_t * tensor = malloc(sizeof(nanoclj_tensor_t));
+  if (tensor) {
+    while (base->base) base = base->base;
+    base->refcnt++;
+    tensor->type = t;
+    tensor->data = data;
+    tensor->sparse_indices = NULL;
+    tensor->n_dims = n_dims;
+    for (int i = 0; i < n_dims; i++) {
+      tensor->ne[i] = ne[i];
+      tensor->nb[i] = nb[i];
     }
+    tensor->nb[n_dims] = ne[n_dims - 1] * nb[n_dims - 1];
+    tensor->refcnt = 0;
+    tensor->mapped_size = 0;
+    tensor->base = base;
   }
-  return NULL;
+  return tensor;
+}
+
+/* Copies a tensor with arbitrary strides into a new contiguous tensor */
+static inline nanoclj_tensor_t * tensor_dup_contiguous(const nanoclj_tensor_t * tensor) {
+  nanoclj_tensor_t * t = mk_tensor_nd(tensor->type, tensor->n_dims, tensor->ne);
+  if (t) {
+    size_t s = t->nb[0];
+    int64_t ne0 = tensor->ne[0];
+    int64_t ne1 = tensor->n_dims >= 2 ? tensor->ne[1] : 1;
+    int64_t ne2 = tensor->n_dims >= 3 ? tensor->ne[2] : 1;
+    uint8_t * dst = t->data;
+    for (int64_t i2 = 0; i2 < ne2; i2++) {
+      for (int64_t i1 = 0; i1 < ne1; i1++, dst += ne0 * s) {
+	const uint8_t * src = tensor->data + i2 * tensor->nb[2] + i1 * tensor->nb[1];
+	if (tensor->nb[0] == s) {
+	  memcpy(dst, src, ne0 * s);
+	} else {
+	  for (int64_t i0 = 0; i0 < ne0; i0++) memcpy(dst + i0 * s, src + i0 * tensor->nb[0], s);
+	}
+      }
+    }
+  }
+  return t;
 }
 
 static inline nanoclj_tensor_t * tensor_dup(const nanoclj_tensor_t * tensor) {
-  if (tensor->n_dims == 2) {
+  if (tensor->base || tensor->n_dims == 3) {
+    return tensor_dup_contiguous(tensor);
+  } else if (tensor->n_dims == 2) {
     size_t is = tensor->nb[tensor->n_dims] / tensor->nb[tensor->n_dims - 1];
     nanoclj_tensor_t * t = mk_tensor_2d_padded(tensor->type, tensor->ne[0], tensor->ne[1], is - tensor->ne[1]);
     if (tensor->sparse_indices) {
@@ -415,12 +601,19 @@ static inline nanoclj_tensor_t * tensor_push_f32(nanoclj_tensor_t * tensor, size
 }
 
 /* Semimutable push */
-static inline nanoclj_tensor_t * tensor_push_f64(nanoclj_tensor_t * tensor, size_t head, float val) {
+static inline nanoclj_tensor_t * tensor_push_f64(nanoclj_tensor_t * tensor, size_t head, double val) {
   tensor = tensor_resize(tensor, head, head + 1);
   tensor_mutate_set_f64(tensor, head, val);
   return tensor;
 }
 
+/* Semimutable push */
+static inline nanoclj_tensor_t * tensor_push_i64(nanoclj_tensor_t * tensor, size_t head, uint64_t val) {
+  tensor = tensor_resize(tensor, head, head + 1);
+  tensor_mutate_set_i64(tensor, head, val);
+  return tensor;
+}
+
 /* Semimutable push */
 static inline nanoclj_tensor_t * tensor_push_vec(nanoclj_tensor_t * tensor, int64_t head, nanoclj_val_t * vec) {
   tensor = tensor_resize(tensor, head, head + 1);
@@ -431,7 +624,7 @@ static inline nanoclj_tensor_t * tensor_push_vec(nanoclj_tensor_t * tensor, int6
 static inline void tensor_mutate_append_i32(nanoclj_tensor_t * s, int32_t v) {
   if ((s->ne[0] + 1) * sizeof(int32_t) > s->nb[1]) {
     s->nb[1] = 2 * (s->ne[0] + 1) * sizeof(int32_t);
-    s->data = realloc(s->data, s->nb[1]);
+    s->data = tensor_realloc_data(s, s->nb[1]);
   }
   *(int32_t*)(s->data + s->ne[0] * s->nb[0]) = v;
   s->ne[0]++;
@@ -440,7 +633,7 @@ static inline void tensor_mutate_append_i32(nanoclj_tensor_t * s, int32_t v) {
 static inline size_t tensor_mutate_append_bytes(nanoclj_tensor_t * s, const uint8_t * ptr, size_t n) {
   if (s->ne[0] + n > s->nb[1]) {
     s->nb[1] = 2 * (s->ne[0] + n);
-    s->data = realloc(s->data, s->nb[1]);
+    s->data = tensor_realloc_data(s, s->nb[1]);
   }
   memcpy(s->data + s->ne[0], ptr, n);
   s->ne[0] += n;
@@ -456,7 +649,7 @@ static inline void tensor_mutate_fill_i8(nanoclj_tensor_t * tensor, uint8_t v) {
 static inline void tensor_mutate_append_vec(nanoclj_tensor_t * t, void * vec) {
   if ((t->ne[1] + 1) * t->nb[1] > t->nb[2]) {
     t->nb[2] = 2 * (t->ne[1] + 1) * t->nb[1];
-    t->data = realloc(t->data, t->nb[2]);
+    t->data = tensor_realloc_data(t, t->nb[2]);
   }
   memcpy(t->data + t->ne[1] * t->nb[1], vec, t->nb[1]);
   t->ne[1]++;
@@ -729,26 +922,137 @@ static inline bool tensor_bigint_mutate_sub_int(nanoclj_tensor_t * tensor, uint3
   return false;
 }
 
-static inline nanoclj_tensor_t * tensor_bigint_mul(const nanoclj_tensor_t * a, const nanoclj_tensor_t * b) {
-  int64_t n_a = a->ne[0], n_b = b->ne[0];
-  nanoclj_tensor_t * tensor = mk_tensor_1d(nanoclj_i32, n_a + n_b);
-  tensor_mutate_fill_i8(tensor, 0);
-  const uint32_t * limbs_a = a->data, * limbs_b = b->data;
-  uint32_t * limbs_c = tensor->data;
+/* Operand size in limbs below which multiplication uses the schoolbook method */
+#define BIGINT_KARATSUBA_THRESHOLD 32
 
+/* Sets r = a + b, where n_a >= n_b and r has room for n_a limbs, and returns the carry */
+static inline uint32_t bigint_limbs_add(uint32_t * r, const uint32_t * a, int64_t n_a, const uint32_t * b, int64_t n_b) {
+  uint64_t x = 0;
+  int64_t i = 0;
+  for (; i < n_b; i++) {
+    x += (uint64_t)a[i] + b[i];
+    r[i] = x;
+    x >>= 32;
+  }
+  for (; i < n_a; i++) {
+    x += a[i];
+    r[i] = x;
+    x >>= 32;
+  }
+  return x;
+}
+
+/* Sets r = a - b, where n_a >= n_b and r has room for n_a limbs, and returns the borrow */
+static inline uint32_t bigint_limbs_sub(uint32_t * r, const uint32_t * a, int64_t n_a, const uint32_t * b, int64_t n_b) {
+  uint32_t borrow = 0;
+  int64_t i = 0;
+  for (; i < n_b; i++) {
+    uint64_t x = (uint64_t)a[i] - b[i] - borrow;
+    r[i] = x;
+    borrow = (x >> 32) & 1;
+  }
+  for (; i < n_a; i++) {
+    uint64_t x = (uint64_t)a[i] - borrow;
+    r[i] = x;
+    borrow = (x >> 32) & 1;
+  }
+  return borrow;
+}
+
+static inline void bigint_limbs_mul_basecase(uint32_t * r, const uint32_t * a, int64_t n_a, const uint32_t * b, int64_t n_b) {
+  memset(r, 0, (n_a + n_b) * sizeof(uint32_t));
   for (int64_t i = 0; i < n_a; i++) {
     uint64_t t = 0;
     for (int64_t j = 0; j < n_b; j++) {
-      t += limbs_c[i + j] + (uint64_t)limbs_a[i] * limbs_b[j];
-      limbs_c[i + j] = t;
+      t += r[i + j] + (uint64_t)a[i] * b[j];
+      r[i + j] = t;
       t >>= 32;
     }
-    if (t) limbs_c[i + n_b] = t;
+    r[i + n_b] = t;
+  }
+}
+
+static inline void bigint_limbs_mul(uint32_t * r, const uint32_t * a, int64_t n_a, const uint32_t * b, int64_t n_b);
+
+/* Karatsuba multiplication of two numbers of n limbs. With a = a1 B^k + a0 and b = b1 B^k + b0,
+ * the middle term a0 b1 + a1 b0 is computed as (a0 + a1)(b0 + b1) - a0 b0 - a1 b1. */
+static inline void bigint_limbs_mul_karatsuba(uint32_t * r, const uint32_t * a, const uint32_t * b, int64_t n) {
+  int64_t k = n / 2, h = n - k;
+  bigint_limbs_mul(r, a, k, b, k);
+  bigint_limbs_mul(r + 2 * k, a + k, h, b + k, h);
+
+  uint32_t * sa = malloc(4 * (h + 1) * sizeof(uint32_t)), * sb = sa + h + 1, * z1 = sb + h + 1;
+  sa[h] = bigint_limbs_add(sa, a + k, h, a, k);
+  sb[h] = bigint_limbs_add(sb, b + k, h, b, k);
+  bigint_limbs_mul(z1, sa, h + 1, sb, h + 1);
+  bigint_limbs_sub(z1, z1, 2 * h + 2, r, 2 * k);
+  bigint_limbs_sub(z1, z1, 2 * h + 2, r + 2 * k, 2 * h);
+  /* The middle term is less than 2 B^n, so it has at most n + 1 limbs */
+  bigint_limbs_add(r + k, r + k, k + 2 * h, z1, n + 1);
+  free(sa);
+}
+
+/* Sets r = a * b where r has room for n_a + n_b limbs */
+static inline void bigint_limbs_mul(uint32_t * r, const uint32_t * a, int64_t n_a, const uint32_t * b, int64_t n_b) {
+  if (n_a < n_b) {
+    const uint32_t * tmp = a;
+    a = b;
+    b = tmp;
+    int64_t n_tmp = n_a;
+    n_a = n_b;
+    n_b = n_tmp;
+  }
+  if (n_b < BIGINT_KARATSUBA_THRESHOLD) {
+    bigint_limbs_mul_basecase(r, a, n_a, b, n_b);
+  } else if (n_a == n_b) {
+    bigint_limbs_mul_karatsuba(r, a, b, n_a);
+  } else {
+    /* Unbalanced operands: multiply b with slices of a that have the same length as b */
+    int64_t n_r = n_a + n_b;
+    uint32_t * t = malloc(2 * n_b * sizeof(uint32_t));
+    memset(r, 0, n_r * sizeof(uint32_t));
+    for (int64_t i = 0; i < n_a; i += n_b) {
+      int64_t n = n_a - i < n_b ? n_a - i : n_b;
+      bigint_limbs_mul(t, a + i, n, b, n_b);
+      uint32_t carry = bigint_limbs_add(r + i, r + i, n + n_b, t, n + n_b);
+      for (int64_t j = i + n + n_b; carry && j < n_r; j++) carry = ++r[j] == 0;
+    }
+    free(t);
+  }
+}
+
+static inline nanoclj_tensor_t * tensor_bigint_mul(const nanoclj_tensor_t * a, const nanoclj_tensor_t * b) {
+  int64_t n_a = a->ne[0], n_b = b->ne[0];
+  nanoclj_tensor_t * tensor = mk_tensor_1d(nanoclj_i32, n_a + n_b);
+  if (n_a && n_b) {
+    bigint_limbs_mul(tensor->data, a->data, n_a, b->data, n_b);
+    tensor_mutate_trim(tensor);
+  } else {
+    tensor->ne[0] = 0;
   }
-  tensor_mutate_trim(tensor);
   return tensor;
 }
 
+/* Makes sure that the tensor has room for n limbs */
+static inline void tensor_bigint_reserve(nanoclj_tensor_t * tensor, int64_t n) {
+  if (n * sizeof(uint32_t) > tensor->nb[1]) {
+    tensor->nb[1] = 2 * n * sizeof(uint32_t);
+    tensor->data = tensor_realloc_data(tensor, tensor->nb[1]);
+  }
+}
+
+/* Sets r = a * b using the storage of r, which must not overlap with a or b */
+static inline void tensor_bigint_mul_into(nanoclj_tensor_t * r, const uint32_t * a, int64_t n_a, const uint32_t * b, int64_t n_b) {
+  if (n_a && n_b) {
+    tensor_bigint_reserve(r, n_a + n_b);
+    bigint_limbs_mul(r->data, a, n_a, b, n_b);
+    r->ne[0] = n_a + n_b;
+    tensor_mutate_trim(r);
+  } else {
+    r->ne[0] = 0;
+  }
+}
+
 static inline void tensor_bigint_mutate_mul_int(nanoclj_tensor_t * tensor, uint32_t v) {
   if (!tensor_is_empty(tensor)) {
     if (v == 0) {
@@ -790,6 +1094,59 @@ static inline double tensor_bigint_to_double(const nanoclj_tensor_t * tensor) {
   return v;
 }
 
+/* Knuth's Algorithm D. Divides a by b, where n_a >= n_b >= 2 and the top limb of b is not zero.
+ * The quotient has n_a - n_b + 1 limbs and the remainder n_b limbs, and either one can be NULL. */
+static inline void bigint_limbs_divmod(uint32_t * q, uint32_t * r, const uint32_t * a, int64_t n_a, const uint32_t * b, int64_t n_b) {
+  uint32_t * vn = malloc((n_a + n_b + 1) * sizeof(uint32_t)), * un = vn + n_b;
+  /* Normalize so that the top bit of the divisor is set */
+  int s = __builtin_clz(b[n_b - 1]);
+  for (int64_t i = n_b - 1; i > 0; i--) vn[i] = (b[i] << s) | (s ? b[i - 1] >> (32 - s) : 0);
+  vn[0] = b[0] << s;
+  un[n_a] = s ? a[n_a - 1] >> (32 - s) : 0;
+  for (int64_t i = n_a - 1; i > 0; i--) un[i] = (a[i] << s) | (s ? a[i - 1] >> (32 - s) : 0);
+  un[0] = a[0] << s;
+
+  uint64_t v1 = vn[n_b - 1], v2 = vn[n_b - 2];
+  for (int64_t j = n_a - n_b; j >= 0; j--) {
+    /* Estimate the quotient digit from the top limbs. The estimate is at most one too large. */
+    uint64_t x = (uint64_t)un[j + n_b] << 32 | un[j + n_b - 1];
+    uint64_t qhat = x / v1, rhat = x % v1;
+    while (qhat > UINT32_MAX || qhat * v2 > (rhat << 32 | un[j + n_b - 2])) {
+      qhat--;
+      rhat += v1;
+      if (rhat > UINT32_MAX) break;
+    }
+    /* Multiply and subtract */
+    uint64_t carry = 0;
+    uint32_t borrow = 0;
+    for (int64_t i = 0; i < n_b; i++) {
+      uint64_t p = qhat * vn[i] + carry;
+      carry = p >> 32;
+      uint64_t t = (uint64_t)un[i + j] - (uint32_t)p - borrow;
+      un[i + j] = t;
+      borrow = (t >> 32) & 1;
+    }
+    uint64_t t = (uint64_t)un[j + n_b] - carry - borrow;
+    un[j + n_b] = t;
+    if (t >> 32) {
+      /* The result was negative, so add back */
+      qhat--;
+      uint64_t c = 0;
+      for (int64_t i = 0; i < n_b; i++) {
+	c += (uint64_t)un[i + j] + vn[i];
+	un[i + j] = c;
+	c >>= 32;
+      }
+      un[j + n_b] += c;
+    }
+    if (q) q[j] = qhat;
+  }
+  if (r) {
+    for (int64_t i = 0; i < n_b; i++) r[i] = (un[i] >> s) | (s ? un[i + 1] << (32 - s) : 0);
+  }
+  free(vn);
+}
+
 static inline void tensor_bigint_divmod(const nanoclj_tensor_t * a, const nanoclj_tensor_t * b, nanoclj_tensor_t ** q, nanoclj_tensor_t ** rem) {
   if (b->ne[0] == 1) {
     nanoclj_tensor_t * c = tensor_dup(a);
@@ -797,69 +1154,38 @@ static inline void tensor_bigint_divmod(const nanoclj_tensor_t * a, const nanocl
     if (q) *q = c;
     else tensor_free(c);
     if (rem) *rem = mk_tensor_bigint(r);
+  } else if (tensor_cmp(a, b) < 0) {
+    if (q) *q = mk_tensor_bigint(0);
+    if (rem) *rem = tensor_dup(a);
   } else {
-    nanoclj_tensor_t * c = mk_tensor_bigint(0);
-    nanoclj_tensor_t * current = mk_tensor_bigint(1);
-    nanoclj_tensor_t * denom = tensor_dup(b);
-    nanoclj_tensor_t * tmp = tensor_dup(a);
-    
-    while (tensor_cmp(denom, a) != 1) {
-      tensor_mutate_lshift(current, 1);
-      tensor_mutate_lshift(denom, 1);
+    int64_t n_a = a->ne[0], n_b = b->ne[0];
+    nanoclj_tensor_t * c = q ? mk_tensor_1d(nanoclj_i32, n_a - n_b + 1) : NULL;
+    nanoclj_tensor_t * r = rem ? mk_tensor_1d(nanoclj_i32, n_b) : NULL;
+    bigint_limbs_divmod(c ? c->data : NULL, r ? r->data : NULL, a->data, n_a, b->data, n_b);
+    if (q) {
+      tensor_mutate_trim(c);
+      *q = c;
     }
-    tensor_mutate_rshift(denom, 1);
-    tensor_mutate_rshift(current, 1);
-    while (!tensor_is_empty(current)) {
-      if (tensor_cmp(tmp, denom) != -1) {
-	tensor_bigint_mutate_sub(tmp, denom);
-	tensor_mutate_or(c, current);
-      }
-      tensor_mutate_rshift(current, 1);
-      tensor_mutate_rshift(denom, 1);
-    }
-
     if (rem) {
-      *rem = tensor_dup(a);
-      nanoclj_tensor_t * tmp = tensor_bigint_mul(b, c);
-      *rem = tensor_bigint_sub(*rem, tmp);
-      tensor_free(tmp);
+      tensor_mutate_trim(r);
+      *rem = r;
     }
-    tensor_free(current);
-    tensor_free(denom);
-    tensor_free(tmp);
-
-    if (q) *q = c;
-    else tensor_free(c);
   }
 }
 
 static inline void tensor_bigint_mutate_div(nanoclj_tensor_t * a, const nanoclj_tensor_t * b) {
   if (b->ne[0] == 1) {
     tensor_bigint_mutate_idivmod(a, *(uint32_t*)b->data);
+  } else if (tensor_cmp(a, b) < 0) {
+    tensor_mutate_clear(a);
   } else {
-    nanoclj_tensor_t * current = mk_tensor_bigint(1);
-    nanoclj_tensor_t * denom = tensor_dup(b);
-    nanoclj_tensor_t * tmp = tensor_dup(a);
-    tensor_bigint_assign(a, 0);
-    
-    while (tensor_cmp(denom, tmp) != 1) {
-      tensor_mutate_lshift(current, 1);
-      tensor_mutate_lshift(denom, 1);
-    }
-    tensor_mutate_rshift(denom, 1);
-    tensor_mutate_rshift(current, 1);
-    while (!tensor_is_empty(current)) {
-      if (tensor_cmp(tmp, denom) != -1) {
-	tensor_bigint_mutate_sub(tmp, denom);
-	tensor_mutate_or(a, current);
-      }
-      tensor_mutate_rshift(current, 1);
-      tensor_mutate_rshift(denom, 1);
-    }
-
-    tensor_free(current);
-    tensor_free(denom);
-    tensor_free(tmp);
+    int64_t n_q = a->ne[0] - b->ne[0] + 1;
+    uint32_t * q = malloc(n_q * sizeof(uint32_t));
+    bigint_limbs_divmod(q, NULL, a->data, a->ne[0], b->data, b->ne[0]);
+    memcpy(a->data, q, n_q * sizeof(uint32_t));
+    a->ne[0] = n_q;
+    tensor_mutate_trim(a);
+    free(q);
   }
 }
 
@@ -893,36 +1219,178 @@ static inline nanoclj_tensor_t * tensor_bigint_pow(const nanoclj_tensor_t * base
   }
 }
 
-static inline nanoclj_tensor_t * tensor_bigint_gcd(const nanoclj_tensor_t * a0, const nanoclj_tensor_t * b0) {
-  if (tensor_is_empty(b0)) {
-    return tensor_dup(a0);
+/* Returns the 32 bits of the number starting from bit pos */
+static inline uint32_t bigint_limbs_extract_u32(const uint32_t * limbs, int64_t n, int64_t pos) {
+  int64_t i = pos / 32;
+  int s = pos % 32;
+  uint32_t v = i < n ? limbs[i] >> s : 0;
+  if (s && i + 1 < n) v |= limbs[i + 1] << (32 - s);
+  return v;
+}
+
+/* Sets r = x u - y v, where the result is known to be non-negative and to fit in n limbs */
+static inline void bigint_limbs_mul_sub(uint32_t * r, int64_t n, uint32_t x, const uint32_t * u, int64_t n_u, uint32_t y, const uint32_t * v, int64_t n_v) {
+  uint64_t carry_u = 0, carry_v = 0;
+  uint32_t borrow = 0;
+  for (int64_t i = 0; i < n; i++) {
+    uint64_t pu = (uint64_t)x * (i < n_u ? u[i] : 0) + carry_u;
+    uint64_t pv = (uint64_t)y * (i < n_v ? v[i] : 0) + carry_v;
+    carry_u = pu >> 32;
+    carry_v = pv >> 32;
+    uint64_t t = (uint64_t)(uint32_t)pu - (uint32_t)pv - borrow;
+    r[i] = t;
+    borrow = (t >> 32) & 1;
+  }
+}
+
+/* Returns A a + B b where the coefficients have opposite signs and the result is non-negative */
+static inline nanoclj_tensor_t * tensor_bigint_lehmer_combine(const nanoclj_tensor_t * a, int64_t A, const nanoclj_tensor_t * b, int64_t B) {
+  int64_t n = a->ne[0];
+  nanoclj_tensor_t * r = mk_tensor_1d(nanoclj_i32, n);
+  if (B <= 0) {
+    bigint_limbs_mul_sub(r->data, n, A, a->data, n, -B, b->data, b->ne[0]);
   } else {
-    nanoclj_tensor_t * rem;
-    tensor_bigint_divmod(a0, b0, NULL, &rem);
-    nanoclj_tensor_t * a = tensor_dup(b0);
-    nanoclj_tensor_t * b = rem;
-    while (!tensor_is_empty(b)) {
+    bigint_limbs_mul_sub(r->data, n, B, b->data, b->ne[0], -A, a->data, n);
+  }
+  tensor_mutate_trim(r);
+  return r;
+}
+
+/* Lehmer's GCD. The Euclidean algorithm is simulated on the leading 32 bits of the numbers, and
+ * the accumulated steps are applied to the full numbers at once. If the leading bits don't
+ * determine a quotient, a full division step is made instead. */
+static inline nanoclj_tensor_t * tensor_bigint_gcd(const nanoclj_tensor_t * a0, const nanoclj_tensor_t * b0) {
+  if (tensor_cmp(a0, b0) < 0) {
+    const nanoclj_tensor_t * tmp = a0;
+    a0 = b0;
+    b0 = tmp;
+  }
+  nanoclj_tensor_t * a = tensor_dup(a0), * b = tensor_dup(b0);
+  while (b->ne[0] >= 2) {
+    int64_t n = a->ne[0];
+    int64_t pos = 32 * (n - 1) - __builtin_clz(((uint32_t *)a->data)[n - 1]);
+    int64_t x = bigint_limbs_extract_u32(a->data, n, pos), y = bigint_limbs_extract_u32(b->data, b->ne[0], pos);
+    int64_t A = 1, B = 0, C = 0, D = 1;
+    while (y + C != 0 && y + D != 0) {
+      int64_t q = (x + A) / (y + C);
+      if (q != (x + B) / (y + D)) break;
+      int64_t t = A - q * C;
+      A = C;
+      C = t;
+      t = B - q * D;
+      B = D;
+      D = t;
+      t = x - q * y;
+      x = y;
+      y = t;
+    }
+    if (B == 0) {
+      nanoclj_tensor_t * rem;
       tensor_bigint_divmod(a, b, NULL, &rem);
       tensor_free(a);
       a = b;
       b = rem;
+    } else {
+      nanoclj_tensor_t * a2 = tensor_bigint_lehmer_combine(a, A, b, B);
+      nanoclj_tensor_t * b2 = tensor_bigint_lehmer_combine(a, C, b, D);
+      tensor_free(a);
+      tensor_free(b);
+      a = a2;
+      b = b2;
+    }
+  }
+  if (!tensor_is_empty(b)) {
+    /* Finish with machine words */
+    uint64_t x = *(uint32_t *)b->data, y = tensor_bigint_mutate_idivmod(a, x);
+    while (y) {
+      uint64_t t = x % y;
+      x = y;
+      y = t;
     }
-    tensor_free(b);
-    return a;
+    tensor_bigint_assign(a, x);
   }
+  tensor_free(b);
+  return a;
 }
 
-static inline nanoclj_tensor_t * mk_tensor_bigint_from_string(const char * s, size_t len, int radix) {
+/* Number size in limbs below which radix conversion is done one limb at a time */
+#define BIGINT_DC_THRESHOLD 64
+#define BIGINT_MAX_POWERS 48
+
+/* Returns the number of digits that fit in a limb, and the radix raised to that power in *chunk */
+static inline int bigint_chunk_digits(int radix, uint32_t * chunk) {
+  uint64_t p = radix;
+  int n = 1;
+  while (p * radix <= UINT32_MAX) {
+    p *= radix;
+    n++;
+  }
+  *chunk = p;
+  return n;
+}
+
+static inline void tensor_bigint_mutate_rshift_limbs(nanoclj_tensor_t * tensor, int64_t n) {
+  if (n >= tensor->ne[0]) {
+    tensor_mutate_clear(tensor);
+  } else if (n > 0) {
+    uint32_t * limbs = tensor->data;
+    memmove(limbs, limbs + n, (tensor->ne[0] - n) * sizeof(uint32_t));
+    tensor->ne[0] -= n;
+  }
+}
+
+static inline nanoclj_tensor_t * bigint_parse_basecase(const char * s, size_t len, int radix, int chunk_digits) {
   nanoclj_tensor_t * tensor = mk_tensor_bigint(0);
-  for (size_t i = 0; i < len; i++) {
-    int d = digit(s[i], radix);
-    if (d == -1) {
-      tensor_free(tensor);
-      return NULL;
+  for (size_t i = 0; i < len; ) {
+    uint32_t v = 0, p = 1;
+    for (int j = 0; j < chunk_digits && i < len; j++, i++) {
+      int d = digit(s[i], radix);
+      if (d == -1) {
+	tensor_free(tensor);
+	return NULL;
+      }
+      v = v * radix + d;
+      p *= radix;
     }
-    tensor_bigint_mutate_mul_int(tensor, radix);
-    tensor_bigint_mutate_add_int(tensor, d);
+    tensor_bigint_mutate_mul_int(tensor, p);
+    tensor_bigint_mutate_add_int(tensor, v);
+  }
+  return tensor;
+}
+
+/* Parses long numbers by splitting the digits so that the low part has chunk_digits * 2^k digits,
+ * and computes high * radix^(chunk_digits * 2^k) + low. The powers are created on demand. */
+static inline nanoclj_tensor_t * bigint_parse_dc(const char * s, size_t len, int radix, int chunk_digits, nanoclj_tensor_t ** powers) {
+  if (len <= (size_t)chunk_digits * BIGINT_DC_THRESHOLD) {
+    return bigint_parse_basecase(s, len, radix, chunk_digits);
   }
+  int k = 0;
+  while (((size_t)chunk_digits << (k + 1)) < len) k++;
+  size_t n_low = (size_t)chunk_digits << k;
+  for (int i = 1; i <= k; i++) {
+    if (!powers[i]) powers[i] = tensor_bigint_mul(powers[i - 1], powers[i - 1]);
+  }
+  nanoclj_tensor_t * high = bigint_parse_dc(s, len - n_low, radix, chunk_digits, powers);
+  if (!high) return NULL;
+  nanoclj_tensor_t * low = bigint_parse_dc(s + len - n_low, n_low, radix, chunk_digits, powers);
+  if (!low) {
+    tensor_free(high);
+    return NULL;
+  }
+  nanoclj_tensor_t * tmp = tensor_bigint_mul(high, powers[k]);
+  nanoclj_tensor_t * r = tensor_bigint_add(tmp, low);
+  tensor_free(high);
+  tensor_free(low);
+  tensor_free(tmp);
+  return r;
+}
+
+static inline nanoclj_tensor_t * mk_tensor_bigint_from_string(const char * s, size_t len, int radix) {
+  uint32_t chunk;
+  int chunk_digits = bigint_chunk_digits(radix, &chunk);
+  nanoclj_tensor_t * powers[BIGINT_MAX_POWERS] = { mk_tensor_bigint(chunk) };
+  nanoclj_tensor_t * tensor = bigint_parse_dc(s, len, radix, chunk_digits, powers);
+  for (int i = 0; i < BIGINT_MAX_POWERS && powers[i]; i++) tensor_free(powers[i]);
   return tensor;
 }
 
@@ -1009,6 +1477,20 @@ static inline nanoclj_tensor_t * tensor_hash_mutate_set(nanoclj_tensor_t * tenso
   return tensor;
 }
 
+/* Semimutable set. If the tensor is rebuilt, the old tensor is left to its current owners
+ * and the new tensor is returned unowned. */
+static inline nanoclj_tensor_t * tensor_hash_set(nanoclj_tensor_t * tensor, uint32_t hash, int64_t val_index, nanoclj_val_t key, nanoclj_val_t val, void * context, uint32_t (*hashfun)(nanoclj_val_t, void *)) {
+  tensor->refcnt++;
+  nanoclj_tensor_t * new_tensor = tensor_hash_mutate_set(tensor, hash, val_index, key, val, context, hashfun);
+  if (new_tensor) {
+    new_tensor->refcnt--;
+  } else {
+    /* The rebuild failed before the old tensor was released */
+    tensor->refcnt--;
+  }
+  return new_tensor;
+}
+
 static inline int64_t tensor_hash_first_offset(const nanoclj_tensor_t * tensor, int64_t offset, int64_t limit) {
   int64_t num_buckets = tensor_hash_get_bucket_count(tensor);
   int64_t * sparse_indices = tensor->sparse_indices;
@@ -0,0 +1,989 @@
+#ifndef _NANOCLJ_TENSOR_MATH_H_
+#define _NANOCLJ_TENSOR_MATH_H_
+
+#include "nanoclj_tensor.h"
+#include "nanoclj_threads.h"
+
+#include <math.h>
+
+typedef enum {
+  nanoclj_binop_add = 0,
+  nanoclj_binop_sub,
+  nanoclj_binop_mul,
+  nanoclj_binop_div,
+  nanoclj_binop_min,
+  nanoclj_binop_max,
+  /* Comparisons produce boolean tensors */
+  nanoclj_binop_lt,
+  nanoclj_binop_le,
+  nanoclj_binop_gt,
+  nanoclj_binop_ge,
+  nanoclj_binop_eq,
+  nanoclj_binop_ne
+} nanoclj_binary_op_t;
+
+typedef enum {
+  nanoclj_unop_neg = 0,
+  nanoclj_unop_abs,
+  /* The rest are computed in floating point */
+  nanoclj_unop_sqrt,
+  nanoclj_unop_exp,
+  nanoclj_unop_log,
+  nanoclj_unop_sin,
+  nanoclj_unop_cos,
+  nanoclj_unop_tanh,
+  nanoclj_unop_floor,
+  nanoclj_unop_ceil,
+  nanoclj_unop_round
+} nanoclj_unary_op_t;
+
+static inline bool tensor_is_float_type(nanoclj_tensor_type_t t) {
+  return t == nanoclj_f32 || t == nanoclj_f64;
+}
+
+static inline bool tensor_is_comparison(nanoclj_binary_op_t op) {
+  return op >= nanoclj_binop_lt;
+}
+
+static inline bool tensor_is_unsigned_type(nanoclj_tensor_type_t t) {
+  return t == nanoclj_u8 || t == nanoclj_u16 || t == nanoclj_u32;
+}
+
+/* Returns the signed integer type of the given size in bytes */
+static inline nanoclj_tensor_type_t tensor_signed_type(size_t size) {
+  switch (size) {
+  case 1: return nanoclj_i8;
+  case 2: return nanoclj_i16;
+  case 4: return nanoclj_i32;
+  }
+  return nanoclj_i64;
+}
+
+/* Returns the type in which an operation on two tensors is computed. Booleans are treated as bytes.
+ * As in NumPy, a signed and an unsigned integer are combined in a signed type that can hold both,
+ * and integers wider than 16 bits are combined with f32 in double precision as they don't fit. */
+static inline nanoclj_tensor_type_t tensor_promote_types(nanoclj_tensor_type_t a, nanoclj_tensor_type_t b) {
+  if (a == nanoclj_boolean) a = nanoclj_i8;
+  if (b == nanoclj_boolean) b = nanoclj_i8;
+  size_t sa = tensor_get_cell_size(a), sb = tensor_get_cell_size(b);
+  if (a == b) {
+    return a;
+  } else if (tensor_is_float_type(a) && tensor_is_float_type(b)) {
+    return nanoclj_f64;
+  } else if (!tensor_is_float_type(a) && !tensor_is_float_type(b)) {
+    if (tensor_is_unsigned_type(a) == tensor_is_unsigned_type(b)) {
+      return sa > sb ? a : b;
+    }
+    size_t ss = tensor_is_unsigned_type(a) ? sb : sa, su = tensor_is_unsigned_type(a) ? sa : sb;
+    return tensor_signed_type(ss > su ? ss : 2 * su);
+  } else {
+    nanoclj_tensor_type_t ft = tensor_is_float_type(a) ? a : b, it = tensor_is_float_type(a) ? b : a;
+    return ft == nanoclj_f32 && tensor_get_cell_size(it) <= 2 ? nanoclj_f32 : nanoclj_f64;
+  }
+}
+
+/* Returns the type in which an operation between a tensor and a scalar is computed.
+ * As in NumPy, the scalar doesn't widen the tensor type unless it is a float and the tensor is not. */
+static inline nanoclj_tensor_type_t tensor_promote_scalar(nanoclj_tensor_type_t a, bool scalar_is_float) {
+  if (a == nanoclj_boolean) a = nanoclj_i8;
+  if (scalar_is_float && !tensor_is_float_type(a)) return nanoclj_f64;
+  return a;
+}
+
+static inline tensorview_t tensorview_from_tensor(const nanoclj_tensor_t * tensor) {
+  tensorview_t tv;
+  tv.n_dims = tensor->n_dims;
+  for (int i = 0; i <= NANOCLJ_MAX_DIMS; i++) {
+    if (i < NANOCLJ_MAX_DIMS) tv.ne[i] = i < tensor->n_dims ? tensor->ne[i] : 1;
+    tv.nb[i] = i <= tensor->n_dims ? tensor->nb[i] : 0;
+  }
+  tv.data = tensor->data;
+  tv.type = tensor->type;
+  return tv;
+}
+
+static inline double tensor_load_f64(const void * p, nanoclj_tensor_type_t t) {
+  switch (t) {
+  case nanoclj_boolean:
+  case nanoclj_i8: return *(const int8_t *)p;
+  case nanoclj_i16: return *(const int16_t *)p;
+  case nanoclj_i32: return *(const int32_t *)p;
+  case nanoclj_f32: return *(const float *)p;
+  case nanoclj_f64: return *(const double *)p;
+  case nanoclj_val: break;
+  case nanoclj_i64: return *(const int64_t *)p;
+  case nanoclj_u8: return *(const uint8_t *)p;
+  case nanoclj_u16: return *(const uint16_t *)p;
+  case nanoclj_u32: return *(const uint32_t *)p;
+  }
+  return NAN;
+}
+
+static inline int64_t tensor_load_i64(const void * p, nanoclj_tensor_type_t t) {
+  switch (t) {
+  case nanoclj_boolean:
+  case nanoclj_i8: return *(const int8_t *)p;
+  case nanoclj_i16: return *(const int16_t *)p;
+  case nanoclj_i32: return *(const int32_t *)p;
+  case nanoclj_i64: return *(const int64_t *)p;
+  case nanoclj_u8: return *(const uint8_t *)p;
+  case nanoclj_u16: return *(const uint16_t *)p;
+  case nanoclj_u32: return *(const uint32_t *)p;
+  default: return (int64_t)tensor_load_f64(p, t);
+  }
+}
+
+/* Returns true if the shapes are equal or one of them is 1 in each dimension */
+static inline bool tensorview_can_broadcast(const tensorview_t * a, const tensorview_t * b) {
+  for (int d = 0; d < NANOCLJ_MAX_DIMS; d++) {
+    int64_t ea = d < a->n_dims ? a->ne[d] : 1, eb = d < b->n_dims ? b->ne[d] : 1;
+    if (ea != eb && ea != 1 && eb != 1) return false;
+  }
+  return true;
+}
+
+/* Creates a contiguous copy of a view converted to type t */
+static inline nanoclj_tensor_t * tensorview_convert(const tensorview_t * tv, nanoclj_tensor_type_t t) {
+  nanoclj_tensor_t * r = mk_tensor_nd(t, tv->n_dims, tv->ne);
+  if (!r) return NULL;
+  int64_t n0 = tv->ne[0], n1 = tv->n_dims >= 2 ? tv->ne[1] : 1, n2 = tv->n_dims >= 3 ? tv->ne[2] : 1;
+  size_t i = 0;
+  for (int64_t i2 = 0; i2 < n2; i2++) {
+    for (int64_t i1 = 0; i1 < n1; i1++) {
+      const uint8_t * p = (const uint8_t *)tv->data + i1 * tv->nb[1] + i2 * tv->nb[2];
+      for (int64_t i0 = 0; i0 < n0; i0++, i++, p += tv->nb[0]) {
+	switch (t) {
+	case nanoclj_boolean: ((uint8_t *)r->data)[i] = tensor_load_f64(p, tv->type) != 0; break;
+	case nanoclj_i8: ((int8_t *)r->data)[i] = (int8_t)tensor_load_i64(p, tv->type); break;
+	case nanoclj_i16: ((int16_t *)r->data)[i] = (int16_t)tensor_load_i64(p, tv->type); break;
+	case nanoclj_i32: ((int32_t *)r->data)[i] = (int32_t)tensor_load_i64(p, tv->type); break;
+	case nanoclj_f32: ((float *)r->data)[i] = tensor_load_f64(p, tv->type); break;
+	case nanoclj_f64: ((double *)r->data)[i] = tensor_load_f64(p, tv->type); break;
+	case nanoclj_val: break;
+	case nanoclj_i64: ((int64_t *)r->data)[i] = tensor_load_i64(p, tv->type); break;
+	case nanoclj_u8: ((uint8_t *)r->data)[i] = (uint8_t)tensor_load_i64(p, tv->type); break;
+	case nanoclj_u16: ((uint16_t *)r->data)[i] = (uint16_t)tensor_load_i64(p, tv->type); break;
+	case nanoclj_u32: ((uint32_t *)r->data)[i] = (uint32_t)tensor_load_i64(p, tv->type); break;
+	}
+      }
+    }
+  }
+  return r;
+}
+
+/* The kernels operate on rows where the operands have element strides sa and sb.
+ * Contiguous and broadcast scalar rows get their own loops so that the compiler
+ * can vectorize them for each element type. */
+#define TENSOR_BINARY_LOOP(T, R, EXPR)					\
+  if (sa == 1 && sb == 1) {						\
+    for (int64_t i = 0; i < n; i++) { T x = a[i], y = b[i]; R[i] = (EXPR); } \
+  } else if (sa == 1 && sb == 0) {					\
+    T y = b[0];								\
+    for (int64_t i = 0; i < n; i++) { T x = a[i]; R[i] = (EXPR); }	\
+  } else if (sa == 0 && sb == 1) {					\
+    T x = a[0];								\
+    for (int64_t i = 0; i < n; i++) { T y = b[i]; R[i] = (EXPR); }	\
+  } else {								\
+    for (int64_t i = 0; i < n; i++) { T x = a[i * sa], y = b[i * sb]; R[i] = (EXPR); } \
+  }
+
+/* Integer arithmetic wraps around, so it is done with unsigned type U */
+#define TENSOR_BINARY_KERNEL(NAME, T, U, IS_FLOAT)			\
+  static void NAME(nanoclj_binary_op_t op, int64_t n, const void * a0, int64_t sa, const void * b0, int64_t sb, void * r0) { \
+    const T * restrict a = a0, * restrict b = b0;			\
+    T * restrict r = r0;						\
+    uint8_t * restrict rb = r0;						\
+    switch (op) {							\
+    case nanoclj_binop_add: TENSOR_BINARY_LOOP(T, r, (T)((U)x + (U)y)); break; \
+    case nanoclj_binop_sub: TENSOR_BINARY_LOOP(T, r, (T)((U)x - (U)y)); break; \
+    case nanoclj_binop_mul: TENSOR_BINARY_LOOP(T, r, (T)((U)x * (U)y)); break; \
+    case nanoclj_binop_div: if (IS_FLOAT) { TENSOR_BINARY_LOOP(T, r, x / y); } break; \
+    case nanoclj_binop_min: TENSOR_BINARY_LOOP(T, r, y < x ? y : x); break; \
+    case nanoclj_binop_max: TENSOR_BINARY_LOOP(T, r, y > x ? y : x); break; \
+    case nanoclj_binop_lt: TENSOR_BINARY_LOOP(T, rb, x < y); break;	\
+    case nanoclj_binop_le: TENSOR_BINARY_LOOP(T, rb, x <= y); break;	\
+    case nanoclj_binop_gt: TENSOR_BINARY_LOOP(T, rb, x > y); break;	\
+    case nanoclj_binop_ge: TENSOR_BINARY_LOOP(T, rb, x >= y); break;	\
+    case nanoclj_binop_eq: TENSOR_BINARY_LOOP(T, rb, x == y); break;	\
+    case nanoclj_binop_ne: TENSOR_BINARY_LOOP(T, rb, x != y); break;	\
+    }									\
+  }
+
+TENSOR_BINARY_KERNEL(tensor_binary_row_i8, int8_t, uint8_t, false)
+TENSOR_BINARY_KERNEL(tensor_binary_row_i16, int16_t, uint16_t, false)
+TENSOR_BINARY_KERNEL(tensor_binary_row_i32, int32_t, uint32_t, false)
+TENSOR_BINARY_KERNEL(tensor_binary_row_i64, int64_t, uint64_t, false)
+TENSOR_BINARY_KERNEL(tensor_binary_row_u8, uint8_t, uint8_t, false)
+TENSOR_BINARY_KERNEL(tensor_binary_row_u16, uint16_t, uint16_t, false)
+TENSOR_BINARY_KERNEL(tensor_binary_row_u32, uint32_t, uint32_t, false)
+TENSOR_BINARY_KERNEL(tensor_binary_row_f32, float, float, true)
+TENSOR_BINARY_KERNEL(tensor_binary_row_f64, double, double, true)
+
+#define TENSOR_UNARY_LOOP(T, EXPR)					\
+  if (sa == 1) {							\
+    for (int64_t i = 0; i < n; i++) { T x = a[i]; r[i] = (EXPR); }	\
+  } else {								\
+    for (int64_t i = 0; i < n; i++) { T x = a[i * sa]; r[i] = (EXPR); } \
+  }
+
+#define TENSOR_UNARY_INT_KERNEL(NAME, T, U)				\
+  static void NAME(nanoclj_unary_op_t op, int64_t n, const void * a0, int64_t sa, void * r0) { \
+    const T * restrict a = a0;						\
+    T * restrict r = r0;						\
+    switch (op) {							\
+    case nanoclj_unop_neg: TENSOR_UNARY_LOOP(T, (T)(-(U)x)); break;	\
+    case nanoclj_unop_abs: TENSOR_UNARY_LOOP(T, x < 0 ? (T)(-(U)x) : x); break; \
+    default: break;							\
+    }									\
+  }
+
+#define TENSOR_UNARY_FLOAT_KERNEL(NAME, T, SUFFIX)			\
+  static void NAME(nanoclj_unary_op_t op, int64_t n, const void * a0, int64_t sa, void * r0) { \
+    const T * restrict a = a0;						\
+    T * restrict r = r0;						\
+    switch (op) {							\
+    case nanoclj_unop_neg: TENSOR_UNARY_LOOP(T, -x); break;		\
+    case nanoclj_unop_abs: TENSOR_UNARY_LOOP(T, fabs##SUFFIX(x)); break; \
+    case nanoclj_unop_sqrt: TENSOR_UNARY_LOOP(T, sqrt##SUFFIX(x)); break; \
+    case nanoclj_unop_exp: TENSOR_UNARY_LOOP(T, exp##SUFFIX(x)); break; \
+    case nanoclj_unop_log: TENSOR_UNARY_LOOP(T, log##SUFFIX(x)); break; \
+    case nanoclj_unop_sin: TENSOR_UNARY_LOOP(T, sin##SUFFIX(x)); break; \
+    case nanoclj_unop_cos: TENSOR_UNARY_LOOP(T, cos##SUFFIX(x)); break; \
+    case nanoclj_unop_tanh: TENSOR_UNARY_LOOP(T, tanh##SUFFIX(x)); break; \
+    case nanoclj_unop_floor: TENSOR_UNARY_LOOP(T, floor##SUFFIX(x)); break; \
+    case nanoclj_unop_ceil: TENSOR_UNARY_LOOP(T, ceil##SUFFIX(x)); break; \
+    case nanoclj_unop_round: TENSOR_UNARY_LOOP(T, round##SUFFIX(x)); break; \
+    }									\
+  }
+
+TENSOR_UNARY_INT_KERNEL(tensor_unary_row_i8, int8_t, uint8_t)
+TENSOR_UNARY_INT_KERNEL(tensor_unary_row_i16, int16_t, uint16_t)
+TENSOR_UNARY_INT_KERNEL(tensor_unary_row_i32, int32_t, uint32_t)
+TENSOR_UNARY_INT_KERNEL(tensor_unary_row_i64, int64_t, uint64_t)
+TENSOR_UNARY_INT_KERNEL(tensor_unary_row_u8, uint8_t, uint8_t)
+TENSOR_UNARY_INT_KERNEL(tensor_unary_row_u16, uint16_t, uint16_t)
+TENSOR_UNARY_INT_KERNEL(tensor_unary_row_u32, uint32_t, uint32_t)
+TENSOR_UNARY_FLOAT_KERNEL(tensor_unary_row_f32, float, f)
+TENSOR_UNARY_FLOAT_KERNEL(tensor_unary_row_f64, double, )
+
+/* Applies a binary operation elementwise. The operands are broadcast against each other
+ * as in NumPy, aligning the innermost dimensions, and converted to type t if necessary.
+ * Integer division is done in double precision. Returns NULL if the shapes are incompatible. */
+static inline nanoclj_tensor_t * tensor_binary(nanoclj_binary_op_t op, tensorview_t a, tensorview_t b, nanoclj_tensor_type_t t) {
+  if (op == nanoclj_binop_div && !tensor_is_float_type(t)) t = nanoclj_f64;
+
+  if (!tensorview_can_broadcast(&a, &b)) return NULL;
+
+  int n_dims = a.n_dims > b.n_dims ? a.n_dims : b.n_dims;
+  int64_t ne[NANOCLJ_MAX_DIMS];
+  for (int d = 0; d < NANOCLJ_MAX_DIMS; d++) {
+    int64_t ea = d < a.n_dims ? a.ne[d] : 1, eb = d < b.n_dims ? b.ne[d] : 1;
+    ne[d] = ea == 1 ? eb : ea;
+  }
+
+  nanoclj_tensor_t * ca = NULL, * cb = NULL;
+  if (a.type != t) {
+    if (!(ca = tensorview_convert(&a, t))) return NULL;
+    a = tensorview_from_tensor(ca);
+  }
+  if (b.type != t) {
+    if (!(cb = tensorview_convert(&b, t))) {
+      tensor_free(ca);
+      return NULL;
+    }
+    b = tensorview_from_tensor(cb);
+  }
+
+  nanoclj_tensor_t * r = mk_tensor_nd(tensor_is_comparison(op) ? nanoclj_boolean : t, n_dims, ne);
+  if (r) {
+    void (*kernel)(nanoclj_binary_op_t, int64_t, const void *, int64_t, const void *, int64_t, void *) = NULL;
+    switch (t) {
+    case nanoclj_boolean:
+    case nanoclj_i8: kernel = tensor_binary_row_i8; break;
+    case nanoclj_i16: kernel = tensor_binary_row_i16; break;
+    case nanoclj_i32: kernel = tensor_binary_row_i32; break;
+    case nanoclj_f32: kernel = tensor_binary_row_f32; break;
+    case nanoclj_f64: kernel = tensor_binary_row_f64; break;
+    case nanoclj_val: break;
+    case nanoclj_i64: kernel = tensor_binary_row_i64; break;
+    case nanoclj_u8: kernel = tensor_binary_row_u8; break;
+    case nanoclj_u16: kernel = tensor_binary_row_u16; break;
+    case nanoclj_u32: kernel = tensor_binary_row_u32; break;
+    }
+    /* Broadcast dimensions have zero stride */
+    size_t ba[NANOCLJ_MAX_DIMS], bb[NANOCLJ_MAX_DIMS];
+    for (int d = 0; d < NANOCLJ_MAX_DIMS; d++) {
+      ba[d] = d < a.n_dims && a.ne[d] != 1 ? a.nb[d] : 0;
+      bb[d] = d < b.n_dims && b.ne[d] != 1 ? b.nb[d] : 0;
+    }
+    size_t es = tensor_get_cell_size(t);
+    int64_t sa = ba[0] / es, sb = bb[0] / es;
+    uint8_t * out = r->data;
+    size_t row_size = ne[0] * r->nb[0];
+    for (int64_t i2 = 0; i2 < ne[2]; i2++) {
+      for (int64_t i1 = 0; i1 < ne[1]; i1++, out += row_size) {
+	const uint8_t * pa = (const uint8_t *)a.data + i1 * ba[1] + i2 * ba[2];
+	const uint8_t * pb = (const uint8_t *)b.data + i1 * bb[1] + i2 * bb[2];
+	if (kernel) kernel(op, ne[0], pa, sa, pb, sb, out);
+      }
+    }
+  }
+  tensor_free(ca);
+  tensor_free(cb);
+  return r;
+}
+
+/* Applies a unary operation elementwise. Integer tensors are converted to double
+ * for the operations other than negation and absolute value. */
+static inline nanoclj_tensor_t * tensor_unary(nanoclj_unary_op_t op, tensorview_t a) {
+  nanoclj_tensor_type_t t = a.type == nanoclj_boolean ? nanoclj_i8 : a.type;
+  if (op > nanoclj_unop_abs && !tensor_is_float_type(t)) t = nanoclj_f64;
+  nanoclj_tensor_t * ca = NULL;
+  if (a.type != t) {
+    if (!(ca = tensorview_convert(&a, t))) return NULL;
+    a = tensorview_from_tensor(ca);
+  }
+  nanoclj_tensor_t * r = mk_tensor_nd(t, a.n_dims, a.ne);
+  if (r) {
+    void (*kernel)(nanoclj_unary_op_t, int64_t, const void *, int64_t, void *) = NULL;
+    switch (t) {
+    case nanoclj_i8: kernel = tensor_unary_row_i8; break;
+    case nanoclj_i16: kernel = tensor_unary_row_i16; break;
+    case nanoclj_i32: kernel = tensor_unary_row_i32; break;
+    case nanoclj_f32: kernel = tensor_unary_row_f32; break;
+    case nanoclj_f64: kernel = tensor_unary_row_f64; break;
+    case nanoclj_i64: kernel = tensor_unary_row_i64; break;
+    case nanoclj_u8: kernel = tensor_unary_row_u8; break;
+    case nanoclj_u16: kernel = tensor_unary_row_u16; break;
+    case nanoclj_u32: kernel = tensor_unary_row_u32; break;
+    default: break;
+    }
+    int64_t n1 = a.n_dims >= 2 ? a.ne[1] : 1, n2 = a.n_dims >= 3 ? a.ne[2] : 1;
+    int64_t sa = a.nb[0] / r->nb[0];
+    uint8_t * out = r->data;
+    size_t row_size = a.ne[0] * r->nb[0];
+    for (int64_t i2 = 0; i2 < n2; i2++) {
+      for (int64_t i1 = 0; i1 < n1; i1++, out += row_size) {
+	if (kernel) kernel(op, a.ne[0], (const uint8_t *)a.data + i1 * a.nb[1] + i2 * a.nb[2], sa, out);
+      }
+    }
+  }
+  tensor_free(ca);
+  return r;
+}
+
+typedef enum {
+  nanoclj_reduce_sum = 0,
+  nanoclj_reduce_min,
+  nanoclj_reduce_max,
+  /* Sum of squared distances from a center */
+  nanoclj_reduce_norm,
+  /* The rest are computed using the above */
+  nanoclj_reduce_mean,
+  nanoclj_reduce_argmin,
+  nanoclj_reduce_argmax,
+  nanoclj_reduce_var,
+  nanoclj_reduce_std
+} nanoclj_reduce_op_t;
+
+/* Elements are converted to double in blocks of this size before they are reduced */
+#define TENSOR_REDUCE_BLOCK 256
+/* Number of independent accumulators, so that the reductions can be vectorized
+ * without reassociating floating point additions */
+#define TENSOR_REDUCE_LANES 8
+/* Full reductions are split into chunks of this many elements. The chunking doesn't depend
+ * on the number of threads, so the partial results are always combined in the same order. */
+#define TENSOR_REDUCE_CHUNK (1 << 16)
+/* Minimum number of elements for reducing in parallel */
+#define TENSOR_REDUCE_PARALLEL_MIN (1 << 18)
+
+typedef struct {
+  double value;
+  /* Index of the minimum or maximum, or -1 if nothing has been reduced */
+  int64_t index;
+} tensor_reduce_acc_t;
+
+#define TENSOR_LOAD_BLOCK(T)						\
+  if (stride == sizeof(T)) {						\
+    const T * restrict a = (const T *)p;				\
+    for (int64_t i = 0; i < n; i++) out[i] = a[i];			\
+  } else {								\
+    for (int64_t i = 0; i < n; i++) out[i] = *(const T *)(p + i * stride); \
+  }
+
+/* Loads n elements with a byte stride as floats */
+static inline void tensor_load_block_f32(const uint8_t * p, nanoclj_tensor_type_t t, int64_t n, size_t stride, float * restrict out) {
+  switch (t) {
+  case nanoclj_boolean:
+  case nanoclj_i8: TENSOR_LOAD_BLOCK(int8_t); break;
+  case nanoclj_i16: TENSOR_LOAD_BLOCK(int16_t); break;
+  case nanoclj_i32: TENSOR_LOAD_BLOCK(int32_t); break;
+  case nanoclj_f32: TENSOR_LOAD_BLOCK(float); break;
+  case nanoclj_f64: TENSOR_LOAD_BLOCK(double); break;
+  case nanoclj_val: break;
+  case nanoclj_i64: TENSOR_LOAD_BLOCK(int64_t); break;
+  case nanoclj_u8: TENSOR_LOAD_BLOCK(uint8_t); break;
+  case nanoclj_u16: TENSOR_LOAD_BLOCK(uint16_t); break;
+  case nanoclj_u32: TENSOR_LOAD_BLOCK(uint32_t); break;
+  }
+}
+
+/* Loads n elements with a byte stride as doubles */
+static inline void tensor_load_block_f64(const uint8_t * p, nanoclj_tensor_type_t t, int64_t n, size_t stride, double * restrict out) {
+  switch (t) {
+  case nanoclj_boolean:
+  case nanoclj_i8: TENSOR_LOAD_BLOCK(int8_t); break;
+  case nanoclj_i16: TENSOR_LOAD_BLOCK(int16_t); break;
+  case nanoclj_i32: TENSOR_LOAD_BLOCK(int32_t); break;
+  case nanoclj_f32: TENSOR_LOAD_BLOCK(float); break;
+  case nanoclj_f64: TENSOR_LOAD_BLOCK(double); break;
+  case nanoclj_val: break;
+  case nanoclj_i64: TENSOR_LOAD_BLOCK(int64_t); break;
+  case nanoclj_u8: TENSOR_LOAD_BLOCK(uint8_t); break;
+  case nanoclj_u16: TENSOR_LOAD_BLOCK(uint16_t); break;
+  case nanoclj_u32: TENSOR_LOAD_BLOCK(uint32_t); break;
+  }
+}
+
+static inline double tensor_block_sum(const double * restrict x, int64_t n, double center, bool squares) {
+  double acc[TENSOR_REDUCE_LANES] = { 0 };
+  int64_t i = 0;
+  if (squares) {
+    for (; i + TENSOR_REDUCE_LANES <= n; i += TENSOR_REDUCE_LANES) {
+      for (int j = 0; j < TENSOR_REDUCE_LANES; j++) {
+	double d = x[i + j] - center;
+	acc[j] += d * d;
+      }
+    }
+    for (; i < n; i++) acc[0] += (x[i] - center) * (x[i] - center);
+  } else {
+    for (; i + TENSOR_REDUCE_LANES <= n; i += TENSOR_REDUCE_LANES) {
+      for (int j = 0; j < TENSOR_REDUCE_LANES; j++) acc[j] += x[i + j];
+    }
+    for (; i < n; i++) acc[0] += x[i];
+  }
+  double s = 0.0;
+  for (int j = 0; j < TENSOR_REDUCE_LANES; j++) s += acc[j];
+  return s;
+}
+
+/* Returns the index of the first minimum or maximum in a non-empty block. NaNs are skipped. */
+static inline int64_t tensor_block_extremum(const double * restrict x, int64_t n, bool is_max) {
+  double acc[TENSOR_REDUCE_LANES];
+  for (int j = 0; j < TENSOR_REDUCE_LANES; j++) acc[j] = is_max ? -INFINITY : INFINITY;
+  int64_t i = 0;
+  if (is_max) {
+    for (; i + TENSOR_REDUCE_LANES <= n; i += TENSOR_REDUCE_LANES) {
+      for (int j = 0; j < TENSOR_REDUCE_LANES; j++) acc[j] = x[i + j] > acc[j] ? x[i + j] : acc[j];
+    }
+    for (; i < n; i++) acc[0] = x[i] > acc[0] ? x[i] : acc[0];
+  } else {
+    for (; i + TENSOR_REDUCE_LANES <= n; i += TENSOR_REDUCE_LANES) {
+      for (int j = 0; j < TENSOR_REDUCE_LANES; j++) acc[j] = x[i + j] < acc[j] ? x[i + j] : acc[j];
+    }
+    for (; i < n; i++) acc[0] = x[i] < acc[0] ? x[i] : acc[0];
+  }
+  double m = acc[0];
+  for (int j = 1; j < TENSOR_REDUCE_LANES; j++) {
+    if (is_max ? acc[j] > m : acc[j] < m) m = acc[j];
+  }
+  for (i = 0; i < n; i++) {
+    if (x[i] == m) return i;
+  }
+  return 0;
+}
+
+/* Merges a partial result into acc. Ties keep the earlier index. */
+static inline void tensor_reduce_merge(nanoclj_reduce_op_t kind, tensor_reduce_acc_t * acc, tensor_reduce_acc_t p) {
+  if (kind == nanoclj_reduce_min || kind == nanoclj_reduce_max) {
+    if (p.index >= 0 && (acc->index < 0 || (kind == nanoclj_reduce_max ? p.value > acc->value : p.value < acc->value) ||
+			 (isnan(acc->value) && !isnan(p.value)))) {
+      *acc = p;
+    }
+  } else {
+    acc->value += p.value;
+  }
+}
+
+/* Reduces n elements with a byte stride. The index of the first element is base. */
+static inline tensor_reduce_acc_t tensor_reduce_segment(nanoclj_reduce_op_t kind, const uint8_t * p, nanoclj_tensor_type_t t,
+							 int64_t n, size_t stride, double center, int64_t base) {
+  tensor_reduce_acc_t acc = { 0.0, -1 };
+  double block[TENSOR_REDUCE_BLOCK];
+  for (int64_t i = 0; i < n; i += TENSOR_REDUCE_BLOCK) {
+    int64_t m = n - i < TENSOR_REDUCE_BLOCK ? n - i : TENSOR_REDUCE_BLOCK;
+    tensor_load_block_f64(p + i * stride, t, m, stride, block);
+    tensor_reduce_acc_t r;
+    if (kind == nanoclj_reduce_min || kind == nanoclj_reduce_max) {
+      int64_t j = tensor_block_extremum(block, m, kind == nanoclj_reduce_max);
+      r = (tensor_reduce_acc_t){ block[j], base + i + j };
+    } else {
+      r = (tensor_reduce_acc_t){ tensor_block_sum(block, m, center, kind == nanoclj_reduce_norm), -1 };
+    }
+    tensor_reduce_merge(kind, &acc, r);
+  }
+  return acc;
+}
+
+typedef struct {
+  nanoclj_reduce_op_t kind;
+  const tensorview_t * tv;
+  int axis;
+  /* Range of work items */
+  int64_t first, last;
+  /* Centers for nanoclj_reduce_norm, one per output or a single one for full reductions */
+  const double * center;
+  tensor_reduce_acc_t * out;
+} tensor_reduce_task_t;
+
+static inline bool tensorview_is_contiguous(const tensorview_t * tv) {
+  size_t s = tensor_get_cell_size(tv->type);
+  for (int d = 0; d < tv->n_dims; s *= tv->ne[d], d++) {
+    if (tv->ne[d] != 1 && tv->nb[d] != s) return false;
+  }
+  return true;
+}
+
+/* The work items of a full reduction are chunks of rows, where rows are along dimension 0 */
+static inline int64_t tensor_reduce_chunks_per_row(const tensorview_t * tv) {
+  return tv->ne[0] > 0 ? (tv->ne[0] + TENSOR_REDUCE_CHUNK - 1) / TENSOR_REDUCE_CHUNK : 1;
+}
+
+static NANOCLJ_THREAD_SIG tensor_reduce_all_main(void * arg) {
+  tensor_reduce_task_t * task = arg;
+  const tensorview_t * tv = task->tv;
+  int64_t cpr = tensor_reduce_chunks_per_row(tv);
+  for (int64_t c = task->first; c < task->last; c++) {
+    int64_t row = c / cpr, i0 = (c % cpr) * TENSOR_REDUCE_CHUNK;
+    int64_t n = tv->ne[0] - i0 < TENSOR_REDUCE_CHUNK ? tv->ne[0] - i0 : TENSOR_REDUCE_CHUNK;
+    const uint8_t * p = (const uint8_t *)tv->data + (row % tv->ne[1]) * tv->nb[1] + (row / tv->ne[1]) * tv->nb[2] + i0 * tv->nb[0];
+    task->out[c] = tensor_reduce_segment(task->kind, p, tv->type, n, tv->nb[0], task->center[0], row * tv->ne[0] + i0);
+  }
+  return 0;
+}
+
+/* Work items of axis reductions. Along dimension 0 the items are rows, and along the other dimensions
+ * they are blocks of columns where whole rows are accumulated elementwise. */
+static NANOCLJ_THREAD_SIG tensor_reduce_axis_main(void * arg) {
+  tensor_reduce_task_t * task = arg;
+  const tensorview_t * tv = task->tv;
+  nanoclj_reduce_op_t kind = task->kind;
+  if (task->axis == 0) {
+    for (int64_t row = task->first; row < task->last; row++) {
+      const uint8_t * p = (const uint8_t *)tv->data + (row % tv->ne[1]) * tv->nb[1] + (row / tv->ne[1]) * tv->nb[2];
+      task->out[row] = tensor_reduce_segment(kind, p, tv->type, tv->ne[0], tv->nb[0], task->center ? task->center[row] : 0.0, 0);
+    }
+    return 0;
+  }
+  /* The other dimension besides 0 and the axis */
+  int other = task->axis == 1 ? 2 : 1;
+  int64_t n_blocks = (tv->ne[0] + TENSOR_REDUCE_BLOCK - 1) / TENSOR_REDUCE_BLOCK;
+  double block[TENSOR_REDUCE_BLOCK], acc[TENSOR_REDUCE_BLOCK], c[TENSOR_REDUCE_BLOCK];
+  int64_t index[TENSOR_REDUCE_BLOCK];
+  for (int64_t item = task->first; item < task->last; item++) {
+    int64_t j = item / n_blocks, i0 = (item % n_blocks) * TENSOR_REDUCE_BLOCK;
+    int64_t n = tv->ne[0] - i0 < TENSOR_REDUCE_BLOCK ? tv->ne[0] - i0 : TENSOR_REDUCE_BLOCK;
+    /* The outputs are laid out with dimension 0 first and the other dimension second */
+    int64_t out0 = j * tv->ne[0] + i0;
+    for (int64_t i = 0; i < n; i++) {
+      acc[i] = 0.0;
+      index[i] = 0;
+      c[i] = task->center ? task->center[out0 + i] : 0.0;
+    }
+    const uint8_t * p = (const uint8_t *)tv->data + j * tv->nb[other] + i0 * tv->nb[0];
+    for (int64_t k = 0; k < tv->ne[task->axis]; k++, p += tv->nb[task->axis]) {
+      tensor_load_block_f64(p, tv->type, n, tv->nb[0], block);
+      switch (kind) {
+      case nanoclj_reduce_sum:
+	for (int64_t i = 0; i < n; i++) acc[i] += block[i];
+	break;
+      case nanoclj_reduce_norm:
+	for (int64_t i = 0; i < n; i++) acc[i] += (block[i] - c[i]) * (block[i] - c[i]);
+	break;
+      case nanoclj_reduce_min:
+	for (int64_t i = 0; i < n; i++) {
+	  if (k == 0 || block[i] < acc[i] || (isnan(acc[i]) && !isnan(block[i]))) { acc[i] = block[i]; index[i] = k; }
+	}
+	break;
+      case nanoclj_reduce_max:
+	for (int64_t i = 0; i < n; i++) {
+	  if (k == 0 || block[i] > acc[i] || (isnan(acc[i]) && !isnan(block[i]))) { acc[i] = block[i]; index[i] = k; }
+	}
+	break;
+      default:
+	break;
+      }
+    }
+    for (int64_t i = 0; i < n; i++) task->out[out0 + i] = (tensor_reduce_acc_t){ acc[i], index[i] };
+  }
+  return 0;
+}
+
+/* Runs the work items in parallel in contiguous ranges */
+static inline void tensor_reduce_run(tensor_reduce_task_t task, NANOCLJ_THREAD_SIG (*fn)(void *), int64_t n_items, int64_t n_elem, int n_threads) {
+  if (n_elem < TENSOR_REDUCE_PARALLEL_MIN || n_threads < 2 || n_items < 2) {
+    task.first = 0;
+    task.last = n_items;
+    fn(&task);
+    return;
+  }
+  if (n_threads > n_items) n_threads = n_items;
+  tensor_reduce_task_t * tasks = malloc(n_threads * sizeof(tensor_reduce_task_t));
+  for (int i = 0; i < n_threads; i++) {
+    tasks[i] = task;
+    tasks[i].first = n_items * i / n_threads;
+    tasks[i].last = n_items * (i + 1) / n_threads;
+  }
+  nanoclj_run_parallel(fn, tasks, sizeof(tensor_reduce_task_t), n_threads);
+  free(tasks);
+}
+
+static inline tensorview_t tensorview_pad_dims(tensorview_t tv) {
+  for (int d = tv.n_dims; d < NANOCLJ_MAX_DIMS; d++) {
+    tv.ne[d] = 1;
+    tv.nb[d] = 0;
+  }
+  return tv;
+}
+
+static inline int64_t tensorview_n_elem(const tensorview_t * tv) {
+  int64_t n = 1;
+  for (int d = 0; d < tv->n_dims; d++) n *= tv->ne[d];
+  return n;
+}
+
+static inline tensor_reduce_acc_t tensor_reduce_all_kind(nanoclj_reduce_op_t kind, const tensorview_t * tv, double center, int n_threads) {
+  int64_t n_chunks = tensor_reduce_chunks_per_row(tv) * tv->ne[1] * tv->ne[2];
+  tensor_reduce_acc_t * partials = malloc(n_chunks * sizeof(tensor_reduce_acc_t));
+  tensor_reduce_run((tensor_reduce_task_t){ kind, tv, -1, 0, 0, &center, partials }, tensor_reduce_all_main,
+		    n_chunks, tensorview_n_elem(tv), n_threads);
+  tensor_reduce_acc_t acc = { 0.0, -1 };
+  for (int64_t c = 0; c < n_chunks; c++) tensor_reduce_merge(kind, &acc, partials[c]);
+  free(partials);
+  return acc;
+}
+
+/* Reduces all the elements of a tensor to a double. The index of the minimum or maximum is stored in
+ * index for argmin and argmax. Empty tensors give zero sums and NaN for the other operations. */
+static inline double tensor_reduce_all(nanoclj_reduce_op_t op, tensorview_t tv, int n_threads, int64_t * index) {
+  tv = tensorview_pad_dims(tv);
+  int64_t n = tensorview_n_elem(&tv);
+  if (tensorview_is_contiguous(&tv)) {
+    /* Contiguous tensors are reduced as a single row */
+    tv.ne[0] = n;
+    tv.ne[1] = tv.ne[2] = 1;
+  }
+  *index = -1;
+  switch (op) {
+  case nanoclj_reduce_sum:
+    return tensor_reduce_all_kind(op, &tv, 0.0, n_threads).value;
+  case nanoclj_reduce_mean:
+    return tensor_reduce_all_kind(nanoclj_reduce_sum, &tv, 0.0, n_threads).value / n;
+  case nanoclj_reduce_norm:
+    return sqrt(tensor_reduce_all_kind(op, &tv, 0.0, n_threads).value);
+  case nanoclj_reduce_var:
+  case nanoclj_reduce_std:
+    {
+      double mean = tensor_reduce_all_kind(nanoclj_reduce_sum, &tv, 0.0, n_threads).value / n;
+      double var = tensor_reduce_all_kind(nanoclj_reduce_norm, &tv, mean, n_threads).value / n;
+      return op == nanoclj_reduce_var ? var : sqrt(var);
+    }
+  default:
+    {
+      nanoclj_reduce_op_t kind = op == nanoclj_reduce_min || op == nanoclj_reduce_argmin ? nanoclj_reduce_min : nanoclj_reduce_max;
+      tensor_reduce_acc_t acc = tensor_reduce_all_kind(kind, &tv, 0.0, n_threads);
+      *index = acc.index;
+      return acc.index >= 0 ? acc.value : NAN;
+    }
+  }
+}
+
+static inline void tensor_store_f64(void * p, nanoclj_tensor_type_t t, double v) {
+  switch (t) {
+  case nanoclj_boolean: *(uint8_t *)p = v != 0; break;
+  case nanoclj_i8: *(int8_t *)p = (int8_t)v; break;
+  case nanoclj_i16: *(int16_t *)p = (int16_t)v; break;
+  case nanoclj_i32: *(int32_t *)p = (int32_t)v; break;
+  case nanoclj_f32: *(float *)p = v; break;
+  case nanoclj_f64: *(double *)p = v; break;
+  case nanoclj_val: break;
+  case nanoclj_i64: *(int64_t *)p = (int64_t)v; break;
+  case nanoclj_u8: *(uint8_t *)p = (uint8_t)v; break;
+  case nanoclj_u16: *(uint16_t *)p = (uint16_t)v; break;
+  case nanoclj_u32: *(uint32_t *)p = (uint32_t)v; break;
+  }
+}
+
+static inline tensor_reduce_acc_t * tensor_reduce_axis_kind(nanoclj_reduce_op_t kind, const tensorview_t * tv, int axis,
+							    const double * center, int64_t n_out, int n_threads) {
+  tensor_reduce_acc_t * out = malloc(n_out * sizeof(tensor_reduce_acc_t));
+  if (!out) return NULL;
+  int64_t n_items;
+  if (axis == 0) {
+    n_items = tv->ne[1] * tv->ne[2];
+  } else {
+    n_items = (tv->ne[0] + TENSOR_REDUCE_BLOCK - 1) / TENSOR_REDUCE_BLOCK * tv->ne[axis == 1 ? 2 : 1];
+  }
+  tensor_reduce_run((tensor_reduce_task_t){ kind, tv, axis, 0, 0, center, out }, tensor_reduce_axis_main,
+		    n_items, tensorview_n_elem(tv), n_threads);
+  return out;
+}
+
+/* Reduces a tensor along dimension axis, which must exist and be non-empty. The result has one
+ * dimension less. Sums, means, variances and norms are doubles, argmin and argmax give i32 indices
+ * and minimum and maximum keep the type of the tensor. */
+static inline nanoclj_tensor_t * tensor_reduce_axis(nanoclj_reduce_op_t op, tensorview_t tv, int axis, int n_threads) {
+  int n_dims = tv.n_dims;
+  tv = tensorview_pad_dims(tv);
+  int64_t ne[NANOCLJ_MAX_DIMS] = { 1, 1, 1 };
+  for (int d = 0, i = 0; d < n_dims; d++) {
+    if (d != axis) ne[i++] = tv.ne[d];
+  }
+  int64_t n_out = ne[0] * ne[1] * ne[2], n = tv.ne[axis];
+  nanoclj_tensor_type_t t = nanoclj_f64;
+  nanoclj_reduce_op_t kind = op;
+  switch (op) {
+  case nanoclj_reduce_min: case nanoclj_reduce_max: t = tv.type; break;
+  case nanoclj_reduce_argmin: kind = nanoclj_reduce_min; t = nanoclj_i32; break;
+  case nanoclj_reduce_argmax: kind = nanoclj_reduce_max; t = nanoclj_i32; break;
+  case nanoclj_reduce_mean: case nanoclj_reduce_var: case nanoclj_reduce_std: kind = nanoclj_reduce_sum; break;
+  default: break;
+  }
+  tensor_reduce_acc_t * acc = tensor_reduce_axis_kind(kind, &tv, axis, NULL, n_out, n_threads);
+  if (!acc) return NULL;
+  if (op == nanoclj_reduce_var || op == nanoclj_reduce_std) {
+    double * mean = malloc(n_out * sizeof(double));
+    if (!mean) {
+      free(acc);
+      return NULL;
+    }
+    for (int64_t i = 0; i < n_out; i++) mean[i] = acc[i].value / n;
+    free(acc);
+    acc = tensor_reduce_axis_kind(nanoclj_reduce_norm, &tv, axis, mean, n_out, n_threads);
+    free(mean);
+    if (!acc) return NULL;
+  }
+  nanoclj_tensor_t * r = mk_tensor_nd(t, n_dims > 1 ? n_dims - 1 : 1, ne);
+  if (r) {
+    uint8_t * p = r->data;
+    for (int64_t i = 0; i < n_out; i++, p += r->nb[0]) {
+      double v = acc[i].value;
+      switch (op) {
+      case nanoclj_reduce_argmin: case nanoclj_reduce_argmax: v = acc[i].index; break;
+      case nanoclj_reduce_mean: case nanoclj_reduce_var: v /= n; break;
+      case nanoclj_reduce_std: v = sqrt(v / n); break;
+      case nanoclj_reduce_norm: v = sqrt(v); break;
+      default: break;
+      }
+      tensor_store_f64(p, t, v);
+    }
+  }
+  free(acc);
+  return r;
+}
+
+/* Fused expressions are programs in postfix order that evaluate an elementwise expression of several
+ * operands without creating intermediate tensors. The program is run on blocks of TENSOR_REDUCE_BLOCK
+ * elements, and the intermediate results are kept on a stack of block buffers that stays in the cache. */
+typedef enum {
+  tensor_expr_load = 0,
+  tensor_expr_unary,
+  tensor_expr_binary
+} tensor_expr_kind_t;
+
+typedef struct {
+  tensor_expr_kind_t kind;
+  /* Operand index for loads, nanoclj_unary_op_t or nanoclj_binary_op_t otherwise */
+  int op;
+} tensor_expr_instr_t;
+
+typedef struct {
+  const tensor_expr_instr_t * code;
+  int n_code, depth;
+  /* Operands with zero strides in the broadcast dimensions */
+  const tensorview_t * operands;
+  nanoclj_tensor_t * r;
+  /* Range of work items, which are blocks of rows */
+  int64_t first, last;
+} tensor_expr_task_t;
+
+/* Computes the shape of the result of broadcasting n tensors together. Returns false if the shapes are incompatible. */
+static inline bool tensorview_broadcast_shape(const tensorview_t * tv, int n, int * n_dims, int64_t * ne) {
+  *n_dims = 1;
+  for (int d = 0; d < NANOCLJ_MAX_DIMS; d++) ne[d] = 1;
+  for (int i = 0; i < n; i++) {
+    if (tv[i].n_dims > *n_dims) *n_dims = tv[i].n_dims;
+    for (int d = 0; d < tv[i].n_dims; d++) {
+      if (ne[d] == 1) ne[d] = tv[i].ne[d];
+      else if (tv[i].ne[d] != 1 && tv[i].ne[d] != ne[d]) return false;
+    }
+  }
+  return true;
+}
+
+/* Returns the stack depth needed by a program, or -1 if it is invalid */
+static inline int tensor_expr_depth(const tensor_expr_instr_t * code, int n_code, int n_operands) {
+  int sp = 0, depth = 0;
+  for (int i = 0; i < n_code; i++) {
+    switch (code[i].kind) {
+    case tensor_expr_load:
+      if (code[i].op < 0 || code[i].op >= n_operands) return -1;
+      if (++sp > depth) depth = sp;
+      break;
+    case tensor_expr_unary:
+      if (sp < 1) return -1;
+      break;
+    case tensor_expr_binary:
+      if (sp < 2 || tensor_is_comparison(code[i].op)) return -1;
+      sp--;
+      break;
+    }
+  }
+  return sp == 1 ? depth : -1;
+}
+
+#define TENSOR_EXPR_LOOP(T, EXPR) for (int64_t i = 0; i < n; i++) { T x = a[i]; o[i] = (EXPR); }
+#define TENSOR_EXPR_LOOP2(T, EXPR) for (int64_t i = 0; i < n; i++) { T x = a[i], y = b[i]; o[i] = (EXPR); }
+
+/* Operands of type T with unit stride are used in place, and the others are converted into the stack */
+#define TENSOR_EXPR_KERNEL(NAME, T, SUFFIX, TYPE, LOAD)			\
+  static NANOCLJ_THREAD_SIG NAME(void * arg) {				\
+    tensor_expr_task_t * task = arg;					\
+    nanoclj_tensor_t * r = task->r;					\
+    int64_t ne0 = r->ne[0], ne1 = r->n_dims >= 2 ? r->ne[1] : 1;	\
+    int64_t bpr = (ne0 + TENSOR_REDUCE_BLOCK - 1) / TENSOR_REDUCE_BLOCK; \
+    T * stack = malloc(task->depth * TENSOR_REDUCE_BLOCK * sizeof(T));	\
+    const T ** val = malloc(task->depth * sizeof(T *));		\
+    if (!stack || !val) {						\
+      free(stack);							\
+      free(val);							\
+      return 0;								\
+    }									\
+    for (int64_t item = task->first; item < task->last; item++) {	\
+      int64_t row = item / bpr, i0 = (item % bpr) * TENSOR_REDUCE_BLOCK; \
+      int64_t i1 = row % ne1, i2 = row / ne1;				\
+      int64_t n = ne0 - i0 < TENSOR_REDUCE_BLOCK ? ne0 - i0 : TENSOR_REDUCE_BLOCK; \
+      int sp = 0;							\
+      for (int k = 0; k < task->n_code; k++) {				\
+	int op = task->code[k].op;					\
+	switch (task->code[k].kind) {					\
+	case tensor_expr_load: {					\
+	  const tensorview_t * v = &task->operands[op];			\
+	  const uint8_t * p = (const uint8_t *)v->data + i0 * v->nb[0] + i1 * v->nb[1] + i2 * v->nb[2]; \
+	  if (v->type == TYPE && v->nb[0] == sizeof(T)) {		\
+	    val[sp] = (const T *)p;					\
+	  } else {							\
+	    LOAD(p, v->type, n, v->nb[0], stack + sp * TENSOR_REDUCE_BLOCK); \
+	    val[sp] = stack + sp * TENSOR_REDUCE_BLOCK;			\
+	  }								\
+	  sp++;								\
+	  break;							\
+	}								\
+	case tensor_expr_unary: {					\
+	  const T * a = val[sp - 1];					\
+	  T * o = stack + (sp - 1) * TENSOR_REDUCE_BLOCK;		\
+	  switch ((nanoclj_unary_op_t)op) {				\
+	  case nanoclj_unop_neg: TENSOR_EXPR_LOOP(T, -x); break;		\
+	  case nanoclj_unop_abs: TENSOR_EXPR_LOOP(T, fabs##SUFFIX(x)); break; \
+	  case nanoclj_unop_sqrt: TENSOR_EXPR_LOOP(T, sqrt##SUFFIX(x)); break; \
+	  case nanoclj_unop_exp: TENSOR_EXPR_LOOP(T, exp##SUFFIX(x)); break; \
+	  case nanoclj_unop_log: TENSOR_EXPR_LOOP(T, log##SUFFIX(x)); break; \
+	  case nanoclj_unop_sin: TENSOR_EXPR_LOOP(T, sin##SUFFIX(x)); break; \
+	  case nanoclj_unop_cos: TENSOR_EXPR_LOOP(T, cos##SUFFIX(x)); break; \
+	  case nanoclj_unop_tanh: TENSOR_EXPR_LOOP(T, tanh##SUFFIX(x)); break; \
+	  case nanoclj_unop_floor: TENSOR_EXPR_LOOP(T, floor##SUFFIX(x)); break; \
+	  case nanoclj_unop_ceil: TENSOR_EXPR_LOOP(T, ceil##SUFFIX(x)); break; \
+	  case nanoclj_unop_round: TENSOR_EXPR_LOOP(T, round##SUFFIX(x)); break; \
+	  }								\
+	  val[sp - 1] = o;						\
+	  break;							\
+	}								\
+	case tensor_expr_binary: {					\
+	  const T * a = val[sp - 2], * b = val[sp - 1];			\
+	  T * o = stack + (sp - 2) * TENSOR_REDUCE_BLOCK;		\
+	  switch ((nanoclj_binary_op_t)op) {				\
+	  case nanoclj_binop_add: TENSOR_EXPR_LOOP2(T, x + y); break;	\
+	  case nanoclj_binop_sub: TENSOR_EXPR_LOOP2(T, x - y); break;	\
+	  case nanoclj_binop_mul: TENSOR_EXPR_LOOP2(T, x * y); break;	\
+	  case nanoclj_binop_div: TENSOR_EXPR_LOOP2(T, x / y); break;	\
+	  case nanoclj_binop_min: TENSOR_EXPR_LOOP2(T, y < x ? y : x); break; \
+	  case nanoclj_binop_max: TENSOR_EXPR_LOOP2(T, y > x ? y : x); break; \
+	  default: break;						\
+	  }								\
+	  val[sp - 2] = o;						\
+	  sp--;								\
+	  break;							\
+	}								\
+	}								\
+      }									\
+      memcpy((T *)r->data + row * ne0 + i0, val[0], n * sizeof(T));	\
+    }									\
+    free(stack);							\
+    free(val);								\
+    return 0;								\
+  }
+
+TENSOR_EXPR_KERNEL(tensor_expr_main_f32, float, f, nanoclj_f32, tensor_load_block_f32)
+TENSOR_EXPR_KERNEL(tensor_expr_main_f64, double, , nanoclj_f64, tensor_load_block_f64)
+
+/* Evaluates a fused expression. The operands are broadcast against each other and the result is
+ * computed in single precision if all the tensor operands are f32 and in double precision otherwise.
+ * Scalars should be given as single element f64 views, and they don't affect the type. Returns NULL
+ * if the program is invalid, the shapes are incompatible or memory runs out. */
+static inline nanoclj_tensor_t * tensor_expr_eval(const tensor_expr_instr_t * code, int n_code,
+						  const tensorview_t * operands, const bool * is_scalar,
+						  int n_operands, int n_threads) {
+  int depth = tensor_expr_depth(code, n_code, n_operands);
+  if (depth < 0) return NULL;
+
+  int n_dims;
+  int64_t ne[NANOCLJ_MAX_DIMS];
+  if (!tensorview_broadcast_shape(operands, n_operands, &n_dims, ne)) return NULL;
+  nanoclj_tensor_type_t t = nanoclj_f32;
+  bool has_tensor = false;
+  for (int i = 0; i < n_operands; i++) {
+    if (!is_scalar[i]) {
+      if (operands[i].type != nanoclj_f32) t = nanoclj_f64;
+      has_tensor = true;
+    }
+  }
+  if (!has_tensor) t = nanoclj_f64;
+
+  tensorview_t * ops = malloc(n_operands * sizeof(tensorview_t));
+  if (!ops) return NULL;
+  for (int i = 0; i < n_operands; i++) {
+    ops[i] = tensorview_pad_dims(operands[i]);
+    for (int d = 0; d < NANOCLJ_MAX_DIMS; d++) {
+      if (ops[i].ne[d] == 1) ops[i].nb[d] = 0;
+    }
+  }
+
+  nanoclj_tensor_t * r = mk_tensor_nd(t, n_dims, ne);
+  if (r) {
+    int64_t n_items = (ne[0] + TENSOR_REDUCE_BLOCK - 1) / TENSOR_REDUCE_BLOCK * ne[1] * ne[2];
+    tensor_expr_task_t task = { code, n_code, depth, ops, r, 0, n_items };
+    NANOCLJ_THREAD_SIG (*fn)(void *) = t == nanoclj_f32 ? tensor_expr_main_f32 : tensor_expr_main_f64;
+    int64_t n_elem = ne[0] * ne[1] * ne[2];
+    if (n_elem < TENSOR_REDUCE_PARALLEL_MIN || n_threads < 2 || n_items < 2) {
+      fn(&task);
+    } else {
+      if (n_threads > n_items) n_threads = n_items;
+      tensor_expr_task_t * tasks = malloc(n_threads * sizeof(tensor_expr_task_t));
+      if (tasks) {
+	for (int i = 0; i < n_threads; i++) {
+	  tasks[i] = task;
+	  tasks[i].first = n_items * i / n_threads;
+	  tasks[i].last = n_items * (i + 1) / n_threads;
+	}
+	nanoclj_run_parallel(fn, tasks, sizeof(tensor_expr_task_t), n_threads);
+	free(tasks);
+      } else {
+	fn(&task);
+      }
+    }
+  }
+  free(ops);
+  return r;
+}
+
+#endif
@@ -37,10 +37,40 @@ static inline void nanoclj_sleep(long long ms) {
   Sleep(ms);
 }
 
+static inline int nanoclj_get_cpu_count() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+/* Runs start_routine for n work items of item_size bytes in parallel and waits for all of them.
+ * The items are processed serially if the thread handles can't be allocated. */
+static inline void nanoclj_run_parallel(unsigned (__stdcall *start_routine)(void *), void * items, size_t item_size, int n) {
+  HANDLE * threads = malloc(n * sizeof(HANDLE));
+  if (!threads) {
+    for (int i = 0; i < n; i++) start_routine((char *)items + i * item_size);
+    return;
+  }
+  for (int i = 1; i < n; i++) {
+    threads[i] = (HANDLE)_beginthreadex(NULL, 0, start_routine, (char *)items + i * item_size, 0, NULL);
+    if (!threads[i]) start_routine((char *)items + i * item_size);
+  }
+  if (n > 0) start_routine(items);
+  for (int i = 1; i < n; i++) {
+    if (threads[i]) {
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+    }
+  }
+  free(threads);
+}
+
 #else
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
 
 typedef pthread_mutex_t nanoclj_mutex_t;
 typedef pthread_t nanoclj_thread_t;
@@ -80,6 +110,35 @@ static inline void nanoclj_sleep(long long ms) {
   nanosleep(&t, &t2);
 }
 
+static inline int nanoclj_get_cpu_count() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? n : 1;
+}
+
+/* Runs start_routine for n work items of item_size bytes in parallel and waits for all of them.
+ * The first item is processed in the calling thread, and the items are processed serially if the
+ * thread handles can't be allocated. */
+static inline void nanoclj_run_parallel(NANOCLJ_THREAD_SIG (*start_routine)(void *), void * items, size_t item_size, int n) {
+  pthread_t * threads = malloc(n * sizeof(pthread_t));
+  bool * started = calloc(n, sizeof(bool));
+  if (!threads || !started) {
+    free(started);
+    free(threads);
+    for (int i = 0; i < n; i++) start_routine((char *)items + i * item_size);
+    return;
+  }
+  for (int i = 1; i < n; i++) {
+    started[i] = pthread_create(&threads[i], NULL, start_routine, (char *)items + i * item_size) == 0;
+    if (!started[i]) start_routine((char *)items + i * item_size);
+  }
+  if (n > 0) start_routine(items);
+  for (int i = 1; i < n; i++) {
+    if (started[i]) pthread_join(threads[i], NULL);
+  }
+  free(started);
+  free(threads);
+}
+
 #endif
 
 #endif
@@ -21,6 +21,10 @@ typedef enum {
   nanoclj_f32,
   nanoclj_f64,
   nanoclj_val,
+  nanoclj_i64,
+  nanoclj_u8,
+  nanoclj_u16,
+  nanoclj_u32,
 } nanoclj_tensor_type_t;
 
 typedef enum {
@@ -82,6 +86,12 @@ typedef enum {
   nanoclj_mode_block
 } nanoclj_display_mode_t;
 
+typedef enum {
+  nanoclj_flush_on_size = 0,
+  nanoclj_flush_on_newline,
+  nanoclj_flush_explicit
+} nanoclj_flush_policy_t;
+
 typedef struct {
   nanoclj_color_t fg;
   nanoclj_color_t bg;
@@ -110,7 +120,6 @@ typedef struct {
 } nanoclj_vec2f;
 
 typedef struct {
-  nanoclj_vec2f pos, ppos;
   nanoclj_val_t data;
 } nanoclj_node_t;
 
@@ -119,6 +128,12 @@ typedef struct {
   nanoclj_val_t data;
 } nanoclj_edge_t;
 
+/* Adjacency in compressed sparse row format: the neighbours of node i and the indices of the
+ * edges that connect them are at offsets[i] ... offsets[i + 1] - 1 */
+typedef struct {
+  uint32_t * offsets, * nodes, * edges;
+} nanoclj_csr_t;
+
 typedef struct {
   size_t num_rows, num_columns;
 } nanoclj_table_t;
@@ -53,6 +53,24 @@ static inline int32_t decode_utf8(const char *s) {
   return codepoint;
 }
 
+/* Returns true if the string is valid UTF-8 */
+static inline bool utf8_is_valid(const char * s, size_t size) {
+  const uint8_t * p = (const uint8_t *)s, * end = p + size;
+  while (p < end) {
+    if (*p < 0x80) {
+      p++;
+      continue;
+    }
+    size_t n = utf8_sequence_length(*p);
+    if (n == 0 || end - p < n) return false;
+    for (size_t i = 1; i < n; i++) {
+      if ((p[i] & 0xc0) != 0x80) return false;
+    }
+    p += n;
+  }
+  return true;
+}
+
 /* Returns the number of codepoints in utf8 string */
 static inline long long utf8_num_codepoints(const char *s, size_t size) {
   const char * end = s + size;
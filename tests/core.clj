@@ -44,12 +44,32 @@
 
 (t/is (= (abs -100N) (abs -100) 100))
 (t/is (= (abs Integer/MIN_VALUE) 2147483648))
+(t/is (= (abs -5000000000000000000) 5000000000000000000))
+(t/is (= (inc 140737488355327) 140737488355328))
+(t/is (= (dec -140737488355328) -140737488355329))
+(t/is (= (hash (* 50000 100000)) (hash 5000000000)))
+(t/is (= (compare 5000000000 -140737488355329) 1))
 
 (t/is (= (inc 5) 6))
 (t/is (= (dec 6) 5))
 (t/is (= (dec Integer/MIN_VALUE) -2147483649))
 (t/is (= (inc Integer/MAX_VALUE) 2147483648))
 
+(t/is (= (* 3037000499 3037000499) 9223372030926249001))
+(t/is (= (*' 140737488355327 140737488355327) 19807040628565802923409276929N))
+(t/is (= (/ 12 4) 3))
+(t/is (= (/ 3 6) 1/2))
+(t/is (= (< 1 2.5) true))
+
+(def inline-op clojure.core/-add)
+(defn inline-fn ([x] x) ([x y] (inline-op x y)))
+(t/is (= (inline-fn 3 4) 7))
+(def inline-op clojure.core/-mul)
+(t/is (= (inline-fn 3 4) 12))
+(t/is (= (reduce inline-fn [2 3 4]) 24))
+(defn inline-shadow ([inline-op] inline-op) ([inline-op y] (inline-op inline-op y)))
+(t/is (= (inline-shadow (fn [f y] y) 5) 5))
+
 (t/is (= (+ 1/2 1/2) 1))
 (t/is (= (- 10 10/3) 20/3))
 
@@ -64,6 +84,10 @@
 (t/is (= (* 100000000000000000000 100000000000000000000)
        10000000000000000000000000000000000000000))
 (t/is (= (/ 100000000000000000000000000 1000000000000000000000000) 100N))
+(t/is (= (quot (*' (apply *' (range 1 61)) 1000003) (apply *' (range 1 51))) (*' (apply *' (range 51 61)) 1000003)))
+(t/is (= (count (str (apply *' (range 1 2001)))) 5736))
+(t/is (let [x (apply *' (range 1 3001))] (= (read-string (str x)) x)))
+(t/is (= (mod (*' (apply *' (range 1 1001)) (apply *' (range 1 1501))) 1000003) (mod (*' (mod (apply *' (range 1 1001)) 1000003) (mod (apply *' (range 1 1501)) 1000003)) 1000003)))
 
                                         ; Ratios
 
@@ -73,6 +97,10 @@
 
 (t/is (= 1/2 (/ 1 2)))
 (t/is (= (* 2/3 5/4) 5/6))
+(t/is (= (reduce + (map #(/ 1 %) (range 1 31))) 9304682830147/2329089562800))
+(t/is (= (reduce * (map #(/ (inc %) %) (range 1 100))) 100))
+(t/is (= (reduce +' [9223372036854775807 1]) 9223372036854775808N))
+(t/is (= (reduce + 1/2 [0.5 1]) 2.0))
 
 (t/is (= (rationalize 1.25) 5/4))
 (t/is (= (rationalize -2/4) -1/2))
@@ -151,6 +179,11 @@
 (t/is (= (vector-of :int 1.0 2.0 3.0) [ 1 2 3 ]))
 (t/is (= (vector-of :float 1.0 2.0 3.0) [ 1.0 2.0 3.0 ]))
 (t/is (= (vector-of :double 1.0 2.0 3.0) [ 1.0 2.0 3.0 ]))
+(t/is (= (vector-of :long 1 9000000000 -5) [ 1 9000000000 -5 ]))
+(t/is (= (vector-of :ubyte 200 255) [ 200 255 ]))
+(t/is (= (vector-of :ushort 65535) [ 65535 ]))
+(t/is (= (vector-of :uint 4294967295) [ 4294967295 ]))
+(t/is (= (let [a (long-array 2)] (aset a 1 -9000000000) (seq a)) '( 0 -9000000000 )))
 
 (t/is (= (dedupe '( 10 10 10 1 1 9 :a :a 4 2 2 )) '( 10 1 9 :a 4 2 )))
 
@@ -174,6 +207,38 @@
 (t/is (= (print-str ["a"]) "[a]"))
 (t/is (= (pr-str ["a"]) "[\"a\"]"))
 
+                                        ; Readers
+
+(t/is (= (line-seq (clojure.java.io/reader (char-array "a\nb\r\n\nc"))) '( "a" "b" "" "c" )))
+(t/is (= (read-line (clojure.java.io/reader (char-array ""))) nil))
+
+(def rfn "/tmp/nanoclj-reader-test.txt")
+(spit rfn (apply str "a\nb\n" (repeat 10000 \x)))
+(t/is (= (map count (line-seq (clojure.java.io/reader rfn))) '( 1 1 10000 )))
+(t/is (= (with-open [r (clojure.java.io/reader rfn)] [(read-line r) (read-line r)]) [ "a" "b" ]))
+(def w (java.io.Writer rfn))
+(binding [*out* w] (dotimes [i 20] (print (apply str (repeat 100000 \y)))))
+(.close w)
+(t/is (= (count (slurp rfn)) 2000000))
+(t/is (= (try (slurp "tests") (catch java.io.IOException e :error)) :error))
+(t/is (= (try (read-line (clojure.java.io/reader "tests")) (catch java.io.IOException e :error)) :error))
+
+                                        ; Writers
+
+(def wfn "/tmp/nanoclj-writer-test.txt")
+(def w (java.io.Writer wfn :flush :explicit :buffer-size 4))
+(binding [*out* w] (print "abc") (print "defgh"))
+(t/is (= (slurp wfn) ""))
+(flush w)
+(t/is (= (slurp wfn) "abcdefgh"))
+(.close w)
+(def w (java.io.Writer wfn :flush :newline))
+(binding [*out* w] (print "a") (println "b"))
+(t/is (= (slurp wfn) "ab\n"))
+(.close w)
+(spit wfn (apply str (repeat 100000 \x)) :buffer-size 16)
+(t/is (= (count (slurp wfn)) 100000))
+
                                         ; Lazy-seqs and Delays
 
 (t/is (= (range 5) '( 0 1 2 3 4 )))
@@ -6,3 +6,11 @@
 (def rdr (io/reader (char-array "1,2,3,4\n")))
 (def d (csv/read-csv rdr))
 (t/is (= d '( [ "1" "2" "3" "4" ])))
+
+(def rdr2 (io/reader (char-array "a,\"b\nc\"\r\nd,e")))
+(t/is (= (csv/read-csv rdr2) '( [ "a" "b\nc" ] [ "d" "e" ])))
+
+(def cols (csv/read-columns (io/reader (char-array "n,x,s\n1,1.5,a\n2,,\"b,\"\"c\"\"\"\n"))))
+(t/is (= (cols "n") [1 2]))
+(t/is (= (cols "s") [ "a" "b,\"c\"" ]))
+(t/is (= (first (cols "x")) 1.5))
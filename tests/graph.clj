@@ -0,0 +1,31 @@
+(ns test.graph)
+(require '[clojure.test :as t]
+         '[nanoclj.graph :as graph])
+
+(defn- separation [g i j]
+  (let [[x0 y0] (:position (get g i))
+        [x1 y1] (:position (get g j))]
+    [(- x1 x0) (- y1 y0)]))
+
+(defn- dot [[x0 y0] [x1 y1]] (+ (* x0 x1) (* y0 y1)))
+
+                                        ; Layout
+
+; Unlinked nodes repel: the separation grows along its original direction
+(def g2 (graph/load "tests/two-nodes.graphml"))
+(def s0 (separation g2 0 1))
+(graph/update-layout g2 {:iterations 1 :gravity 0 :theta 0})
+(t/is (> (dot (separation g2 0 1) s0) (dot s0 s0)))
+
+                                        ; Algorithms
+
+(def wg (graph/load "tests/weighted.graphml"))
+
+(t/is (= (graph/bfs wg "a") [0 1 2]))
+(t/is (= (graph/bfs wg "c" {:direction :in}) [2 1 0]))
+(t/is (= (graph/dfs wg 0) [0 1 2]))
+(t/is (= (graph/connected-components wg) [0 0 0 1 1 2]))
+(t/is (= (graph/shortest-paths wg "a") {:distances [0.0 1.0 1.0 nil nil nil] :previous [nil 0 0 nil nil nil]}))
+(t/is (= (graph/shortest-paths wg "a" {:weight "weight"}) {:distances [0.0 1.0 3.0 nil nil nil] :previous [nil 0 1 nil nil nil]}))
+(t/is (< (abs (- (reduce + (graph/page-rank wg)) 1)) 1e-6))
+(t/is (= (try (graph/bfs wg "z") (catch Exception e :error)) :error))
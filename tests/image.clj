@@ -0,0 +1,37 @@
+(ns test.image)
+(require '[clojure.test :as t]
+         '[nanoclj.image :as img])
+
+(defn- dimensions [i] [(i :width) (i :height) (i :channels)])
+
+(def i (img/load "tests/rgb.png"))
+
+                                        ; Loading
+
+(t/is (image? i))
+(t/is (= (dimensions i) [6 4 3]))
+(t/is (= (dimensions (img/load "tests/rgb.png" {:region [1 1 3 2]})) [3 2 3]))
+(t/is (= (dimensions (img/load "tests/rgb.png" {:level 1})) [3 2 3]))
+(t/is (= (dimensions (img/load "tests/rgb.png" {:level 10})) [1 1 3]))
+(t/is (= (dimensions (img/load "tests/rgb.png" {:region [1 0 5 3] :level 1})) [3 2 3]))
+(t/is (= (try (img/load "tests/rgb.png" {:region [4 0 3 2]}) (catch IllegalArgumentException e :error)) :error))
+(t/is (= (try (img/load "tests/rgb.png" {:region [0 0 7 1]}) (catch IllegalArgumentException e :error)) :error))
+
+(def png "/tmp/nanoclj-image-test.png")
+(img/save i png)
+(t/is (= (dimensions (img/load png)) [6 4 3]))
+
+                                        ; Transforms
+
+(t/is (= (dimensions (img/transpose i)) [4 6 3]))
+(t/is (= (dimensions (img/rotate i 90)) [4 6 3]))
+(t/is (= (dimensions (img/rotate i 180)) [6 4 3]))
+(t/is (= (dimensions (img/flip-horizontal i)) [6 4 3]))
+(t/is (= (dimensions (img/gaussian-blur i 1)) [6 4 3]))
+
+                                        ; Scaling
+
+(t/is (= (map dimensions (img/pyramid i)) [[6 4 3] [3 2 3] [2 1 3] [1 1 3]]))
+(t/is (identical? (img/pyramid i) (img/pyramid i)))
+(t/is (= (dimensions (img/thumbnail i 3)) [3 2 3]))
+(t/is (identical? (img/thumbnail i 10) i))
@@ -7,3 +7,6 @@
 (t/is (= (towr/expt 1000N 10N) 1000000000000000000000000000000N))
 
 (t/is (= (towr/gcd 15 10) 5))
+(t/is (= (towr/gcd (*' (apply *' (range 1 61)) (+ (towr/expt 2 100) 277))
+                   (*' (apply *' (range 1 51)) (+ (towr/expt 3 70) 5)))
+         60828186403426756087225216332129537688755283137921024000000000000N))
@@ -5,3 +5,7 @@
 (load-file "tests/xml.clj")
 (load-file "tests/csv.clj")
 (load-file "tests/numeric-tower.clj")
+(load-file "tests/table.clj")
+(load-file "tests/tensor.clj")
+(load-file "tests/graph.clj")
+(load-file "tests/image.clj")
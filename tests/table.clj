@@ -0,0 +1,33 @@
+(ns test.table)
+(require '[ clojure.test :as t ]
+         '[ clojure.java.io :as io ]
+         '[ nanoclj.table :as tbl ])
+
+(def data (tbl/load (io/reader (char-array "city,pop,area\nB,20,2.5\nA,10,1.0\nB,30,4.0\nC,5,\n"))))
+
+(t/is (table? data))
+(t/is (= (tbl/row-count data) 4))
+(t/is (= (tbl/column-names data) [ "city" "pop" "area" ]))
+(t/is (= (data "pop") [20 10 30 5]))
+(t/is (= (tbl/row data 1) { "city" "A" "pop" 10 "area" 1.0 }))
+
+(t/is (= ((tbl/filter data "pop" :> 10) "city") [ "B" "B" ]))
+(t/is (= ((tbl/filter data "area" :>= 2.5) "pop") [20 30]))
+(t/is (= ((tbl/filter data "city" := "B") "pop") [20 30]))
+(t/is (= ((tbl/sort-by data "pop") "pop") [5 10 20 30]))
+(t/is (= ((tbl/sort-by data "city" true) "pop") [5 20 30 10]))
+(t/is (= (tbl/column-names (tbl/project data [ "area" "city" ])) [ "area" "city" ]))
+
+(def groups (tbl/group-by data "city" { "n" [ :count ] "total" [ :sum "pop" ] }))
+(t/is (= (groups "city") [ "A" "B" "C" ]))
+(t/is (= (groups "n") [1 2 1]))
+(t/is (= (first (groups "total")) 10))
+(t/is (= (groups "total") [10 50 5]))
+(t/is (= ((tbl/aggregate data { :mean [ :mean "area" ] }) :mean) 2.5))
+(t/is (= (tbl/aggregate data { :sum [ :sum "pop" ] :max [ :max "pop" ] :mean [ :mean "pop" ] }) { :sum 65 :max 30 :mean 16.25 }))
+(t/is (= ((tbl/filter data "pop" :< 10.5) "pop") [10 5]))
+(t/is (= ((tbl/sort-by data "pop" true) "city") [ "B" "B" "A" "C" ]))
+
+(def t2 (table [ { :a 1 :b "x" } { :a 2 :b "y" } ]))
+(t/is (= (t2 :b) [ "x" "y" ]))
+(t/is (= (count (tbl/rows (table { :a [1 2 3] }))) 3))
@@ -0,0 +1,123 @@
+(ns test.tensor)
+(require '[ clojure.test :as t ]
+         '[ nanoclj.tensor :as nt ])
+
+                                        ; Arithmetic
+
+(t/is (= (seq (+ (double-array [ 1 2 3 ]) 1)) '( 2.0 3.0 4.0 )))
+(t/is (= (seq (* (double-array [ 1 2 3 ]) (double-array [ 4 5 6 ]))) '( 4.0 10.0 18.0 )))
+(t/is (= (seq (- (float-array [ 1 2 ]))) '( -1.0 -2.0 )))
+(t/is (= (seq (- 10 (int-array [ 1 2 ]))) '( 9 8 )))
+(t/is (= (seq (/ (int-array [ 1 2 3 ]) 2)) '( 0.5 1.0 1.5 )))
+(t/is (= (+ (vector-of :double 1 2 3) (vector-of :double 10 20 30)) [ 11.0 22.0 33.0 ]))
+(t/is (= (+ (vector-of :int 1 2 3) 0.5) [ 1.5 2.5 3.5 ]))
+(t/is (= (+ (vector-of :byte 100 100) 100) [ -56 -56 ]))
+(t/is (= (+ (vector-of :short 1 2) (vector-of :int 3 4)) [ 4 6 ]))
+(t/is (= (+ (vector-of :float 1 2) (vector-of :int 1 2)) [ 2.0 4.0 ]))
+(t/is (= (seq (+ (double-array [ 1 2 ]) (subvec (vector-of :double 1 2 3) 1))) '( 3.0 5.0 )))
+(t/is (= (class (+ (vector-of :double 1 2) (double-array [ 1 2 ]))) nanoclj.lang.Tensor))
+(t/is (= (class (* (vector-of :double 1 2) 2)) clojure.lang.PersistentVector))
+(t/is (= (seq (+ (vector-of :ubyte 200 255) 1)) '( 201 0 )))
+(t/is (= (seq (+ (vector-of :ubyte 200) (vector-of :byte -1))) '( 199 )))
+(t/is (= (seq (* (vector-of :long 3000000000) 2)) '( 6000000000 )))
+
+                                        ; Broadcasting
+
+(t/is (= (seq (+ (double-array [ 1 2 3 ]) (double-array [ 10 ]))) '( 11.0 12.0 13.0 )))
+(t/is (= (try (+ (double-array 3) (double-array 2)) (catch IllegalArgumentException e :error)) :error))
+(t/is (= (try (+ (to-array [ 1 2 ]) 1) (catch ClassCastException e :error)) :error))
+
+                                        ; Comparisons and math functions
+
+(t/is (= (seq (nt/< (double-array [ 1 2 3 ]) 2.5)) '( true true false )))
+(t/is (= (seq (nt/== (int-array [ 1 2 3 ]) (int-array [ 1 0 3 ]))) '( true false true )))
+(t/is (= (seq (nt/max (double-array [ 1 5 3 ]) 2)) '( 2.0 5.0 3.0 )))
+(t/is (= (nt/min (vector-of :int 1 5 3) (vector-of :int 4 4 4)) [ 1 4 3 ]))
+(t/is (= (nt/abs (vector-of :int -1 2 -3)) [ 1 2 3 ]))
+(t/is (= (seq (nt/sqrt (double-array [ 4 9 ]))) '( 2.0 3.0 )))
+(t/is (= (seq (nt/floor (double-array [ 1.5 -1.5 ]))) '( 1.0 -2.0 )))
+(t/is (= (seq (nt/round (float-array [ 0.5 1.4 ]))) '( 1.0 1.0 )))
+(t/is (= (seq (nt/exp (int-array [ 0 ]))) '( 1.0 )))
+
+                                        ; Reductions
+
+(def r (double-array [ 3 1 4 1 5 9 2 6 ]))
+(t/is (= (nt/sum r) 31.0))
+(t/is (= (nt/mean r) 3.875))
+(t/is (= (nt/amin r) 1.0))
+(t/is (= (nt/amax r) 9.0))
+(t/is (= (nt/argmin r) 1))
+(t/is (= (nt/argmax r) 5))
+(t/is (= (nt/variance r) 6.609375))
+(t/is (= (nt/norm (double-array [ 3 4 ])) 5.0))
+(t/is (= (nt/sum r 0) 31.0))
+(t/is (= (nt/amax (vector-of :int 1 7 3)) 7))
+(t/is (= (nt/argmax (vector-of :byte 1 7 7)) 1))
+(t/is (= (nt/sum (subvec (vector-of :double 1 2 3) 1)) 5.0))
+(t/is (= (nt/sum (double-array 0)) 0.0))
+(t/is (= (nt/sum (double-array 1000000 0.5)) 500000.0))
+(t/is (= (try (nt/amin (double-array 0)) (catch IllegalArgumentException e :error)) :error))
+(t/is (= (try (nt/sum r 1) (catch IllegalArgumentException e :error)) :error))
+
+                                        ; Linear algebra
+
+(def m (nt/matrix [[ 1 2 ] [ 3 4 ] [ 5 6 ]]))
+(t/is (= (nt/shape m) [ 3 2 ]))
+(t/is (= (seq (nt/reshape (nt/matmul m (nt/matrix [[ 1 0 2 ] [ 0 1 3 ]])) [ 9 ])) '( 1.0 2.0 8.0 3.0 4.0 18.0 5.0 6.0 28.0 )))
+(t/is (= (seq (nt/matmul m (double-array [ 1 1 ]))) '( 3.0 7.0 11.0 )))
+(t/is (= (seq (nt/matmul (double-array [ 1 1 1 ]) m)) '( 9.0 12.0 )))
+(t/is (= (nt/dot (double-array [ 1 2 3 ]) (vector-of :float 4 5 6)) 32.0))
+(t/is (= (seq (nt/reshape (nt/transpose m) [ 6 ])) '( 1.0 3.0 5.0 2.0 4.0 6.0 )))
+(t/is (= (seq (nt/sum m 0)) '( 9.0 12.0 )))
+(t/is (= (seq (nt/sum m 1)) '( 3.0 7.0 11.0 )))
+(def s (nt/matrix [[ 0 2 1 ] [ 1 1 1 ] [ 2 1 3 ]]))
+(t/is (= (nt/det s) -3.0))
+(t/is (= (seq (nt/round (* (nt/solve s (double-array [ 5 6 13 ])) 3))) '( 7.0 4.0 7.0 )))
+(t/is (= (seq (nt/reshape (nt/cholesky (nt/matrix [[ 4 12 -16 ] [ 12 37 -43 ] [ -16 -43 98 ]])) [ 9 ])) '( 2.0 0.0 0.0 6.0 1.0 0.0 -8.0 5.0 3.0 )))
+(t/is (= (try (nt/matmul m m) (catch IllegalArgumentException e :error)) :error))
+(t/is (= (try (nt/solve (nt/matrix [[ 1 2 ] [ 2 4 ]]) (double-array [ 1 2 ])) (catch ArithmeticException e :error)) :error))
+
+                                        ; Views
+
+(def v (nt/reshape (double-array (range 12)) [ 3 4 ]))
+(t/is (nt/contiguous? v))
+(t/is (not (nt/contiguous? (nt/transpose v))))
+(t/is (= (nt/shape (nt/transpose v)) [ 4 3 ]))
+(t/is (= (seq (nt/slice v nil 1)) '( 1.0 5.0 9.0 )))
+(t/is (= (seq (nt/slice v 2)) '( 8.0 9.0 10.0 11.0 )))
+(t/is (= (nt/slice v 1 2) 6.0))
+(t/is (= (nt/shape (nt/slice v [ 0 3 2 ] [ 1 4 ])) [ 2 3 ]))
+(t/is (= (seq (nt/contiguous (nt/slice (nt/transpose v) 1))) '( 1.0 5.0 9.0 )))
+(t/is (= (seq (nt/reshape (nt/slice v [ 1 3 ] [ 0 4 2 ]) [ 4 ])) '( 4.0 6.0 8.0 10.0 )))
+(t/is (= (seq (subvec (int-array [ 1 2 3 4 ]) 1 3)) '( 2 3 )))
+(t/is (= (subvec (vector-of :double 1 2 3 4) 2 2) []))
+(t/is (= (try (subvec (vector-of :double 1 2 3 4) 3 2) (catch IndexOutOfBoundsException e :error)) :error))
+(t/is (= (try (subvec (int-array [ 1 2 3 4 ]) 3 2) (catch IndexOutOfBoundsException e :error)) :error))
+(t/is (= (try (subvec (int-array [ 1 2 3 4 ]) 1 5) (catch IndexOutOfBoundsException e :error)) :error))
+(def a (double-array 4))
+(aset (nt/slice a [ 1 3 ]) 0 5.0)
+(t/is (= (seq a) '( 0.0 5.0 0.0 0.0 )))
+(t/is (= (try (nt/slice v 3) (catch IndexOutOfBoundsException e :error)) :error))
+(t/is (= (try (nt/slice v nil nil nil) (catch IllegalArgumentException e :error)) :error))
+
+                                        ; Fused expressions
+
+(def x (double-array [ 1 2 3 ]))
+(t/is (= (seq (nt/fuse (+ (* x x) 1))) '( 2.0 5.0 10.0 )))
+(t/is (= (seq (nt/fuse (nt/sqrt (- (* 4 x x) x)))) (seq (nt/sqrt (- (* 4 x x) x)))))
+(t/is (= (seq (nt/fuse (nt/min (nt/max (- x) -2.5) 0))) '( -1.0 -2.0 -2.5 )))
+(t/is (= (seq (nt/reshape (nt/fuse (+ (nt/transpose v) (double-array [ 0 100 200 ]))) [ 12 ]))
+         '( 0.0 104.0 208.0 1.0 105.0 209.0 2.0 106.0 210.0 3.0 107.0 211.0 )))
+(t/is (= (nt/fuse (/ (vector-of :float 1 2) 2)) [ 0.5 1.0 ]))
+(t/is (= (try (nt/fuse (+ x (double-array 2))) (catch IllegalArgumentException e :error)) :error))
+
+                                        ; NPY files
+
+(def npy "/tmp/nanoclj-tensor-test.npy")
+(nt/save (nt/transpose (nt/matrix [[ 1 2 3 ] [ 4 5 6 ]])) npy)
+(t/is (= (nt/shape (nt/load npy)) [ 3 2 ]))
+(t/is (= (seq (nt/reshape (nt/load npy) [ 6 ])) '( 1.0 4.0 2.0 5.0 3.0 6.0 )))
+(nt/save (vector-of :long 1 9000000000) npy)
+(t/is (= (seq (nt/load npy)) '( 1 9000000000 )))
+(t/is (= (try (nt/load "/tmp/nanoclj-missing.npy") (catch java.io.FileNotFoundException e :error)) :error))
+(t/is (= (try (nt/load "tests/bad-shape.npy") (catch java.io.IOException e :error)) :error))